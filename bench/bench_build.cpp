@@ -0,0 +1,132 @@
+#include <benchmark/benchmark.h>
+#include <glog/logging.h>
+#include <omp.h>
+#include "runtime/ir.h"
+#include "runtime/runtime_ir.hpp"
+
+using namespace magic_infer;
+
+
+/**
+ * 生成一个合成的pnnx计算图并保存，每个块包含Identity、ReLU、Sigmoid和一个读取两路输入的Expression
+ * @param block_num 块的个数，计算节点的个数约为块数的4倍
+ * @param param_path 结构文件路径
+ * @param bin_path 权重文件路径
+ */
+static void SaveSyntheticGraph(uint32_t block_num, const string &param_path, const string &bin_path)
+{
+    pnnx::Graph pnnx_graph;
+    uint32_t operand_index = 0;
+    auto link = [&pnnx_graph, &operand_index](pnnx::Operator *op, const vector<pnnx::Operand *> &inputs, bool has_output) {
+        for (pnnx::Operand *input : inputs) {
+            op->inputs.push_back(input);
+            input->consumers.push_back(op);
+        }
+        if (!has_output) return (pnnx::Operand *) nullptr;
+
+        pnnx::Operand *output = pnnx_graph.new_operand(to_string(operand_index++));
+        output->type = 1;
+        output->shape = {1, 1, 4, 4};
+        output->producer = op;
+        op->outputs.push_back(output);
+        return output;
+    };
+
+    pnnx::Operand *x = link(pnnx_graph.new_operator("pnnx.Input", "pnnx_input_0"), {}, true);
+    for (uint32_t i = 0; i < block_num; ++i) {
+        const string &suffix = to_string(i);
+        pnnx::Operand *identity = link(pnnx_graph.new_operator("nn.Identity", "identity_" + suffix), {x}, true);
+        pnnx::Operand *relu = link(pnnx_graph.new_operator("nn.ReLU", "relu_" + suffix), {identity}, true);
+        pnnx::Operand *sigmoid = link(pnnx_graph.new_operator("nn.Sigmoid", "sigmoid_" + suffix), {relu}, true);
+
+        pnnx::Operator *expression_op = pnnx_graph.new_operator("pnnx.Expression", "expression_" + suffix);
+        expression_op->params["expr"] = "add(@0,@1)";
+        x = link(expression_op, {relu, sigmoid}, true);
+    }
+    link(pnnx_graph.new_operator("pnnx.Output", "pnnx_output_0"), {x}, false);
+    CHECK(pnnx_graph.save(param_path, bin_path) == 0);
+}
+
+
+static void BM_BuildSyntheticGraph(benchmark::State &state)
+{
+    const uint32_t block_num = state.range(0);
+    const string &param_path = "synthetic_" + to_string(block_num) + ".pnnx.param";
+    const string &bin_path = "synthetic_" + to_string(block_num) + ".pnnx.bin";
+    SaveSyntheticGraph(block_num, param_path, bin_path);
+
+    for (auto _ : state) {
+        RuntimeGraph graph(param_path, bin_path);
+        graph.Build("pnnx_input_0", "pnnx_output_0");
+        benchmark::DoNotOptimize(graph.operators().size());
+    }
+
+    // 以加载的计算节点个数作为规模，检查Build的开销是否随节点数线性增长
+    state.SetComplexityN(block_num * 4 + 2);
+    state.counters["nodes"] = block_num * 4 + 2;
+}
+
+
+static void BM_LoadSyntheticGraph(benchmark::State &state)
+{
+    const uint32_t block_num = state.range(0);
+    const string &param_path = "synthetic_load_" + to_string(block_num) + ".pnnx.param";
+    const string &bin_path = "synthetic_load_" + to_string(block_num) + ".pnnx.bin";
+    SaveSyntheticGraph(block_num, param_path, bin_path);
+
+    for (auto _ : state) {
+        pnnx::Graph pnnx_graph;
+        CHECK(pnnx_graph.load(param_path, bin_path) == 0);
+        benchmark::DoNotOptimize(pnnx_graph.ops.size());
+    }
+    state.SetComplexityN(block_num * 4 + 2);
+}
+
+
+/**
+ * 测量从模型文件创建计算图到Build完成的冷启动时间
+ * @param state benchmark状态，参数为Build使用的线程数，0表示使用全部线程
+ * @param param_path 结构文件路径
+ * @param bin_path 权重文件路径
+ * @param lazy_weights 是否延迟创建带权重的Layer
+ */
+static void ColdStart(benchmark::State &state, const string &param_path, const string &bin_path, bool lazy_weights = false)
+{
+    const int32_t max_threads = omp_get_max_threads();
+    const int32_t thread_num = state.range(0) > 0 ? state.range(0) : max_threads;
+    omp_set_num_threads(thread_num);
+
+    for (auto _ : state) {
+        RuntimeGraph graph(param_path, bin_path);
+        graph.set_lazy_weights(lazy_weights);
+        graph.Build("pnnx_input_0", "pnnx_output_0");
+        benchmark::DoNotOptimize(graph.operators().size());
+    }
+    state.counters["threads"] = thread_num;
+    omp_set_num_threads(max_threads);
+}
+
+
+static void BM_ColdStart_Resnet18(benchmark::State &state)
+{
+    ColdStart(state, "../../weights/resnet/resnet18_batch8.pnnx.param", "../../weights/resnet/resnet18_batch8.pnnx.bin");
+}
+
+
+static void BM_ColdStart_Yolov5s(benchmark::State &state)
+{
+    ColdStart(state, "../../weights/yolo/demo/yolov5s_batch4.pnnx.param", "../../weights/yolo/demo/yolov5s_batch4.pnnx.bin");
+}
+
+
+static void BM_LazyStart_Yolov5s(benchmark::State &state)
+{
+    ColdStart(state, "../../weights/yolo/demo/yolov5s_batch4.pnnx.param", "../../weights/yolo/demo/yolov5s_batch4.pnnx.bin", true);
+}
+
+
+BENCHMARK(BM_BuildSyntheticGraph)->RangeMultiplier(2)->Range(2 << 10, 16 << 10)->Unit(benchmark::kMillisecond)->Complexity(benchmark::oN);
+BENCHMARK(BM_LoadSyntheticGraph)->RangeMultiplier(2)->Range(2 << 10, 16 << 10)->Unit(benchmark::kMillisecond)->Complexity(benchmark::oN);
+BENCHMARK(BM_ColdStart_Resnet18)->Arg(1)->Arg(0)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_ColdStart_Yolov5s)->Arg(1)->Arg(0)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_LazyStart_Yolov5s)->Arg(1)->Arg(0)->Unit(benchmark::kMillisecond);
@@ -0,0 +1,155 @@
+#include <benchmark/benchmark.h>
+#include <cfloat>
+#include <cmath>
+#include "layer/details/activation_kernel.hpp"
+#include "utils/avx_math.hpp"
+#include "utils/avx512_math.hpp"
+
+#if __SSE2__
+#include <emmintrin.h>
+#include "utils/sse_math.hpp"
+#endif
+
+using namespace magic_infer;
+
+typedef void (*MathKernel)(const float *input, float *output, uint32_t size);
+
+
+template<float (*Func)(float)>
+static void ApplyLibm(const float *input, float *output, uint32_t size)
+{
+    for (uint32_t i = 0; i < size; ++i) {
+        output[i] = Func(input[i]);
+    }
+}
+
+
+#if __SSE2__
+template<__m128 (*Func)(__m128)>
+static void Apply128(const float *input, float *output, uint32_t size)
+{
+    for (uint32_t i = 0; i + 4 <= size; i += 4) {
+        _mm_storeu_ps(output + i, Func(_mm_loadu_ps(input + i)));
+    }
+}
+
+
+static __m128 sigmoid_ps(__m128 x)
+{
+    const __m128 one = _mm_set1_ps(1.f);
+    return _mm_div_ps(one, _mm_add_ps(one, exp_ps(_mm_sub_ps(_mm_setzero_ps(), x))));
+}
+#endif
+
+
+template<__m256 (*Func)(__m256)>
+static MAGIC_TARGET_AVX2 void Apply256(const float *input, float *output, uint32_t size)
+{
+    for (uint32_t i = 0; i + 8 <= size; i += 8) {
+        _mm256_storeu_ps(output + i, Func(_mm256_loadu_ps(input + i)));
+    }
+}
+
+
+template<__m512 (*Func)(__m512)>
+static MAGIC_TARGET_AVX512 void Apply512(const float *input, float *output, uint32_t size)
+{
+    for (uint32_t i = 0; i + 16 <= size; i += 16) {
+        _mm512_storeu_ps(output + i, Func(_mm512_loadu_ps(input + i)));
+    }
+}
+
+
+static float SigmoidLibm(float x) { return 1.f / (1.f + expf(-x)); }
+
+
+static double Sigmoid(double x) { return 1. / (1. + exp(-x)); }
+
+
+/**
+ * 测量核函数的吞吐，并报告相对于double参考值的最大ULP误差、绝对误差和相对误差
+ * @param kernel 核函数
+ * @param reference double精度的参考实现
+ * @param low 输入的下界
+ * @param high 输入的上界
+ * @param isa 核函数需要的指令集
+ */
+static void BM_Math(benchmark::State &state, MathKernel kernel, double (*reference)(double), float low, float high, CpuIsa isa)
+{
+    if (ActivationKernelRegistry::HostIsa() < isa) {
+        state.SkipWithError("The isa is not supported on this cpu");
+        return;
+    }
+
+    const uint32_t size = 1 << 16;
+    vector<float> input(size);
+    vector<float> output(size);
+    for (uint32_t i = 0; i < size; ++i) {
+        input.at(i) = low + (high - low) * float(i) / float(size - 1);
+    }
+
+    for (auto _ : state) {
+        kernel(input.data(), output.data(), size);
+        benchmark::DoNotOptimize(output.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(int64_t(state.iterations()) * size);
+
+    double max_ulp = 0.;
+    double max_absolute = 0.;
+    double max_relative = 0.;
+    for (uint32_t i = 0; i < size; ++i) {
+        const double expected = reference(input.at(i));
+        const double error = fabs(double(output.at(i)) - expected);
+        const float magnitude = max(fabsf(float(expected)), FLT_MIN);
+        max_ulp = max(max_ulp, error / (nextafterf(magnitude, FLT_MAX) - magnitude));
+        max_absolute = max(max_absolute, error);
+        if (expected != 0.) max_relative = max(max_relative, error / fabs(expected));
+    }
+    state.counters["max_ulp"] = max_ulp;
+    state.counters["max_abs"] = max_absolute;
+    state.counters["max_rel"] = max_relative;
+}
+
+
+BENCHMARK_CAPTURE(BM_Math, exp_libm, ApplyLibm<expf>, exp, -87.f, 88.f, CpuIsa::kScalar);
+#if __SSE2__
+BENCHMARK_CAPTURE(BM_Math, exp_sse2, Apply128<exp_ps>, exp, -87.f, 88.f, CpuIsa::kSSE2);
+#endif
+BENCHMARK_CAPTURE(BM_Math, exp_avx2, Apply256<exp256_ps>, exp, -87.f, 88.f, CpuIsa::kAVX2);
+BENCHMARK_CAPTURE(BM_Math, exp_avx2_fast, Apply256<exp256_fast_ps>, exp, -87.f, 88.f, CpuIsa::kAVX2);
+BENCHMARK_CAPTURE(BM_Math, exp_avx512, Apply512<exp512_ps>, exp, -87.f, 88.f, CpuIsa::kAVX512);
+BENCHMARK_CAPTURE(BM_Math, exp_avx512_fast, Apply512<exp512_fast_ps>, exp, -87.f, 88.f, CpuIsa::kAVX512);
+
+BENCHMARK_CAPTURE(BM_Math, log_libm, ApplyLibm<logf>, log, 1e-30f, 1e30f, CpuIsa::kScalar);
+#if __SSE2__
+BENCHMARK_CAPTURE(BM_Math, log_sse2, Apply128<log_ps>, log, 1e-30f, 1e30f, CpuIsa::kSSE2);
+#endif
+BENCHMARK_CAPTURE(BM_Math, log_avx2, Apply256<log256_ps>, log, 1e-30f, 1e30f, CpuIsa::kAVX2);
+BENCHMARK_CAPTURE(BM_Math, log_avx2_fast, Apply256<log256_fast_ps>, log, 1e-30f, 1e30f, CpuIsa::kAVX2);
+BENCHMARK_CAPTURE(BM_Math, log_avx512, Apply512<log512_ps>, log, 1e-30f, 1e30f, CpuIsa::kAVX512);
+BENCHMARK_CAPTURE(BM_Math, log_avx512_fast, Apply512<log512_fast_ps>, log, 1e-30f, 1e30f, CpuIsa::kAVX512);
+
+BENCHMARK_CAPTURE(BM_Math, sigmoid_libm, ApplyLibm<SigmoidLibm>, Sigmoid, -20.f, 20.f, CpuIsa::kScalar);
+#if __SSE2__
+BENCHMARK_CAPTURE(BM_Math, sigmoid_sse2, Apply128<sigmoid_ps>, Sigmoid, -20.f, 20.f, CpuIsa::kSSE2);
+#endif
+BENCHMARK_CAPTURE(BM_Math, sigmoid_avx2, Apply256<sigmoid256_ps>, Sigmoid, -20.f, 20.f, CpuIsa::kAVX2);
+BENCHMARK_CAPTURE(BM_Math, sigmoid_avx2_fast, Apply256<sigmoid256_fast_ps>, Sigmoid, -20.f, 20.f, CpuIsa::kAVX2);
+BENCHMARK_CAPTURE(BM_Math, sigmoid_avx512, Apply512<sigmoid512_ps>, Sigmoid, -20.f, 20.f, CpuIsa::kAVX512);
+BENCHMARK_CAPTURE(BM_Math, sigmoid_avx512_fast, Apply512<sigmoid512_fast_ps>, Sigmoid, -20.f, 20.f, CpuIsa::kAVX512);
+
+BENCHMARK_CAPTURE(BM_Math, tanh_libm, ApplyLibm<tanhf>, tanh, -9.f, 9.f, CpuIsa::kScalar);
+#if __SSE2__
+BENCHMARK_CAPTURE(BM_Math, tanh_sse2, Apply128<tanh_ps>, tanh, -9.f, 9.f, CpuIsa::kSSE2);
+#endif
+BENCHMARK_CAPTURE(BM_Math, tanh_avx2, Apply256<tanh256_ps>, tanh, -9.f, 9.f, CpuIsa::kAVX2);
+BENCHMARK_CAPTURE(BM_Math, tanh_avx2_fast, Apply256<tanh256_fast_ps>, tanh, -9.f, 9.f, CpuIsa::kAVX2);
+BENCHMARK_CAPTURE(BM_Math, tanh_avx512, Apply512<tanh512_ps>, tanh, -9.f, 9.f, CpuIsa::kAVX512);
+BENCHMARK_CAPTURE(BM_Math, tanh_avx512_fast, Apply512<tanh512_fast_ps>, tanh, -9.f, 9.f, CpuIsa::kAVX512);
+
+BENCHMARK_CAPTURE(BM_Math, erf_libm, ApplyLibm<erff>, erf, -4.f, 4.f, CpuIsa::kScalar);
+BENCHMARK_CAPTURE(BM_Math, erf_avx2, Apply256<erf256_ps>, erf, -4.f, 4.f, CpuIsa::kAVX2);
+BENCHMARK_CAPTURE(BM_Math, erf_avx2_fast, Apply256<erf256_fast_ps>, erf, -4.f, 4.f, CpuIsa::kAVX2);
+BENCHMARK_CAPTURE(BM_Math, erf_avx512, Apply512<erf512_ps>, erf, -4.f, 4.f, CpuIsa::kAVX512);
+BENCHMARK_CAPTURE(BM_Math, erf_avx512_fast, Apply512<erf512_fast_ps>, erf, -4.f, 4.f, CpuIsa::kAVX512);
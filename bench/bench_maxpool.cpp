@@ -0,0 +1,125 @@
+#include <benchmark/benchmark.h>
+#include <cstring>
+#include "data/tensor.hpp"
+#include "layer/details/maxpooling.hpp"
+#include "layer/details/sppf.hpp"
+
+using namespace magic_infer;
+
+
+/**
+ * 逐个窗口比较的最大池化，作为专用实现的对照
+ * @param input 输入，已经填充
+ * @param output 输出
+ * @param kernel 池化窗口的高和宽
+ * @param stride 步长
+ */
+static void MaxPoolingNaive(const Tensor<float> &input, Tensor<float> &output, uint32_t kernel, uint32_t stride)
+{
+    for (uint32_t ic = 0; ic < input.channels(); ++ic) {
+        const arma::fmat &input_channel = input.at(ic);
+        arma::fmat &output_channel = output.at(ic);
+        for (uint32_t c = 0; c < output.cols(); ++c) {
+            for (uint32_t r = 0; r < output.rows(); ++r) {
+                float max_value = numeric_limits<float>::lowest();
+                for (uint32_t w = 0; w < kernel; ++w) {
+                    const float *col_ptr = input_channel.colptr(c * stride + w) + r * stride;
+                    for (uint32_t h = 0; h < kernel; ++h) {
+                        max_value = max(max_value, col_ptr[h]);
+                    }
+                }
+                output_channel.at(r, c) = max_value;
+            }
+        }
+    }
+}
+
+
+static void BM_MaxPoolNaive(benchmark::State &state, uint32_t kernel, uint32_t stride, uint32_t padding)
+{
+    shared_ptr<Tensor<float>> input = make_shared<Tensor<float>>(64, 80, 80);
+    input->Rand();
+    input->Padding({padding, padding, padding, padding}, numeric_limits<float>::lowest());
+
+    const uint32_t output_size = (input->rows() - kernel) / stride + 1;
+    Tensor<float> output(64, output_size, output_size);
+    for (auto _ : state) {
+        MaxPoolingNaive(*input, output, kernel, stride);
+        benchmark::DoNotOptimize(output.RawPtr());
+    }
+    state.SetItemsProcessed(int64_t(state.iterations()) * output.size());
+}
+
+
+static void BM_MaxPool(benchmark::State &state, uint32_t kernel, uint32_t stride, uint32_t padding)
+{
+    shared_ptr<Tensor<float>> input = make_shared<Tensor<float>>(64, 80, 80);
+    input->Rand();
+
+    MaxPoolingLayer max_layer(padding, padding, kernel, kernel, stride, stride);
+    vector<shared_ptr<Tensor<float>>> inputs{input};
+    vector<shared_ptr<Tensor<float>>> outputs(1);
+    for (auto _ : state) {
+        max_layer.Forward(inputs, outputs);
+        benchmark::DoNotOptimize(outputs.front()->RawPtr());
+    }
+    state.SetItemsProcessed(int64_t(state.iterations()) * outputs.front()->size());
+}
+
+
+BENCHMARK_CAPTURE(BM_MaxPoolNaive, k2s2, 2, 2, 0)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_MaxPool, k2s2, 2, 2, 0)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_MaxPoolNaive, k3s2, 3, 2, 1)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_MaxPool, k3s2, 3, 2, 1)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_MaxPoolNaive, k5s1, 5, 1, 2)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_MaxPool, k5s1, 5, 1, 2)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_MaxPoolNaive, k9s1, 9, 1, 4)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_MaxPool, k9s1, 9, 1, 4)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_MaxPoolNaive, k13s1, 13, 1, 6)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_MaxPool, k13s1, 13, 1, 6)->Unit(benchmark::kMicrosecond);
+
+
+static void BM_SPPFUnfused(benchmark::State &state)
+{
+    shared_ptr<Tensor<float>> input = make_shared<Tensor<float>>(256, 20, 20);
+    input->Rand();
+
+    // 逐级池化之后再拷贝到拼接的输出中
+    MaxPoolingLayer max_layer(2, 2, 5, 5, 1, 1);
+    Tensor<float> output(1024, 20, 20);
+    vector<shared_ptr<Tensor<float>>> pooled(4);
+    pooled.front() = input;
+    for (auto _ : state) {
+        for (uint32_t k = 1; k < pooled.size(); ++k) {
+            vector<shared_ptr<Tensor<float>>> inputs{pooled.at(k - 1)};
+            vector<shared_ptr<Tensor<float>>> outputs{pooled.at(k)};
+            max_layer.Forward(inputs, outputs);
+            pooled.at(k) = outputs.front();
+        }
+        float *output_ptr = output.data().memptr();
+        for (const auto &tensor : pooled) {
+            memcpy(output_ptr, tensor->RawPtr(), tensor->size() * sizeof(float));
+            output_ptr += tensor->size();
+        }
+        benchmark::DoNotOptimize(output.RawPtr());
+    }
+}
+
+
+static void BM_SPPFFused(benchmark::State &state)
+{
+    shared_ptr<Tensor<float>> input = make_shared<Tensor<float>>(256, 20, 20);
+    input->Rand();
+
+    SPPFLayer sppf_layer(make_shared<MaxPoolingLayer>(2, 2, 5, 5, 1, 1));
+    vector<shared_ptr<Tensor<float>>> inputs{input};
+    vector<shared_ptr<Tensor<float>>> outputs(1);
+    for (auto _ : state) {
+        sppf_layer.Forward(inputs, outputs);
+        benchmark::DoNotOptimize(outputs.front()->RawPtr());
+    }
+}
+
+
+BENCHMARK(BM_SPPFUnfused)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_SPPFFused)->Unit(benchmark::kMicrosecond);
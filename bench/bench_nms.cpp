@@ -0,0 +1,126 @@
+#include <benchmark/benchmark.h>
+#include <random>
+#include "nets/nms.hpp"
+
+using namespace magic_infer;
+
+
+/**
+ * 随机生成成簇的候选框，每簇8个框的类别相同
+ * @param size 候选框个数
+ * @param seed 随机数种子
+ * @return 候选框
+ */
+static vector<YoloCandidate> RandomCandidates(uint32_t size, uint32_t seed)
+{
+    mt19937 engine(seed);
+    uniform_real_distribution<float> center(0.f, 640.f);
+    uniform_real_distribution<float> jitter(-16.f, 16.f);
+    uniform_real_distribution<float> extent(8.f, 160.f);
+    uniform_real_distribution<float> score(0.25f, 1.f);
+    uniform_int_distribution<int32_t> class_id(0, 79);
+
+    vector<YoloCandidate> candidates;
+    while (candidates.size() < size) {
+        YoloCandidate cluster;
+        cluster.x = center(engine);
+        cluster.y = center(engine);
+        cluster.w = extent(engine);
+        cluster.h = extent(engine);
+        cluster.class_id = class_id(engine);
+        for (uint32_t i = 0; i < 8 && candidates.size() < size; ++i) {
+            YoloCandidate candidate = cluster;
+            candidate.x += jitter(engine);
+            candidate.y += jitter(engine);
+            candidate.w += jitter(engine);
+            candidate.h += jitter(engine);
+            candidate.score = score(engine);
+            candidates.push_back(candidate);
+        }
+    }
+    return candidates;
+}
+
+
+/**
+ * 排序之后两两比较的逐个标量实现，作为对照
+ */
+static vector<YoloCandidate> NmsNaive(const vector<YoloCandidate> &candidates, float iou_thresh)
+{
+    vector<YoloCandidate> sorted = candidates;
+    stable_sort(sorted.begin(), sorted.end(), [](const YoloCandidate &lhs, const YoloCandidate &rhs) { return lhs.score > rhs.score; });
+
+    vector<YoloCandidate> results;
+    vector<bool> suppressed(sorted.size(), false);
+    for (uint32_t i = 0; i < sorted.size(); ++i) {
+        if (suppressed.at(i)) continue;
+        const YoloCandidate &lhs = sorted.at(i);
+        results.push_back(lhs);
+        for (uint32_t j = i + 1; j < sorted.size(); ++j) {
+            const YoloCandidate &rhs = sorted.at(j);
+            if (suppressed.at(j) || lhs.class_id != rhs.class_id) continue;
+            const float inter_w = max(min(lhs.x + lhs.w * 0.5f, rhs.x + rhs.w * 0.5f) - max(lhs.x - lhs.w * 0.5f, rhs.x - rhs.w * 0.5f), 0.f);
+            const float inter_h = max(min(lhs.y + lhs.h * 0.5f, rhs.y + rhs.h * 0.5f) - max(lhs.y - lhs.h * 0.5f, rhs.y - rhs.h * 0.5f), 0.f);
+            const float inter = inter_w * inter_h;
+            suppressed.at(j) = inter / (lhs.w * lhs.h + rhs.w * rhs.h - inter) > iou_thresh;
+        }
+    }
+    return results;
+}
+
+
+static void BM_NmsNaive(benchmark::State &state)
+{
+    const vector<YoloCandidate> &candidates = RandomCandidates(state.range(0), 42);
+    for (auto _ : state) {
+        const vector<YoloCandidate> &results = NmsNaive(candidates, 0.45f);
+        benchmark::DoNotOptimize(results.data());
+    }
+    state.SetItemsProcessed(int64_t(state.iterations()) * candidates.size());
+}
+
+
+static void BM_Nms(benchmark::State &state)
+{
+    const vector<YoloCandidate> &candidates = RandomCandidates(state.range(0), 42);
+    const NonMaxSuppression nms(0.45f, uint32_t(state.range(1)), true);
+    for (auto _ : state) {
+        const vector<YoloCandidate> &results = nms.Suppress(candidates);
+        benchmark::DoNotOptimize(results.data());
+    }
+    state.SetItemsProcessed(int64_t(state.iterations()) * candidates.size());
+}
+
+
+/// 8张图的稀疏输出，每张图的候选框数量为state.range(0)
+static void BM_NmsBatch(benchmark::State &state)
+{
+    const uint32_t batch_size = 8;
+    const uint32_t size = state.range(0);
+    vector<shared_ptr<Tensor<float>>> outputs;
+    for (uint32_t b = 0; b < batch_size; ++b) {
+        const vector<YoloCandidate> &candidates = RandomCandidates(size, b);
+        shared_ptr<Tensor<float>> output = make_shared<Tensor<float>>(1, size + 1, 85);
+        for (uint32_t r = 0; r < size; ++r) {
+            const YoloCandidate &candidate = candidates.at(r);
+            const vector<float> values{candidate.x, candidate.y, candidate.w, candidate.h, candidate.score, float(candidate.class_id)};
+            for (uint32_t c = 0; c < values.size(); ++c) {
+                output->at(0, r, c) = values.at(c);
+            }
+        }
+        output->at(0, size, 5) = -1.f;
+        outputs.push_back(output);
+    }
+
+    const NonMaxSuppression nms(0.45f, 300, true);
+    for (auto _ : state) {
+        const vector<vector<YoloCandidate>> &results = nms.Forward(outputs, YoloDecodeMode::kDecodeSparse, 0.25f);
+        benchmark::DoNotOptimize(results.data());
+    }
+    state.SetItemsProcessed(int64_t(state.iterations()) * batch_size * size);
+}
+
+
+BENCHMARK(BM_NmsNaive)->Arg(1000)->Arg(5000)->Arg(10000)->Arg(30000)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Nms)->Args({1000, 0})->Args({5000, 0})->Args({10000, 0})->Args({30000, 0})->Args({30000, 300})->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_NmsBatch)->Arg(1000)->Arg(10000)->Arg(30000)->Unit(benchmark::kMillisecond);
@@ -6,6 +6,8 @@
 
 #include "data/tensor.hpp"
 #include "image_util.hpp"
+#include "nets/nms.hpp"
+#include "nets/yolo_detect.hpp"
 #include "runtime/runtime_ir.hpp"
 #include "utils/tick.hpp"
 
@@ -43,7 +45,9 @@ void SingleImageYoloInferNano(const string &param_file, const string &weight_fil
     const int32_t input_h = 640;
     const int32_t input_w = 640;
 
+    // Detect层只输出置信度超过阈值的候选框
     RuntimeGraph graph(param_file, weight_file);
+    graph.set_yolo_decode_mode(YoloDecodeMode::kDecodeSparse, conf_thresh);
     graph.Build("pnnx_input_0", "pnnx_output_0");
     
     map<int, string> class_names = load_name(classes_file);
@@ -101,50 +105,18 @@ void SingleImageYoloInferNano(const string &param_file, const string &weight_fil
 
         const uint32_t batch = shapes.at(0);
         assert(batch == 1);
-        const uint32_t elements = shapes.at(1);
-        const uint32_t num_info = shapes.at(2);
         vector<Detection> detections;
+        const NonMaxSuppression nms(iou_thresh);
+        for (const YoloCandidate &candidate : nms.Forward(outputs, YoloDecodeMode::kDecodeSparse, conf_thresh).front()) {
+            int left = (int) (candidate.x) - (int) (candidate.w) / 2;
+            int top = (int) (candidate.y) - (int) (candidate.h) / 2;
 
-        vector<Rect> boxes;
-        vector<float> confs;
-        vector<int> class_ids;
-
-        const uint32_t b = 0;
-        for (uint32_t i = 0; i < elements; ++i) {
-            float cls_conf = output->at(b, i, 4);
-            if (cls_conf >= conf_thresh) {
-                int center_x = (int) (output->at(b, i, 0));
-                int center_y = (int) (output->at(b, i, 1));
-                int width = (int) (output->at(b, i, 2));
-                int height = (int) (output->at(b, i, 3));
-                int left = center_x - width / 2;
-                int top = center_y - height / 2;
-
-                int best_class_id = -1;
-                float best_conf = -1.f;
-                for (uint32_t j = 5; j < num_info; ++j) {
-                    if (output->at(b, i, j) > best_conf) {
-                        best_conf = output->at(b, i, j);
-                        best_class_id = int(j - 5);
-                    }
-                }
-
-                boxes.emplace_back(left, top, width, height);
-                confs.emplace_back(best_conf * cls_conf);
-                class_ids.emplace_back(best_class_id);
-            }
-        }
-
-        vector<int> indices;
-        dnn::NMSBoxes(boxes, confs, conf_thresh, iou_thresh, indices);
-
-        for (int idx : indices) {
             Detection det;
-            det.box = Rect(boxes[idx]);
+            det.box = Rect(left, top, (int) (candidate.w), (int) (candidate.h));
             ScaleCoords(Size{input_w, input_h}, det.box, Size{origin_input_w, origin_input_h});
 
-            det.conf = confs[idx];
-            det.class_id = class_ids[idx];
+            det.conf = candidate.score;
+            det.class_id = candidate.class_id;
             detections.emplace_back(det);
         }
 
@@ -170,7 +142,9 @@ void MultiImageYoloInferNano(const string &param_file, const string &weight_file
     const int32_t input_h = 640;
     const int32_t input_w = 640;
 
+    // Detect层只输出置信度超过阈值的候选框
     RuntimeGraph graph(param_file, weight_file);
+    graph.set_yolo_decode_mode(YoloDecodeMode::kDecodeSparse, conf_thresh);
     graph.Build("pnnx_input_0", "pnnx_output_0");
 
     map<int, string> class_names = load_name(classes_file);
@@ -226,62 +200,29 @@ void MultiImageYoloInferNano(const string &param_file, const string &weight_file
     double font_scale = 2;
 	int    thickness = 2;
 
+    // 整个batch并行做按类别的非极大值抑制
+    const NonMaxSuppression nms(iou_thresh);
+    const vector<vector<YoloCandidate>> &batch_candidates = nms.Forward(outputs, YoloDecodeMode::kDecodeSparse, conf_thresh);
+
     for (int i = 0; i < outputs.size(); ++i) {
         const auto &image = images.at(i);
         const int32_t origin_input_h = image.size().height;
         const int32_t origin_input_w = image.size().width;
 
-        const auto &output = outputs.at(i);
-        assert(!output->empty());
-        const auto &shapes = output->shapes();
-        assert(shapes.size() == 3);
-
-        const uint32_t elements = shapes.at(1);
-        const uint32_t num_info = shapes.at(2);
         vector<Detection> detections;
+        for (const YoloCandidate &candidate : batch_candidates.at(i)) {
+            int width  = (int) (candidate.w);
+            int height = (int) (candidate.h);
 
-        vector<Rect> boxes;
-        vector<float> confs;
-        vector<int> class_ids;
-
-        const uint32_t b = 0;
-        for (uint32_t e = 0; e < elements; ++e) {
-            float cls_conf = output->at(b, e, 4);
-            if (cls_conf >= conf_thresh) {
-                int center_x = (int) (output->at(b, e, 0));
-                int center_y = (int) (output->at(b, e, 1));
-                
-                int width  = (int) (output->at(b, e, 2));
-                int height = (int) (output->at(b, e, 3));
-
-                int left   = center_x - width / 2;
-                int top    = center_y - height / 2;
-
-                int best_class_id = -1;
-                float best_conf = -1.f;
-                for (uint32_t j = 5; j < num_info; ++j) {
-                    if (output->at(b, e, j) > best_conf) {
-                        best_conf = output->at(b, e, j);
-                        best_class_id = int(j - 5);
-                    }
-                }
-
-                boxes.emplace_back(left, top, width, height);
-                confs.emplace_back(best_conf * cls_conf);
-                class_ids.emplace_back(best_class_id);
-            }
-        }
-
-        vector<int> indices;
-        dnn::NMSBoxes(boxes, confs, conf_thresh, iou_thresh, indices);
+            int left   = (int) (candidate.x) - width / 2;
+            int top    = (int) (candidate.y) - height / 2;
 
-        for (int idx : indices) {
             Detection det;
-            det.box = Rect(boxes[idx]);
+            det.box = Rect(left, top, width, height);
             ScaleCoords(Size{input_w, input_h}, det.box, Size{origin_input_w, origin_input_h});
 
-            det.conf = confs[idx];
-            det.class_id = class_ids[idx];
+            det.conf = candidate.score;
+            det.class_id = candidate.class_id;
             detections.emplace_back(det);
         }
 
@@ -3,6 +3,7 @@
 
 #include <armadillo>
 #include <string>
+#include "data/tensor.hpp"
 
 using namespace std;
 
@@ -21,14 +22,13 @@ public:
      */
     static arma::fmat LoadData(const string &file_path, char split_char = ',');
 
-private:
     /**
-     * 得到csv文件的尺寸大小
-     * @param file csv文件的路径
-     * @param split_char 分割符号
-     * @return 根据csv文件的尺寸大小
+     * 从csv文件中直接填充张量，文件中依次存放每个通道的所有行，行数为通道数乘以张量的行数
+     * @param file_path csv文件的路径
+     * @param tensor 待填充的张量，形状已经确定
+     * @param split_char 分隔符号
      */
-    static pair<size_t, size_t> GetMatrixSize(ifstream &file, char split_char);
+    static void LoadData(const string &file_path, Tensor<float> &tensor, char split_char = ',');
 };
 
 }
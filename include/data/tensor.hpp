@@ -31,6 +31,15 @@ public:
     explicit Tensor(uint32_t channels, uint32_t rows, uint32_t cols);
     explicit Tensor(const vector<uint32_t> &shapes);
 
+    /**
+     * 创建共享外部内存的张量，张量不拥有这块内存，调用者需要保证内存的生命周期
+     * @param raw_ptr 外部内存的起始地址，按列主序存放channels * rows * cols个元素
+     * @param channels 张量的通道数
+     * @param rows 张量的行数
+     * @param cols 张量的列数
+     */
+    explicit Tensor(float *raw_ptr, uint32_t channels, uint32_t rows, uint32_t cols);
+
     Tensor(const Tensor &tensor);
 
     Tensor<float> &operator=(const Tensor &tensor);
@@ -160,6 +169,13 @@ public:
      */
     void Fill(const vector<float> &values);
 
+    /**
+     * 使用数组填充张量，数组按行主序存放
+     * @param values 数组的起始地址
+     * @param size 数组的元素个数，必须和张量的元素个数一致
+     */
+    void Fill(const float *values, uint32_t size);
+
     /**
      * 以常量1初始化张量
      */
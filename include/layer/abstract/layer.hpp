@@ -10,6 +10,7 @@
 #include "utils/status_code.hpp"
 #include "data/tensor.hpp"
 #include "runtime/runtime_op.hpp"
+#include "runtime/runtime_layer_options.hpp"
 
 
 namespace magic_infer 
@@ -61,12 +62,32 @@ public:
      */
     virtual void set_bias(const vector<float> &bias);
 
+    /**
+     * 设置Layer的权重，权重可以直接来自映射的权重文件
+     * @param weights 权重的起始地址
+     * @param elem_size 权重的元素个数
+     */
+    virtual void set_weights(const float *weights, uint32_t elem_size);
+
+    /**
+     * 设置Layer的偏移量，偏移量可以直接来自映射的权重文件
+     * @param bias 偏移量的起始地址
+     * @param elem_size 偏移量的元素个数
+     */
+    virtual void set_bias(const float *bias, uint32_t elem_size);
+
     /**
      * 返回层的名称
      * @return 层的名称
      */
     virtual const string &layer_name() const { return this->layer_name_; }
 
+    /**
+     * 按计算图的设置配置Layer，计算图创建或者加载Layer之后调用，默认不做任何事
+     * @param options 计算图设置的Layer选项
+     */
+    virtual void Configure(const RuntimeLayerOptions &options);
+
 protected:
     string layer_name_; /// Layer的名称
 };
@@ -17,10 +17,22 @@ public:
     void set_weights(const vector<float> &weights) override;
     void set_bias(const vector<float> &bias) override;
 
+    void set_weights(const float *weights, uint32_t elem_size) override;
+    void set_bias(const float *bias, uint32_t elem_size) override;
+
     void set_weights(const vector<shared_ptr<Tensor<float>>> &weights) override;
     void set_bias(const vector<shared_ptr<Tensor<float>>> &bias) override;
 
 protected:
+    /**
+     * 从源数组填充单个权重张量，内容相同的权重在多个Layer之间共享，用于权重来自多个不连续数组的层
+     * @param kind 权重的种类，作为权重缓存中打包格式的一部分
+     * @param values 源数组，可以直接来自映射的权重文件
+     * @param elem_size 元素个数
+     * @param tensor 待设置的张量，命中缓存时替换为共享的张量
+     */
+    void ShareTensor(const string &kind, const float *values, uint32_t elem_size, shared_ptr<Tensor<float>> &tensor);
+
     vector<shared_ptr<Tensor<float>>> weights_;
     vector<shared_ptr<Tensor<float>>> bias_;
 };
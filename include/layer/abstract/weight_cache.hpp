@@ -0,0 +1,162 @@
+#ifndef MAGIC_LAYER_ABSTRACT_WEIGHT_CACHE_HPP_
+#define MAGIC_LAYER_ABSTRACT_WEIGHT_CACHE_HPP_
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+#include <memory>
+#include <vector>
+#include <unordered_map>
+
+#include "data/tensor.hpp"
+
+
+namespace magic_infer
+{
+
+/// 权重缓存的统计信息
+struct WeightCacheStats
+{
+    uint64_t hit_num = 0;            /// 命中缓存、直接共享权重的次数
+    uint64_t miss_num = 0;           /// 未命中缓存、新填充权重的次数
+    uint64_t entry_num = 0;          /// 缓存中仍被Layer引用的权重块个数
+    uint64_t cached_bytes = 0;       /// 缓存中仍被Layer引用的权重字节数
+    uint64_t deduplicated_bytes = 0; /// 命中缓存时没有重复分配的权重字节数累计
+    uint64_t segment_hit_num = 0;    /// 直接引用共享权重段的次数
+    uint64_t segment_bytes = 0;      /// 已经映射的共享权重段的字节数
+};
+
+
+/**
+ * 进程内按内容哈希共享的权重缓存
+ *
+ * 同一个模型的多个计算图(例如不同batch的yolov5s)中，相同层的权重内容完全一致，打包之后的权重张量只读，
+ * 可以在多个Layer之间共享。缓存只持有权重张量的弱引用，所有Layer释放之后权重随之释放
+ *
+ * 多个进程之间通过共享权重段共享权重：第一个进程把缓存中打包好的权重导出到共享内存或者文件中，
+ * 之后的进程只读映射该权重段，内容相同的权重直接引用映射中的数据，所有进程只占用一份物理内存。
+ * 路径以"/"开头且不含其他"/"时使用POSIX共享内存(shm_open)，否则使用普通文件
+ */
+class WeightCache
+{
+public:
+    /**
+     * 返回进程内唯一的权重缓存
+     * @return 权重缓存
+     */
+    static WeightCache &Instance();
+
+    /**
+     * 按内容查找已经打包的权重，命中时tensors替换为缓存中的共享张量，否则用原始权重填充tensors并加入缓存
+     * @param layout 权重的打包格式，包含层的名称和张量的形状，不同格式的相同数据不会共享
+     * @param values 原始权重，按张量的顺序连续存放，每个张量内按行优先存放
+     * @param size 原始权重的元素个数
+     * @param tensors Layer自身的权重张量，形状已经确定
+     * @return 是否命中缓存
+     */
+    bool Share(const string &layout, const float *values, uint32_t size, vector<shared_ptr<Tensor<float>>> &tensors);
+
+    /**
+     * 返回缓存的统计信息
+     * @return 统计信息
+     */
+    WeightCacheStats stats() const;
+
+    /**
+     * 设置是否启用缓存，关闭之后每个Layer都持有自己的权重
+     * @param enabled 是否启用
+     */
+    void set_enabled(bool enabled);
+
+    /**
+     * 返回是否启用缓存
+     * @return 是否启用
+     */
+    bool enabled() const;
+
+    /**
+     * 清空缓存和统计信息，已经共享的权重仍由Layer持有，已经映射的共享权重段保持映射
+     */
+    void Clear();
+
+    /**
+     * 只读映射已经存在的共享权重段，之后未命中缓存的权重先在权重段中查找，同一个路径只映射一次
+     * @param path 共享内存的名称或者文件路径
+     * @return 是否映射成功，权重段不存在、尚未写完或者格式错误时返回false
+     */
+    bool AttachSegment(const string &path);
+
+    /**
+     * 将缓存中仍被引用的权重导出为共享权重段，共享内存已经存在时不会覆盖
+     * @param path 共享内存的名称或者文件路径
+     * @return 是否导出成功
+     */
+    bool ExportSegment(const string &path) const;
+
+    /**
+     * 删除共享权重段，已经映射的进程不受影响
+     * @param path 共享内存的名称或者文件路径
+     * @return 是否删除成功
+     */
+    static bool RemoveSegment(const string &path);
+
+private:
+    WeightCache() = default;
+
+    struct WeightCacheEntry
+    {
+        string layout;                             /// 权重的打包格式
+        vector<weak_ptr<Tensor<float>>> tensors;   /// 共享的权重张量
+        uint64_t bytes = 0;                        /// 权重的字节数
+    };
+
+    struct WeightSegmentEntry
+    {
+        string layout;                    /// 权重的打包格式
+        vector<vector<uint32_t>> shapes;  /// 每个张量的通道数、行数和列数
+        const char *data = nullptr;       /// 第一个张量在映射中的地址，之后的张量按64字节对齐依次存放
+        uint64_t bytes = 0;               /// 权重的字节数
+    };
+
+    struct WeightSegment
+    {
+        shared_ptr<const char> mapping;   /// 只读的映射，进程退出之前不会释放
+        size_t size = 0;                  /// 映射的字节数
+        unordered_multimap<uint64_t, WeightSegmentEntry> entries; /// 内容哈希到权重的映射
+    };
+
+    /**
+     * 在已经映射的共享权重段中查找内容相同的权重，找到时tensors替换为引用映射数据的张量
+     * @param content_hash 权重内容和打包格式的哈希
+     * @param layout 权重的打包格式
+     * @param values 原始权重
+     * @param size 原始权重的元素个数
+     * @param tensors Layer自身的权重张量
+     * @return 是否找到
+     */
+    bool ShareSegment(uint64_t content_hash, const string &layout, const float *values, uint32_t size,
+        vector<shared_ptr<Tensor<float>>> &tensors);
+
+    /**
+     * 插入缓存项，缓存项个数达到水位时删除权重已经释放的缓存项，调用者需要持有mutex_
+     * @param content_hash 权重内容和打包格式的哈希
+     * @param entry 缓存项
+     */
+    void InsertEntry(uint64_t content_hash, WeightCacheEntry entry);
+
+    static constexpr size_t kMinPruneWatermark = 64; /// 清理释放的缓存项的最低水位
+
+    atomic<bool> enabled_{true};
+    mutable mutex mutex_;
+    unordered_multimap<uint64_t, WeightCacheEntry> entries_; /// 内容哈希到权重块的映射
+    size_t prune_watermark_ = kMinPruneWatermark;             /// 下一次清理释放的缓存项时的缓存项个数
+    uint64_t hit_num_ = 0;
+    uint64_t miss_num_ = 0;
+    uint64_t deduplicated_bytes_ = 0;
+    uint64_t segment_hit_num_ = 0;
+    map<string, WeightSegment> segments_; /// 按路径保存已经映射的共享权重段
+};
+
+}
+#endif //MAGIC_LAYER_ABSTRACT_WEIGHT_CACHE_HPP_
@@ -0,0 +1,133 @@
+#ifndef MAGIC_LAYER_DETAILS_ACTIVATION_KERNEL_HPP_
+#define MAGIC_LAYER_DETAILS_ACTIVATION_KERNEL_HPP_
+
+#include <cstdint>
+#include <string>
+
+using namespace std;
+
+
+namespace magic_infer
+{
+
+/// 核函数使用的指令集，按能力从低到高排列
+enum class CpuIsa
+{
+    kScalar = 0,
+    kSSE2 = 1,
+    kAVX2 = 2,   /// AVX2和FMA
+    kAVX512 = 3, /// AVX-512F
+    kIsaNum = 4,
+};
+
+
+/// 逐元素的激活函数
+enum class ActivationType
+{
+    kReLU = 0,
+    kSigmoid = 1,
+    kSiLU = 2,
+    kHardSwish = 3,
+    kHardSigmoid = 4,
+    kActivationNum = 5,
+};
+
+
+/// 超越函数的精度，快速版本使用更低阶的多项式，误差见utils/avx_math.hpp
+enum class MathMode
+{
+    kAccurate = 0,
+    kFast = 1,
+    kModeNum = 2,
+};
+
+
+/**
+ * 激活函数的核函数，output可以和input相同
+ * @param input 输入数据
+ * @param output 输出数据
+ * @param size 元素个数
+ */
+typedef void (*ActivationKernel)(const float *input, float *output, uint32_t size);
+
+
+/**
+ * 按激活函数和指令集注册的核函数，每个指令集的实现放在单独的源文件中并按函数开启对应的指令集，
+ * 同一个二进制在运行时按CPUID选择当前CPU支持的最高指令集的核函数
+ */
+class ActivationKernelRegistry
+{
+public:
+    /**
+     * 注册核函数，在静态初始化时调用
+     * @param type 激活函数
+     * @param isa 核函数使用的指令集
+     * @param kernel 核函数
+     * @param mode 核函数的精度
+     */
+    static void Register(ActivationType type, CpuIsa isa, ActivationKernel kernel, MathMode mode = MathMode::kAccurate);
+
+    /**
+     * 返回不超过指定指令集的最好的核函数，指令集没有快速版本时使用精确版本
+     * @param type 激活函数
+     * @param max_isa 允许使用的最高指令集
+     * @param mode 核函数的精度
+     * @return 核函数
+     */
+    static ActivationKernel Get(ActivationType type, CpuIsa max_isa, MathMode mode = MathMode::kAccurate);
+
+    /**
+     * 返回当前CPU上最好的核函数，精度由math_mode决定
+     * @param type 激活函数
+     * @return 核函数
+     */
+    static ActivationKernel Get(ActivationType type);
+
+    /**
+     * 返回不超过指定指令集的最好的核函数所使用的指令集
+     * @param type 激活函数
+     * @param max_isa 允许使用的最高指令集
+     * @return 核函数使用的指令集
+     */
+    static CpuIsa KernelIsa(ActivationType type, CpuIsa max_isa);
+
+    /**
+     * 返回当前CPU支持的最高指令集，只检测一次。
+     * 环境变量MAGIC_CPU_ISA(scalar、sse2、avx2、avx512)可以限制使用的最高指令集
+     * @return 当前CPU支持的最高指令集
+     */
+    static CpuIsa HostIsa();
+
+    /**
+     * 返回指令集的名称
+     * @param isa 指令集
+     * @return 指令集的名称
+     */
+    static string IsaName(CpuIsa isa);
+
+    /**
+     * 设置激活函数使用的精度，对之后执行的Forward生效
+     * @param mode 精度
+     */
+    static void set_math_mode(MathMode mode);
+
+    /**
+     * 返回激活函数使用的精度，默认为精确版本，环境变量MAGIC_FAST_MATH=1时默认为快速版本
+     * @return 精度
+     */
+    static MathMode math_mode();
+};
+
+
+class ActivationKernelRegistererWrapper
+{
+public:
+    ActivationKernelRegistererWrapper(ActivationType type, CpuIsa isa, ActivationKernel kernel,
+        MathMode mode = MathMode::kAccurate)
+    {
+        ActivationKernelRegistry::Register(type, isa, kernel, mode);
+    }
+};
+
+}
+#endif //MAGIC_LAYER_DETAILS_ACTIVATION_KERNEL_HPP_
@@ -15,6 +15,15 @@ public:
     InferStatus Forward(const vector<shared_ptr<Tensor<float>>> &inputs, vector<shared_ptr<Tensor<float>>> &outputs) override;
     static ParseParameterAttrStatus GetInstance(const shared_ptr<RuntimeOperator> &op, shared_ptr<Layer> &avg_layer);
 
+    /**
+     * 全局平均池化，对每个通道求均值，通道之间并行
+     * @param input 输入，按通道连续存放channels * plane_size个元素
+     * @param channels 通道数
+     * @param plane_size 每个通道的元素个数
+     * @param output 输出，channels个元素
+     */
+    static void GlobalAveragePool(const float *input, uint32_t channels, uint32_t plane_size, float *output);
+
 private:
     uint32_t output_h_ = 0;
     uint32_t output_w_ = 0;
@@ -15,10 +15,34 @@ public:
     InferStatus Forward(const vector<shared_ptr<Tensor<float>>> &inputs, vector<shared_ptr<Tensor<float>>> &outputs) override;
     static ParseParameterAttrStatus GetInstance(const shared_ptr<RuntimeOperator> &op, shared_ptr<Layer> &batch_layer);
 
+    /**
+     * 设置均值，同时更新预计算的缩放和偏移
+     * @param weights 均值
+     */
+    void set_weights(const vector<float> &weights) override;
+    void set_weights(const vector<shared_ptr<Tensor<float>>> &weights) override;
+    void set_weights(const float *weights, uint32_t elem_size) override;
+
+    /**
+     * 设置方差，同时更新预计算的缩放和偏移
+     * @param bias 方差
+     */
+    void set_bias(const vector<float> &bias) override;
+    void set_bias(const vector<shared_ptr<Tensor<float>>> &bias) override;
+    void set_bias(const float *bias, uint32_t elem_size) override;
+
 private:
+    /**
+     * 预计算每个通道的 scale = weight / sqrt(var + eps) 和 shift = bias - mean * scale
+     */
+    void UpdateScaleShift();
+
     float eps_ = 1e-5;
     vector<float> affine_weight_;
     vector<float> affine_bias_;
+
+    vector<float> scale_; /// 每个通道的缩放系数
+    vector<float> shift_; /// 每个通道的偏移量
 };
 
 }
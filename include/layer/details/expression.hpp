@@ -18,6 +18,7 @@ public:
 
 private:
     unique_ptr<ExpressionParser> parser_;
+    ExpressionProgram program_; /// 构造时编译好的字节码
 };
 
 }
@@ -0,0 +1,27 @@
+#ifndef MAGIC_LAYER_DETAILS_GLOBAL_POOL_LINEAR_HPP_
+#define MAGIC_LAYER_DETAILS_GLOBAL_POOL_LINEAR_HPP_
+
+#include "layer/details/linear.hpp"
+
+
+namespace magic_infer
+{
+
+/// 全局平均池化、torch.flatten和Linear融合而成的分类头，由GlobalPoolLinearFusionPass生成
+/// 池化的结果直接作为矩阵乘法的输入，不生成池化和展平的中间Tensor，整个batch只做一次矩阵乘法
+class GlobalPoolLinearLayer : public LinearLayer
+{
+public:
+    explicit GlobalPoolLinearLayer(int32_t in_features, int32_t out_features, bool use_bias);
+
+    InferStatus Forward(const vector<shared_ptr<Tensor<float>>> &inputs, vector<shared_ptr<Tensor<float>>> &outputs) override;
+    static ParseParameterAttrStatus GetInstance(const shared_ptr<RuntimeOperator> &op, shared_ptr<Layer> &head_layer);
+
+private:
+    vector<float> pooled_; /// 整个batch池化之后的结果，每个样本一列，在多次Forward之间复用
+    vector<float> result_; /// 多个样本时矩阵乘法的结果，在多次Forward之间复用
+    mutex buffer_mutex_;
+};
+
+}
+#endif //MAGIC_LAYER_DETAILS_GLOBAL_POOL_LINEAR_HPP_
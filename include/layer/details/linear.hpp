@@ -1,6 +1,7 @@
 #ifndef MAGIC_LAYER_DETAILS_LINEAR_HPP_
 #define MAGIC_LAYER_DETAILS_LINEAR_HPP_
 
+#include <mutex>
 #include "layer/abstract/layer.hpp"
 #include "layer/abstract/param_layer.hpp"
 
@@ -17,10 +18,49 @@ public:
     InferStatus Forward(const vector<shared_ptr<Tensor<float>>> &inputs, vector<shared_ptr<Tensor<float>>> &outputs) override;
     static ParseParameterAttrStatus GetInstance(const shared_ptr<RuntimeOperator> &op, shared_ptr<Layer> &linear_layer);
 
-private:
+    int32_t in_features() const;
+    int32_t out_features() const;
+    bool use_bias() const;
+
+    /**
+     * 设置Forward读取的权重精度。fp16和int8的权重在第一次Forward时由float权重转换，int8按输出通道对称量化；
+     * 转换之后释放float权重，再切换精度之前需要重新设置权重。计算图通过RuntimeGraph::set_linear_weight_type设置
+     * @param weight_type 权重精度
+     */
+    void set_weight_type(LinearWeightType weight_type);
+    LinearWeightType weight_type() const;
+
+    void Configure(const RuntimeLayerOptions &options) override;
+
+    void set_weights(const vector<float> &weights) override;
+    void set_weights(const float *weights, uint32_t elem_size) override;
+    void set_weights(const vector<shared_ptr<Tensor<float>>> &weights) override;
+
+protected:
+    /**
+     * 按当前的权重精度转换权重并释放float权重，重新设置float权重之后再次转换
+     */
+    void PrepareWeights();
+
+    /**
+     * 计算output = weight * input + bias，只有一列时使用按行分块的GEMV，多列时float权重整体做一次GEMM，
+     * 低精度权重按行和列分块直接累加
+     * @param input 输入矩阵，按列主序存放in_features * columns个元素
+     * @param columns 输入矩阵的列数
+     * @param output 输出矩阵，按列主序存放out_features * columns个元素
+     */
+    void MatMul(const float *input, uint32_t columns, float *output) const;
+
+protected:
     int32_t in_features_  = 0;
     int32_t out_features_ = 0;
     bool use_bias_ = false;
+
+    LinearWeightType weight_type_ = LinearWeightType::kFloat32;
+    vector<uint16_t> half_weights_;        /// fp16权重，和float权重一样按列主序存放
+    vector<int8_t> int8_weights_;          /// int8权重，按列主序存放
+    vector<float> int8_scales_;            /// int8权重每个输出通道的缩放系数
+    mutex packed_mutex_;
 };
 
 }
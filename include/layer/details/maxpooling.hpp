@@ -1,12 +1,12 @@
-#ifndef MAGIC_LAYER_DETAILS_AVGPOOLING_HPP_
-#define MAGIC_LAYER_DETAILS_AVGPOOLING_HPP_
+#ifndef MAGIC_LAYER_DETAILS_MAXPOOLING_HPP_
+#define MAGIC_LAYER_DETAILS_MAXPOOLING_HPP_
 
 #include "layer/abstract/layer.hpp"
 
 
-namespace magic_infer 
+namespace magic_infer
 {
-class MaxPoolingLayer : public Layer 
+class MaxPoolingLayer : public Layer
 {
 public:
     explicit MaxPoolingLayer(uint32_t padding_h, uint32_t padding_w, uint32_t pooling_size_h,
@@ -15,16 +15,40 @@ public:
     InferStatus Forward(const vector<shared_ptr<Tensor<float>>> &inputs, vector<shared_ptr<Tensor<float>>> &outputs) override;
     static ParseParameterAttrStatus GetInstance(const shared_ptr<RuntimeOperator> &op, shared_ptr<Layer> &max_layer);
 
+    /**
+     * 对单个通道做最大池化，先在列之间取最大值，再在每一列之内取最大值，填充的位置视为最小值
+     * 步长为1时两个方向都使用van Herk / Gil-Werman算法，每个输出的比较次数和池化窗口的大小无关
+     * @param input 输入通道，按列主序存放input_h * input_w个元素
+     * @param input_h 输入的高
+     * @param input_w 输入的宽
+     * @param output 输出通道，按列主序存放OutputHeight(input_h) * OutputWidth(input_w)个元素，不能和输入重叠
+     */
+    void PoolChannel(const float *input, uint32_t input_h, uint32_t input_w, float *output) const;
+
+    /**
+     * 返回输出的高
+     * @param input_h 输入的高
+     * @return 输出的高，输入小于池化窗口时返回0
+     */
+    uint32_t OutputHeight(uint32_t input_h) const;
+
+    /**
+     * 返回输出的宽
+     * @param input_w 输入的宽
+     * @return 输出的宽，输入小于池化窗口时返回0
+     */
+    uint32_t OutputWidth(uint32_t input_w) const;
+
 private:
     uint32_t padding_h_ = 0;
     uint32_t padding_w_ = 0;
 
     uint32_t pooling_size_h_ = 0;
     uint32_t pooling_size_w_ = 0;
-    
+
     uint32_t stride_h_ = 1;
     uint32_t stride_w_ = 1;
 };
 
 }
-#endif //MAGIC_LAYER_DETAILS_AVGPOOLING_HPP_
+#endif //MAGIC_LAYER_DETAILS_MAXPOOLING_HPP_
@@ -11,12 +11,32 @@
 namespace magic_infer 
 {
 
+enum class SoftmaxMode { kSoftmax = 0, kLogSoftmax = 1, };
+
 class SoftmaxLayer : public Layer 
 {
 public:
-    explicit SoftmaxLayer();
+    /**
+     * @param dim 归一化的维度，按Tensor的(batch, channels, rows, cols)计：1是通道、2是行、3是列，负数从列开始倒数
+     * @param mode 输出概率或者对数概率
+     */
+    explicit SoftmaxLayer(int dim = -1, SoftmaxMode mode = SoftmaxMode::kSoftmax);
+
     InferStatus Forward(const vector<shared_ptr<Tensor<float>>> &inputs, vector<shared_ptr<Tensor<float>>> &outputs) override;
+    static ParseParameterAttrStatus GetInstance(const shared_ptr<RuntimeOperator> &op, shared_ptr<Layer> &softmax_layer);
+
+    /**
+     * 分类输出的softmax和top-k，一遍读取同时得到最大值、指数和以及最大的k个输入，只对这k个输入求概率
+     * @param logits 分类输出
+     * @param size 类别数
+     * @param k 返回的类别数，大于类别数时返回所有类别
+     * @return 按概率从大到小排列的类别和概率，概率相同时类别小的在前
+     */
+    static vector<pair<uint32_t, float>> TopK(const float *logits, uint32_t size, uint32_t k);
 
+private:
+    int dim_ = 3;
+    SoftmaxMode mode_ = SoftmaxMode::kSoftmax;
 };
 
 }
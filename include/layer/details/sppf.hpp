@@ -0,0 +1,28 @@
+#ifndef MAGIC_LAYER_DETAILS_SPPF_HPP_
+#define MAGIC_LAYER_DETAILS_SPPF_HPP_
+
+#include "layer/abstract/layer.hpp"
+#include "layer/details/maxpooling.hpp"
+
+
+namespace magic_infer
+{
+
+/// YOLOv5的SPPF结构中连续三次最大池化和通道拼接融合而成的Layer，由SPPFFusionPass生成
+/// 输出依次是输入本身和输入连续池化一次、两次、三次的结果，每个通道的四份结果在一次遍历中算出
+class SPPFLayer : public Layer
+{
+public:
+    explicit SPPFLayer(shared_ptr<MaxPoolingLayer> pooling_layer);
+
+    InferStatus Forward(const vector<shared_ptr<Tensor<float>>> &inputs, vector<shared_ptr<Tensor<float>>> &outputs) override;
+    static ParseParameterAttrStatus GetInstance(const shared_ptr<RuntimeOperator> &op, shared_ptr<Layer> &sppf_layer);
+
+    static const uint32_t kPoolingNum = 3; /// 级联的池化次数
+
+private:
+    shared_ptr<MaxPoolingLayer> pooling_layer_; /// 每一级使用的池化参数，输出和输入大小相同
+};
+
+}
+#endif //MAGIC_LAYER_DETAILS_SPPF_HPP_
@@ -0,0 +1,31 @@
+#ifndef MAGIC_LAYER_DETAILS_SQUEEZE_EXCITATION_HPP_
+#define MAGIC_LAYER_DETAILS_SQUEEZE_EXCITATION_HPP_
+
+#include "layer/abstract/param_layer.hpp"
+
+
+namespace magic_infer
+{
+
+/// MobileNetV3的SE模块，由SqueezeExcitationFusionPass将全局平均池化、1x1卷积、ReLU、1x1卷积、Hardsigmoid和逐通道乘法融合而成
+/// 每个通道的缩放系数只在一个很小的数组中计算，输入的特征图只读一遍，乘以缩放系数之后直接写到输出中
+class SqueezeExcitationLayer : public ParamLayer
+{
+public:
+    /**
+     * 权重是两个squeeze_channels * channels的矩阵，偏置是fc1和fc2各自的向量，都按先fc1后fc2的顺序存放
+     * @param channels 输入和输出的通道数
+     * @param squeeze_channels 压缩之后的通道数
+     */
+    explicit SqueezeExcitationLayer(uint32_t channels, uint32_t squeeze_channels);
+
+    InferStatus Forward(const vector<shared_ptr<Tensor<float>>> &inputs, vector<shared_ptr<Tensor<float>>> &outputs) override;
+    static ParseParameterAttrStatus GetInstance(const shared_ptr<RuntimeOperator> &op, shared_ptr<Layer> &se_layer);
+
+private:
+    uint32_t channels_ = 0;
+    uint32_t squeeze_channels_ = 0;
+};
+
+}
+#endif //MAGIC_LAYER_DETAILS_SQUEEZE_EXCITATION_HPP_
@@ -8,12 +8,18 @@
 namespace magic_infer 
 {
 
-enum class UpSampleMode { kModeNearest = 0, }; // 目前上采样层只支持邻近采样
+enum class UpSampleMode { kModeNearest = 0, kModeBilinear = 1, }; // 上采样层支持邻近采样和双线性插值
 
 class UpSampleLayer : public Layer 
 {
 public:
-    explicit UpSampleLayer(float scale_h, float scale_w, UpSampleMode mode = UpSampleMode::kModeNearest);
+    /**
+     * @param scale_h 高度方向的放大倍数
+     * @param scale_w 宽度方向的放大倍数
+     * @param mode 采样方式
+     * @param align_corners 双线性插值时是否对齐输入和输出四个角上的像素，和PyTorch的同名参数一致
+     */
+    explicit UpSampleLayer(float scale_h, float scale_w, UpSampleMode mode = UpSampleMode::kModeNearest, bool align_corners = false);
 
     InferStatus Forward(const vector<shared_ptr<Tensor<float>>> &inputs, vector<shared_ptr<Tensor<float>>> &outputs) override;
     static ParseParameterAttrStatus GetInstance(const shared_ptr<RuntimeOperator> &op, shared_ptr<Layer> &upsample_layer);
@@ -21,8 +27,9 @@ public:
 private:
     float scale_h_ = 0.f;
     float scale_w_ = 0.f;
-    
+
     UpSampleMode mode_ = UpSampleMode::kModeNearest;
+    bool align_corners_ = false;
 };
 
 }
@@ -0,0 +1,50 @@
+#ifndef MAGIC_NETS_NMS_HPP_
+#define MAGIC_NETS_NMS_HPP_
+
+#include "data/tensor.hpp"
+#include "nets/yolo_detect.hpp"
+
+
+namespace magic_infer
+{
+
+/**
+ * YOLO检测结果的非极大值抑制，候选框按置信度从高到低依次和已经保留的框比较，
+ * 一次计算4个已保留框的IoU；按类别抑制时只有相同类别的框才会互相抑制
+ */
+class NonMaxSuppression
+{
+public:
+    /**
+     * @param iou_thresh IoU超过该值的低置信度框被抑制
+     * @param top_k 每张图最多保留的框数，为0时不限制
+     * @param class_aware 是否只在相同类别之间抑制
+     * @param max_candidates 参与抑制的最多候选框数，超出时只保留置信度最高的部分
+     */
+    explicit NonMaxSuppression(float iou_thresh = 0.45f, uint32_t top_k = 300, bool class_aware = true, uint32_t max_candidates = 30000);
+
+    /**
+     * 对一张图的候选框做非极大值抑制
+     * @param candidates 候选框
+     * @return 保留的框，按置信度从高到低排列
+     */
+    vector<YoloCandidate> Suppress(const vector<YoloCandidate> &candidates) const;
+
+    /**
+     * 直接读取Detect层的输出，对整个batch并行做非极大值抑制
+     * @param outputs Detect层的输出，每个样本一个张量
+     * @param mode Detect层的输出方式，稠密输出时按conf_thresh筛选候选框
+     * @param conf_thresh 目标置信度和类别置信度乘积的阈值
+     * @return 每个样本保留的框
+     */
+    vector<vector<YoloCandidate>> Forward(const vector<shared_ptr<Tensor<float>>> &outputs, YoloDecodeMode mode, float conf_thresh) const;
+
+private:
+    float iou_thresh_ = 0.45f;
+    uint32_t top_k_ = 300;
+    bool class_aware_ = true;
+    uint32_t max_candidates_ = 30000;
+};
+
+}
+#endif //MAGIC_NETS_NMS_HPP_
@@ -8,6 +8,19 @@
 namespace magic_infer 
 {
 
+
+/// 稀疏输出中的一个候选框，坐标是输入图像上的中心点和宽高
+struct YoloCandidate
+{
+    float x = 0.f;
+    float y = 0.f;
+    float w = 0.f;
+    float h = 0.f;
+    float score = 0.f;    /// 目标置信度和类别置信度的乘积
+    int32_t class_id = -1;
+};
+
+
 class YoloDetectLayer : public Layer 
 {
 public:
@@ -17,6 +30,37 @@ public:
     InferStatus Forward(const vector<shared_ptr<Tensor<float>>> &inputs, vector<shared_ptr<Tensor<float>>> &outputs) override;
     static ParseParameterAttrStatus GetInstance(const shared_ptr<RuntimeOperator> &op, shared_ptr<Layer> &yolo_detect_layer);
 
+    /**
+     * 设置输出方式。稀疏输出时先用目标置信度过滤anchor，被拒绝的anchor不再计算类别的sigmoid，
+     * 保留下来的候选框按YoloCandidate的顺序写在输出的前6列，之后的行score为0、class_id为-1。
+     * 计算图通过RuntimeGraph::set_yolo_decode_mode设置
+     * @param mode 输出方式
+     * @param conf_thresh 稀疏输出时目标置信度和类别置信度乘积的阈值，取值在(0, 1)之间
+     */
+    void set_decode_mode(YoloDecodeMode mode, float conf_thresh = 0.25f);
+    YoloDecodeMode decode_mode() const;
+    float conf_thresh() const;
+
+    void Configure(const RuntimeLayerOptions &options) override;
+
+    /**
+     * 读取稀疏输出中的候选框
+     * @param output Detect层稀疏输出的一个样本
+     * @return 候选框，和anchor在稠密输出中的顺序一致
+     */
+    static vector<YoloCandidate> ReadCandidates(const Tensor<float> &output);
+
+private:
+    /**
+     * 对一个stage中一个样本的卷积输出做稀疏解码
+     * @param stage stage的编号
+     * @param input 卷积输出，通道数为3 * (num_classes + 5)
+     * @param candidates 追加的候选框
+     */
+    void DecodeSparse(uint32_t stage, const Tensor<float> &input, vector<YoloCandidate> &candidates) const;
+
+    InferStatus ForwardSparse(const vector<vector<shared_ptr<Tensor<float>>>> &batches, vector<shared_ptr<Tensor<float>>> &outputs);
+
 private:
     int32_t stages_ = 0;
     int32_t num_classes_ = 0;
@@ -25,6 +69,9 @@ private:
     vector<arma::fmat> anchor_grids_;
     vector<arma::fmat> grids_;
     vector<shared_ptr<ConvolutionLayer>> conv_layers_;
+
+    YoloDecodeMode decode_mode_ = YoloDecodeMode::kDecodeDense;
+    float conf_thresh_ = 0.25f;
 };
 
 }
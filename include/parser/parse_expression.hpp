@@ -24,8 +24,60 @@ enum class TokenType
     
     TokenLeftBracket  = 4,
     TokenRightBracket = 5,
+    TokenConstant     = 6, // 标量常数，例如2、-1.5、1.000000e-05
+
+    // 二元运算
+    TokenSub          = 7,
+    TokenDiv          = 8,
+    TokenPow          = 9,
+    TokenMax          = 10,
+    TokenMin          = 11,
+    TokenFloorDivide  = 12,
+    TokenRemainder    = 13,
+    TokenAtan2        = 14,
+
+    // 一元运算
+    TokenNeg          = 20,
+    TokenAbs          = 21,
+    TokenSqrt         = 22,
+    TokenRsqrt        = 23,
+    TokenSquare       = 24,
+    TokenReciprocal   = 25,
+    TokenExp          = 26,
+    TokenLog          = 27,
+    TokenLog10        = 28,
+    TokenSin          = 29,
+    TokenCos          = 30,
+    TokenTan          = 31,
+    TokenAsin         = 32,
+    TokenAcos         = 33,
+    TokenAtan         = 34,
+    TokenSinh         = 35,
+    TokenCosh         = 36,
+    TokenTanh         = 37,
+    TokenFloor        = 38,
+    TokenCeil         = 39,
+    TokenRound        = 40,
+    TokenTrunc        = 41,
+    TokenSign         = 42,
 };
 
+/**
+ * 返回运算的操作数个数
+ * @param token_type 运算的类型
+ * @return 一元运算返回1，二元运算返回2，不是运算时返回0
+ */
+int32_t TokenArity(TokenType token_type);
+
+/**
+ * 计算标量的运算结果，用于常量折叠
+ * @param token_type 运算的类型
+ * @param lhs 左操作数
+ * @param rhs 右操作数，一元运算时忽略
+ * @return 运算结果
+ */
+float EvaluateToken(TokenType token_type, float lhs, float rhs);
+
 struct Token 
 {
     TokenType token_type = TokenType::TokenUnknown;
@@ -38,7 +90,8 @@ struct Token
 
 struct TokenNode 
 {
-    int32_t num_index = -1;
+    int32_t num_index = -1; // 大于等于0时表示输入@N，小于0时为运算类型的相反数
+    float value = 0.f; // num_index为-TokenConstant时表示常数的值
     shared_ptr<TokenNode> left  = nullptr;
     shared_ptr<TokenNode> right = nullptr;
 
@@ -47,6 +100,40 @@ struct TokenNode
 };
 
 
+/// 字节码操作数的来源
+enum class OperandSource 
+{
+    SourceRegister = 0, /// 中间结果寄存器
+    SourceInput    = 1, /// 表达式的输入@N
+    SourceOutput   = 2, /// 表达式的输出
+    SourceConstant = 3, /// 表达式中的常数
+};
+
+struct ExpressionOperand 
+{
+    OperandSource source = OperandSource::SourceRegister;
+    int32_t index = 0; /// 寄存器或者输入的编号
+};
+
+/// 字节码指令dst = op(lhs, rhs)，一元运算只使用lhs，op为TokenInputNumber时表示dst = lhs
+struct ExpressionInstruction 
+{
+    TokenType op = TokenType::TokenUnknown;
+    ExpressionOperand dst;
+    ExpressionOperand lhs;
+    ExpressionOperand rhs;
+};
+
+/// 编译后的表达式，按顺序执行指令即可得到表达式的结果
+struct ExpressionProgram 
+{
+    vector<ExpressionInstruction> instructions;
+    vector<float> constants;   /// 折叠之后剩余的常数
+    uint32_t register_num = 0; /// 需要的中间结果寄存器个数
+    uint32_t input_num = 0;    /// 使用到的输入个数，即最大的@N加1
+};
+
+
 // add(add(add(@0,@1),@1),add(@0,@2))
 class ExpressionParser 
 {
@@ -56,6 +143,12 @@ public:
     void Tokenizer(bool need_retoken = false);
     vector<shared_ptr<TokenNode>> Generate();
 
+    /**
+     * 将表达式编译为字节码，最后一条指令直接写入输出
+     * @return 编译后的表达式
+     */
+    ExpressionProgram Compile();
+
     const vector<Token> &tokens() const;
     const vector<string> &token_strs() const;
 
@@ -3,8 +3,10 @@
 
 #include <initializer_list>
 #include <map>
+#include <memory>
 #include <set>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 using namespace std;
@@ -102,10 +104,18 @@ public:
 
     Attribute(const initializer_list<int>& shape, const vector<float>& t);
 
+    // weight bytes, either owned in data or viewed in the mapped bin file
+    const char* raw_data() const { return mapped_data ? mapped_data.get() : data.data(); }
+    size_t raw_size() const { return mapped_data ? mapped_size : data.size(); }
+
     // 0=null 1=f32 2=f64 3=f16 4=i32 5=i64 6=i16 7=i8 8=u8 9=bool
     int type;
     vector<int> shape;
     vector<char> data;
+
+    // set by Graph::load, shares the ownership of the whole bin file mapping
+    shared_ptr<const char> mapped_data;
+    size_t mapped_size = 0;
 };
 
 
@@ -187,6 +197,12 @@ public:
 private:
     Graph(const Graph& rhs);
     Graph& operator=(const Graph& rhs);
+
+    // name index of operands, rebuilt lazily when operands is modified directly
+    mutable unordered_map<string, Operand*> operand_index;
+    mutable size_t indexed_operand_count = 0;
+
+    void update_operand_index() const;
 };
 
 } // namespace pnnx
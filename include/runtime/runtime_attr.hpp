@@ -2,6 +2,7 @@
 #define MAGIC_RUNTIME_RUNTIME_ATTR_HPP_
 
 #include <vector>
+#include <memory>
 #include <glog/logging.h>
 #include "utils/status_code.hpp"
 #include "runtime_datatype.hpp"
@@ -9,52 +10,92 @@
 using namespace std;
 
 
-namespace magic_infer 
+namespace magic_infer
 {
 
+/// 权重数据的只读视图，不拥有数据
+template<class T>
+struct RuntimeAttributeSpan
+{
+    const T *data = nullptr; /// 数据的起始地址
+    size_t size = 0;         /// 元素个数
+
+    const T *begin() const { return data; }
+    const T *end() const { return data + size; }
+    bool empty() const { return size == 0; }
+    const T &operator[](size_t index) const { return data[index]; }
+};
+
+
 /// 计算图节点的属性信息
-struct RuntimeAttribute 
+struct RuntimeAttribute
 {
-    vector<char> weight_data; /// 节点中的权重参数
+    vector<char> weight_data; /// 节点中的权重参数，图优化改写之后的权重也保存在这里
+    shared_ptr<const char> mapped_data; /// 映射到权重文件中的权重参数，不为空时优先使用
+    size_t mapped_size = 0;   /// 映射的权重参数字节数
     vector<int> shape;        /// 节点中的形状信息
     RuntimeDataType type = RuntimeDataType::kTypeUnknown; /// 节点中的数据类型
 
+    /**
+     * 返回权重参数的起始地址
+     * @return 权重参数的起始地址
+     */
+    const char *raw_data() const { return mapped_data ? mapped_data.get() : weight_data.data(); }
+
+    /**
+     * 返回权重参数的字节数
+     * @return 权重参数的字节数
+     */
+    size_t raw_size() const { return mapped_data ? mapped_size : weight_data.size(); }
+
+    /**
+     * 返回权重参数的视图，不拷贝数据，视图在属性被修改或者释放之前有效
+     * @tparam T 权重类型
+     * @return 权重参数视图
+     */
+    template<class T>
+    RuntimeAttributeSpan<T> span() const;
+
     /**
      * 从节点中加载权重参数
      * @tparam T 权重类型
      * @return 权重参数数组
      */
     template<class T> //
-    vector<T> get();
+    vector<T> get() const;
 };
 
 
 template<class T>
-vector<T> RuntimeAttribute::get() 
+RuntimeAttributeSpan<T> RuntimeAttribute::span() const
 {
     /// 检查节点属性中的权重类型
-    CHECK(!weight_data.empty());
+    CHECK(raw_size() > 0);
     CHECK(type != RuntimeDataType::kTypeUnknown);
-    vector<T> weights;
-   
+    RuntimeAttributeSpan<T> weights;
+
     switch (type) {
         case RuntimeDataType::kTypeFloat32: { /// 加载的数据类型是float
             const bool is_float = is_same<T, float>::value;
             CHECK_EQ(is_float, true);
-            const uint32_t float_size = sizeof(float);
-            CHECK_EQ(weight_data.size() % float_size, 0);
-            
-            for (uint32_t i = 0; i < weight_data.size() / float_size; ++i) {
-                float weight = *((float *) weight_data.data() + i);
-                weights.push_back(weight);
-            }
+            CHECK_EQ(raw_size() % sizeof(float), 0);
+            weights.data = (const T *) raw_data();
+            weights.size = raw_size() / sizeof(float);
             break;
-        } 
+        }
         default: LOG(FATAL) << "Unknown weight data type";
     }
 
     return weights;
 }
 
+
+template<class T>
+vector<T> RuntimeAttribute::get() const
+{
+    const RuntimeAttributeSpan<T> &weights = span<T>();
+    return vector<T>(weights.begin(), weights.end());
+}
+
 }
 #endif //MAGIC_RUNTIME_RUNTIME_ATTR_HPP_
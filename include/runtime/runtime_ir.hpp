@@ -6,12 +6,16 @@
 #include <glog/logging.h>
 #include <memory>
 #include <map>
+#include <unordered_map>
 #include <queue>
+#include <thread>
 
 #include "ir.h"
 #include "layer/abstract/layer.hpp"
 #include "runtime/runtime_operand.hpp"
 #include "runtime_op.hpp"
+#include "runtime_optimizer.hpp"
+#include "runtime_model.hpp"
 
 
 namespace magic_infer 
@@ -35,6 +39,20 @@ public:
      */
     static void InitOperatorOutputTensor(const std::vector<pnnx::Operator *> &pnnx_operators,
         const std::vector<std::shared_ptr<RuntimeOperator>> &operators);
+
+    /**
+     * 根据节点输出operand中已经记录的形状准备好输出张量，用于从原生模型文件加载的计算图
+     * @param operators 计算图中的计算节点
+     */
+    static void InitOperatorOutputTensor(const std::vector<std::shared_ptr<RuntimeOperator>> &operators);
+
+    /**
+     * 规划通道维度上的concat，concat的输入张量改为输出张量通道切片的视图，
+     * 只输出到concat的前驱节点直接把结果写入切片中，concat不再需要拷贝
+     * @param operators 计算图中的计算节点，输入和输出张量已经初始化
+     * @return 原地执行的concat节点个数
+     */
+    static uint32_t InitConcatInplaceTensor(const std::vector<std::shared_ptr<RuntimeOperator>> &operators);
 };
 
 
@@ -49,6 +67,8 @@ public:
      */
     RuntimeGraph(std::string param_path, std::string bin_path);
 
+    ~RuntimeGraph();
+
     /**
      * 构建计算图
      * @param input_name 计算图输入节点的名称
@@ -56,6 +76,27 @@ public:
      */
     void Build(const std::string &input_name, const std::string &output_name);
 
+    /**
+     * 按请求的多个输出构建计算图，不为任何一个输出提供输入的计算节点被删除
+     * @param input_name 计算图输入节点的名称
+     * @param output_names 请求的输出节点的名称，可以是pnnx.Output节点，也可以是中间的计算节点
+     */
+    void Build(const std::string &input_name, const std::vector<std::string> &output_names);
+
+    /**
+     * 将Build之后的计算图保存为原生模型文件，保存图优化的结果和打包之后的权重
+     * @param model_path 模型文件路径
+     * @return 是否保存成功
+     */
+    bool Save(const std::string &model_path) const;
+
+    /**
+     * 映射并加载原生模型文件，加载之后计算图处于Build完成的状态，可以直接执行
+     * @param model_path 模型文件路径
+     * @return 是否加载成功
+     */
+    bool Load(const std::string &model_path);
+
     /**
      * 设置权重文件
      * @param bin_path 权重文件路径
@@ -68,6 +109,41 @@ public:
      */
     void set_param_path(const std::string &param_path);
 
+    /**
+     * 设置Build时是否原地执行通道维度上的concat，默认开启
+     * @param inplace_concat 是否原地执行concat
+     */
+    void set_inplace_concat(bool inplace_concat);
+
+    /**
+     * 设置跨进程共享权重段，Build时权重段已经存在则只读映射并直接引用其中的权重，
+     * 不存在时由当前进程在创建Layer之后导出，路径以"/"开头且不含其他"/"时使用POSIX共享内存
+     * @param shared_weight_path 共享内存的名称或者文件路径，为空时不共享
+     */
+    void set_shared_weight_path(const std::string &shared_weight_path);
+
+    /**
+     * 设置是否延迟创建带权重的Layer，延迟时权重的解码和打包在节点第一次执行时才进行，
+     * 只执行一部分节点或者很少执行的模型只占用实际执行的节点的内存
+     * @param lazy_weights 是否延迟创建
+     * @param prefetch_weights 是否在Build之后按执行顺序在后台线程中提前创建
+     */
+    void set_lazy_weights(bool lazy_weights, bool prefetch_weights = false);
+
+    /**
+     * 设置Linear层和融合之后的分类头在Forward中读取的权重精度，在Build或者Load之前设置，
+     * fp16和int8的权重在第一次执行时转换，转换之后释放float权重
+     * @param linear_weight_type 权重精度，默认为float
+     */
+    void set_linear_weight_type(LinearWeightType linear_weight_type);
+
+    /**
+     * 设置Detect层的输出方式，在Build或者Load之前设置
+     * @param decode_mode 输出方式，默认为稠密输出
+     * @param conf_thresh 稀疏输出时目标置信度和类别置信度乘积的阈值，取值在(0, 1)之间
+     */
+    void set_yolo_decode_mode(YoloDecodeMode decode_mode, float conf_thresh = 0.25f);
+
     /**
      * 返回结构文件
      * @return 返回结构文件
@@ -80,6 +156,18 @@ public:
      */
     const std::string &bin_path() const;
 
+    /**
+     * 返回Build之后的计算节点
+     * @return 计算图的计算节点
+     */
+    const std::vector<std::shared_ptr<RuntimeOperator>> &operators() const;
+
+    /**
+     * 返回Build时每个图优化pass的统计信息
+     * @return 每个pass的统计信息
+     */
+    const std::vector<RuntimePassReport> &pass_reports() const;
+
     /**
      * 计算图的执行,根据广度优先搜索的顺序执行
      * @param inputs 计算图的输入张量
@@ -88,6 +176,15 @@ public:
      */
     std::vector<std::shared_ptr<Tensor<float>>> Forward(const std::vector<std::shared_ptr<Tensor<float>>> &inputs, bool debug = false);
 
+    /**
+     * 执行一次计算图，返回Build时请求的所有输出
+     * @param inputs 计算图的输入张量
+     * @param debug 是否调试，如果调试则输出一些中间信息
+     * @return 按请求的顺序排列的每个输出的张量
+     */
+    std::vector<std::vector<std::shared_ptr<Tensor<float>>>> ForwardOutputs(const std::vector<std::shared_ptr<Tensor<float>>> &inputs,
+        bool debug = false);
+
 private:
     /**
      * 计算图的初始化
@@ -133,9 +230,42 @@ private:
     /**
      * 根据计算图中的计算节点来返回Layer
      * @param op 计算图中的计算节点
+     * @param options 计算图设置的Layer选项
      * @return 创建成功的Layer
      */
-    static std::shared_ptr<Layer> CreateLayer(const std::shared_ptr<RuntimeOperator> &op);
+    static std::shared_ptr<Layer> CreateLayer(const std::shared_ptr<RuntimeOperator> &op, const RuntimeLayerOptions &options);
+
+
+    /**
+     * 返回请求的输出对应的pnnx.Output节点，请求的是中间的计算节点时为其添加一个pnnx.Output节点，
+     * 图优化不会删除或融合pnnx.Output节点，因此中间节点的结果在图优化之后仍然可以得到
+     * @param output_name 请求的输出节点的名称
+     * @param operators_map 名称到计算节点的索引，新添加的pnnx.Output节点也会加入索引
+     * @param pnnx_operators_map 名称到pnnx节点的索引
+     * @return pnnx.Output节点的名称
+     */
+    std::string AddOutputOperator(const std::string &output_name,
+        std::unordered_map<std::string, std::shared_ptr<RuntimeOperator>> &operators_map,
+        const std::unordered_map<std::string, pnnx::Operator *> &pnnx_operators_map);
+
+    /**
+     * 原生模型文件加载的计算图已经优化并创建了Layer，再次Build时只从保存的输出节点中重新选择输入和输出
+     * @param input_name 输入节点的名称
+     * @param output_names 请求的输出节点的名称，中间节点需要在保存模型之前请求过
+     */
+    void BuildLoadedGraph(const std::string &input_name, const std::vector<std::string> &output_names);
+
+    /**
+     * 节点的Layer还没有创建时创建，可以被执行线程和预取线程同时调用
+     * @param op 计算图中的计算节点
+     * @param options 计算图设置的Layer选项
+     */
+    static void MaterializeLayer(const std::shared_ptr<RuntimeOperator> &op, const RuntimeLayerOptions &options);
+
+    /**
+     * 等待后台创建Layer的线程结束
+     */
+    void JoinPrefetch();
 
     /**
      * 检查当前节点是否就绪
@@ -163,14 +293,22 @@ private:
 
     GraphState graph_state_ = GraphState::NeedInit;
     std::string input_name_; /// 计算图输入节点的名称
-    std::string output_name_; /// 计算图输出节点的名称
+    std::vector<std::string> output_names_; /// 请求的输出对应的pnnx.Output节点的名称
     std::string param_path_; /// 计算图的结构文件
     std::string bin_path_; /// 计算图的权重文件
+    bool inplace_concat_ = true; /// 是否原地执行concat
+    std::string shared_weight_path_; /// 跨进程共享权重段的路径
+    bool lazy_weights_ = false; /// 是否延迟创建带权重的Layer
+    bool prefetch_weights_ = false; /// 是否在后台线程中提前创建延迟的Layer
+    RuntimeLayerOptions layer_options_; /// 创建Layer时设置的选项
+    std::thread prefetch_thread_; /// 后台创建Layer的线程
     
     std::map<std::string, std::shared_ptr<RuntimeOperator>> input_operators_maps_; /// 保存输入节点
     std::map<std::string, std::shared_ptr<RuntimeOperator>> output_operators_maps_; /// 保存输出节点
     std::vector<std::shared_ptr<RuntimeOperator>> operators_; /// 计算图的计算节点
+    std::vector<RuntimePassReport> pass_reports_; /// 图优化pass的统计信息
     std::unique_ptr<pnnx::Graph> graph_; /// pnnx的graph
+    std::shared_ptr<char> model_mapping_; /// 原生模型文件的映射，加载的权重引用其中的数据
 };
 
 }
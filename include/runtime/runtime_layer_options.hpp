@@ -0,0 +1,22 @@
+#ifndef MAGIC_RUNTIME_RUNTIME_LAYER_OPTIONS_HPP_
+#define MAGIC_RUNTIME_RUNTIME_LAYER_OPTIONS_HPP_
+
+
+namespace magic_infer
+{
+
+enum class LinearWeightType { kFloat32 = 0, kFloat16 = 1, kInt8 = 2, }; // Forward中矩阵乘法读取的权重精度
+
+enum class YoloDecodeMode { kDecodeDense = 0, kDecodeSparse = 1, }; // Detect层输出全部anchor或者只输出候选框
+
+
+/// 计算图创建Layer时统一设置的选项，由各Layer的Configure读取自己关心的部分
+struct RuntimeLayerOptions
+{
+    LinearWeightType linear_weight_type = LinearWeightType::kFloat32; /// Linear层的权重精度
+    YoloDecodeMode yolo_decode_mode = YoloDecodeMode::kDecodeDense;   /// Detect层的输出方式
+    float yolo_conf_thresh = 0.25f;                                    /// Detect层稀疏输出时的置信度阈值
+};
+
+}
+#endif //MAGIC_RUNTIME_RUNTIME_LAYER_OPTIONS_HPP_
@@ -0,0 +1,50 @@
+#ifndef MAGIC_RUNTIME_RUNTIME_MODEL_HPP_
+#define MAGIC_RUNTIME_RUNTIME_MODEL_HPP_
+
+#include <vector>
+#include <string>
+#include <memory>
+
+#include "runtime_op.hpp"
+
+
+namespace magic_infer
+{
+
+/**
+ * MagicInfer原生的二进制模型文件，保存图优化之后的计算图
+ *
+ * 文件由头部、元数据和数据区三部分组成，数据区中的每块数据都按64字节对齐，可以直接映射使用：
+ * 1. 计算节点按执行顺序保存，节点之间的连接关系保存为节点的下标，加载时不需要按名称查找
+ * 2. 卷积和全连接的权重按照Layer内部的打包格式保存，加载时直接作为Layer的权重张量，不需要重新打包
+ * 3. 其余的属性保存原始数据，加载之后的属性直接引用文件的映射
+ */
+class RuntimeModel
+{
+public:
+    /**
+     * 将Build之后的计算图保存为原生模型文件
+     * @param model_path 模型文件路径
+     * @param operators 计算图的计算节点，Layer已经创建
+     * @param input_name 计算图输入节点的名称
+     * @param output_names 计算图输出节点的名称，保存为个数加上带长度前缀的名称
+     * @return 是否保存成功
+     */
+    static bool Save(const std::string &model_path, const std::vector<std::shared_ptr<RuntimeOperator>> &operators,
+        const std::string &input_name, const std::vector<std::string> &output_names);
+
+    /**
+     * 映射并加载原生模型文件，创建计算节点和Layer，节点的输入输出张量由调用者初始化
+     * @param model_path 模型文件路径
+     * @param operators 加载得到的计算节点
+     * @param input_name 计算图输入节点的名称
+     * @param output_names 计算图输出节点的名称
+     * @param mapping 模型文件的映射，权重张量引用其中的数据，需要和计算节点一起保存
+     * @return 是否加载成功
+     */
+    static bool Load(const std::string &model_path, std::vector<std::shared_ptr<RuntimeOperator>> &operators,
+        std::string &input_name, std::vector<std::string> &output_names, std::shared_ptr<char> &mapping);
+};
+
+}
+#endif //MAGIC_RUNTIME_RUNTIME_MODEL_HPP_
@@ -5,6 +5,7 @@
 #include <unordered_map>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <string>
 
 #include "layer/abstract/layer.hpp"
@@ -32,6 +33,8 @@ struct RuntimeOperator
     std::string name; /// 计算节点的名称
     std::string type; /// 计算节点的类型
     std::shared_ptr<Layer> layer; /// 节点对应的计算Layer
+    std::mutex layer_mutex; /// 延迟创建Layer时保护layer
+    bool prepacked_weights = false; /// 权重由原生模型文件的加载器按打包格式设置，属性中没有数据
 
     std::vector<std::string> output_names; /// 节点的输出节点名称
     std::shared_ptr<RuntimeOperand> output_operands; /// 节点的输出操作数
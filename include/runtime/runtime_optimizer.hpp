@@ -0,0 +1,186 @@
+#ifndef MAGIC_RUNTIME_RUNTIME_OPTIMIZER_HPP_
+#define MAGIC_RUNTIME_RUNTIME_OPTIMIZER_HPP_
+
+#include <map>
+#include <vector>
+#include <string>
+#include <memory>
+
+#include "runtime_op.hpp"
+
+
+namespace magic_infer
+{
+
+/// 计算图优化pass的基类，在Build创建Layer之前对计算节点进行变换
+class RuntimeGraphPass
+{
+public:
+    explicit RuntimeGraphPass(string pass_name);
+
+    virtual ~RuntimeGraphPass() = default;
+
+    /**
+     * 对计算图执行变换
+     * @param operators 计算图中的计算节点
+     * @return 被修改或删除的节点数量
+     */
+    virtual uint32_t Run(vector<shared_ptr<RuntimeOperator>> &operators) = 0;
+
+    /**
+     * 返回pass的名称
+     * @return pass的名称
+     */
+    const string &pass_name() const;
+
+protected:
+    string pass_name_; /// pass的名称
+};
+
+
+/// 单个pass执行前后的统计信息
+struct RuntimePassReport
+{
+    string pass_name;         /// pass的名称
+    uint32_t changed_num = 0; /// 被修改或删除的节点数量
+    uint32_t nodes_before = 0; /// 执行前的节点数量
+    uint32_t nodes_after = 0;  /// 执行后的节点数量
+    uint64_t flops_before = 0; /// 执行前估算的浮点运算次数
+    uint64_t flops_after = 0;  /// 执行后估算的浮点运算次数
+};
+
+
+/// 按节点类型注册浮点运算次数的估算函数，由各个Layer和融合pass在自己的源文件中注册
+class FlopsEstimatorRegisterer
+{
+public:
+    typedef uint64_t (*Estimator)(const shared_ptr<RuntimeOperator> &op, uint64_t output_elements);
+    typedef map<string, Estimator> EstimateRegistry;
+
+    static void RegisterEstimator(const string &op_type, const Estimator &estimator);
+    static Estimator GetEstimator(const string &op_type);
+    static EstimateRegistry &Registry();
+};
+
+
+class FlopsEstimatorRegistererWrapper
+{
+public:
+    FlopsEstimatorRegistererWrapper(const string &op_type, const FlopsEstimatorRegisterer::Estimator &estimator)
+    {
+        FlopsEstimatorRegisterer::RegisterEstimator(op_type, estimator);
+    }
+};
+
+
+/// 计算图优化的pass管理器，按顺序执行pass并在每个pass之后检查计算图是否合法
+class RuntimeGraphOptimizer
+{
+public:
+    /**
+     * 添加一个pass，pass按照添加的顺序执行
+     * @param pass 待添加的pass
+     */
+    void AddPass(const shared_ptr<RuntimeGraphPass> &pass);
+
+    /**
+     * 依次执行所有pass，每个pass执行之后检查计算图是否合法
+     * @param operators 计算图中的计算节点
+     * @return 每个pass的统计信息
+     */
+    const vector<RuntimePassReport> &Run(vector<shared_ptr<RuntimeOperator>> &operators);
+
+    /**
+     * 返回最近一次执行的统计信息
+     * @return 每个pass的统计信息
+     */
+    const vector<RuntimePassReport> &reports() const;
+
+    /**
+     * 返回Build时默认执行的pass管理器
+     * @param output_names 保留的pnnx.Output节点的名称，为空时保留所有的输出节点
+     * @return 包含默认pass的管理器
+     */
+    static RuntimeGraphOptimizer DefaultOptimizer(const vector<string> &output_names = {});
+
+    /**
+     * 检查计算图是否合法：节点名称唯一，节点之间的输入输出关系一致，并且没有环
+     * @param operators 计算图中的计算节点
+     * @return 计算图是否合法
+     */
+    static bool Validate(const vector<shared_ptr<RuntimeOperator>> &operators);
+
+    /**
+     * 估算计算图的浮点运算次数，节点类型注册了估算函数时使用注册的函数，否则按每个输出元素1次计算
+     * @param operators 计算图中的计算节点
+     * @return 估算的浮点运算次数
+     */
+    static uint64_t EstimateFlops(const vector<shared_ptr<RuntimeOperator>> &operators);
+
+    /**
+     * 计算形状中的元素个数
+     * @param shapes 操作数的形状
+     * @return 元素个数，形状为空时返回0
+     */
+    static uint64_t ShapeElements(const vector<int32_t> &shapes);
+
+    /**
+     * 估算带"weight"属性的卷积和全连接的浮点运算次数，乘加按2次计算，
+     * 每个输出元素对应的乘加次数等于权重中除输出通道之外的元素个数
+     * @param op 计算节点
+     * @param output_elements 输出的元素个数
+     * @return 浮点运算次数，没有权重形状时返回输出的元素个数
+     */
+    static uint64_t EstimateWeightFlops(const shared_ptr<RuntimeOperator> &op, uint64_t output_elements);
+
+    /**
+     * 返回节点的输出形状，从后继节点的输入操作数中获取
+     * @param op 计算节点
+     * @return 节点的输出形状，节点没有后继时返回空
+     */
+    static vector<int32_t> OutputShapes(const shared_ptr<RuntimeOperator> &op);
+
+    /**
+     * 按节点类型匹配计算图中的链式结构，链中除最后一个节点之外，每个节点的输出只被下一个节点使用
+     * @param operators 计算图中的计算节点
+     * @param types 链中每个节点的类型
+     * @return 匹配到的所有节点链
+     */
+    static vector<vector<shared_ptr<RuntimeOperator>>> MatchChain(const vector<shared_ptr<RuntimeOperator>> &operators,
+        const vector<string> &types);
+
+    /**
+     * 删除只有一个输入的节点，节点的后继改为直接读取其前驱的输出
+     * @param operators 计算图中的计算节点
+     * @param op 待删除的节点
+     * @return 是否删除成功
+     */
+    static bool RemoveOperator(vector<shared_ptr<RuntimeOperator>> &operators, const shared_ptr<RuntimeOperator> &op);
+
+    /**
+     * 批量删除只有一个输入的节点，名称索引只建立一次，节点数组只整理一次，删除的开销和节点数成线性关系
+     * @param operators 计算图中的计算节点
+     * @param removed_operators 待删除的节点，按顺序删除
+     * @return 每个节点是否删除成功
+     */
+    static vector<bool> RemoveOperators(vector<shared_ptr<RuntimeOperator>> &operators,
+        const vector<shared_ptr<RuntimeOperator>> &removed_operators);
+
+    /**
+     * 用一个新的节点替换计算图中的一组节点，新节点使用链尾节点的输出。链中除链尾之外的节点只能输出到链中，
+     * 链外的节点可以同时输出到链中的多个节点，例如SPPF中x同时输出到第一级池化和torch.cat
+     * @param operators 计算图中的计算节点
+     * @param chain 待替换的节点，由MatchChain得到或者按执行顺序排列，最后一个节点是链尾
+     * @param new_op 新的节点，只需要设置名称、类型、参数和属性，没有设置输入时使用链首节点的输入
+     * @return 是否替换成功
+     */
+    static bool ReplaceOperators(vector<shared_ptr<RuntimeOperator>> &operators, const vector<shared_ptr<RuntimeOperator>> &chain,
+        const shared_ptr<RuntimeOperator> &new_op);
+
+private:
+    vector<shared_ptr<RuntimeGraphPass>> passes_; /// 按顺序执行的pass
+    vector<RuntimePassReport> reports_;           /// 最近一次执行的统计信息
+};
+
+}
+#endif //MAGIC_RUNTIME_RUNTIME_OPTIMIZER_HPP_
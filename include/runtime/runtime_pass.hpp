@@ -0,0 +1,92 @@
+#ifndef MAGIC_RUNTIME_RUNTIME_PASS_HPP_
+#define MAGIC_RUNTIME_RUNTIME_PASS_HPP_
+
+#include <vector>
+#include <string>
+#include <memory>
+
+#include "runtime_optimizer.hpp"
+
+
+namespace magic_infer
+{
+
+/// 删除无法到达任何输出节点的计算节点
+class DeadOperatorEliminationPass : public RuntimeGraphPass
+{
+public:
+    /**
+     * @param output_names 保留的pnnx.Output节点的名称，为空时保留所有的输出节点
+     */
+    explicit DeadOperatorEliminationPass(vector<string> output_names = {});
+
+    uint32_t Run(vector<shared_ptr<RuntimeOperator>> &operators) override;
+
+private:
+    vector<string> output_names_; /// 保留的pnnx.Output节点的名称
+};
+
+
+/// 删除输入输出形状一致的view、reshape、flatten等恒等节点
+class IdentityOperatorEliminationPass : public RuntimeGraphPass
+{
+public:
+    IdentityOperatorEliminationPass();
+
+    uint32_t Run(vector<shared_ptr<RuntimeOperator>> &operators) override;
+};
+
+
+/**
+ * 将紧跟在卷积之后的BatchNorm2d折叠进卷积的权重和偏移量中，并从计算图中删除BatchNorm2d节点
+ * 只有当卷积的输出仅被该BatchNorm2d使用时才进行折叠
+ */
+class ConvBatchNormFoldPass : public RuntimeGraphPass
+{
+public:
+    ConvBatchNormFoldPass();
+
+    uint32_t Run(vector<shared_ptr<RuntimeOperator>> &operators) override;
+};
+
+
+/**
+ * 将YOLOv5的SPPF结构融合为一个magic.SPPF节点：x依次经过三个相同的步长为1、输出大小不变的MaxPool2d，
+ * 再和三个池化结果一起在通道维度上拼接。融合节点沿用torch.cat的名称和输出，读取x并保留池化的参数
+ */
+class SPPFFusionPass : public RuntimeGraphPass
+{
+public:
+    SPPFFusionPass();
+
+    uint32_t Run(vector<shared_ptr<RuntimeOperator>> &operators) override;
+};
+
+
+/**
+ * 将分类头中输出为1x1的AdaptiveAvgPool2d、torch.flatten和nn.Linear融合为一个magic.GlobalPoolLinear节点
+ * 融合节点沿用Linear的名称、参数和权重，直接读取池化之前的特征图
+ */
+class GlobalPoolLinearFusionPass : public RuntimeGraphPass
+{
+public:
+    GlobalPoolLinearFusionPass();
+
+    uint32_t Run(vector<shared_ptr<RuntimeOperator>> &operators) override;
+};
+
+
+/**
+ * 将MobileNetV3的SE模块融合为一个magic.SqueezeExcitation节点：x经过输出为1x1的AdaptiveAvgPool2d、1x1卷积、ReLU、
+ * 1x1卷积和Hardsigmoid得到逐通道的缩放系数，再由pnnx.Expression的mul和x相乘。融合节点沿用乘法的名称和输出，读取x并保存两个卷积的权重
+ */
+class SqueezeExcitationFusionPass : public RuntimeGraphPass
+{
+public:
+    SqueezeExcitationFusionPass();
+
+    uint32_t Run(vector<shared_ptr<RuntimeOperator>> &operators) override;
+};
+
+}
+#endif //MAGIC_RUNTIME_RUNTIME_PASS_HPP_
@@ -2,7 +2,9 @@
 #define PNNX_STOREZIP_H
 
 #include <map>
+#include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 using namespace std;
@@ -20,10 +22,14 @@ public:
     int open(const string& path);
     size_t get_file_size(const string& name);
     int read_file(const string& name, char* data);
+
+    // zero-copy view of a stored entry, keeps the file mapping alive even after close()
+    shared_ptr<const char> get_file_data(const string& name);
     int close();
 
 private:
-    FILE* fp;
+    shared_ptr<const char> mapping;
+    size_t mapping_size;
 
     struct StoreZipMeta
     {
@@ -31,7 +37,7 @@ private:
         size_t size;
     };
 
-    map<string, StoreZipMeta> filemetas;
+    unordered_map<string, StoreZipMeta> filemetas;
 };
 
 
@@ -0,0 +1,295 @@
+#ifndef MAGIC_UTILS_AVX512_MATH_HPP_
+#define MAGIC_UTILS_AVX512_MATH_HPP_
+
+#include "platform.hpp"
+
+#if MAGIC_X86_DISPATCH
+#include <immintrin.h>
+
+/*
+ * 16路float的数学函数，算法和常数与avx_math.hpp中的8路版本一致，误差见avx_math.hpp。
+ * 函数按MAGIC_TARGET_AVX512单独开启AVX-512F，只能在运行时确认CPU支持之后调用。
+ * AVX-512F没有浮点的位运算(属于AVX-512DQ)，位运算按整数计算
+ */
+
+static MAGIC_TARGET_AVX512 MAGIC_FORCEINLINE __m512 and512_ps(__m512 a, __m512 b)
+{
+    return _mm512_castsi512_ps(_mm512_and_si512(_mm512_castps_si512(a), _mm512_castps_si512(b)));
+}
+
+
+static MAGIC_TARGET_AVX512 MAGIC_FORCEINLINE __m512 or512_ps(__m512 a, __m512 b)
+{
+    return _mm512_castsi512_ps(_mm512_or_si512(_mm512_castps_si512(a), _mm512_castps_si512(b)));
+}
+
+
+static MAGIC_TARGET_AVX512 MAGIC_FORCEINLINE __m512 xor512_ps(__m512 a, __m512 b)
+{
+    return _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(a), _mm512_castps_si512(b)));
+}
+
+
+/// exp(x)，输入限制在[-88.38, 88.38]之内
+static MAGIC_TARGET_AVX512 MAGIC_FORCEINLINE __m512 exp512_ps(__m512 x)
+{
+    const __m512 one = _mm512_set1_ps(1.f);
+    x = _mm512_min_ps(x, _mm512_set1_ps(88.3762626647949f));
+    x = _mm512_max_ps(x, _mm512_set1_ps(-88.3762626647949f));
+
+    // exp(x) = exp(g + n * log(2))
+    __m512 fx = _mm512_fmadd_ps(x, _mm512_set1_ps(1.44269504088896341f), _mm512_set1_ps(0.5f));
+    fx = _mm512_roundscale_ps(fx, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+
+    x = _mm512_fnmadd_ps(fx, _mm512_set1_ps(0.693359375f), x);
+    x = _mm512_fnmadd_ps(fx, _mm512_set1_ps(-2.12194440e-4f), x);
+    const __m512 x2 = _mm512_mul_ps(x, x);
+
+    __m512 y = _mm512_set1_ps(1.9875691500E-4f);
+    y = _mm512_fmadd_ps(y, x, _mm512_set1_ps(1.3981999507E-3f));
+    y = _mm512_fmadd_ps(y, x, _mm512_set1_ps(8.3334519073E-3f));
+    y = _mm512_fmadd_ps(y, x, _mm512_set1_ps(4.1665795894E-2f));
+    y = _mm512_fmadd_ps(y, x, _mm512_set1_ps(1.6666665459E-1f));
+    y = _mm512_fmadd_ps(y, x, _mm512_set1_ps(5.0000001201E-1f));
+    y = _mm512_fmadd_ps(y, x2, x);
+    y = _mm512_add_ps(y, one);
+
+    // 2^n
+    __m512i n = _mm512_cvttps_epi32(fx);
+    n = _mm512_slli_epi32(_mm512_add_epi32(n, _mm512_set1_epi32(0x7f)), 23);
+    return _mm512_mul_ps(y, _mm512_castsi512_ps(n));
+}
+
+
+/// 快速exp(x)，exp(x) = 2^n * 2^f，2^f在[-0.5, 0.5]上用3阶多项式近似
+static MAGIC_TARGET_AVX512 MAGIC_FORCEINLINE __m512 exp512_fast_ps(__m512 x)
+{
+    x = _mm512_min_ps(x, _mm512_set1_ps(88.3762626647949f));
+    x = _mm512_max_ps(x, _mm512_set1_ps(-87.3365478515625f));
+
+    const __m512 t = _mm512_mul_ps(x, _mm512_set1_ps(1.44269504088896341f));
+    const __m512 n = _mm512_roundscale_ps(t, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    const __m512 f = _mm512_sub_ps(t, n);
+
+    __m512 y = _mm512_set1_ps(5.508868381e-02f);
+    y = _mm512_fmadd_ps(y, f, _mm512_set1_ps(2.426040515e-01f));
+    y = _mm512_fmadd_ps(y, f, _mm512_set1_ps(6.932762417e-01f));
+    y = _mm512_fmadd_ps(y, f, _mm512_set1_ps(9.999289404e-01f));
+
+    const __m512i e = _mm512_slli_epi32(_mm512_cvtps_epi32(n), 23);
+    return _mm512_castsi512_ps(_mm512_add_epi32(_mm512_castps_si512(y), e));
+}
+
+
+/// 把x拆分为尾数和指数，x = (1 + m) * 2^e，1 + m在[sqrt(0.5), sqrt(2))之内
+static MAGIC_TARGET_AVX512 MAGIC_FORCEINLINE __m512 log512_reduce_ps(__m512 x, __m512 &e)
+{
+    const __m512 one = _mm512_set1_ps(1.f);
+    x = _mm512_max_ps(x, _mm512_castsi512_ps(_mm512_set1_epi32(0x00800000)));
+
+    const __m512i exponent = _mm512_srli_epi32(_mm512_castps_si512(x), 23);
+    e = _mm512_cvtepi32_ps(_mm512_sub_epi32(exponent, _mm512_set1_epi32(0x7e)));
+    x = and512_ps(x, _mm512_castsi512_ps(_mm512_set1_epi32(~0x7f800000)));
+    x = or512_ps(x, _mm512_set1_ps(0.5f));
+
+    // 尾数在[0.5, sqrt(0.5))时乘2，指数减1
+    const __mmask16 mask = _mm512_cmp_ps_mask(x, _mm512_set1_ps(0.707106781186547524f), _CMP_LT_OQ);
+    e = _mm512_mask_sub_ps(e, mask, e, one);
+    return _mm512_mask_add_ps(_mm512_sub_ps(x, one), mask, _mm512_sub_ps(x, one), x);
+}
+
+
+/// 处理log的特殊输入：0返回-inf，+inf返回+inf，负数和NaN返回NaN
+static MAGIC_TARGET_AVX512 MAGIC_FORCEINLINE __m512 log512_special_ps(__m512 x, __m512 y)
+{
+    const __m512 inf = _mm512_castsi512_ps(_mm512_set1_epi32(0x7f800000));
+    y = _mm512_mask_mov_ps(y, _mm512_cmp_ps_mask(x, _mm512_setzero_ps(), _CMP_EQ_OQ), _mm512_sub_ps(_mm512_setzero_ps(), inf));
+    y = _mm512_mask_mov_ps(y, _mm512_cmp_ps_mask(x, inf, _CMP_EQ_OQ), inf);
+    return _mm512_mask_mov_ps(y, _mm512_cmp_ps_mask(x, _mm512_setzero_ps(), _CMP_NGE_UQ),
+        _mm512_castsi512_ps(_mm512_set1_epi32(-1)));
+}
+
+
+/// log(x)，非规格化数按最小的规格化数计算
+static MAGIC_TARGET_AVX512 MAGIC_FORCEINLINE __m512 log512_ps(__m512 x)
+{
+    __m512 e;
+    const __m512 m = log512_reduce_ps(x, e);
+    const __m512 z = _mm512_mul_ps(m, m);
+
+    __m512 y = _mm512_set1_ps(7.0376836292E-2f);
+    y = _mm512_fmadd_ps(y, m, _mm512_set1_ps(-1.1514610310E-1f));
+    y = _mm512_fmadd_ps(y, m, _mm512_set1_ps(1.1676998740E-1f));
+    y = _mm512_fmadd_ps(y, m, _mm512_set1_ps(-1.2420140846E-1f));
+    y = _mm512_fmadd_ps(y, m, _mm512_set1_ps(1.4249322787E-1f));
+    y = _mm512_fmadd_ps(y, m, _mm512_set1_ps(-1.6668057665E-1f));
+    y = _mm512_fmadd_ps(y, m, _mm512_set1_ps(2.0000714765E-1f));
+    y = _mm512_fmadd_ps(y, m, _mm512_set1_ps(-2.4999993993E-1f));
+    y = _mm512_fmadd_ps(y, m, _mm512_set1_ps(3.3333331174E-1f));
+    y = _mm512_mul_ps(_mm512_mul_ps(y, m), z);
+
+    y = _mm512_fmadd_ps(e, _mm512_set1_ps(-2.12194440e-4f), y);
+    y = _mm512_fnmadd_ps(z, _mm512_set1_ps(0.5f), y);
+    y = _mm512_add_ps(m, y);
+    y = _mm512_fmadd_ps(e, _mm512_set1_ps(0.693359375f), y);
+    return log512_special_ps(x, y);
+}
+
+
+/// 快速log(x)，log(1 + m) = m - m^2 / 2 + m^3 * P(m)，P为3阶多项式
+static MAGIC_TARGET_AVX512 MAGIC_FORCEINLINE __m512 log512_fast_ps(__m512 x)
+{
+    __m512 e;
+    const __m512 m = log512_reduce_ps(x, e);
+    const __m512 z = _mm512_mul_ps(m, m);
+
+    __m512 y = _mm512_set1_ps(-1.518858526e-01f);
+    y = _mm512_fmadd_ps(y, m, _mm512_set1_ps(2.152305107e-01f));
+    y = _mm512_fmadd_ps(y, m, _mm512_set1_ps(-2.513835180e-01f));
+    y = _mm512_fmadd_ps(y, m, _mm512_set1_ps(3.331183141e-01f));
+    y = _mm512_mul_ps(_mm512_mul_ps(y, m), z);
+
+    y = _mm512_fnmadd_ps(z, _mm512_set1_ps(0.5f), y);
+    y = _mm512_add_ps(m, y);
+    y = _mm512_fmadd_ps(e, _mm512_set1_ps(0.693147180559945f), y);
+    return log512_special_ps(x, y);
+}
+
+
+/// sigmoid(x) = 1 / (1 + exp(-x))
+static MAGIC_TARGET_AVX512 MAGIC_FORCEINLINE __m512 sigmoid512_ps(__m512 x)
+{
+    const __m512 one = _mm512_set1_ps(1.f);
+    return _mm512_div_ps(one, _mm512_add_ps(one, exp512_ps(_mm512_sub_ps(_mm512_setzero_ps(), x))));
+}
+
+
+/// 快速sigmoid(x)
+static MAGIC_TARGET_AVX512 MAGIC_FORCEINLINE __m512 sigmoid512_fast_ps(__m512 x)
+{
+    const __m512 one = _mm512_set1_ps(1.f);
+    return _mm512_div_ps(one, _mm512_add_ps(one, exp512_fast_ps(_mm512_sub_ps(_mm512_setzero_ps(), x))));
+}
+
+
+/// tanh(x)，[-9, 9]上的13/6阶有理函数近似，之外返回±1，|x| < 0.0004时返回x
+static MAGIC_TARGET_AVX512 MAGIC_FORCEINLINE __m512 tanh512_ps(__m512 x)
+{
+    const __m512 value = _mm512_max_ps(_mm512_min_ps(x, _mm512_set1_ps(9.f)), _mm512_set1_ps(-9.f));
+    const __m512 value_squared = _mm512_mul_ps(value, value);
+
+    __m512 p = _mm512_fmadd_ps(value_squared, _mm512_set1_ps(-2.76076847742355E-16f), _mm512_set1_ps(2.00018790482477E-13f));
+    p = _mm512_fmadd_ps(p, value_squared, _mm512_set1_ps(-8.60467152213735E-11f));
+    p = _mm512_fmadd_ps(p, value_squared, _mm512_set1_ps(5.12229709037114E-08f));
+    p = _mm512_fmadd_ps(p, value_squared, _mm512_set1_ps(1.48572235717979E-05f));
+    p = _mm512_fmadd_ps(p, value_squared, _mm512_set1_ps(6.37261928875436E-04f));
+    p = _mm512_fmadd_ps(p, value_squared, _mm512_set1_ps(4.89352455891786E-03f));
+    p = _mm512_mul_ps(p, value);
+
+    __m512 q = _mm512_fmadd_ps(value_squared, _mm512_set1_ps(1.19825839466702e-06f), _mm512_set1_ps(1.18534705686654e-04f));
+    q = _mm512_fmadd_ps(q, value_squared, _mm512_set1_ps(2.26843463243900e-03f));
+    q = _mm512_fmadd_ps(q, value_squared, _mm512_set1_ps(4.89352455891786E-03f));
+
+    // |x|很小时p会下溢，直接返回x
+    const __mmask16 tiny_mask = _mm512_cmp_ps_mask(value_squared, _mm512_set1_ps(0.0004f * 0.0004f), _CMP_LT_OQ);
+    return _mm512_mask_mov_ps(_mm512_div_ps(p, q), tiny_mask, x);
+}
+
+
+/// 快速tanh(x)，Lambert连分式的7/6阶Padé近似，|x| > 4.8时返回±1
+static MAGIC_TARGET_AVX512 MAGIC_FORCEINLINE __m512 tanh512_fast_ps(__m512 x)
+{
+    const __m512 value = _mm512_max_ps(_mm512_min_ps(x, _mm512_set1_ps(4.8f)), _mm512_set1_ps(-4.8f));
+    const __m512 value_squared = _mm512_mul_ps(value, value);
+
+    __m512 p = _mm512_add_ps(value_squared, _mm512_set1_ps(378.f));
+    p = _mm512_fmadd_ps(p, value_squared, _mm512_set1_ps(17325.f));
+    p = _mm512_fmadd_ps(p, value_squared, _mm512_set1_ps(135135.f));
+    p = _mm512_mul_ps(p, value);
+
+    __m512 q = _mm512_fmadd_ps(value_squared, _mm512_set1_ps(28.f), _mm512_set1_ps(3150.f));
+    q = _mm512_fmadd_ps(q, value_squared, _mm512_set1_ps(62370.f));
+    q = _mm512_fmadd_ps(q, value_squared, _mm512_set1_ps(135135.f));
+
+    const __m512 one = _mm512_set1_ps(1.f);
+    return _mm512_max_ps(_mm512_min_ps(_mm512_div_ps(p, q), one), _mm512_sub_ps(_mm512_setzero_ps(), one));
+}
+
+
+/**
+ * erf(x)，|x| < 1时用cephes的x * T(x^2)；
+ * 否则erf(|x|) = 1 - exp(-x^2) * Q(1 / |x|)，x^2的舍入误差用FMA补偿
+ */
+static MAGIC_TARGET_AVX512 MAGIC_FORCEINLINE __m512 erf512_ps(__m512 x)
+{
+    const __m512 one = _mm512_set1_ps(1.f);
+    const __m512 sign = and512_ps(x, _mm512_castsi512_ps(_mm512_set1_epi32(int(0x80000000))));
+    const __m512 abs_x = _mm512_min_ps(xor512_ps(x, sign), _mm512_set1_ps(4.f));
+
+    const __m512 z = _mm512_mul_ps(x, x);
+    __m512 small_value = _mm512_set1_ps(7.853861353153693E-5f);
+    small_value = _mm512_fmadd_ps(small_value, z, _mm512_set1_ps(-8.010193625184903E-4f));
+    small_value = _mm512_fmadd_ps(small_value, z, _mm512_set1_ps(5.188327685732524E-3f));
+    small_value = _mm512_fmadd_ps(small_value, z, _mm512_set1_ps(-2.685381193529856E-2f));
+    small_value = _mm512_fmadd_ps(small_value, z, _mm512_set1_ps(1.128358514861418E-1f));
+    small_value = _mm512_fmadd_ps(small_value, z, _mm512_set1_ps(-3.761262582423300E-1f));
+    small_value = _mm512_fmadd_ps(small_value, z, _mm512_set1_ps(1.128379165726710E0f));
+    small_value = _mm512_mul_ps(small_value, x);
+
+    const __m512 t = _mm512_div_ps(one, abs_x);
+    __m512 q = _mm512_set1_ps(3.032184551e-02f);
+    q = _mm512_fmadd_ps(q, t, _mm512_set1_ps(-1.771958845e-01f));
+    q = _mm512_fmadd_ps(q, t, _mm512_set1_ps(4.313137147e-01f));
+    q = _mm512_fmadd_ps(q, t, _mm512_set1_ps(-5.262205525e-01f));
+    q = _mm512_fmadd_ps(q, t, _mm512_set1_ps(2.280327294e-01f));
+    q = _mm512_fmadd_ps(q, t, _mm512_set1_ps(2.367490586e-01f));
+    q = _mm512_fmadd_ps(q, t, _mm512_set1_ps(-3.783782954e-01f));
+    q = _mm512_fmadd_ps(q, t, _mm512_set1_ps(2.115146779e-02f));
+    q = _mm512_fmadd_ps(q, t, _mm512_set1_ps(5.616834664e-01f));
+    q = _mm512_fmadd_ps(q, t, _mm512_set1_ps(1.260333604e-04f));
+
+    // exp(-x^2) = exp(-hi) * exp(-lo) ~ exp(-hi) * (1 - lo)
+    const __m512 hi = _mm512_mul_ps(abs_x, abs_x);
+    const __m512 lo = _mm512_fmsub_ps(abs_x, abs_x, hi);
+    const __m512 erfc = _mm512_mul_ps(_mm512_mul_ps(exp512_ps(_mm512_sub_ps(_mm512_setzero_ps(), hi)), q),
+        _mm512_sub_ps(one, lo));
+    const __m512 large_value = or512_ps(_mm512_sub_ps(one, erfc), sign);
+    return _mm512_mask_mov_ps(large_value, _mm512_cmp_ps_mask(abs_x, one, _CMP_LT_OQ), small_value);
+}
+
+
+/**
+ * 快速erf(x)，|x| < 1时用x * T(x^2)，T为4阶多项式；
+ * 否则用Abramowitz-Stegun 7.1.28：erf(x) = 1 - 1 / (1 + a1 * x + ... + a6 * x^6)^16，不需要计算exp
+ */
+static MAGIC_TARGET_AVX512 MAGIC_FORCEINLINE __m512 erf512_fast_ps(__m512 x)
+{
+    const __m512 one = _mm512_set1_ps(1.f);
+    const __m512 sign = and512_ps(x, _mm512_castsi512_ps(_mm512_set1_epi32(int(0x80000000))));
+    const __m512 abs_x = _mm512_min_ps(xor512_ps(x, sign), _mm512_set1_ps(4.f));
+
+    const __m512 z = _mm512_mul_ps(x, x);
+    __m512 small_value = _mm512_set1_ps(3.489161046e-03f);
+    small_value = _mm512_fmadd_ps(small_value, z, _mm512_set1_ps(-2.543781836e-02f));
+    small_value = _mm512_fmadd_ps(small_value, z, _mm512_set1_ps(1.123353414e-01f));
+    small_value = _mm512_fmadd_ps(small_value, z, _mm512_set1_ps(-3.760628126e-01f));
+    small_value = _mm512_fmadd_ps(small_value, z, _mm512_set1_ps(1.128377843e+00f));
+    small_value = _mm512_mul_ps(small_value, x);
+
+    __m512 p = _mm512_set1_ps(0.0000430638f);
+    p = _mm512_fmadd_ps(p, abs_x, _mm512_set1_ps(0.0002765672f));
+    p = _mm512_fmadd_ps(p, abs_x, _mm512_set1_ps(0.0001520143f));
+    p = _mm512_fmadd_ps(p, abs_x, _mm512_set1_ps(0.0092705272f));
+    p = _mm512_fmadd_ps(p, abs_x, _mm512_set1_ps(0.0422820123f));
+    p = _mm512_fmadd_ps(p, abs_x, _mm512_set1_ps(0.0705230784f));
+    p = _mm512_fmadd_ps(p, abs_x, one);
+    p = _mm512_mul_ps(p, p);
+    p = _mm512_mul_ps(p, p);
+    p = _mm512_mul_ps(p, p);
+    p = _mm512_mul_ps(p, p);
+    const __m512 large_value = or512_ps(_mm512_sub_ps(one, _mm512_div_ps(one, p)), sign);
+    return _mm512_mask_mov_ps(large_value, _mm512_cmp_ps_mask(abs_x, one, _CMP_LT_OQ), small_value);
+}
+
+#endif // MAGIC_X86_DISPATCH
+#endif //MAGIC_UTILS_AVX512_MATH_HPP_
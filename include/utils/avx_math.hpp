@@ -0,0 +1,286 @@
+#ifndef MAGIC_UTILS_AVX_MATH_HPP_
+#define MAGIC_UTILS_AVX_MATH_HPP_
+
+#include "platform.hpp"
+
+#if MAGIC_X86_DISPATCH
+#include <immintrin.h>
+
+/*
+ * 8路float的数学函数，exp、log和tanh的算法和常数与sse_math.hpp中的cephes实现一致。
+ * 函数按MAGIC_TARGET_AVX2单独开启AVX2和FMA，只能在运行时确认CPU支持之后调用
+ *
+ * 每个函数都有精确和快速两个版本，快速版本(*_fast_ps)使用更低阶的多项式，用于对精度不敏感的激活函数。
+ * 下面的误差是和double精度的libm结果对比，在给定区间内逐个float测得的最大误差，
+ * bench_math.cpp可以重新测量误差和吞吐，test_math.cpp检查误差不超过这里的上限
+ *
+ *   函数          区间                   精确版本       快速版本
+ *   exp           [-87, 88]              1.01 ULP       相对误差8.1e-5
+ *   log           [FLT_MIN, FLT_MAX]     0.83 ULP       绝对误差2.0e-5
+ *   sigmoid       [-87, 88]              2.5 ULP        相对误差8.1e-5
+ *   tanh          [-9, 9]                5.5 ULP        绝对误差7.3e-5
+ *   erf           [-4, 4]                2.5 ULP        绝对误差1.1e-6
+ */
+
+/// exp(x)，输入限制在[-88.38, 88.38]之内
+static MAGIC_TARGET_AVX2 MAGIC_FORCEINLINE __m256 exp256_ps(__m256 x)
+{
+    const __m256 one = _mm256_set1_ps(1.f);
+    x = _mm256_min_ps(x, _mm256_set1_ps(88.3762626647949f));
+    x = _mm256_max_ps(x, _mm256_set1_ps(-88.3762626647949f));
+
+    // exp(x) = exp(g + n * log(2))
+    __m256 fx = _mm256_fmadd_ps(x, _mm256_set1_ps(1.44269504088896341f), _mm256_set1_ps(0.5f));
+    fx = _mm256_floor_ps(fx);
+
+    x = _mm256_fnmadd_ps(fx, _mm256_set1_ps(0.693359375f), x);
+    x = _mm256_fnmadd_ps(fx, _mm256_set1_ps(-2.12194440e-4f), x);
+    const __m256 x2 = _mm256_mul_ps(x, x);
+
+    __m256 y = _mm256_set1_ps(1.9875691500E-4f);
+    y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(1.3981999507E-3f));
+    y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(8.3334519073E-3f));
+    y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(4.1665795894E-2f));
+    y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(1.6666665459E-1f));
+    y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(5.0000001201E-1f));
+    y = _mm256_fmadd_ps(y, x2, x);
+    y = _mm256_add_ps(y, one);
+
+    // 2^n
+    __m256i n = _mm256_cvttps_epi32(fx);
+    n = _mm256_slli_epi32(_mm256_add_epi32(n, _mm256_set1_epi32(0x7f)), 23);
+    return _mm256_mul_ps(y, _mm256_castsi256_ps(n));
+}
+
+
+/// 快速exp(x)，exp(x) = 2^n * 2^f，2^f在[-0.5, 0.5]上用3阶多项式近似
+static MAGIC_TARGET_AVX2 MAGIC_FORCEINLINE __m256 exp256_fast_ps(__m256 x)
+{
+    x = _mm256_min_ps(x, _mm256_set1_ps(88.3762626647949f));
+    x = _mm256_max_ps(x, _mm256_set1_ps(-87.3365478515625f));
+
+    const __m256 t = _mm256_mul_ps(x, _mm256_set1_ps(1.44269504088896341f));
+    const __m256 n = _mm256_round_ps(t, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    const __m256 f = _mm256_sub_ps(t, n);
+
+    __m256 y = _mm256_set1_ps(5.508868381e-02f);
+    y = _mm256_fmadd_ps(y, f, _mm256_set1_ps(2.426040515e-01f));
+    y = _mm256_fmadd_ps(y, f, _mm256_set1_ps(6.932762417e-01f));
+    y = _mm256_fmadd_ps(y, f, _mm256_set1_ps(9.999289404e-01f));
+
+    const __m256i e = _mm256_slli_epi32(_mm256_cvtps_epi32(n), 23);
+    return _mm256_castsi256_ps(_mm256_add_epi32(_mm256_castps_si256(y), e));
+}
+
+
+/// 把x拆分为尾数和指数，x = (1 + m) * 2^e，1 + m在[sqrt(0.5), sqrt(2))之内
+static MAGIC_TARGET_AVX2 MAGIC_FORCEINLINE __m256 log256_reduce_ps(__m256 x, __m256 &e)
+{
+    const __m256 one = _mm256_set1_ps(1.f);
+    x = _mm256_max_ps(x, _mm256_castsi256_ps(_mm256_set1_epi32(0x00800000)));
+
+    const __m256i exponent = _mm256_srli_epi32(_mm256_castps_si256(x), 23);
+    e = _mm256_cvtepi32_ps(_mm256_sub_epi32(exponent, _mm256_set1_epi32(0x7e)));
+    x = _mm256_and_ps(x, _mm256_castsi256_ps(_mm256_set1_epi32(~0x7f800000)));
+    x = _mm256_or_ps(x, _mm256_set1_ps(0.5f));
+
+    // 尾数在[0.5, sqrt(0.5))时乘2，指数减1
+    const __m256 mask = _mm256_cmp_ps(x, _mm256_set1_ps(0.707106781186547524f), _CMP_LT_OQ);
+    e = _mm256_sub_ps(e, _mm256_and_ps(one, mask));
+    return _mm256_add_ps(_mm256_sub_ps(x, one), _mm256_and_ps(x, mask));
+}
+
+
+/// 处理log的特殊输入：0返回-inf，+inf返回+inf，负数和NaN返回NaN
+static MAGIC_TARGET_AVX2 MAGIC_FORCEINLINE __m256 log256_special_ps(__m256 x, __m256 y)
+{
+    const __m256 inf = _mm256_castsi256_ps(_mm256_set1_epi32(0x7f800000));
+    y = _mm256_blendv_ps(y, _mm256_sub_ps(_mm256_setzero_ps(), inf), _mm256_cmp_ps(x, _mm256_setzero_ps(), _CMP_EQ_OQ));
+    y = _mm256_blendv_ps(y, inf, _mm256_cmp_ps(x, inf, _CMP_EQ_OQ));
+    return _mm256_or_ps(y, _mm256_cmp_ps(x, _mm256_setzero_ps(), _CMP_NGE_UQ));
+}
+
+
+/// log(x)，非规格化数按最小的规格化数计算
+static MAGIC_TARGET_AVX2 MAGIC_FORCEINLINE __m256 log256_ps(__m256 x)
+{
+    __m256 e;
+    const __m256 m = log256_reduce_ps(x, e);
+    const __m256 z = _mm256_mul_ps(m, m);
+
+    __m256 y = _mm256_set1_ps(7.0376836292E-2f);
+    y = _mm256_fmadd_ps(y, m, _mm256_set1_ps(-1.1514610310E-1f));
+    y = _mm256_fmadd_ps(y, m, _mm256_set1_ps(1.1676998740E-1f));
+    y = _mm256_fmadd_ps(y, m, _mm256_set1_ps(-1.2420140846E-1f));
+    y = _mm256_fmadd_ps(y, m, _mm256_set1_ps(1.4249322787E-1f));
+    y = _mm256_fmadd_ps(y, m, _mm256_set1_ps(-1.6668057665E-1f));
+    y = _mm256_fmadd_ps(y, m, _mm256_set1_ps(2.0000714765E-1f));
+    y = _mm256_fmadd_ps(y, m, _mm256_set1_ps(-2.4999993993E-1f));
+    y = _mm256_fmadd_ps(y, m, _mm256_set1_ps(3.3333331174E-1f));
+    y = _mm256_mul_ps(_mm256_mul_ps(y, m), z);
+
+    y = _mm256_fmadd_ps(e, _mm256_set1_ps(-2.12194440e-4f), y);
+    y = _mm256_fnmadd_ps(z, _mm256_set1_ps(0.5f), y);
+    y = _mm256_add_ps(m, y);
+    y = _mm256_fmadd_ps(e, _mm256_set1_ps(0.693359375f), y);
+    return log256_special_ps(x, y);
+}
+
+
+/// 快速log(x)，log(1 + m) = m - m^2 / 2 + m^3 * P(m)，P为3阶多项式
+static MAGIC_TARGET_AVX2 MAGIC_FORCEINLINE __m256 log256_fast_ps(__m256 x)
+{
+    __m256 e;
+    const __m256 m = log256_reduce_ps(x, e);
+    const __m256 z = _mm256_mul_ps(m, m);
+
+    __m256 y = _mm256_set1_ps(-1.518858526e-01f);
+    y = _mm256_fmadd_ps(y, m, _mm256_set1_ps(2.152305107e-01f));
+    y = _mm256_fmadd_ps(y, m, _mm256_set1_ps(-2.513835180e-01f));
+    y = _mm256_fmadd_ps(y, m, _mm256_set1_ps(3.331183141e-01f));
+    y = _mm256_mul_ps(_mm256_mul_ps(y, m), z);
+
+    y = _mm256_fnmadd_ps(z, _mm256_set1_ps(0.5f), y);
+    y = _mm256_add_ps(m, y);
+    y = _mm256_fmadd_ps(e, _mm256_set1_ps(0.693147180559945f), y);
+    return log256_special_ps(x, y);
+}
+
+
+/// sigmoid(x) = 1 / (1 + exp(-x))
+static MAGIC_TARGET_AVX2 MAGIC_FORCEINLINE __m256 sigmoid256_ps(__m256 x)
+{
+    const __m256 one = _mm256_set1_ps(1.f);
+    return _mm256_div_ps(one, _mm256_add_ps(one, exp256_ps(_mm256_sub_ps(_mm256_setzero_ps(), x))));
+}
+
+
+/// 快速sigmoid(x)
+static MAGIC_TARGET_AVX2 MAGIC_FORCEINLINE __m256 sigmoid256_fast_ps(__m256 x)
+{
+    const __m256 one = _mm256_set1_ps(1.f);
+    return _mm256_div_ps(one, _mm256_add_ps(one, exp256_fast_ps(_mm256_sub_ps(_mm256_setzero_ps(), x))));
+}
+
+
+/// tanh(x)，[-9, 9]上的13/6阶有理函数近似，之外返回±1，|x| < 0.0004时返回x
+static MAGIC_TARGET_AVX2 MAGIC_FORCEINLINE __m256 tanh256_ps(__m256 x)
+{
+    const __m256 value = _mm256_max_ps(_mm256_min_ps(x, _mm256_set1_ps(9.f)), _mm256_set1_ps(-9.f));
+    const __m256 value_squared = _mm256_mul_ps(value, value);
+
+    __m256 p = _mm256_fmadd_ps(value_squared, _mm256_set1_ps(-2.76076847742355E-16f), _mm256_set1_ps(2.00018790482477E-13f));
+    p = _mm256_fmadd_ps(p, value_squared, _mm256_set1_ps(-8.60467152213735E-11f));
+    p = _mm256_fmadd_ps(p, value_squared, _mm256_set1_ps(5.12229709037114E-08f));
+    p = _mm256_fmadd_ps(p, value_squared, _mm256_set1_ps(1.48572235717979E-05f));
+    p = _mm256_fmadd_ps(p, value_squared, _mm256_set1_ps(6.37261928875436E-04f));
+    p = _mm256_fmadd_ps(p, value_squared, _mm256_set1_ps(4.89352455891786E-03f));
+    p = _mm256_mul_ps(p, value);
+
+    __m256 q = _mm256_fmadd_ps(value_squared, _mm256_set1_ps(1.19825839466702e-06f), _mm256_set1_ps(1.18534705686654e-04f));
+    q = _mm256_fmadd_ps(q, value_squared, _mm256_set1_ps(2.26843463243900e-03f));
+    q = _mm256_fmadd_ps(q, value_squared, _mm256_set1_ps(4.89352455891786E-03f));
+
+    // |x|很小时p会下溢，直接返回x
+    const __m256 tiny_mask = _mm256_cmp_ps(value_squared, _mm256_set1_ps(0.0004f * 0.0004f), _CMP_LT_OQ);
+    return _mm256_blendv_ps(_mm256_div_ps(p, q), x, tiny_mask);
+}
+
+
+/// 快速tanh(x)，Lambert连分式的7/6阶Padé近似，|x| > 4.8时返回±1
+static MAGIC_TARGET_AVX2 MAGIC_FORCEINLINE __m256 tanh256_fast_ps(__m256 x)
+{
+    const __m256 value = _mm256_max_ps(_mm256_min_ps(x, _mm256_set1_ps(4.8f)), _mm256_set1_ps(-4.8f));
+    const __m256 value_squared = _mm256_mul_ps(value, value);
+
+    __m256 p = _mm256_add_ps(value_squared, _mm256_set1_ps(378.f));
+    p = _mm256_fmadd_ps(p, value_squared, _mm256_set1_ps(17325.f));
+    p = _mm256_fmadd_ps(p, value_squared, _mm256_set1_ps(135135.f));
+    p = _mm256_mul_ps(p, value);
+
+    __m256 q = _mm256_fmadd_ps(value_squared, _mm256_set1_ps(28.f), _mm256_set1_ps(3150.f));
+    q = _mm256_fmadd_ps(q, value_squared, _mm256_set1_ps(62370.f));
+    q = _mm256_fmadd_ps(q, value_squared, _mm256_set1_ps(135135.f));
+
+    const __m256 one = _mm256_set1_ps(1.f);
+    return _mm256_max_ps(_mm256_min_ps(_mm256_div_ps(p, q), one), _mm256_sub_ps(_mm256_setzero_ps(), one));
+}
+
+
+/**
+ * erf(x)，|x| < 1时用cephes的x * T(x^2)；
+ * 否则erf(|x|) = 1 - exp(-x^2) * Q(1 / |x|)，x^2的舍入误差用FMA补偿
+ */
+static MAGIC_TARGET_AVX2 MAGIC_FORCEINLINE __m256 erf256_ps(__m256 x)
+{
+    const __m256 one = _mm256_set1_ps(1.f);
+    const __m256 sign = _mm256_and_ps(x, _mm256_castsi256_ps(_mm256_set1_epi32(int(0x80000000))));
+    const __m256 abs_x = _mm256_min_ps(_mm256_xor_ps(x, sign), _mm256_set1_ps(4.f));
+
+    const __m256 z = _mm256_mul_ps(x, x);
+    __m256 small_value = _mm256_set1_ps(7.853861353153693E-5f);
+    small_value = _mm256_fmadd_ps(small_value, z, _mm256_set1_ps(-8.010193625184903E-4f));
+    small_value = _mm256_fmadd_ps(small_value, z, _mm256_set1_ps(5.188327685732524E-3f));
+    small_value = _mm256_fmadd_ps(small_value, z, _mm256_set1_ps(-2.685381193529856E-2f));
+    small_value = _mm256_fmadd_ps(small_value, z, _mm256_set1_ps(1.128358514861418E-1f));
+    small_value = _mm256_fmadd_ps(small_value, z, _mm256_set1_ps(-3.761262582423300E-1f));
+    small_value = _mm256_fmadd_ps(small_value, z, _mm256_set1_ps(1.128379165726710E0f));
+    small_value = _mm256_mul_ps(small_value, x);
+
+    const __m256 t = _mm256_div_ps(one, abs_x);
+    __m256 q = _mm256_set1_ps(3.032184551e-02f);
+    q = _mm256_fmadd_ps(q, t, _mm256_set1_ps(-1.771958845e-01f));
+    q = _mm256_fmadd_ps(q, t, _mm256_set1_ps(4.313137147e-01f));
+    q = _mm256_fmadd_ps(q, t, _mm256_set1_ps(-5.262205525e-01f));
+    q = _mm256_fmadd_ps(q, t, _mm256_set1_ps(2.280327294e-01f));
+    q = _mm256_fmadd_ps(q, t, _mm256_set1_ps(2.367490586e-01f));
+    q = _mm256_fmadd_ps(q, t, _mm256_set1_ps(-3.783782954e-01f));
+    q = _mm256_fmadd_ps(q, t, _mm256_set1_ps(2.115146779e-02f));
+    q = _mm256_fmadd_ps(q, t, _mm256_set1_ps(5.616834664e-01f));
+    q = _mm256_fmadd_ps(q, t, _mm256_set1_ps(1.260333604e-04f));
+
+    // exp(-x^2) = exp(-hi) * exp(-lo) ~ exp(-hi) * (1 - lo)
+    const __m256 hi = _mm256_mul_ps(abs_x, abs_x);
+    const __m256 lo = _mm256_fmsub_ps(abs_x, abs_x, hi);
+    const __m256 erfc = _mm256_mul_ps(_mm256_mul_ps(exp256_ps(_mm256_sub_ps(_mm256_setzero_ps(), hi)), q),
+        _mm256_sub_ps(one, lo));
+    const __m256 large_value = _mm256_or_ps(_mm256_sub_ps(one, erfc), sign);
+    return _mm256_blendv_ps(large_value, small_value, _mm256_cmp_ps(abs_x, one, _CMP_LT_OQ));
+}
+
+
+/**
+ * 快速erf(x)，|x| < 1时用x * T(x^2)，T为4阶多项式；
+ * 否则用Abramowitz-Stegun 7.1.28：erf(x) = 1 - 1 / (1 + a1 * x + ... + a6 * x^6)^16，不需要计算exp
+ */
+static MAGIC_TARGET_AVX2 MAGIC_FORCEINLINE __m256 erf256_fast_ps(__m256 x)
+{
+    const __m256 one = _mm256_set1_ps(1.f);
+    const __m256 sign = _mm256_and_ps(x, _mm256_castsi256_ps(_mm256_set1_epi32(int(0x80000000))));
+    const __m256 abs_x = _mm256_min_ps(_mm256_xor_ps(x, sign), _mm256_set1_ps(4.f));
+
+    const __m256 z = _mm256_mul_ps(x, x);
+    __m256 small_value = _mm256_set1_ps(3.489161046e-03f);
+    small_value = _mm256_fmadd_ps(small_value, z, _mm256_set1_ps(-2.543781836e-02f));
+    small_value = _mm256_fmadd_ps(small_value, z, _mm256_set1_ps(1.123353414e-01f));
+    small_value = _mm256_fmadd_ps(small_value, z, _mm256_set1_ps(-3.760628126e-01f));
+    small_value = _mm256_fmadd_ps(small_value, z, _mm256_set1_ps(1.128377843e+00f));
+    small_value = _mm256_mul_ps(small_value, x);
+
+    __m256 p = _mm256_set1_ps(0.0000430638f);
+    p = _mm256_fmadd_ps(p, abs_x, _mm256_set1_ps(0.0002765672f));
+    p = _mm256_fmadd_ps(p, abs_x, _mm256_set1_ps(0.0001520143f));
+    p = _mm256_fmadd_ps(p, abs_x, _mm256_set1_ps(0.0092705272f));
+    p = _mm256_fmadd_ps(p, abs_x, _mm256_set1_ps(0.0422820123f));
+    p = _mm256_fmadd_ps(p, abs_x, _mm256_set1_ps(0.0705230784f));
+    p = _mm256_fmadd_ps(p, abs_x, one);
+    p = _mm256_mul_ps(p, p);
+    p = _mm256_mul_ps(p, p);
+    p = _mm256_mul_ps(p, p);
+    p = _mm256_mul_ps(p, p);
+    const __m256 large_value = _mm256_or_ps(_mm256_sub_ps(one, _mm256_div_ps(one, p)), sign);
+    return _mm256_blendv_ps(large_value, small_value, _mm256_cmp_ps(abs_x, one, _CMP_LT_OQ));
+}
+
+#endif // MAGIC_X86_DISPATCH
+#endif //MAGIC_UTILS_AVX_MATH_HPP_
@@ -27,4 +27,15 @@
 #define MAGIC_FORCEINLINE inline
 #endif
 
+// 按函数开启更高的指令集，同一个二进制在运行时按CPU支持的指令集选择核函数
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define MAGIC_X86_DISPATCH 1
+#define MAGIC_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define MAGIC_TARGET_AVX512 __attribute__((target("avx512f,avx2,fma")))
+#else
+#define MAGIC_X86_DISPATCH 0
+#define MAGIC_TARGET_AVX2
+#define MAGIC_TARGET_AVX512
+#endif
+
 #endif //MAGIC_LAYER_DETAILS_PLATFORM_HPP_
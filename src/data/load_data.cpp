@@ -1,7 +1,13 @@
 
 #include "data/load_data.hpp"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <string.h>
 #include <string>
-#include <fstream>
+#include <algorithm>
+#include <charconv>
 #include <armadillo>
 #include <utility>
 #include <glog/logging.h>
@@ -10,82 +16,170 @@
 namespace magic_infer 
 {
 
-arma::fmat CSVDataLoader::LoadData(const string &file_path, const char split_char) 
+/// 只读映射的csv文件，以及第一个空行之前每一行的范围
+struct CSVFile
+{
+    string path;
+    const char *data = nullptr;
+    size_t size = 0;
+    vector<pair<size_t, size_t>> lines; /// 每一行的起止偏移，不含换行符
+    size_t cols = 0;                    /// 最长一行的元素个数
+
+    CSVFile() = default;
+    CSVFile(const CSVFile &) = delete;
+    CSVFile &operator=(const CSVFile &) = delete;
+    ~CSVFile() { if (data) munmap((void *) data, size); }
+};
+
+
+/**
+ * 映射csv文件并找出所有的行，遇到空行时结束
+ * @param file_path csv文件的路径
+ * @param split_char 分隔符号
+ * @param file 映射之后的csv文件
+ */
+static void MapCSVFile(const string &file_path, char split_char, CSVFile &file)
 {
     CHECK(!file_path.empty()) << "File path is empty!";
-    ifstream in(file_path);
-    CHECK(in.is_open() && in.good()) << "File open failed! " << file_path;
+    int fd = open(file_path.c_str(), O_RDONLY);
+    CHECK(fd >= 0) << "File open failed! " << file_path;
+
+    struct stat st;
+    const bool stat_ok = fstat(fd, &st) == 0;
+    file.path = file_path;
+    file.size = stat_ok ? st.st_size : 0;
+    void *addr = file.size > 0 ? mmap(nullptr, file.size, PROT_READ, MAP_PRIVATE, fd, 0) : nullptr;
+    close(fd);
+    CHECK(stat_ok && addr != MAP_FAILED) << "File map failed! " << file_path;
+    file.data = (const char *) addr;
+
+    const char *end = file.data + file.size;
+    for (const char *p = file.data; p < end;) {
+        const char *eol = (const char *) memchr(p, '\n', end - p);
+        if (!eol) eol = end;
+
+        const char *line_end = eol;
+        if (line_end > p && *(line_end - 1) == '\r') line_end -= 1;
+        if (line_end == p) break;
+
+        file.lines.emplace_back(p - file.data, line_end - file.data);
+        p = eol + 1;
+    }
 
-    arma::fmat data;
-    string line_str;
-    stringstream line_stream;
+    // 各行的元素个数互不依赖，按行分块并行统计
+    const int64_t line_num = file.lines.size();
+    size_t cols = 0;
+#pragma omp parallel for schedule(static) reduction(max:cols)
+    for (int64_t i = 0; i < line_num; ++i) {
+        const auto &[begin, end_offset] = file.lines.at(i);
+        const size_t line_cols = std::count(file.data + begin, file.data + end_offset, split_char) + 1;
+        cols = max(cols, line_cols);
+    }
+    file.cols = cols;
+}
 
-    const auto &[rows, cols] = CSVDataLoader::GetMatrixSize(in, split_char);
-    data.zeros(rows, cols);
 
-    size_t row = 0;
-    while (in.good()) {
-        getline(in, line_str);
-        if (line_str.empty()) break;
+/**
+ * 解析一个元素，前后的空白字符被忽略，只有空白字符的元素作为缺失值0
+ * @param begin 元素的起始位置
+ * @param end 元素的结束位置
+ * @param value 解析得到的值
+ * @return 是否为合法的数字
+ */
+static bool ParseCSVCell(const char *begin, const char *end, float &value)
+{
+    auto is_blank = [](char c) { return c == ' ' || c == '\t'; };
+    while (begin < end && is_blank(*begin)) begin += 1;
+    while (end > begin && is_blank(*(end - 1))) end -= 1;
+
+    value = 0.f;
+    if (begin == end) return true;
+    if (*begin == '+') begin += 1;
+
+    const auto &[ptr, ec] = from_chars(begin, end, value);
+    if (ec == errc::result_out_of_range) {
+        // 非规格化数和溢出与stof一样按strtof的结果取值
+        value = strtof(string(begin, end).c_str(), nullptr);
+        return ptr == end;
+    }
+    return ec == errc() && ptr == end;
+}
+
+
+/**
+ * 按行分块并行解析所有元素，遇到非法的元素时报告第一个错误所在的行和列
+ * @param file 映射之后的csv文件
+ * @param split_char 分隔符号
+ * @param set_value 写入第row行第col个元素
+ */
+template <typename SetValue>
+static void ParseCSVFile(const CSVFile &file, char split_char, const SetValue &set_value)
+{
+    const int64_t rows = file.lines.size();
+    int64_t error_row = rows;
+    size_t error_offset = 0;
+    size_t error_cell = 0;
+    string error_token;
 
-        string token;
-        line_stream.clear();
-        line_stream.str(line_str);
+#pragma omp parallel for schedule(static)
+    for (int64_t row = 0; row < rows; ++row) {
+        const char *line_begin = file.data + file.lines.at(row).first;
+        const char *line_end = file.data + file.lines.at(row).second;
 
         size_t col = 0;
-        while (line_stream.good()) {
-            getline(line_stream, token, split_char);
-            try {
-                data.at(row, col) = stof(token);
-            } catch (exception &e) {
-                LOG(ERROR) << "Parse CSV File meet error: " << e.what();
-                continue;
+        for (const char *p = line_begin;; ++col) {
+            const char *sep = (const char *) memchr(p, split_char, line_end - p);
+            if (!sep) sep = line_end;
+
+            float value = 0.f;
+            if (!ParseCSVCell(p, sep, value)) {
+#pragma omp critical
+                if (row < error_row) {
+                    error_row = row;
+                    error_offset = p - line_begin;
+                    error_cell = col;
+                    error_token.assign(p, sep);
+                }
+                break;
             }
-            
-            col += 1;
-            CHECK(col <= cols) << "There are excessive elements on the column";
-        }
+            set_value(row, col, value);
 
-        row += 1;
-        CHECK(row <= rows) << "There are excessive elements on the row";
+            if (sep == line_end) break;
+            p = sep + 1;
+        }
     }
+
+    LOG_IF(FATAL, error_row < rows) << "Parse CSV file meet error at " << file.path << ":" << error_row + 1 << ":" << error_offset + 1
+        << " (element " << error_cell + 1 << "), invalid number \"" << error_token << "\"";
+}
+
+
+arma::fmat CSVDataLoader::LoadData(const string &file_path, const char split_char) 
+{
+    CSVFile file;
+    MapCSVFile(file_path, split_char, file);
+
+    // 较短的行缺失的元素为0
+    arma::fmat data;
+    data.zeros(file.lines.size(), file.cols);
+    ParseCSVFile(file, split_char, [&data](size_t row, size_t col, float value) { data.at(row, col) = value; });
     return data;
 }
 
 
-pair<size_t, size_t> CSVDataLoader::GetMatrixSize(ifstream &file, char split_char) 
+void CSVDataLoader::LoadData(const string &file_path, Tensor<float> &tensor, const char split_char)
 {
-    bool load_ok = file.good();
-    file.clear();
-    size_t fn_rows = 0;
-    size_t fn_cols = 0;
-    const ifstream::pos_type start_pos = file.tellg();
-
-    string token;
-    string line_str;
-    stringstream line_stream;
-
-    while (file.good() && load_ok) {
-        getline(file, line_str);
-        if (line_str.empty()) break;
-
-        line_stream.clear();
-        line_stream.str(line_str);
-        size_t line_cols = 0;
-
-        string row_token;
-        while (line_stream.good()) {
-            getline(line_stream, row_token, split_char);
-            ++line_cols;
-        }
+    CSVFile file;
+    MapCSVFile(file_path, split_char, file);
 
-        if (line_cols > fn_cols) fn_cols = line_cols;
-        ++fn_rows;
-    }
+    const uint32_t rows = tensor.rows();
+    const uint32_t cols = tensor.cols();
+    CHECK(file.lines.size() == size_t(tensor.channels()) * rows && file.cols == cols) << "The shape of " << file_path << " is "
+        << file.lines.size() << " x " << file.cols << ", but the tensor needs " << tensor.channels() * rows << " x " << cols;
 
-    file.clear();
-    file.seekg(start_pos);
-    return {fn_rows, fn_cols};
+    tensor.Fill(0.f);
+    arma::fcube &data = tensor.data();
+    ParseCSVFile(file, split_char, [&data, rows](size_t row, size_t col, float value) { data.at(row % rows, col, row / rows) = value; });
 }
 
 }
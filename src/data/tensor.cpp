@@ -39,6 +39,22 @@ Tensor<float>::Tensor(const vector<uint32_t> &shapes)
 }
 
 
+Tensor<float>::Tensor(float *raw_ptr, uint32_t channels, uint32_t rows, uint32_t cols)
+{
+    CHECK(raw_ptr != nullptr);
+    // 不拷贝外部内存，尺寸不变的赋值会直接写入外部内存
+    data_ = arma::fcube(raw_ptr, rows, cols, channels, false, false);
+
+    if (channels == 1 && rows == 1) {
+        this->raw_shapes_ = vector<uint32_t>{cols};
+    } else if (channels == 1) {
+        this->raw_shapes_ = vector<uint32_t>{rows, cols};
+    } else {
+        this->raw_shapes_ = vector<uint32_t>{channels, rows, cols};
+    }
+}
+
+
 Tensor<float>::Tensor(const Tensor &tensor) 
 {
     if (this != &tensor) {
@@ -207,10 +223,16 @@ void Tensor<float>::Fill(float value)
 
 
 void Tensor<float>::Fill(const vector<float> &values) 
+{
+    this->Fill(values.data(), values.size());
+}
+
+
+void Tensor<float>::Fill(const float *values, uint32_t size)
 {
     CHECK(!this->data_.empty());
     const uint32_t total_elems = this->data_.size();
-    CHECK_EQ(values.size(), total_elems);
+    CHECK_EQ(size, total_elems);
 
     const uint32_t rows = this->rows();
     const uint32_t cols = this->cols();
@@ -219,7 +241,7 @@ void Tensor<float>::Fill(const vector<float> &values)
 
     for (uint32_t i = 0; i < channels; ++i) {
         auto &channel_data = this->data_.slice(i);
-        const arma::fmat &channel_data_t = arma::fmat(values.data() + i * planes, this->cols(), this->rows());
+        const arma::fmat &channel_data_t = arma::fmat(values + i * planes, this->cols(), this->rows());
         channel_data = channel_data_t.t();
     }
 }
@@ -34,12 +34,27 @@ void Layer::set_weights(const vector<float> &weights)
 }
 
 
+void Layer::set_weights(const float *, uint32_t)
+{
+    LOG(FATAL) << this->layer_name_ << " layer not implement yet!";
+}
+
+
+void Layer::set_bias(const float *, uint32_t)
+{
+    LOG(FATAL) << this->layer_name_ << " layer not implement yet!";
+}
+
+
 void Layer::set_weights(const vector<shared_ptr<Tensor<float>>> &weights) 
 {
     LOG(FATAL) << this->layer_name_ << " layer not implement yet!";
 }
 
 
+void Layer::Configure(const RuntimeLayerOptions &) {}
+
+
 InferStatus Layer::Forward(const vector<shared_ptr<Tensor<float>>> &inputs, vector<shared_ptr<Tensor<float>>> &outputs) 
 {
     LOG(FATAL) << this->layer_name_ << " layer not implement yet!";
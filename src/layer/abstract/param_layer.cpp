@@ -1,5 +1,6 @@
 #include <glog/logging.h>
 #include "layer/abstract/param_layer.hpp"
+#include "layer/abstract/weight_cache.hpp"
 
 
 namespace magic_infer 
@@ -34,7 +35,35 @@ void ParamLayer::set_bias(const vector<shared_ptr<Tensor<float>>> &bias)
 
 void ParamLayer::set_weights(const vector<float> &weights) 
 {
-    const uint32_t elem_size = weights.size();
+    ParamLayer::set_weights(weights.data(), weights.size());
+}
+
+
+void ParamLayer::set_bias(const vector<float> &bias) 
+{
+    ParamLayer::set_bias(bias.data(), bias.size());
+}
+
+
+/**
+ * 返回权重张量的打包格式，作为权重缓存中区分不同层的标识
+ * @param layer_name 层的名称
+ * @param kind 权重的种类
+ * @param tensors 权重张量
+ * @return 打包格式
+ */
+static string WeightLayout(const string &layer_name, const string &kind, const vector<shared_ptr<Tensor<float>>> &tensors)
+{
+    string layout = layer_name + "." + kind + ":" + to_string(tensors.size());
+    for (const auto &tensor : tensors) {
+        layout += "," + to_string(tensor->channels()) + "x" + to_string(tensor->rows()) + "x" + to_string(tensor->cols());
+    }
+    return layout;
+}
+
+
+void ParamLayer::set_weights(const float *weights, uint32_t elem_size)
+{
     uint32_t weight_size = 0;
     const uint32_t batch_size = this->weights_.size();
 
@@ -43,19 +72,13 @@ void ParamLayer::set_weights(const vector<float> &weights)
     }
     CHECK_EQ(weight_size, elem_size);
 
-    const uint32_t blob_size = elem_size / batch_size;
-    for (uint32_t idx = 0; idx < batch_size; ++idx) {
-        const uint32_t start_offset = idx * blob_size;
-        const uint32_t end_offset = start_offset + blob_size;
-        const auto &sub_values = vector<float>{weights.begin() + start_offset, weights.begin() + end_offset};
-        this->weights_.at(idx)->Fill(sub_values);
-    }
+    // 按块直接从源数组填充，内容相同的权重在多个Layer之间共享
+    WeightCache::Instance().Share(WeightLayout(this->layer_name_, "weight", this->weights_), weights, elem_size, this->weights_);
 }
 
 
-void ParamLayer::set_bias(const vector<float> &bias) 
+void ParamLayer::set_bias(const float *bias, uint32_t elem_size)
 {
-    const uint32_t elem_size = bias.size();
     uint32_t bias_size = 0;
     const uint32_t batch_size = this->bias_.size();
 
@@ -64,13 +87,19 @@ void ParamLayer::set_bias(const vector<float> &bias)
     }
 
     CHECK_EQ(bias_size, elem_size);
-    const uint32_t blob_size = elem_size / batch_size;
-    for (uint32_t idx = 0; idx < batch_size; ++idx) {
-        const uint32_t start_offset = idx * blob_size;
-        const uint32_t end_offset = start_offset + blob_size;
-        const auto &sub_values = vector<float>{bias.begin() + start_offset, bias.begin() + end_offset};
-        this->bias_.at(idx)->Fill(sub_values);
-    }
+    WeightCache::Instance().Share(WeightLayout(this->layer_name_, "bias", this->bias_), bias, elem_size, this->bias_);
+}
+
+
+
+void ParamLayer::ShareTensor(const string &kind, const float *values, uint32_t elem_size, shared_ptr<Tensor<float>> &tensor)
+{
+    CHECK(tensor != nullptr);
+    CHECK_EQ(tensor->size(), elem_size);
+
+    vector<shared_ptr<Tensor<float>>> tensors{tensor};
+    WeightCache::Instance().Share(WeightLayout(this->layer_name_, kind, tensors), values, elem_size, tensors);
+    tensor = tensors.front();
 }
 
 }
@@ -0,0 +1,505 @@
+#include "layer/abstract/weight_cache.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <iterator>
+#include <string_view>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <glog/logging.h>
+
+
+namespace magic_infer
+{
+
+static const char kSegmentMagic[8] = {'M', 'A', 'G', 'I', 'C', 'S', 'W', 'S'};
+static const uint32_t kSegmentVersion = 1;
+static const uint64_t kSegmentAlignment = 64;
+
+
+/// 共享权重段的头部，ready在所有数据写完之后才置为1
+struct WeightSegmentHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t ready;
+    uint64_t entry_num;
+    uint64_t table_offset; /// 权重索引表的偏移，索引表之后是按64字节对齐的权重数据
+    uint64_t table_size;
+    uint64_t total_size;
+};
+
+
+WeightCache &WeightCache::Instance()
+{
+    static WeightCache *kWeightCache = new WeightCache();
+    CHECK(kWeightCache != nullptr) << "Global weight cache init failed!";
+    return *kWeightCache;
+}
+
+
+/**
+ * 检查共享的权重张量和原始权重的内容是否一致，避免哈希冲突时共享错误的权重
+ * @param tensors 共享的权重张量
+ * @param values 原始权重，每个张量内按行优先存放
+ * @param size 原始权重的元素个数
+ * @return 内容是否一致
+ */
+static bool SameContent(const vector<shared_ptr<Tensor<float>>> &tensors, const float *values, uint32_t size)
+{
+    uint32_t offset = 0;
+    for (const auto &tensor : tensors) {
+        if (offset + tensor->size() > size) return false;
+
+        const uint32_t rows = tensor->rows();
+        const uint32_t cols = tensor->cols();
+        for (uint32_t c = 0; c < tensor->channels(); ++c) {
+            const arma::fmat &channel = tensor->at(c);
+            for (uint32_t r = 0; r < rows; ++r) {
+                for (uint32_t col = 0; col < cols; ++col) {
+                    if (channel.at(r, col) != values[offset + r * cols + col]) return false;
+                }
+            }
+            offset += rows * cols;
+        }
+    }
+    return offset == size;
+}
+
+
+/**
+ * 用形状相同的新张量替换Layer的权重张量，并按块用原始权重填充。Layer原来的张量可能被其他Layer共享，
+ * 也可能引用只读的共享权重段，不能直接写入
+ * @param values 原始权重
+ * @param size 原始权重的元素个数
+ * @param tensors 待替换的张量
+ */
+static void FillNewTensors(const float *values, uint32_t size, vector<shared_ptr<Tensor<float>>> &tensors)
+{
+    const uint32_t blob_size = size / tensors.size();
+    for (uint32_t i = 0; i < tensors.size(); ++i) {
+        shared_ptr<Tensor<float>> &tensor = tensors.at(i);
+        shared_ptr<Tensor<float>> new_tensor = make_shared<Tensor<float>>(tensor->channels(), tensor->rows(), tensor->cols());
+        new_tensor->ReRawshape(tensor->raw_shapes());
+        new_tensor->Fill(values + i * blob_size, blob_size);
+        tensor = new_tensor;
+    }
+}
+
+
+bool WeightCache::Share(const string &layout, const float *values, uint32_t size, vector<shared_ptr<Tensor<float>>> &tensors)
+{
+    CHECK(!tensors.empty() && size % tensors.size() == 0) << "The weight size " << size << " does not match the tensors";
+    if (!this->enabled_) {
+        FillNewTensors(values, size, tensors);
+        return false;
+    }
+
+    // 哈希和内容比较都在锁外进行，只在查找和插入时加锁，并行创建Layer时互不阻塞
+    const uint64_t bytes = uint64_t(size) * sizeof(float);
+    const uint64_t content_hash = hash<string_view>()(string_view((const char *) values, bytes)) ^ (hash<string>()(layout) * 0x9e3779b97f4a7c15ull);
+    vector<vector<shared_ptr<Tensor<float>>>> candidates;
+    {
+        lock_guard<mutex> lock(this->mutex_);
+        auto range = this->entries_.equal_range(content_hash);
+        for (auto entry_iter = range.first; entry_iter != range.second;) {
+            const WeightCacheEntry &entry = entry_iter->second;
+            vector<shared_ptr<Tensor<float>>> shared_tensors;
+            for (const auto &weak_tensor : entry.tensors) {
+                shared_ptr<Tensor<float>> tensor = weak_tensor.lock();
+                if (!tensor) break;
+                shared_tensors.push_back(tensor);
+            }
+
+            // 权重已经被释放的缓存项直接删除
+            if (shared_tensors.size() != entry.tensors.size()) {
+                entry_iter = this->entries_.erase(entry_iter);
+                continue;
+            }
+
+            // 持有强引用之后，即使其他Layer释放了权重，候选的张量在比较时依然有效
+            if (entry.layout == layout && shared_tensors.size() == tensors.size()) candidates.push_back(move(shared_tensors));
+            ++entry_iter;
+        }
+    }
+
+    for (const auto &shared_tensors : candidates) {
+        if (!SameContent(shared_tensors, values, size)) continue;
+
+        // Layer自身的张量随之释放
+        tensors = shared_tensors;
+        lock_guard<mutex> lock(this->mutex_);
+        this->hit_num_ += 1;
+        this->deduplicated_bytes_ += bytes;
+        return true;
+    }
+
+    // 其他进程已经导出的共享权重段中有相同的权重时直接引用，不在本进程中再保存一份
+    if (ShareSegment(content_hash, layout, values, size, tensors)) {
+        WeightCacheEntry entry;
+        entry.layout = layout;
+        entry.bytes = bytes;
+        entry.tensors.assign(tensors.begin(), tensors.end());
+
+        lock_guard<mutex> lock(this->mutex_);
+        InsertEntry(content_hash, move(entry));
+        this->segment_hit_num_ += 1;
+        return true;
+    }
+
+    // 缓存中的张量只读，未命中时总是填充新的张量，不会改写其他Layer正在共享的权重
+    FillNewTensors(values, size, tensors);
+    WeightCacheEntry entry;
+    entry.layout = layout;
+    entry.bytes = bytes;
+    entry.tensors.assign(tensors.begin(), tensors.end());
+
+    lock_guard<mutex> lock(this->mutex_);
+    InsertEntry(content_hash, move(entry));
+    this->miss_num_ += 1;
+    return false;
+}
+
+
+void WeightCache::InsertEntry(uint64_t content_hash, WeightCacheEntry entry)
+{
+    this->entries_.insert({content_hash, move(entry)});
+    if (this->entries_.size() < this->prune_watermark_) return;
+
+    // 缓存项达到水位时清理权重已经释放的缓存项，水位随存活的缓存项个数翻倍，清理的开销均摊到每次插入
+    for (auto entry_iter = this->entries_.begin(); entry_iter != this->entries_.end();) {
+        bool alive = true;
+        for (const auto &weak_tensor : entry_iter->second.tensors) {
+            alive = alive && !weak_tensor.expired();
+        }
+        entry_iter = alive ? next(entry_iter) : this->entries_.erase(entry_iter);
+    }
+    this->prune_watermark_ = max(kMinPruneWatermark, 2 * this->entries_.size());
+}
+
+
+WeightCacheStats WeightCache::stats() const
+{
+    lock_guard<mutex> lock(this->mutex_);
+    WeightCacheStats stats;
+    stats.hit_num = this->hit_num_;
+    stats.miss_num = this->miss_num_;
+    stats.deduplicated_bytes = this->deduplicated_bytes_;
+    stats.segment_hit_num = this->segment_hit_num_;
+    for (const auto &segment : this->segments_) {
+        stats.segment_bytes += segment.second.size;
+    }
+
+    for (const auto &entry : this->entries_) {
+        bool alive = true;
+        for (const auto &weak_tensor : entry.second.tensors) {
+            alive = alive && !weak_tensor.expired();
+        }
+        if (!alive) continue;
+
+        stats.entry_num += 1;
+        stats.cached_bytes += entry.second.bytes;
+    }
+    return stats;
+}
+
+
+void WeightCache::set_enabled(bool enabled) { this->enabled_ = enabled; }
+
+bool WeightCache::enabled() const { return this->enabled_; }
+
+
+void WeightCache::Clear()
+{
+    lock_guard<mutex> lock(this->mutex_);
+    this->entries_.clear();
+    this->prune_watermark_ = kMinPruneWatermark;
+    this->hit_num_ = 0;
+    this->miss_num_ = 0;
+    this->deduplicated_bytes_ = 0;
+    this->segment_hit_num_ = 0;
+}
+
+
+static uint64_t AlignSize(uint64_t size)
+{
+    return (size + kSegmentAlignment - 1) / kSegmentAlignment * kSegmentAlignment;
+}
+
+
+/**
+ * 判断共享权重段的路径是否是POSIX共享内存的名称
+ * @param path 共享内存的名称或者文件路径
+ * @return 是否是共享内存的名称
+ */
+static bool IsSharedMemoryName(const string &path)
+{
+    return path.size() > 1 && path.front() == '/' && path.find('/', 1) == string::npos;
+}
+
+
+bool WeightCache::ShareSegment(uint64_t content_hash, const string &layout, const float *values, uint32_t size,
+    vector<shared_ptr<Tensor<float>>> &tensors)
+{
+    lock_guard<mutex> lock(this->mutex_);
+    for (const auto &segment : this->segments_) {
+        auto range = segment.second.entries.equal_range(content_hash);
+        for (auto entry_iter = range.first; entry_iter != range.second; ++entry_iter) {
+            const WeightSegmentEntry &entry = entry_iter->second;
+            if (entry.layout != layout || entry.shapes.size() != tensors.size() || entry.bytes != uint64_t(size) * sizeof(float)) continue;
+
+            // 张量直接引用PROT_READ的映射，映射在进程退出之前不会释放。张量不拥有也不能写入这块内存，
+            // 写入会触发SIGSEGV：Layer只读取权重，重新设置权重时Share总是换成新分配的张量
+            vector<shared_ptr<Tensor<float>>> segment_tensors;
+            uint64_t offset = 0;
+            for (const vector<uint32_t> &shape : entry.shapes) {
+                float *data = (float *) (entry.data + offset);
+                segment_tensors.push_back(make_shared<Tensor<float>>(data, shape.at(0), shape.at(1), shape.at(2)));
+                offset = AlignSize(offset + uint64_t(shape.at(0)) * shape.at(1) * shape.at(2) * sizeof(float));
+            }
+            if (!SameContent(segment_tensors, values, size)) continue;
+
+            tensors = segment_tensors;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/**
+ * 只读映射共享内存或者文件
+ * @param path 共享内存的名称或者文件路径
+ * @param size 映射的字节数
+ * @return 映射，失败时返回空
+ */
+static shared_ptr<const char> MapSegment(const string &path, size_t &size)
+{
+    const int fd = IsSharedMemoryName(path) ? shm_open(path.c_str(), O_RDONLY, 0) : open(path.c_str(), O_RDONLY);
+    if (fd < 0) return nullptr;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(WeightSegmentHeader)) {
+        close(fd);
+        return nullptr;
+    }
+
+    size = st.st_size;
+    void *addr = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) return nullptr;
+
+    const size_t mapping_size = size;
+    return shared_ptr<const char>((const char *) addr, [mapping_size](const char *ptr) { munmap((void *) ptr, mapping_size); });
+}
+
+
+/**
+ * 从索引表中按顺序读取数据，越界时返回false
+ * @param table 索引表的当前位置，读取之后向后移动
+ * @param table_end 索引表的结束位置
+ * @param value 读取的数据
+ * @param size 读取的字节数
+ * @return 是否读取成功
+ */
+static bool ReadTable(const char *&table, const char *table_end, void *value, size_t size)
+{
+    if (size_t(table_end - table) < size) return false;
+    memcpy(value, table, size);
+    table += size;
+    return true;
+}
+
+
+bool WeightCache::AttachSegment(const string &path)
+{
+    lock_guard<mutex> lock(this->mutex_);
+    if (this->segments_.count(path)) return true;
+
+    WeightSegment segment;
+    segment.mapping = MapSegment(path, segment.size);
+    if (!segment.mapping) return false;
+
+    WeightSegmentHeader header;
+    memcpy(&header, segment.mapping.get(), sizeof(header));
+    if (memcmp(header.magic, kSegmentMagic, sizeof(kSegmentMagic)) != 0 || header.version != kSegmentVersion) {
+        LOG(ERROR) << "The shared weight segment is not supported: " << path;
+        return false;
+    }
+
+    // 导出进程还没有写完时不使用该权重段
+    if (__atomic_load_n(&((const WeightSegmentHeader *) segment.mapping.get())->ready, __ATOMIC_ACQUIRE) != 1) {
+        LOG(WARNING) << "The shared weight segment is not ready: " << path;
+        return false;
+    }
+
+    if (header.total_size != segment.size || header.table_offset > segment.size || header.table_size > segment.size - header.table_offset) {
+        LOG(ERROR) << "The shared weight segment is broken: " << path;
+        return false;
+    }
+
+    const char *table = segment.mapping.get() + header.table_offset;
+    const char *table_end = table + header.table_size;
+    for (uint64_t i = 0; i < header.entry_num; ++i) {
+        uint64_t content_hash = 0;
+        uint64_t data_offset = 0;
+        uint32_t layout_size = 0;
+        uint32_t tensor_num = 0;
+        WeightSegmentEntry entry;
+        bool success = ReadTable(table, table_end, &content_hash, sizeof(content_hash)) &&
+            ReadTable(table, table_end, &data_offset, sizeof(data_offset)) && ReadTable(table, table_end, &entry.bytes, sizeof(entry.bytes)) &&
+            ReadTable(table, table_end, &layout_size, sizeof(layout_size)) && ReadTable(table, table_end, &tensor_num, sizeof(tensor_num));
+        if (success) {
+            entry.layout.resize(layout_size);
+            success = ReadTable(table, table_end, &entry.layout[0], layout_size);
+        }
+
+        uint64_t data_size = 0;
+        for (uint32_t j = 0; success && j < tensor_num; ++j) {
+            vector<uint32_t> shape(3);
+            success = ReadTable(table, table_end, shape.data(), shape.size() * sizeof(uint32_t));
+            data_size = AlignSize(data_size) + uint64_t(shape.at(0)) * shape.at(1) * shape.at(2) * sizeof(float);
+            entry.shapes.push_back(shape);
+        }
+
+        if (!success || data_offset % kSegmentAlignment != 0 || data_offset > segment.size || data_size > segment.size - data_offset) {
+            LOG(ERROR) << "The shared weight segment is broken: " << path;
+            return false;
+        }
+        entry.data = segment.mapping.get() + data_offset;
+        segment.entries.insert({content_hash, move(entry)});
+    }
+
+    LOG(INFO) << "Attach the shared weight segment " << path << ", " << header.entry_num << " blocks, " << segment.size << " bytes";
+    this->segments_.insert({path, move(segment)});
+    return true;
+}
+
+
+/**
+ * 向数据末尾追加一个值
+ * @param buffer 数据
+ * @param value 追加的值
+ * @param size 追加的字节数
+ */
+static void AppendBuffer(vector<char> &buffer, const void *value, size_t size)
+{
+    buffer.insert(buffer.end(), (const char *) value, (const char *) value + size);
+}
+
+
+bool WeightCache::ExportSegment(const string &path) const
+{
+    // 收集仍被引用的权重，导出期间持有张量避免被释放
+    vector<pair<uint64_t, const WeightCacheEntry *>> live_entries;
+    vector<vector<shared_ptr<Tensor<float>>>> live_tensors;
+    unique_lock<mutex> lock(this->mutex_);
+    for (const auto &entry : this->entries_) {
+        vector<shared_ptr<Tensor<float>>> tensors;
+        for (const auto &weak_tensor : entry.second.tensors) {
+            shared_ptr<Tensor<float>> tensor = weak_tensor.lock();
+            if (!tensor) break;
+            tensors.push_back(tensor);
+        }
+        if (tensors.size() != entry.second.tensors.size()) continue;
+
+        live_entries.push_back({entry.first, &entry.second});
+        live_tensors.push_back(tensors);
+    }
+
+    // 索引表的每条记录: 内容哈希、数据偏移、字节数、格式长度、张量个数、格式、每个张量的形状
+    uint64_t table_size = 0;
+    for (uint32_t i = 0; i < live_entries.size(); ++i) {
+        table_size += 3 * sizeof(uint64_t) + 2 * sizeof(uint32_t) + live_entries.at(i).second->layout.size() +
+            live_tensors.at(i).size() * 3 * sizeof(uint32_t);
+    }
+
+    WeightSegmentHeader header;
+    memcpy(header.magic, kSegmentMagic, sizeof(kSegmentMagic));
+    header.version = kSegmentVersion;
+    header.ready = 0;
+    header.entry_num = live_entries.size();
+    header.table_offset = sizeof(header);
+    header.table_size = table_size;
+
+    vector<char> table;
+    vector<uint64_t> data_offsets;
+    uint64_t data_end = AlignSize(header.table_offset + header.table_size);
+    for (uint32_t i = 0; i < live_entries.size(); ++i) {
+        const WeightCacheEntry &entry = *live_entries.at(i).second;
+        const uint64_t data_offset = AlignSize(data_end);
+        const uint32_t layout_size = entry.layout.size();
+        const uint32_t tensor_num = live_tensors.at(i).size();
+        data_offsets.push_back(data_offset);
+
+        AppendBuffer(table, &live_entries.at(i).first, sizeof(uint64_t));
+        AppendBuffer(table, &data_offset, sizeof(data_offset));
+        AppendBuffer(table, &entry.bytes, sizeof(entry.bytes));
+        AppendBuffer(table, &layout_size, sizeof(layout_size));
+        AppendBuffer(table, &tensor_num, sizeof(tensor_num));
+        AppendBuffer(table, entry.layout.data(), layout_size);
+
+        data_end = data_offset;
+        for (const auto &tensor : live_tensors.at(i)) {
+            const uint32_t shape[3] = {tensor->channels(), tensor->rows(), tensor->cols()};
+            AppendBuffer(table, shape, sizeof(shape));
+            data_end = AlignSize(data_end) + uint64_t(tensor->size()) * sizeof(float);
+        }
+    }
+    CHECK_EQ(table.size(), table_size);
+    header.total_size = data_end;
+
+    vector<char> buffer(header.total_size, 0);
+    memcpy(buffer.data(), &header, sizeof(header));
+    memcpy(buffer.data() + header.table_offset, table.data(), table.size());
+    for (uint32_t i = 0; i < live_entries.size(); ++i) {
+        uint64_t offset = data_offsets.at(i);
+        for (const auto &tensor : live_tensors.at(i)) {
+            offset = AlignSize(offset);
+            memcpy(buffer.data() + offset, tensor->RawPtr(), tensor->size() * sizeof(float));
+            offset += tensor->size() * sizeof(float);
+        }
+    }
+    lock.unlock();
+
+    // 共享内存独占创建，普通文件先写入临时文件再改名，其他进程只会看到完整的权重段
+    const bool shared_memory = IsSharedMemoryName(path);
+    const string &write_path = shared_memory ? path : path + ".tmp." + to_string(getpid());
+    const int fd = shared_memory ? shm_open(write_path.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644) :
+        open(write_path.c_str(), O_CREAT | O_TRUNC | O_WRONLY, 0644);
+    if (fd < 0) {
+        LOG(WARNING) << "Can not create the shared weight segment: " << path;
+        return false;
+    }
+
+    bool success = ftruncate(fd, buffer.size()) == 0;
+    for (size_t written = 0; success && written < buffer.size();) {
+        const ssize_t result = pwrite(fd, buffer.data() + written, buffer.size() - written, written);
+        success = result > 0;
+        if (success) written += result;
+    }
+
+    const uint32_t ready = 1;
+    success = success && pwrite(fd, &ready, sizeof(ready), offsetof(WeightSegmentHeader, ready)) == sizeof(ready);
+    close(fd);
+    if (success && !shared_memory) success = rename(write_path.c_str(), path.c_str()) == 0;
+
+    if (!success) {
+        LOG(ERROR) << "Can not write the shared weight segment: " << path;
+        shared_memory ? shm_unlink(write_path.c_str()) : unlink(write_path.c_str());
+        return false;
+    }
+    LOG(INFO) << "Export the shared weight segment " << path << ", " << live_entries.size() << " blocks, " << buffer.size() << " bytes";
+    return true;
+}
+
+
+bool WeightCache::RemoveSegment(const string &path)
+{
+    return IsSharedMemoryName(path) ? shm_unlink(path.c_str()) == 0 : unlink(path.c_str()) == 0;
+}
+
+}
@@ -0,0 +1,253 @@
+#include "layer/details/activation_kernel.hpp"
+
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <glog/logging.h>
+
+#include "utils/platform.hpp"
+
+#if __SSE2__
+#include <emmintrin.h>
+#include "utils/sse_math.hpp"
+#endif
+
+
+namespace magic_infer
+{
+
+typedef ActivationKernel ActivationKernelTable[int(ActivationType::kActivationNum)][int(CpuIsa::kIsaNum)][int(MathMode::kModeNum)];
+
+
+static ActivationKernelTable &KernelTable()
+{
+    static ActivationKernelTable kernel_table = {};
+    return kernel_table;
+}
+
+
+static atomic<MathMode> &CurrentMathMode()
+{
+    static atomic<MathMode> math_mode{[]() {
+        const char *fast_math_env = getenv("MAGIC_FAST_MATH");
+        return fast_math_env != nullptr && string(fast_math_env) == "1" ? MathMode::kFast : MathMode::kAccurate;
+    }()};
+    return math_mode;
+}
+
+
+void ActivationKernelRegistry::Register(ActivationType type, CpuIsa isa, ActivationKernel kernel, MathMode mode)
+{
+    CHECK(kernel != nullptr) << "The activation kernel is empty";
+    ActivationKernel &registered_kernel = KernelTable()[int(type)][int(isa)][int(mode)];
+    CHECK(registered_kernel == nullptr) << "The activation kernel of " << IsaName(isa) << " has been registered";
+    registered_kernel = kernel;
+}
+
+
+CpuIsa ActivationKernelRegistry::KernelIsa(ActivationType type, CpuIsa max_isa)
+{
+    for (int isa = int(max_isa); isa > int(CpuIsa::kScalar); --isa) {
+        if (KernelTable()[int(type)][isa][int(MathMode::kAccurate)] != nullptr) return CpuIsa(isa);
+    }
+    return CpuIsa::kScalar;
+}
+
+
+ActivationKernel ActivationKernelRegistry::Get(ActivationType type, CpuIsa max_isa, MathMode mode)
+{
+    const ActivationKernel (&kernels)[int(MathMode::kModeNum)] = KernelTable()[int(type)][int(KernelIsa(type, max_isa))];
+    const ActivationKernel kernel = kernels[int(mode)] != nullptr ? kernels[int(mode)] : kernels[int(MathMode::kAccurate)];
+    CHECK(kernel != nullptr) << "The scalar activation kernel is not registered";
+    return kernel;
+}
+
+
+ActivationKernel ActivationKernelRegistry::Get(ActivationType type)
+{
+    return Get(type, HostIsa(), math_mode());
+}
+
+
+void ActivationKernelRegistry::set_math_mode(MathMode mode)
+{
+    CurrentMathMode() = mode;
+}
+
+
+MathMode ActivationKernelRegistry::math_mode()
+{
+    return CurrentMathMode();
+}
+
+
+CpuIsa ActivationKernelRegistry::HostIsa()
+{
+    static const CpuIsa kHostIsa = []() {
+        CpuIsa isa = CpuIsa::kScalar;
+#if MAGIC_X86_DISPATCH
+        // __builtin_cpu_supports同时检查操作系统是否保存对应的寄存器状态
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("sse2")) isa = CpuIsa::kSSE2;
+        if (isa == CpuIsa::kSSE2 && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) isa = CpuIsa::kAVX2;
+        if (isa == CpuIsa::kAVX2 && __builtin_cpu_supports("avx512f")) isa = CpuIsa::kAVX512;
+#endif
+
+        const char *isa_env = getenv("MAGIC_CPU_ISA");
+        if (isa_env != nullptr) {
+            for (int limit = int(CpuIsa::kScalar); limit < int(CpuIsa::kIsaNum); ++limit) {
+                if (IsaName(CpuIsa(limit)) == isa_env && limit < int(isa)) isa = CpuIsa(limit);
+            }
+        }
+        LOG(INFO) << "Activation kernels use " << IsaName(isa);
+        return isa;
+    }();
+    return kHostIsa;
+}
+
+
+string ActivationKernelRegistry::IsaName(CpuIsa isa)
+{
+    switch (isa) {
+        case CpuIsa::kScalar: return "scalar";
+        case CpuIsa::kSSE2: return "sse2";
+        case CpuIsa::kAVX2: return "avx2";
+        case CpuIsa::kAVX512: return "avx512";
+        default: return "unknown";
+    }
+}
+
+
+static void ReluScalar(const float *input, float *output, uint32_t size)
+{
+    for (uint32_t i = 0; i < size; ++i) {
+        output[i] = input[i] > 0.f ? input[i] : 0.f;
+    }
+}
+
+
+static void SigmoidScalar(const float *input, float *output, uint32_t size)
+{
+    for (uint32_t i = 0; i < size; ++i) {
+        output[i] = 1.f / (1.f + expf(-input[i]));
+    }
+}
+
+
+static void SiLUScalar(const float *input, float *output, uint32_t size)
+{
+    for (uint32_t i = 0; i < size; ++i) {
+        output[i] = input[i] / (1.f + expf(-input[i]));
+    }
+}
+
+
+static void HardSwishScalar(const float *input, float *output, uint32_t size)
+{
+    for (uint32_t i = 0; i < size; ++i) {
+        const float value = input[i];
+        if (value <= -3.f) output[i] = 0.f;
+        else if (value >= 3.f) output[i] = value;
+        else output[i] = value * (value + 3.f) / 6.f;
+    }
+}
+
+
+static void HardSigmoidScalar(const float *input, float *output, uint32_t size)
+{
+    for (uint32_t i = 0; i < size; ++i) {
+        const float value = input[i];
+        if (value <= -3.f) output[i] = 0.f;
+        else if (value >= 3.f) output[i] = 1.f;
+        else output[i] = value / 6.f + 0.5f;
+    }
+}
+
+
+static ActivationKernelRegistererWrapper kReluScalar(ActivationType::kReLU, CpuIsa::kScalar, ReluScalar);
+static ActivationKernelRegistererWrapper kSigmoidScalar(ActivationType::kSigmoid, CpuIsa::kScalar, SigmoidScalar);
+static ActivationKernelRegistererWrapper kSiLUScalar(ActivationType::kSiLU, CpuIsa::kScalar, SiLUScalar);
+static ActivationKernelRegistererWrapper kHardSwishScalar(ActivationType::kHardSwish, CpuIsa::kScalar, HardSwishScalar);
+static ActivationKernelRegistererWrapper kHardSigmoidScalar(ActivationType::kHardSigmoid, CpuIsa::kScalar, HardSigmoidScalar);
+
+
+#if __SSE2__
+struct ReluSSE2
+{
+    static __m128 Apply(__m128 x) { return _mm_max_ps(x, _mm_setzero_ps()); }
+};
+
+
+struct SigmoidSSE2
+{
+    static __m128 Apply(__m128 x)
+    {
+        const __m128 one = _mm_set1_ps(1.f);
+        return _mm_div_ps(one, _mm_add_ps(one, exp_ps(_mm_sub_ps(_mm_setzero_ps(), x))));
+    }
+};
+
+
+struct SiLUSSE2
+{
+    static __m128 Apply(__m128 x)
+    {
+        const __m128 one = _mm_set1_ps(1.f);
+        return _mm_div_ps(x, _mm_add_ps(one, exp_ps(_mm_sub_ps(_mm_setzero_ps(), x))));
+    }
+};
+
+
+struct HardSwishSSE2
+{
+    static __m128 Apply(__m128 x)
+    {
+        const __m128 three = _mm_set1_ps(3.f);
+        const __m128 value = _mm_div_ps(_mm_mul_ps(x, _mm_add_ps(x, three)), _mm_set1_ps(6.f));
+        const __m128 upper = _mm_cmpge_ps(x, three);
+        const __m128 result = _mm_or_ps(_mm_and_ps(upper, x), _mm_andnot_ps(upper, value));
+        return _mm_and_ps(result, _mm_cmpgt_ps(x, _mm_set1_ps(-3.f)));
+    }
+};
+
+
+struct HardSigmoidSSE2
+{
+    static __m128 Apply(__m128 x)
+    {
+        const __m128 value = _mm_add_ps(_mm_div_ps(x, _mm_set1_ps(6.f)), _mm_set1_ps(0.5f));
+        const __m128 upper = _mm_cmpge_ps(x, _mm_set1_ps(3.f));
+        const __m128 result = _mm_or_ps(_mm_and_ps(upper, _mm_set1_ps(1.f)), _mm_andnot_ps(upper, value));
+        return _mm_and_ps(result, _mm_cmpgt_ps(x, _mm_set1_ps(-3.f)));
+    }
+};
+
+
+/// SSE2没有掩码读写，尾部不足4个的元素补齐之后按向量计算，和主体的结果一致
+template<typename Op>
+static void ApplySSE2(const float *input, float *output, uint32_t size)
+{
+    const uint32_t packet_size = 4;
+    uint32_t i = 0;
+    for (; i + packet_size <= size; i += packet_size) {
+        _mm_storeu_ps(output + i, Op::Apply(_mm_loadu_ps(input + i)));
+    }
+
+    if (i < size) {
+        float tail[packet_size] = {0.f, 0.f, 0.f, 0.f};
+        memcpy(tail, input + i, sizeof(float) * (size - i));
+        _mm_storeu_ps(tail, Op::Apply(_mm_loadu_ps(tail)));
+        memcpy(output + i, tail, sizeof(float) * (size - i));
+    }
+}
+
+
+static ActivationKernelRegistererWrapper kReluSSE2(ActivationType::kReLU, CpuIsa::kSSE2, ApplySSE2<ReluSSE2>);
+static ActivationKernelRegistererWrapper kSigmoidSSE2(ActivationType::kSigmoid, CpuIsa::kSSE2, ApplySSE2<SigmoidSSE2>);
+static ActivationKernelRegistererWrapper kSiLUSSE2(ActivationType::kSiLU, CpuIsa::kSSE2, ApplySSE2<SiLUSSE2>);
+static ActivationKernelRegistererWrapper kHardSwishSSE2(ActivationType::kHardSwish, CpuIsa::kSSE2, ApplySSE2<HardSwishSSE2>);
+static ActivationKernelRegistererWrapper kHardSigmoidSSE2(ActivationType::kHardSigmoid, CpuIsa::kSSE2, ApplySSE2<HardSigmoidSSE2>);
+#endif
+
+}
@@ -0,0 +1,102 @@
+#include "layer/details/activation_kernel.hpp"
+#include "utils/platform.hpp"
+
+#if MAGIC_X86_DISPATCH
+#include <immintrin.h>
+#include "utils/avx_math.hpp"
+
+
+namespace magic_infer
+{
+
+struct ReluAVX2
+{
+    static MAGIC_TARGET_AVX2 MAGIC_FORCEINLINE __m256 Apply(__m256 x) { return _mm256_max_ps(x, _mm256_setzero_ps()); }
+};
+
+
+struct SigmoidAVX2
+{
+    static MAGIC_TARGET_AVX2 MAGIC_FORCEINLINE __m256 Apply(__m256 x) { return sigmoid256_ps(x); }
+};
+
+
+struct SigmoidFastAVX2
+{
+    static MAGIC_TARGET_AVX2 MAGIC_FORCEINLINE __m256 Apply(__m256 x) { return sigmoid256_fast_ps(x); }
+};
+
+
+struct SiLUAVX2
+{
+    static MAGIC_TARGET_AVX2 MAGIC_FORCEINLINE __m256 Apply(__m256 x)
+    {
+        const __m256 one = _mm256_set1_ps(1.f);
+        return _mm256_div_ps(x, _mm256_add_ps(one, exp256_ps(_mm256_sub_ps(_mm256_setzero_ps(), x))));
+    }
+};
+
+
+struct SiLUFastAVX2
+{
+    static MAGIC_TARGET_AVX2 MAGIC_FORCEINLINE __m256 Apply(__m256 x)
+    {
+        const __m256 one = _mm256_set1_ps(1.f);
+        return _mm256_div_ps(x, _mm256_add_ps(one, exp256_fast_ps(_mm256_sub_ps(_mm256_setzero_ps(), x))));
+    }
+};
+
+
+struct HardSwishAVX2
+{
+    static MAGIC_TARGET_AVX2 MAGIC_FORCEINLINE __m256 Apply(__m256 x)
+    {
+        const __m256 three = _mm256_set1_ps(3.f);
+        const __m256 value = _mm256_div_ps(_mm256_mul_ps(x, _mm256_add_ps(x, three)), _mm256_set1_ps(6.f));
+        const __m256 result = _mm256_blendv_ps(value, x, _mm256_cmp_ps(x, three, _CMP_GE_OQ));
+        return _mm256_and_ps(result, _mm256_cmp_ps(x, _mm256_set1_ps(-3.f), _CMP_GT_OQ));
+    }
+};
+
+
+struct HardSigmoidAVX2
+{
+    static MAGIC_TARGET_AVX2 MAGIC_FORCEINLINE __m256 Apply(__m256 x)
+    {
+        const __m256 value = _mm256_add_ps(_mm256_div_ps(x, _mm256_set1_ps(6.f)), _mm256_set1_ps(0.5f));
+        const __m256 result = _mm256_blendv_ps(value, _mm256_set1_ps(1.f), _mm256_cmp_ps(x, _mm256_set1_ps(3.f), _CMP_GE_OQ));
+        return _mm256_and_ps(result, _mm256_cmp_ps(x, _mm256_set1_ps(-3.f), _CMP_GT_OQ));
+    }
+};
+
+
+/// 主体每次处理8个元素，尾部用掩码读写，不会越界访问
+template<typename Op>
+static MAGIC_TARGET_AVX2 void ApplyAVX2(const float *input, float *output, uint32_t size)
+{
+    const uint32_t packet_size = 8;
+    uint32_t i = 0;
+    for (; i + packet_size <= size; i += packet_size) {
+        _mm256_storeu_ps(output + i, Op::Apply(_mm256_loadu_ps(input + i)));
+    }
+
+    if (i < size) {
+        const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+        const __m256i mask = _mm256_cmpgt_epi32(_mm256_set1_epi32(int(size - i)), lanes);
+        _mm256_maskstore_ps(output + i, mask, Op::Apply(_mm256_maskload_ps(input + i, mask)));
+    }
+}
+
+
+static ActivationKernelRegistererWrapper kReluAVX2(ActivationType::kReLU, CpuIsa::kAVX2, ApplyAVX2<ReluAVX2>);
+static ActivationKernelRegistererWrapper kSigmoidAVX2(ActivationType::kSigmoid, CpuIsa::kAVX2, ApplyAVX2<SigmoidAVX2>);
+static ActivationKernelRegistererWrapper kSiLUAVX2(ActivationType::kSiLU, CpuIsa::kAVX2, ApplyAVX2<SiLUAVX2>);
+static ActivationKernelRegistererWrapper kHardSwishAVX2(ActivationType::kHardSwish, CpuIsa::kAVX2, ApplyAVX2<HardSwishAVX2>);
+static ActivationKernelRegistererWrapper kHardSigmoidAVX2(ActivationType::kHardSigmoid, CpuIsa::kAVX2, ApplyAVX2<HardSigmoidAVX2>);
+static ActivationKernelRegistererWrapper kSigmoidFastAVX2(ActivationType::kSigmoid, CpuIsa::kAVX2, ApplyAVX2<SigmoidFastAVX2>,
+    MathMode::kFast);
+static ActivationKernelRegistererWrapper kSiLUFastAVX2(ActivationType::kSiLU, CpuIsa::kAVX2, ApplyAVX2<SiLUFastAVX2>,
+    MathMode::kFast);
+
+}
+#endif // MAGIC_X86_DISPATCH
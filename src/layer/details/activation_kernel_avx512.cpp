@@ -0,0 +1,101 @@
+#include "layer/details/activation_kernel.hpp"
+#include "utils/platform.hpp"
+
+#if MAGIC_X86_DISPATCH
+#include <immintrin.h>
+#include "utils/avx512_math.hpp"
+
+
+namespace magic_infer
+{
+
+struct ReluAVX512
+{
+    static MAGIC_TARGET_AVX512 MAGIC_FORCEINLINE __m512 Apply(__m512 x) { return _mm512_max_ps(x, _mm512_setzero_ps()); }
+};
+
+
+struct SigmoidAVX512
+{
+    static MAGIC_TARGET_AVX512 MAGIC_FORCEINLINE __m512 Apply(__m512 x) { return sigmoid512_ps(x); }
+};
+
+
+struct SigmoidFastAVX512
+{
+    static MAGIC_TARGET_AVX512 MAGIC_FORCEINLINE __m512 Apply(__m512 x) { return sigmoid512_fast_ps(x); }
+};
+
+
+struct SiLUAVX512
+{
+    static MAGIC_TARGET_AVX512 MAGIC_FORCEINLINE __m512 Apply(__m512 x)
+    {
+        const __m512 one = _mm512_set1_ps(1.f);
+        return _mm512_div_ps(x, _mm512_add_ps(one, exp512_ps(_mm512_sub_ps(_mm512_setzero_ps(), x))));
+    }
+};
+
+
+struct SiLUFastAVX512
+{
+    static MAGIC_TARGET_AVX512 MAGIC_FORCEINLINE __m512 Apply(__m512 x)
+    {
+        const __m512 one = _mm512_set1_ps(1.f);
+        return _mm512_div_ps(x, _mm512_add_ps(one, exp512_fast_ps(_mm512_sub_ps(_mm512_setzero_ps(), x))));
+    }
+};
+
+
+struct HardSwishAVX512
+{
+    static MAGIC_TARGET_AVX512 MAGIC_FORCEINLINE __m512 Apply(__m512 x)
+    {
+        const __m512 three = _mm512_set1_ps(3.f);
+        const __m512 value = _mm512_div_ps(_mm512_mul_ps(x, _mm512_add_ps(x, three)), _mm512_set1_ps(6.f));
+        const __m512 result = _mm512_mask_blend_ps(_mm512_cmp_ps_mask(x, three, _CMP_GE_OQ), value, x);
+        return _mm512_maskz_mov_ps(_mm512_cmp_ps_mask(x, _mm512_set1_ps(-3.f), _CMP_GT_OQ), result);
+    }
+};
+
+
+struct HardSigmoidAVX512
+{
+    static MAGIC_TARGET_AVX512 MAGIC_FORCEINLINE __m512 Apply(__m512 x)
+    {
+        const __m512 value = _mm512_add_ps(_mm512_div_ps(x, _mm512_set1_ps(6.f)), _mm512_set1_ps(0.5f));
+        const __m512 result = _mm512_mask_blend_ps(_mm512_cmp_ps_mask(x, _mm512_set1_ps(3.f), _CMP_GE_OQ), value, _mm512_set1_ps(1.f));
+        return _mm512_maskz_mov_ps(_mm512_cmp_ps_mask(x, _mm512_set1_ps(-3.f), _CMP_GT_OQ), result);
+    }
+};
+
+
+/// 主体每次处理16个元素，尾部用掩码读写，不会越界访问
+template<typename Op>
+static MAGIC_TARGET_AVX512 void ApplyAVX512(const float *input, float *output, uint32_t size)
+{
+    const uint32_t packet_size = 16;
+    uint32_t i = 0;
+    for (; i + packet_size <= size; i += packet_size) {
+        _mm512_storeu_ps(output + i, Op::Apply(_mm512_loadu_ps(input + i)));
+    }
+
+    if (i < size) {
+        const __mmask16 mask = __mmask16((1u << (size - i)) - 1);
+        _mm512_mask_storeu_ps(output + i, mask, Op::Apply(_mm512_maskz_loadu_ps(mask, input + i)));
+    }
+}
+
+
+static ActivationKernelRegistererWrapper kReluAVX512(ActivationType::kReLU, CpuIsa::kAVX512, ApplyAVX512<ReluAVX512>);
+static ActivationKernelRegistererWrapper kSigmoidAVX512(ActivationType::kSigmoid, CpuIsa::kAVX512, ApplyAVX512<SigmoidAVX512>);
+static ActivationKernelRegistererWrapper kSiLUAVX512(ActivationType::kSiLU, CpuIsa::kAVX512, ApplyAVX512<SiLUAVX512>);
+static ActivationKernelRegistererWrapper kHardSwishAVX512(ActivationType::kHardSwish, CpuIsa::kAVX512, ApplyAVX512<HardSwishAVX512>);
+static ActivationKernelRegistererWrapper kHardSigmoidAVX512(ActivationType::kHardSigmoid, CpuIsa::kAVX512, ApplyAVX512<HardSigmoidAVX512>);
+static ActivationKernelRegistererWrapper kSigmoidFastAVX512(ActivationType::kSigmoid, CpuIsa::kAVX512, ApplyAVX512<SigmoidFastAVX512>,
+    MathMode::kFast);
+static ActivationKernelRegistererWrapper kSiLUFastAVX512(ActivationType::kSiLU, CpuIsa::kAVX512, ApplyAVX512<SiLUFastAVX512>,
+    MathMode::kFast);
+
+}
+#endif // MAGIC_X86_DISPATCH
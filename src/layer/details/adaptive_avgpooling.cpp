@@ -1,15 +1,70 @@
 #include "layer/details/adaptive_avgpooling.hpp"
 #include "layer/abstract/layer_factory.hpp"
+#include "runtime/runtime_optimizer.hpp"
 #include <glog/logging.h>
+#if __SSE2__
+#include <emmintrin.h>
+#endif
 
 
 namespace magic_infer 
 {
 
+/// 全局平均池化的元素个数少于该值时不并行，避免线程调度的开销超过计算
+static const size_t kGlobalPoolParallelSize = 1 << 14;
+
+
 AdaptiveAvgPoolingLayer::AdaptiveAvgPoolingLayer(uint32_t output_h, uint32_t output_w)
     : Layer("AdaptiveAvgPoolingLayer"), output_h_(output_h), output_w_(output_w) {}
 
 
+/**
+ * 对连续的size个元素求和，使用4组向量累加器隐藏加法的延迟
+ * @param input 输入
+ * @param size 元素个数
+ * @return 所有元素之和
+ */
+static float SumVector(const float *input, uint32_t size)
+{
+    uint32_t i = 0;
+    float sum = 0.f;
+#if __SSE2__
+    __m128 sum0 = _mm_setzero_ps();
+    __m128 sum1 = _mm_setzero_ps();
+    __m128 sum2 = _mm_setzero_ps();
+    __m128 sum3 = _mm_setzero_ps();
+    for (; i + 16 <= size; i += 16) {
+        sum0 = _mm_add_ps(sum0, _mm_loadu_ps(input + i));
+        sum1 = _mm_add_ps(sum1, _mm_loadu_ps(input + i + 4));
+        sum2 = _mm_add_ps(sum2, _mm_loadu_ps(input + i + 8));
+        sum3 = _mm_add_ps(sum3, _mm_loadu_ps(input + i + 12));
+    }
+    for (; i + 4 <= size; i += 4) {
+        sum0 = _mm_add_ps(sum0, _mm_loadu_ps(input + i));
+    }
+
+    const __m128 sum4 = _mm_add_ps(_mm_add_ps(sum0, sum1), _mm_add_ps(sum2, sum3));
+    const __m128 sum2x = _mm_add_ps(sum4, _mm_movehl_ps(sum4, sum4));
+    sum = _mm_cvtss_f32(_mm_add_ss(sum2x, _mm_shuffle_ps(sum2x, sum2x, _MM_SHUFFLE(1, 1, 1, 1))));
+#endif
+    for (; i < size; ++i) {
+        sum += input[i];
+    }
+    return sum;
+}
+
+
+void AdaptiveAvgPoolingLayer::GlobalAveragePool(const float *input, uint32_t channels, uint32_t plane_size, float *output)
+{
+    CHECK(plane_size > 0) << "The input feature map of global average pooling is empty";
+    const float scale = 1.f / float(plane_size);
+#pragma omp parallel for schedule(static) if(size_t(channels) * plane_size >= kGlobalPoolParallelSize)
+    for (uint32_t c = 0; c < channels; ++c) {
+        output[c] = SumVector(input + size_t(c) * plane_size, plane_size) * scale;
+    }
+}
+
+
 InferStatus AdaptiveAvgPoolingLayer::Forward(const vector<shared_ptr<Tensor<float>>> &inputs, vector<shared_ptr<Tensor<float>>> &outputs) 
 {
     if (inputs.empty()) {
@@ -28,6 +83,26 @@ InferStatus AdaptiveAvgPoolingLayer::Forward(const vector<shared_ptr<Tensor<floa
     }
 
     const uint32_t batch = inputs.size();
+    if (output_h_ == 1 && output_w_ == 1) {
+        // ResNet、MobileNet的分类头和SE模块都是全局平均池化，逐通道向量化求和，并在通道之间并行
+        for (uint32_t i = 0; i < batch; ++i) {
+            const shared_ptr<Tensor<float>> &input_data = inputs.at(i);
+            CHECK(input_data != nullptr && !input_data->empty()) << "The input feature map of average pooling layer is empty";
+
+            const uint32_t input_c = input_data->channels();
+            shared_ptr<Tensor<float>> output_data = outputs.at(i);
+            if (output_data == nullptr || output_data->empty()) {
+                output_data = make_shared<Tensor<float>>(input_c, 1, 1);
+                outputs.at(i) = output_data;
+            }
+
+            CHECK(output_data->rows() == 1 && output_data->cols() == 1 && output_data->channels() == input_c)
+                << "The output size of adaptive pooling is error";
+            GlobalAveragePool(input_data->RawPtr(), input_c, input_data->rows() * input_data->cols(), output_data->data().memptr());
+        }
+        return InferStatus::kInferSuccess;
+    }
+
 #pragma omp parallel for num_threads(batch)
     for (uint32_t i = 0; i < batch; ++i) {
         const shared_ptr<Tensor<float>> &input_data = inputs.at(i);
@@ -104,6 +179,17 @@ ParseParameterAttrStatus AdaptiveAvgPoolingLayer::GetInstance(const shared_ptr<R
 }
 
 
+/**
+ * 估算自适应平均池化的浮点运算次数，每个输入元素累加一次
+ */
+static uint64_t EstimateAdaptiveAvgPoolingFlops(const shared_ptr<RuntimeOperator> &op, uint64_t output_elements)
+{
+    if (op->input_operands_seq.empty()) return output_elements;
+    return RuntimeGraphOptimizer::ShapeElements(op->input_operands_seq.front()->shapes);
+}
+
+
 LayerRegistererWrapper kAdaptiveAvgPoolingGetInstance("nn.AdaptiveAvgPool2d", AdaptiveAvgPoolingLayer::GetInstance);
+FlopsEstimatorRegistererWrapper kAdaptiveAvgPoolingFlops("nn.AdaptiveAvgPool2d", EstimateAdaptiveAvgPoolingFlops);
 
 }
@@ -1,11 +1,52 @@
 #include "layer/details/batchnorm2d.hpp"
 #include "layer/abstract/layer_factory.hpp"
+#include "runtime/runtime_optimizer.hpp"
 #include "runtime/runtime_ir.hpp"
 
+#if __SSE2__
+#include <emmintrin.h>
+#include "utils/x86_usability.hpp"
+#endif
+
 
 namespace magic_infer 
 {
 
+/**
+ * 对连续内存执行 output = input * scale + shift
+ * @param input 输入数据
+ * @param output 输出数据
+ * @param size 元素个数
+ * @param scale 缩放系数
+ * @param shift 偏移量
+ */
+static void ScaleShift(const float *input, float *output, uint32_t size, float scale, float shift)
+{
+    uint32_t j = 0;
+#if __AVX__
+    const __m256 _scale8 = _mm256_set1_ps(scale);
+    const __m256 _shift8 = _mm256_set1_ps(shift);
+    for (; j + 7 < size; j += 8) {
+        __m256 _p = _mm256_loadu_ps(input + j);
+        _p = _mm256_comp_fmadd_ps(_p, _scale8, _shift8);
+        _mm256_storeu_ps(output + j, _p);
+    }
+#endif
+#if __SSE2__
+    const __m128 _scale4 = _mm_set1_ps(scale);
+    const __m128 _shift4 = _mm_set1_ps(shift);
+    for (; j + 3 < size; j += 4) {
+        __m128 _p = _mm_loadu_ps(input + j);
+        _p = _mm_comp_fmadd_ps(_p, _scale4, _shift4);
+        _mm_storeu_ps(output + j, _p);
+    }
+#endif
+    for (; j < size; ++j) {
+        output[j] = input[j] * scale + shift;
+    }
+}
+
+
 InferStatus BatchNorm2DLayer::Forward(const vector<shared_ptr<Tensor<float>>> &inputs, vector<shared_ptr<Tensor<float>>> &outputs) 
 {
     if (inputs.empty()) {
@@ -30,6 +71,11 @@ InferStatus BatchNorm2DLayer::Forward(const vector<shared_ptr<Tensor<float>>> &i
         return InferStatus::kInferFailedWeightParameterError;
     }
 
+    if (this->scale_.size() != mean_value_size || this->shift_.size() != mean_value_size) {
+        LOG(ERROR) << "BatchNorm2d layer scale and shift values is not prepared";
+        return InferStatus::kInferFailedWeightParameterError;
+    }
+
     const uint32_t batch_size = inputs.size();
 #pragma omp parallel for num_threads(batch_size)
     for (uint32_t b = 0; b < batch_size; ++b) {
@@ -47,13 +93,9 @@ InferStatus BatchNorm2DLayer::Forward(const vector<shared_ptr<Tensor<float>>> &i
 
         CHECK(output->shapes() == input->shapes()) << "The output size of batchnorm is error";
 
+        const uint32_t planes = input->rows() * input->cols();
         for (uint32_t i = 0; i < mean_value_size; ++i) {
-            const float mean_value = weights_.at(i)->index(0);
-            const float var_value = bias_.at(i)->index(0);
-            CHECK(input->channels() >= i) << "The channel of the input feature maps and mean values is not adapting";
-
-            float var_value_ = sqrt(var_value + eps_);
-            output->at(i) = ((input->at(i) - mean_value) / var_value_) * affine_weight_.at(i) + affine_bias_.at(i);
+            ScaleShift(input->at(i).memptr(), output->at(i).memptr(), planes, scale_.at(i), shift_.at(i));
         }
     }
 
@@ -141,6 +183,79 @@ BatchNorm2DLayer::BatchNorm2DLayer(uint32_t num_features, float eps, const vecto
 }
 
 
+void BatchNorm2DLayer::set_weights(const vector<float> &weights)
+{
+    ParamLayer::set_weights(weights);
+    this->UpdateScaleShift();
+}
+
+
+void BatchNorm2DLayer::set_weights(const vector<shared_ptr<Tensor<float>>> &weights)
+{
+    ParamLayer::set_weights(weights);
+    this->UpdateScaleShift();
+}
+
+
+void BatchNorm2DLayer::set_weights(const float *weights, uint32_t elem_size)
+{
+    ParamLayer::set_weights(weights, elem_size);
+    this->UpdateScaleShift();
+}
+
+
+void BatchNorm2DLayer::set_bias(const vector<float> &bias)
+{
+    ParamLayer::set_bias(bias);
+    this->UpdateScaleShift();
+}
+
+
+void BatchNorm2DLayer::set_bias(const vector<shared_ptr<Tensor<float>>> &bias)
+{
+    ParamLayer::set_bias(bias);
+    this->UpdateScaleShift();
+}
+
+
+void BatchNorm2DLayer::set_bias(const float *bias, uint32_t elem_size)
+{
+    ParamLayer::set_bias(bias, elem_size);
+    this->UpdateScaleShift();
+}
+
+
+void BatchNorm2DLayer::UpdateScaleShift()
+{
+    const uint32_t num_features = this->weights_.size();
+    this->scale_.clear();
+    this->shift_.clear();
+    if (this->bias_.size() != num_features || this->affine_weight_.size() != num_features || this->affine_bias_.size() != num_features) {
+        return;
+    }
+
+    this->scale_.resize(num_features);
+    this->shift_.resize(num_features);
+    for (uint32_t i = 0; i < num_features; ++i) {
+        const float mean_value = this->weights_.at(i)->index(0);
+        const float var_value = this->bias_.at(i)->index(0);
+        const float scale = this->affine_weight_.at(i) / sqrtf(var_value + this->eps_);
+        this->scale_.at(i) = scale;
+        this->shift_.at(i) = this->affine_bias_.at(i) - mean_value * scale;
+    }
+}
+
+
+/**
+ * 估算批归一化的浮点运算次数，每个输出元素一次乘法和一次加法
+ */
+static uint64_t EstimateBatchNorm2dFlops(const shared_ptr<RuntimeOperator> &, uint64_t output_elements)
+{
+    return 2 * output_elements;
+}
+
+
 LayerRegistererWrapper kBatchNorm2dGetInstance("nn.BatchNorm2d", BatchNorm2DLayer::GetInstance);
+FlopsEstimatorRegistererWrapper kBatchNorm2dFlops("nn.BatchNorm2d", EstimateBatchNorm2dFlops);
 
 }
@@ -27,26 +27,34 @@ InferStatus ConcatLayer::Forward(const vector<shared_ptr<Tensor<float>>> &inputs
 
     const uint32_t output_size = outputs.size();
     CHECK(inputs.size() % output_size == 0);
-    const uint32_t packet_size = inputs.size() / output_size;
     for (uint32_t i = 0; i < outputs.size(); ++i) {
         shared_ptr<Tensor<float>> output = outputs.at(i);
         uint32_t start_channel = 0;
         uint32_t rows = inputs.front()->rows();
         uint32_t cols = inputs.front()->cols();
 
+        // 各个输入的通道数可以不同，输出的通道数是输入通道数之和
+        uint32_t out_channels = 0;
+        for (uint32_t j = i; j < inputs.size(); j += output_size) {
+            out_channels += inputs.at(j)->channels();
+        }
+
         for (uint32_t j = i; j < inputs.size(); j += output_size) {
             const shared_ptr<Tensor<float>> &input = inputs.at(j);
             const uint32_t in_channels = input->channels();
             CHECK(rows == input->rows() && cols == input->cols());
 
             if (output == nullptr || output->empty()) {
-                output = make_shared<Tensor<float>>(in_channels * packet_size, rows, cols);
+                output = make_shared<Tensor<float>>(out_channels, rows, cols);
                 outputs.at(i) = output;
             }
-            CHECK(output->channels() == in_channels * packet_size && output->rows() == rows && output->cols() == cols);
-            
-            for (uint32_t c = 0; c < in_channels; ++c) {
-                output->at(start_channel + c) = input->at(c);
+            CHECK(output->channels() == out_channels && output->rows() == rows && output->cols() == cols);
+
+            // 输入张量已经是输出张量通道切片的视图时，前驱节点直接写入了输出，无需拷贝
+            if (input->RawPtr() != output->at(start_channel).memptr()) {
+                for (uint32_t c = 0; c < in_channels; ++c) {
+                    output->at(start_channel + c) = input->at(c);
+                }
             }
             start_channel += input->channels();
         }
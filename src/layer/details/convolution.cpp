@@ -1,5 +1,6 @@
 #include "layer/details/convolution.hpp"
 #include "layer/abstract/layer_factory.hpp"
+#include "runtime/runtime_optimizer.hpp"
 #include "utils/tick.hpp"
 #include <glog/logging.h>
 
@@ -283,8 +284,15 @@ ParseParameterAttrStatus ConvolutionLayer::GetInstance(const shared_ptr<RuntimeO
             return ParseParameterAttrStatus::kAttrMissingBias;
         }
 
-        const vector<float> &bias_values = bias->get<float>();
-        conv_layer->set_bias(bias_values);
+        // 原生模型文件中的偏移量已经按打包格式保存，由加载器设置
+        if (!op->prepacked_weights) {
+            if (bias->raw_size() == 0) {
+                LOG(ERROR) << "The bias attribute has no data";
+                return ParseParameterAttrStatus::kAttrMissingBias;
+            }
+            const RuntimeAttributeSpan<float> &bias_values = bias->span<float>();
+            conv_layer->set_bias(bias_values.data, bias_values.size);
+        }
     }
 
     if (attrs.find("weight") == attrs.end()) {
@@ -299,12 +307,20 @@ ParseParameterAttrStatus ConvolutionLayer::GetInstance(const shared_ptr<RuntimeO
         return ParseParameterAttrStatus::kAttrMissingWeight;
     }
 
-    const vector<float> &weight_values = weight->get<float>();
-    conv_layer->set_weights(weight_values);
+    // 直接从权重文件的映射中读取权重，原生模型文件中预先打包的权重由加载器设置
+    if (!op->prepacked_weights) {
+        if (weight->raw_size() == 0) {
+            LOG(ERROR) << "The weight attribute has no data";
+            return ParseParameterAttrStatus::kAttrMissingWeight;
+        }
+        const RuntimeAttributeSpan<float> &weight_values = weight->span<float>();
+        conv_layer->set_weights(weight_values.data, weight_values.size);
+    }
     return ParseParameterAttrStatus::kParameterAttrParseSuccess;
 }
 
 
 LayerRegistererWrapper kConvGetInstance("nn.Conv2d", ConvolutionLayer::GetInstance);
+FlopsEstimatorRegistererWrapper kConvFlops("nn.Conv2d", RuntimeGraphOptimizer::EstimateWeightFlops);
 
 }
@@ -1,99 +1,461 @@
 #include "layer/details/expression.hpp"
 #include "layer/abstract/layer_factory.hpp"
-#include <stack>
+#include "runtime/runtime_optimizer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if __SSE2__
+#include <emmintrin.h>
+#include "utils/x86_usability.hpp"
+#include "utils/sse_math.hpp"
+#endif
+
+#if __AVX2__ && __FMA__
+#include "utils/avx_math.hpp"
+#endif
 
 
 namespace magic_infer 
 {
 
+/// 每次执行字节码处理的元素个数，所有寄存器都能放在L1 cache中
+static const uint32_t kTileSize = 256;
+
+
+#if __AVX__
+/// 使用两次128位的运算实现256位的运算
+template<__m128 (*Func)(__m128)>
+static MAGIC_FORCEINLINE __m256 SplitApply(__m256 a)
+{
+    const __m128 low = Func(_mm256_castps256_ps128(a));
+    const __m128 high = Func(_mm256_extractf128_ps(a, 1));
+    return _mm256_insertf128_ps(_mm256_castps128_ps256(low), high, 1);
+}
+#endif
+
+
+struct ExpressionAdd
+{
+    static float Apply(float a, float b) { return a + b; }
+#if __SSE2__
+    static __m128 Apply(__m128 a, __m128 b) { return _mm_add_ps(a, b); }
+#endif
+#if __AVX__
+    static __m256 Apply(__m256 a, __m256 b) { return _mm256_add_ps(a, b); }
+#endif
+};
+
+
+struct ExpressionSub
+{
+    static float Apply(float a, float b) { return a - b; }
+#if __SSE2__
+    static __m128 Apply(__m128 a, __m128 b) { return _mm_sub_ps(a, b); }
+#endif
+#if __AVX__
+    static __m256 Apply(__m256 a, __m256 b) { return _mm256_sub_ps(a, b); }
+#endif
+};
+
+
+struct ExpressionMul
+{
+    static float Apply(float a, float b) { return a * b; }
+#if __SSE2__
+    static __m128 Apply(__m128 a, __m128 b) { return _mm_mul_ps(a, b); }
+#endif
+#if __AVX__
+    static __m256 Apply(__m256 a, __m256 b) { return _mm256_mul_ps(a, b); }
+#endif
+};
+
+
+struct ExpressionDiv
+{
+    static float Apply(float a, float b) { return a / b; }
+#if __SSE2__
+    static __m128 Apply(__m128 a, __m128 b) { return _mm_div_ps(a, b); }
+#endif
+#if __AVX__
+    static __m256 Apply(__m256 a, __m256 b) { return _mm256_div_ps(a, b); }
+#endif
+};
+
+
+struct ExpressionMax
+{
+    static float Apply(float a, float b) { return max(a, b); }
+#if __SSE2__
+    static __m128 Apply(__m128 a, __m128 b) { return _mm_max_ps(a, b); }
+#endif
+#if __AVX__
+    static __m256 Apply(__m256 a, __m256 b) { return _mm256_max_ps(a, b); }
+#endif
+};
+
+
+struct ExpressionMin
+{
+    static float Apply(float a, float b) { return min(a, b); }
+#if __SSE2__
+    static __m128 Apply(__m128 a, __m128 b) { return _mm_min_ps(a, b); }
+#endif
+#if __AVX__
+    static __m256 Apply(__m256 a, __m256 b) { return _mm256_min_ps(a, b); }
+#endif
+};
+
+
+struct ExpressionNeg
+{
+    static float Apply(float a) { return -a; }
+#if __SSE2__
+    static __m128 Apply(__m128 a) { return _mm_sub_ps(_mm_setzero_ps(), a); }
+#endif
+#if __AVX__
+    static __m256 Apply(__m256 a) { return _mm256_sub_ps(_mm256_setzero_ps(), a); }
+#endif
+};
+
+
+struct ExpressionAbs
+{
+    static float Apply(float a) { return fabsf(a); }
+#if __SSE2__
+    static __m128 Apply(__m128 a) { return _mm_andnot_ps(_mm_set1_ps(-0.f), a); }
+#endif
+#if __AVX__
+    static __m256 Apply(__m256 a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.f), a); }
+#endif
+};
+
+
+struct ExpressionSqrt
+{
+    static float Apply(float a) { return sqrtf(a); }
+#if __SSE2__
+    static __m128 Apply(__m128 a) { return _mm_sqrt_ps(a); }
+#endif
+#if __AVX__
+    static __m256 Apply(__m256 a) { return _mm256_sqrt_ps(a); }
+#endif
+};
+
+
+struct ExpressionRsqrt
+{
+    static float Apply(float a) { return 1.f / sqrtf(a); }
+#if __SSE2__
+    static __m128 Apply(__m128 a) { return _mm_div_ps(_mm_set1_ps(1.f), _mm_sqrt_ps(a)); }
+#endif
+#if __AVX__
+    static __m256 Apply(__m256 a) { return _mm256_div_ps(_mm256_set1_ps(1.f), _mm256_sqrt_ps(a)); }
+#endif
+};
+
+
+struct ExpressionSquare
+{
+    static float Apply(float a) { return a * a; }
+#if __SSE2__
+    static __m128 Apply(__m128 a) { return _mm_mul_ps(a, a); }
+#endif
+#if __AVX__
+    static __m256 Apply(__m256 a) { return _mm256_mul_ps(a, a); }
+#endif
+};
+
+
+struct ExpressionReciprocal
+{
+    static float Apply(float a) { return 1.f / a; }
+#if __SSE2__
+    static __m128 Apply(__m128 a) { return _mm_div_ps(_mm_set1_ps(1.f), a); }
+#endif
+#if __AVX__
+    static __m256 Apply(__m256 a) { return _mm256_div_ps(_mm256_set1_ps(1.f), a); }
+#endif
+};
+
+
+struct ExpressionExp
+{
+    static float Apply(float a) { return expf(a); }
+#if __SSE2__
+    static __m128 Apply(__m128 a) { return exp_ps(a); }
+#endif
+#if __AVX2__ && __FMA__
+    static __m256 Apply(__m256 a) { return exp256_ps(a); }
+#elif __AVX__
+    static __m256 Apply(__m256 a) { return SplitApply<exp_ps>(a); }
+#endif
+};
+
+
+struct ExpressionLog
+{
+    static float Apply(float a) { return logf(a); }
+#if __SSE2__
+    static __m128 Apply(__m128 a) { return log_ps(a); }
+#endif
+#if __AVX2__ && __FMA__
+    static __m256 Apply(__m256 a) { return log256_ps(a); }
+#elif __AVX__
+    static __m256 Apply(__m256 a) { return SplitApply<log_ps>(a); }
+#endif
+};
+
+
+struct ExpressionSin
+{
+    static float Apply(float a) { return sinf(a); }
+#if __SSE2__
+    static __m128 Apply(__m128 a) { return sin_ps(a); }
+#endif
+#if __AVX__
+    static __m256 Apply(__m256 a) { return SplitApply<sin_ps>(a); }
+#endif
+};
+
+
+struct ExpressionCos
+{
+    static float Apply(float a) { return cosf(a); }
+#if __SSE2__
+    static __m128 Apply(__m128 a) { return cos_ps(a); }
+#endif
+#if __AVX__
+    static __m256 Apply(__m256 a) { return SplitApply<cos_ps>(a); }
+#endif
+};
+
+
+struct ExpressionTanh
+{
+    static float Apply(float a) { return tanhf(a); }
+#if __SSE2__
+    static __m128 Apply(__m128 a) { return tanh_ps(a); }
+#endif
+#if __AVX2__ && __FMA__
+    static __m256 Apply(__m256 a) { return tanh256_ps(a); }
+#elif __AVX__
+    static __m256 Apply(__m256 a) { return SplitApply<tanh_ps>(a); }
+#endif
+};
+
+
+template<class Op>
+static void BinaryKernel(float *dst, const float *lhs, const float *rhs, uint32_t size)
+{
+    uint32_t i = 0;
+#if __AVX__
+    for (; i + 7 < size; i += 8) {
+        _mm256_storeu_ps(dst + i, Op::Apply(_mm256_loadu_ps(lhs + i), _mm256_loadu_ps(rhs + i)));
+    }
+#endif
+#if __SSE2__
+    for (; i + 3 < size; i += 4) {
+        _mm_storeu_ps(dst + i, Op::Apply(_mm_loadu_ps(lhs + i), _mm_loadu_ps(rhs + i)));
+    }
+#endif
+    for (; i < size; ++i) {
+        dst[i] = Op::Apply(lhs[i], rhs[i]);
+    }
+}
+
+
+template<class Op>
+static void UnaryKernel(float *dst, const float *lhs, uint32_t size)
+{
+    uint32_t i = 0;
+#if __AVX__
+    for (; i + 7 < size; i += 8) {
+        _mm256_storeu_ps(dst + i, Op::Apply(_mm256_loadu_ps(lhs + i)));
+    }
+#endif
+#if __SSE2__
+    for (; i + 3 < size; i += 4) {
+        _mm_storeu_ps(dst + i, Op::Apply(_mm_loadu_ps(lhs + i)));
+    }
+#endif
+    for (; i < size; ++i) {
+        dst[i] = Op::Apply(lhs[i]);
+    }
+}
+
+
+/**
+ * 没有向量实现的运算逐个元素计算
+ * @param op 运算的类型
+ * @param dst 输出地址
+ * @param lhs 左操作数地址
+ * @param rhs 右操作数地址，一元运算时为空
+ * @param size 元素个数
+ */
+static void ScalarKernel(TokenType op, float *dst, const float *lhs, const float *rhs, uint32_t size)
+{
+    for (uint32_t i = 0; i < size; ++i) {
+        dst[i] = EvaluateToken(op, lhs[i], rhs ? rhs[i] : 0.f);
+    }
+}
+
+
+/**
+ * 执行一条字节码指令
+ * @param op 指令的操作类型
+ * @param dst 输出地址
+ * @param lhs 左操作数地址
+ * @param rhs 右操作数地址，一元运算时为空
+ * @param size 元素个数
+ */
+static void ExecuteInstruction(TokenType op, float *dst, const float *lhs, const float *rhs, uint32_t size)
+{
+    switch (op) {
+        case TokenType::TokenInputNumber: {
+            if (dst != lhs) memcpy(dst, lhs, size * sizeof(float));
+            break;
+        }
+        case TokenType::TokenAdd: BinaryKernel<ExpressionAdd>(dst, lhs, rhs, size); break;
+        case TokenType::TokenSub: BinaryKernel<ExpressionSub>(dst, lhs, rhs, size); break;
+        case TokenType::TokenMul: BinaryKernel<ExpressionMul>(dst, lhs, rhs, size); break;
+        case TokenType::TokenDiv: BinaryKernel<ExpressionDiv>(dst, lhs, rhs, size); break;
+        case TokenType::TokenMax: BinaryKernel<ExpressionMax>(dst, lhs, rhs, size); break;
+        case TokenType::TokenMin: BinaryKernel<ExpressionMin>(dst, lhs, rhs, size); break;
+        case TokenType::TokenNeg: UnaryKernel<ExpressionNeg>(dst, lhs, size); break;
+        case TokenType::TokenAbs: UnaryKernel<ExpressionAbs>(dst, lhs, size); break;
+        case TokenType::TokenSqrt: UnaryKernel<ExpressionSqrt>(dst, lhs, size); break;
+        case TokenType::TokenRsqrt: UnaryKernel<ExpressionRsqrt>(dst, lhs, size); break;
+        case TokenType::TokenSquare: UnaryKernel<ExpressionSquare>(dst, lhs, size); break;
+        case TokenType::TokenReciprocal: UnaryKernel<ExpressionReciprocal>(dst, lhs, size); break;
+        case TokenType::TokenExp: UnaryKernel<ExpressionExp>(dst, lhs, size); break;
+        case TokenType::TokenLog: UnaryKernel<ExpressionLog>(dst, lhs, size); break;
+        case TokenType::TokenSin: UnaryKernel<ExpressionSin>(dst, lhs, size); break;
+        case TokenType::TokenCos: UnaryKernel<ExpressionCos>(dst, lhs, size); break;
+        case TokenType::TokenTanh: UnaryKernel<ExpressionTanh>(dst, lhs, size); break;
+        default: {
+            CHECK(TokenArity(op) > 0) << "Unknown operator type: " << int(op);
+            ScalarKernel(op, dst, lhs, rhs, size);
+        }
+    }
+}
+
+
 ExpressionLayer::ExpressionLayer(const string &statement)
-    : Layer("Expression"), parser_(make_unique<ExpressionParser>(statement)) {}
+    : Layer("Expression"), parser_(make_unique<ExpressionParser>(statement))
+{
+    this->program_ = this->parser_->Compile();
+}
 
 
 InferStatus ExpressionLayer::Forward(const vector<shared_ptr<Tensor<float>>> &inputs, vector<shared_ptr<Tensor<float>>> &outputs) 
 {
     if (inputs.empty()) {
-        LOG(ERROR) << "The input feature map of flatten layer is empty";
+        LOG(ERROR) << "The input feature map of expression layer is empty";
         return InferStatus::kInferFailedInputEmpty;
     }
 
-    const uint32_t size = inputs.size();
-    if (!size) {
-        LOG(ERROR) << "The input feature map of add layer is null";
-        return InferStatus::kInferFailedInputEmpty;
-    }
-
-    CHECK(this->parser_ != nullptr);
-    this->parser_->Tokenizer(false);
-    const auto &expressions = this->parser_->tokens();
-    CHECK(!expressions.empty());
-    const auto &expression = expressions.front();
-
     const uint32_t batch_size = outputs.size();
     if (batch_size == 0) {
         LOG(ERROR) << "Output of the expression layer is empty";
         return InferStatus::kInferFailedInputOutSizeAdaptingError;
     }
 
+    const uint32_t input_num = this->program_.input_num;
+    if (inputs.size() % batch_size != 0 || inputs.size() / batch_size < input_num) {
+        LOG(ERROR) << "The input size of expression layer is not adapting";
+        return InferStatus::kInferFailedInputOutSizeAdaptingError;
+    }
+
+    // 输入的形状和输出一致，或者在通道维度、空间维度上可以广播
     for (uint32_t i = 0; i < batch_size; ++i) {
-        if (outputs.at(i) == nullptr || outputs.at(i)->empty()) {
+        const shared_ptr<Tensor<float>> &output = outputs.at(i);
+        if (output == nullptr || output->empty()) {
             LOG(ERROR) << "Output of the expression layer is empty";
             return InferStatus::kInferFailedInputOutSizeAdaptingError;
         }
-        outputs.at(i)->Fill(0.f);
-    }
-
-    stack<vector<shared_ptr<Tensor<float>>>> op_stack;
-    const vector<shared_ptr<TokenNode>> &token_nodes = this->parser_->Generate();
-    for (const auto &token_node : token_nodes) {
-        if (token_node->num_index >= 0) {
-            // operator
-            uint32_t start_pos = token_node->num_index * batch_size;
-            vector<shared_ptr<Tensor<float>>> input_token_nodes;
-            for (uint32_t i = 0; i < batch_size; ++i) {
-                CHECK(i + start_pos < inputs.size());
-                input_token_nodes.push_back(inputs.at(i + start_pos));
-            }
-            op_stack.push(input_token_nodes);
-        
-        } else {
-            //operation
-            const int32_t op = token_node->num_index;
-            CHECK(op_stack.size() >= 2) << "The number of operand is less than two";
-            vector<shared_ptr<Tensor<float>>> input_node1 = op_stack.top();
 
-            CHECK(input_node1.size() == batch_size);
-            op_stack.pop();
+        for (uint32_t k = 0; k < input_num; ++k) {
+            const shared_ptr<Tensor<float>> &input = inputs.at(k * batch_size + i);
+            if (input == nullptr || input->empty()) {
+                LOG(ERROR) << "The input feature map of expression layer is empty";
+                return InferStatus::kInferFailedInputEmpty;
+            }
 
-            vector<shared_ptr<Tensor<float>>> input_node2 = op_stack.top();
-            CHECK(input_node2.size() == batch_size);
-            op_stack.pop();
+            const uint32_t plane_size = input->rows() * input->cols();
+            if ((input->channels() != output->channels() && input->channels() != 1) ||
+                (plane_size != output->rows() * output->cols() && plane_size != 1)) {
+                LOG(ERROR) << "The input and output shape of expression layer is not adapting";
+                return InferStatus::kInferFailedInputOutSizeAdaptingError;
+            }
+        }
+    }
 
-            CHECK(input_node1.size() == input_node2.size());
-            vector<shared_ptr<Tensor<float>>> output_token_nodes(batch_size);
+    // 每个batch的缓存依次存放寄存器、广播输入和常数
+    const uint32_t register_num = this->program_.register_num;
+    const vector<float> &constants = this->program_.constants;
+    const uint32_t batch_workspace_size = (register_num + input_num + constants.size()) * kTileSize;
+    // 缓存只在本次Forward中使用，同一个Layer可以被多个线程同时调用
+    vector<float> workspace(batch_size * batch_workspace_size);
+    for (uint32_t i = 0; i < batch_size; ++i) {
+        float *constant_ptr = workspace.data() + i * batch_workspace_size + (register_num + input_num) * kTileSize;
+        for (uint32_t k = 0; k < constants.size(); ++k) {
+            fill(constant_ptr + k * kTileSize, constant_ptr + (k + 1) * kTileSize, constants.at(k));
+        }
+    }
 
+    const vector<ExpressionInstruction> &instructions = this->program_.instructions;
 #pragma omp parallel for num_threads(batch_size)
-            for (uint32_t i = 0; i < batch_size; ++i) {
-                if (op == -int(TokenType::TokenAdd)) {
-                    output_token_nodes.at(i) = Tensor<float>::ElementAdd(input_node1.at(i), input_node2.at(i));
-                } else if (op == -int(TokenType::TokenMul)) {
-                    output_token_nodes.at(i) = Tensor<float>::ElementMultiply(input_node1.at(i), input_node2.at(i));
-                } else {
-                    LOG(FATAL) << "Unknown operator type: " << op;
+    for (uint32_t i = 0; i < batch_size; ++i) {
+        float *registers = workspace.data() + i * batch_workspace_size;
+        float *broadcasts = registers + register_num * kTileSize;
+        const float *constant_tiles = broadcasts + input_num * kTileSize;
+        const shared_ptr<Tensor<float>> &output = outputs.at(i);
+
+        // 没有需要广播的输入时，把整个张量当作一个连续的平面处理
+        bool need_broadcast = false;
+        for (uint32_t k = 0; k < input_num; ++k) {
+            need_broadcast |= inputs.at(k * batch_size + i)->shapes() != output->shapes();
+        }
+        const uint32_t channels = need_broadcast ? output->channels() : 1;
+        const uint32_t plane_size = need_broadcast ? output->rows() * output->cols() : output->size();
+
+        for (uint32_t c = 0; c < channels; ++c) {
+            float *output_ptr = need_broadcast ? output->at(c).memptr() : output->data().memptr();
+
+            for (uint32_t offset = 0; offset < plane_size; offset += kTileSize) {
+                const uint32_t size = min(kTileSize, plane_size - offset);
+                if (offset == 0) {
+                    for (uint32_t k = 0; k < input_num; ++k) {
+                        const shared_ptr<Tensor<float>> &input = inputs.at(k * batch_size + i);
+                        if (need_broadcast && input->rows() * input->cols() == 1) {
+                            const float value = input->at(input->channels() == 1 ? 0 : c, 0, 0);
+                            fill(broadcasts + k * kTileSize, broadcasts + (k + 1) * kTileSize, value);
+                        }
+                    }
+                }
+
+                auto resolve = [&](const ExpressionOperand &operand) -> const float * {
+                    if (operand.source == OperandSource::SourceRegister) return registers + operand.index * kTileSize;
+                    if (operand.source == OperandSource::SourceConstant) return constant_tiles + operand.index * kTileSize;
+
+                    const shared_ptr<Tensor<float>> &input = inputs.at(operand.index * batch_size + i);
+                    if (!need_broadcast) return input->RawPtr() + offset;
+                    if (input->rows() * input->cols() == 1) return broadcasts + operand.index * kTileSize;
+                    return input->at(input->channels() == 1 ? 0 : c).memptr() + offset;
+                };
+
+                for (const auto &instruction : instructions) {
+                    const ExpressionOperand &dst = instruction.dst;
+                    float *dst_ptr = dst.source == OperandSource::SourceOutput ? output_ptr + offset : registers + dst.index * kTileSize;
+                    const float *rhs_ptr = TokenArity(instruction.op) == 2 ? resolve(instruction.rhs) : nullptr;
+                    ExecuteInstruction(instruction.op, dst_ptr, resolve(instruction.lhs), rhs_ptr, size);
                 }
             }
-            op_stack.push(output_token_nodes);
         }
     }
 
-    CHECK(op_stack.size() == 1);
-    vector<shared_ptr<Tensor<float>>> output_node = op_stack.top();
-    op_stack.pop();
-    for (int i = 0; i < batch_size; ++i) {
-        CHECK(outputs.at(i) != nullptr && !outputs.at(i)->empty());
-        outputs.at(i) = output_node.at(i);
-    }
-    
     return InferStatus::kInferSuccess;
 }
 
@@ -122,6 +484,17 @@ ParseParameterAttrStatus ExpressionLayer::GetInstance(const shared_ptr<RuntimeOp
 }
 
 
+/**
+ * 估算表达式的浮点运算次数，n个输入的表达式每个输出元素计算n-1次，少于两个输入时按1次计算
+ */
+static uint64_t EstimateExpressionFlops(const shared_ptr<RuntimeOperator> &op, uint64_t output_elements)
+{
+    const uint64_t input_num = op->input_operands_seq.size();
+    return output_elements * (input_num > 1 ? input_num - 1 : 1);
+}
+
+
 LayerRegistererWrapper kExpressionGetInstance("pnnx.Expression", ExpressionLayer::GetInstance);
+FlopsEstimatorRegistererWrapper kExpressionFlops("pnnx.Expression", EstimateExpressionFlops);
 
 }
@@ -0,0 +1,157 @@
+#include "layer/details/global_pool_linear.hpp"
+
+#include <cstring>
+#include <glog/logging.h>
+
+#include "layer/abstract/layer_factory.hpp"
+#include "runtime/runtime_optimizer.hpp"
+#include "layer/details/adaptive_avgpooling.hpp"
+
+
+namespace magic_infer
+{
+
+GlobalPoolLinearLayer::GlobalPoolLinearLayer(int32_t in_features, int32_t out_features, bool use_bias)
+    : LinearLayer(in_features, out_features, use_bias) {}
+
+
+InferStatus GlobalPoolLinearLayer::Forward(const vector<shared_ptr<Tensor<float>>> &inputs, vector<shared_ptr<Tensor<float>>> &outputs)
+{
+    if (inputs.empty()) {
+        LOG(ERROR) << "The input feature map of global pool linear layer is empty";
+        return InferStatus::kInferFailedInputEmpty;
+    }
+
+    if (inputs.size() != outputs.size()) {
+        LOG(ERROR) << "The input and output size is not adapting";
+        return InferStatus::kInferFailedInputOutSizeAdaptingError;
+    }
+
+    if (this->weights_.size() != 1) {
+        LOG(ERROR) << "The size of weight parameters is not one";
+        return InferStatus::kInferFailedWeightParameterError;
+    }
+
+    if (use_bias_ && this->bias_.size() != 1) {
+        LOG(ERROR) << "The size of bias parameters is not one";
+        return InferStatus::kInferFailedBiasParameterError;
+    }
+
+    const uint32_t batch = inputs.size();
+    for (uint32_t i = 0; i < batch; ++i) {
+        const shared_ptr<Tensor<float>> &input = inputs.at(i);
+        if (input == nullptr || input->empty()) {
+            LOG(ERROR) << "The input feature map of global pool linear layer is empty";
+            return InferStatus::kInferFailedInputEmpty;
+        }
+
+        if (input->channels() != uint32_t(in_features_)) {
+            LOG(ERROR) << "The channels of the input feature map is not equal to the in features";
+            return InferStatus::kInferFailedChannelParameterError;
+        }
+    }
+
+    for (uint32_t i = 0; i < batch; ++i) {
+        shared_ptr<Tensor<float>> output = outputs.at(i);
+        if (output == nullptr || output->empty()) {
+            output = make_shared<Tensor<float>>(1, out_features_, 1);
+            outputs.at(i) = output;
+        }
+        CHECK(output->size() == uint32_t(out_features_)) << "The output size of global pool linear layer is error";
+    }
+
+    // 每个样本池化之后是一列，池化结果和整个batch的矩阵乘法结果都放在复用的缓存中
+    lock_guard<mutex> lock(this->buffer_mutex_);
+    this->pooled_.resize(size_t(in_features_) * batch);
+    for (uint32_t i = 0; i < batch; ++i) {
+        const shared_ptr<Tensor<float>> &input = inputs.at(i);
+        AdaptiveAvgPoolingLayer::GlobalAveragePool(input->RawPtr(), in_features_, input->rows() * input->cols(),
+            this->pooled_.data() + size_t(i) * in_features_);
+    }
+    PrepareWeights();
+
+    // 单个样本直接把GEMV的结果写入输出张量
+    if (batch == 1) {
+        MatMul(this->pooled_.data(), 1, outputs.front()->data().memptr());
+        return InferStatus::kInferSuccess;
+    }
+
+    // 多个样本的输出张量不连续，整个batch和权重只做一次矩阵乘法之后按列写回
+    this->result_.resize(size_t(out_features_) * batch);
+    MatMul(this->pooled_.data(), batch, this->result_.data());
+    for (uint32_t i = 0; i < batch; ++i) {
+        memcpy(outputs.at(i)->data().memptr(), this->result_.data() + size_t(i) * out_features_, out_features_ * sizeof(float));
+    }
+    return InferStatus::kInferSuccess;
+}
+
+
+ParseParameterAttrStatus GlobalPoolLinearLayer::GetInstance(const shared_ptr<RuntimeOperator> &op, shared_ptr<Layer> &head_layer)
+{
+    CHECK(op != nullptr) << "Global pool linear operator is nullptr";
+
+    // 融合节点保留了Linear的参数和属性
+    const auto &params = op->params;
+    const auto &use_bias_iter = params.find("bias");
+    const auto &use_bias_param = use_bias_iter == params.end() ? nullptr : dynamic_cast<RuntimeParameterBool *>(use_bias_iter->second);
+    if (use_bias_param == nullptr) {
+        LOG(ERROR) << "Can not find the use bias parameter";
+        return ParseParameterAttrStatus::kParameterMissingUseBias;
+    }
+
+    const auto &attr = op->attribute;
+    const auto &weight_iter = attr.find("weight");
+    if (weight_iter == attr.end()) {
+        LOG(ERROR) << "Can not find the weight parameter";
+        return ParseParameterAttrStatus::kAttrMissingWeight;
+    }
+
+    const bool use_bias = use_bias_param->value;
+    const auto &bias_iter = attr.find("bias");
+    if (use_bias && bias_iter == attr.end()) {
+        LOG(ERROR) << "Can not find the bias parameter";
+        return ParseParameterAttrStatus::kAttrMissingBias;
+    }
+
+    const shared_ptr<RuntimeAttribute> &weight = weight_iter->second;
+    CHECK(weight->shape.size() == 2) << "The graph only support two dimension matrix multiply";
+    const shared_ptr<GlobalPoolLinearLayer> &layer = make_shared<GlobalPoolLinearLayer>(weight->shape.at(1), weight->shape.at(0), use_bias);
+    head_layer = layer;
+
+    // 原生模型文件中的权重和偏移量已经按打包格式保存，由加载器设置
+    if (op->prepacked_weights) return ParseParameterAttrStatus::kParameterAttrParseSuccess;
+
+    if (use_bias) {
+        if (bias_iter->second->raw_size() == 0) {
+            LOG(ERROR) << "The bias attribute has no data";
+            return ParseParameterAttrStatus::kAttrMissingBias;
+        }
+        const RuntimeAttributeSpan<float> &bias_values = bias_iter->second->span<float>();
+        head_layer->set_bias(bias_values.data, bias_values.size);
+    }
+
+    if (weight->raw_size() == 0) {
+        LOG(ERROR) << "The weight attribute has no data";
+        return ParseParameterAttrStatus::kAttrMissingWeight;
+    }
+    const RuntimeAttributeSpan<float> &weight_values = weight->span<float>();
+    head_layer->set_weights(weight_values.data, weight_values.size);
+    return ParseParameterAttrStatus::kParameterAttrParseSuccess;
+}
+
+
+/**
+ * 估算全局池化加全连接的浮点运算次数，池化读一遍输入，全连接的乘加按2次计算
+ */
+static uint64_t EstimateGlobalPoolLinearFlops(const shared_ptr<RuntimeOperator> &op, uint64_t output_elements)
+{
+    const uint64_t pool_flops = op->input_operands_seq.empty() ? 0 :
+        RuntimeGraphOptimizer::ShapeElements(op->input_operands_seq.front()->shapes);
+    return pool_flops + RuntimeGraphOptimizer::EstimateWeightFlops(op, output_elements);
+}
+
+
+LayerRegistererWrapper kGlobalPoolLinearGetInstance("magic.GlobalPoolLinear", GlobalPoolLinearLayer::GetInstance);
+FlopsEstimatorRegistererWrapper kGlobalPoolLinearFlops("magic.GlobalPoolLinear", EstimateGlobalPoolLinearFlops);
+
+}
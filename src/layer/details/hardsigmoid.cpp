@@ -1,5 +1,6 @@
 #include "layer/details/hardsigmoid.hpp"
 #include "layer/abstract/layer_factory.hpp"
+#include "layer/details/activation_kernel.hpp"
 
 
 namespace magic_infer 
@@ -20,6 +21,7 @@ InferStatus HardSigmoid::Forward(const vector<shared_ptr<Tensor<float>>> &inputs
         return InferStatus::kInferFailedInputOutSizeAdaptingError;
     }
 
+    const ActivationKernel kernel = ActivationKernelRegistry::Get(ActivationType::kHardSigmoid);
     const uint32_t batch = inputs.size();
 #pragma omp parallel for num_threads(batch)
     for (uint32_t i = 0; i < batch; ++i) {
@@ -34,12 +36,7 @@ InferStatus HardSigmoid::Forward(const vector<shared_ptr<Tensor<float>>> &inputs
         }
 
         CHECK(output->shapes() == input->shapes()) << "The output size of hardsigmoid is error";
-        output->set_data(input->data());
-        output->Transform([](float val) {
-            if (val <= -3.f) return 0.f;
-            else if (val >= 3.f) return 1.f;
-            else return val / 6.f + 0.5f;
-        });
+        kernel(input->RawPtr(), const_cast<float *>(output->RawPtr()), output->size());
     }
     return InferStatus::kInferSuccess;
 }
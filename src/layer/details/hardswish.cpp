@@ -1,5 +1,6 @@
 #include "layer/details/hardswish.hpp"
 #include "layer/abstract/layer_factory.hpp"
+#include "layer/details/activation_kernel.hpp"
 
 
 namespace magic_infer 
@@ -19,6 +20,7 @@ InferStatus HardSwishLayer::Forward(const vector<shared_ptr<Tensor<float>>> &inp
         return InferStatus::kInferFailedInputOutSizeAdaptingError;
     }
 
+    const ActivationKernel kernel = ActivationKernelRegistry::Get(ActivationType::kHardSwish);
     const uint32_t batch = inputs.size();
 #pragma omp parallel for num_threads(batch)
     for (uint32_t i = 0; i < batch; ++i) {
@@ -33,12 +35,7 @@ InferStatus HardSwishLayer::Forward(const vector<shared_ptr<Tensor<float>>> &inp
         }
 
         CHECK(output->shapes() == input->shapes()) << "The output size of hardswish is error";
-        output->set_data(input->data());
-        output->Transform([](float val) {
-            if (val <= -3.f) return 0.f;
-            else if (val >= 3.f) return val;
-            else return val * (val + 3) / 6;
-        });
+        kernel(input->RawPtr(), const_cast<float *>(output->RawPtr()), output->size());
     }
     
     return InferStatus::kInferSuccess;
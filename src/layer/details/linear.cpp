@@ -1,6 +1,12 @@
 #include "layer/details/linear.hpp"
 #include "layer/abstract/layer_factory.hpp"
+#include "runtime/runtime_optimizer.hpp"
+#include <cmath>
+#include <cstring>
 #include <glog/logging.h>
+#if __SSE2__
+#include <emmintrin.h>
+#endif
 
 
 namespace magic_infer 
@@ -20,6 +26,375 @@ LinearLayer::LinearLayer(int32_t in_features, int32_t out_features, bool use_bia
 }
 
 
+int32_t LinearLayer::in_features() const { return this->in_features_; }
+int32_t LinearLayer::out_features() const { return this->out_features_; }
+bool LinearLayer::use_bias() const { return this->use_bias_; }
+LinearWeightType LinearLayer::weight_type() const { return this->weight_type_; }
+
+
+void LinearLayer::set_weight_type(LinearWeightType weight_type)
+{
+    lock_guard<mutex> lock(this->packed_mutex_);
+    if (weight_type == this->weight_type_) return;
+
+    CHECK(this->weights_.empty() || this->weights_.front() != nullptr)
+        << "The float weights of linear layer were released after packing, set the weights again before changing the weight type";
+    this->weight_type_ = weight_type;
+    this->half_weights_.clear();
+    this->int8_weights_.clear();
+    this->int8_scales_.clear();
+}
+
+
+void LinearLayer::Configure(const RuntimeLayerOptions &options) { set_weight_type(options.linear_weight_type); }
+
+
+void LinearLayer::set_weights(const vector<float> &weights)
+{
+    LinearLayer::set_weights(weights.data(), weights.size());
+}
+
+
+void LinearLayer::set_weights(const float *weights, uint32_t elem_size)
+{
+    lock_guard<mutex> lock(this->packed_mutex_);
+    // 转换之后释放的float权重重新创建，填充之后下一次Forward重新转换
+    if (this->weights_.size() == 1 && this->weights_.front() == nullptr) {
+        this->weights_.front() = make_shared<Tensor<float>>(1, out_features_, in_features_);
+    }
+    ParamLayer::set_weights(weights, elem_size);
+}
+
+
+void LinearLayer::set_weights(const vector<shared_ptr<Tensor<float>>> &weights)
+{
+    lock_guard<mutex> lock(this->packed_mutex_);
+    ParamLayer::set_weights(weights);
+}
+
+
+/**
+ * 将float转换为fp16，舍入到最近的偶数，超出fp16范围时取最大的有限值
+ * @param value float数值
+ * @return fp16的位模式
+ */
+static uint16_t FloatToHalf(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    const uint16_t sign = (bits >> 16) & 0x8000;
+    const float abs_value = fabsf(value);
+    if (!(abs_value < 65520.f)) return sign | 0x7bff;
+    if (abs_value < 6.103515625e-05f) return sign | uint16_t(lrintf(abs_value * 16777216.f));
+
+    // 去掉低13位尾数时舍入到最近的偶数，再把指数的偏置从127改为15
+    const uint32_t abs_bits = bits & 0x7fffffff;
+    const uint32_t rounded = abs_bits + 0xfff + ((abs_bits >> 13) & 1) - (112u << 23);
+    return sign | uint16_t(rounded >> 13);
+}
+
+
+/**
+ * 将fp16转换为float，尾数和指数左移之后乘以2^112修正指数的偏置，非规格化数同样适用
+ * @param half fp16的位模式，不能是无穷大或者NaN
+ * @return float数值
+ */
+static float HalfToFloat(uint16_t half)
+{
+    const uint32_t bits = uint32_t(half & 0x7fff) << 13;
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    value *= 5.192296858534828e+33f;
+    return half & 0x8000 ? -value : value;
+}
+
+
+#if __SSE2__
+/// 按列主序连续读取4个权重并转换为float
+struct FloatWeightLoader
+{
+    static __m128 Load4(const float *weight) { return _mm_loadu_ps(weight); }
+    static float Load1(const float *weight) { return *weight; }
+};
+
+
+struct HalfWeightLoader
+{
+    static __m128 Load4(const uint16_t *weight)
+    {
+        const __m128i half = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i *) weight), _mm_setzero_si128());
+        const __m128i sign = _mm_slli_epi32(_mm_and_si128(half, _mm_set1_epi32(0x8000)), 16);
+        const __m128i bits = _mm_slli_epi32(_mm_and_si128(half, _mm_set1_epi32(0x7fff)), 13);
+        const __m128 value = _mm_mul_ps(_mm_castsi128_ps(bits), _mm_castsi128_ps(_mm_set1_epi32(0x77800000)));
+        return _mm_or_ps(value, _mm_castsi128_ps(sign));
+    }
+    static float Load1(const uint16_t *weight) { return HalfToFloat(*weight); }
+};
+
+
+struct Int8WeightLoader
+{
+    static __m128 Load4(const int8_t *weight)
+    {
+        int32_t packed;
+        memcpy(&packed, weight, sizeof(packed));
+        // 复制到高位之后算术右移，完成符号扩展
+        const __m128i bytes = _mm_cvtsi32_si128(packed);
+        const __m128i words = _mm_unpacklo_epi8(bytes, bytes);
+        const __m128i dwords = _mm_srai_epi32(_mm_unpacklo_epi16(words, words), 24);
+        return _mm_cvtepi32_ps(dwords);
+    }
+    static float Load1(const int8_t *weight) { return float(*weight); }
+};
+#else
+struct FloatWeightLoader
+{
+    static float Load1(const float *weight) { return *weight; }
+};
+
+
+struct HalfWeightLoader
+{
+    static float Load1(const uint16_t *weight) { return HalfToFloat(*weight); }
+};
+
+
+struct Int8WeightLoader
+{
+    static float Load1(const int8_t *weight) { return float(*weight); }
+};
+#endif
+
+
+/// GEMV每次处理的输出行数，一块的累加结果留在L1中，每一列权重在块内连续读取
+static const uint32_t kGemvRowBlock = 256;
+
+/// GEMV的乘加次数少于该值时不并行
+static const size_t kGemvParallelSize = 1 << 16;
+
+/// 低精度权重做GEMM时每次累加的输入列数，读取的每个权重在这些列之间复用
+static const uint32_t kGemmColumnBlock = 4;
+
+
+/**
+ * 计算output[row_begin, row_end) = scales * (weight * input) + bias，每次读取4列权重，累加结果按向量留在寄存器中
+ * @param weight 权重，按列主序存放out_features * in_features个元素
+ * @param out_features 输出的行数
+ * @param in_features 输入的长度
+ * @param input 输入向量
+ * @param scales 每一行的缩放系数，为空时不缩放
+ * @param bias 偏置，为空时没有偏置
+ * @param row_begin 起始行
+ * @param row_end 结束行
+ * @param output 输出向量
+ */
+template<class Loader, class T>
+static void GemvBlock(const T *weight, uint32_t out_features, uint32_t in_features, const float *input, const float *scales,
+    const float *bias, uint32_t row_begin, uint32_t row_end, float *output)
+{
+    for (uint32_t o = row_begin; o < row_end; ++o) {
+        output[o] = 0.f;
+    }
+
+    uint32_t i = 0;
+    for (; i + 4 <= in_features; i += 4) {
+        const T *weight0 = weight + size_t(i) * out_features;
+        const T *weight1 = weight0 + out_features;
+        const T *weight2 = weight1 + out_features;
+        const T *weight3 = weight2 + out_features;
+        uint32_t o = row_begin;
+#if __SSE2__
+        const __m128 input0 = _mm_set1_ps(input[i]);
+        const __m128 input1 = _mm_set1_ps(input[i + 1]);
+        const __m128 input2 = _mm_set1_ps(input[i + 2]);
+        const __m128 input3 = _mm_set1_ps(input[i + 3]);
+        for (; o + 4 <= row_end; o += 4) {
+            __m128 sum = _mm_add_ps(_mm_mul_ps(Loader::Load4(weight0 + o), input0), _mm_mul_ps(Loader::Load4(weight1 + o), input1));
+            sum = _mm_add_ps(sum, _mm_add_ps(_mm_mul_ps(Loader::Load4(weight2 + o), input2), _mm_mul_ps(Loader::Load4(weight3 + o), input3)));
+            _mm_storeu_ps(output + o, _mm_add_ps(_mm_loadu_ps(output + o), sum));
+        }
+#endif
+        for (; o < row_end; ++o) {
+            output[o] += Loader::Load1(weight0 + o) * input[i] + Loader::Load1(weight1 + o) * input[i + 1] +
+                Loader::Load1(weight2 + o) * input[i + 2] + Loader::Load1(weight3 + o) * input[i + 3];
+        }
+    }
+    for (; i < in_features; ++i) {
+        const T *weight_col = weight + size_t(i) * out_features;
+        for (uint32_t o = row_begin; o < row_end; ++o) {
+            output[o] += Loader::Load1(weight_col + o) * input[i];
+        }
+    }
+
+    for (uint32_t o = row_begin; o < row_end; ++o) {
+        output[o] = output[o] * (scales ? scales[o] : 1.f) + (bias ? bias[o] : 0.f);
+    }
+}
+
+
+/**
+ * 按行分块计算GEMV，各块之间并行
+ */
+template<class Loader, class T>
+static void Gemv(const T *weight, uint32_t out_features, uint32_t in_features, const float *input, const float *scales,
+    const float *bias, float *output)
+{
+    const uint32_t blocks = (out_features + kGemvRowBlock - 1) / kGemvRowBlock;
+#pragma omp parallel for schedule(static) if(size_t(out_features) * in_features >= kGemvParallelSize && blocks > 1)
+    for (uint32_t block = 0; block < blocks; ++block) {
+        const uint32_t row_begin = block * kGemvRowBlock;
+        const uint32_t row_end = min(row_begin + kGemvRowBlock, out_features);
+        GemvBlock<Loader>(weight, out_features, in_features, input, scales, bias, row_begin, row_end, output);
+    }
+}
+
+
+/**
+ * 计算output[row_begin, row_end)的columns列 = scales * (weight * input) + bias，直接从低精度权重累加，
+ * 读取并转换的每个权重供所有列使用，累加结果留在L1中
+ * @param input 输入矩阵，按列主序存放in_features * columns个元素
+ * @param columns 输入的列数，不超过kGemmColumnBlock
+ * @param output 输出矩阵，按列主序存放out_features * columns个元素
+ */
+template<class Loader, class T>
+static void GemmBlock(const T *weight, uint32_t out_features, uint32_t in_features, const float *input, uint32_t columns,
+    const float *scales, const float *bias, uint32_t row_begin, uint32_t row_end, float *output)
+{
+    for (uint32_t c = 0; c < columns; ++c) {
+        float *output_col = output + size_t(c) * out_features;
+        for (uint32_t o = row_begin; o < row_end; ++o) {
+            output_col[o] = 0.f;
+        }
+    }
+
+    for (uint32_t i = 0; i < in_features; ++i) {
+        const T *weight_col = weight + size_t(i) * out_features;
+        uint32_t o = row_begin;
+#if __SSE2__
+        for (; o + 4 <= row_end; o += 4) {
+            const __m128 weight4 = Loader::Load4(weight_col + o);
+            for (uint32_t c = 0; c < columns; ++c) {
+                float *output_col = output + size_t(c) * out_features + o;
+                const __m128 input1 = _mm_set1_ps(input[size_t(c) * in_features + i]);
+                _mm_storeu_ps(output_col, _mm_add_ps(_mm_loadu_ps(output_col), _mm_mul_ps(weight4, input1)));
+            }
+        }
+#endif
+        for (; o < row_end; ++o) {
+            const float weight1 = Loader::Load1(weight_col + o);
+            for (uint32_t c = 0; c < columns; ++c) {
+                output[size_t(c) * out_features + o] += weight1 * input[size_t(c) * in_features + i];
+            }
+        }
+    }
+
+    for (uint32_t c = 0; c < columns; ++c) {
+        float *output_col = output + size_t(c) * out_features;
+        for (uint32_t o = row_begin; o < row_end; ++o) {
+            output_col[o] = output_col[o] * (scales ? scales[o] : 1.f) + (bias ? bias[o] : 0.f);
+        }
+    }
+}
+
+
+/**
+ * 按输出行和输入列分块计算低精度权重的GEMM，各块之间并行
+ */
+template<class Loader, class T>
+static void Gemm(const T *weight, uint32_t out_features, uint32_t in_features, const float *input, uint32_t columns,
+    const float *scales, const float *bias, float *output)
+{
+    const uint32_t row_blocks = (out_features + kGemvRowBlock - 1) / kGemvRowBlock;
+    const uint32_t column_blocks = (columns + kGemmColumnBlock - 1) / kGemmColumnBlock;
+    const uint32_t blocks = row_blocks * column_blocks;
+#pragma omp parallel for schedule(static) if(size_t(out_features) * in_features * columns >= kGemvParallelSize && blocks > 1)
+    for (uint32_t block = 0; block < blocks; ++block) {
+        const uint32_t row_begin = (block % row_blocks) * kGemvRowBlock;
+        const uint32_t row_end = min(row_begin + kGemvRowBlock, out_features);
+        const uint32_t column_begin = (block / row_blocks) * kGemmColumnBlock;
+        const uint32_t block_columns = min(kGemmColumnBlock, columns - column_begin);
+        GemmBlock<Loader>(weight, out_features, in_features, input + size_t(column_begin) * in_features, block_columns, scales, bias,
+            row_begin, row_end, output + size_t(column_begin) * out_features);
+    }
+}
+
+
+void LinearLayer::PrepareWeights()
+{
+    lock_guard<mutex> lock(this->packed_mutex_);
+    if (this->weight_type_ == LinearWeightType::kFloat32 || this->weights_.front() == nullptr) return;
+
+    const float *weight = this->weights_.front()->RawPtr();
+
+    const uint32_t out_features = out_features_;
+    const size_t weight_size = size_t(out_features_) * in_features_;
+    if (this->weight_type_ == LinearWeightType::kFloat16) {
+        this->half_weights_.resize(weight_size);
+        for (size_t i = 0; i < weight_size; ++i) {
+            this->half_weights_.at(i) = FloatToHalf(weight[i]);
+        }
+    } else {
+        // 每个输出通道按绝对值的最大值对称量化到[-127, 127]
+        this->int8_scales_.assign(out_features, 0.f);
+        for (size_t i = 0; i < weight_size; ++i) {
+            float &scale = this->int8_scales_.at(i % out_features);
+            scale = max(scale, fabsf(weight[i]));
+        }
+        for (float &scale : this->int8_scales_) {
+            scale /= 127.f;
+        }
+
+        this->int8_weights_.resize(weight_size);
+        for (size_t i = 0; i < weight_size; ++i) {
+            const float scale = this->int8_scales_.at(i % out_features);
+            this->int8_weights_.at(i) = scale > 0.f ? int8_t(lrintf(weight[i] / scale)) : int8_t(0);
+        }
+    }
+    // Forward只读取转换之后的权重，释放float权重，和其他Layer共享时由最后一个引用者释放
+    this->weights_.front().reset();
+}
+
+
+void LinearLayer::MatMul(const float *input, uint32_t columns, float *output) const
+{
+    const float *bias = use_bias_ ? this->bias_.front()->RawPtr() : nullptr;
+    const uint32_t out_features = out_features_;
+    const uint32_t in_features = in_features_;
+
+    if (columns == 1) {
+        if (this->weight_type_ == LinearWeightType::kFloat16) {
+            Gemv<HalfWeightLoader>(this->half_weights_.data(), out_features, in_features, input, nullptr, bias, output);
+        } else if (this->weight_type_ == LinearWeightType::kInt8) {
+            Gemv<Int8WeightLoader>(this->int8_weights_.data(), out_features, in_features, input, this->int8_scales_.data(), bias, output);
+        } else {
+            Gemv<FloatWeightLoader>(this->weights_.front()->RawPtr(), out_features, in_features, input, nullptr, bias, output);
+        }
+        return;
+    }
+
+    // 低精度权重直接累加，不转换为float
+    if (this->weight_type_ == LinearWeightType::kFloat16) {
+        Gemm<HalfWeightLoader>(this->half_weights_.data(), out_features, in_features, input, columns, nullptr, bias, output);
+        return;
+    } else if (this->weight_type_ == LinearWeightType::kInt8) {
+        Gemm<Int8WeightLoader>(this->int8_weights_.data(), out_features, in_features, input, columns, this->int8_scales_.data(), bias, output);
+        return;
+    }
+
+    const arma::fmat input_data(const_cast<float *>(input), in_features, columns, false, true);
+    arma::fmat output_data(output, out_features, columns, false, true);
+    output_data = arma::fmat(const_cast<float *>(this->weights_.front()->RawPtr()), out_features, in_features, false, true) * input_data;
+    if (bias) {
+        for (uint32_t c = 0; c < columns; ++c) {
+            float *output_col = output_data.colptr(c);
+            for (uint32_t o = 0; o < out_features; ++o) {
+                output_col[o] += bias[o];
+            }
+        }
+    }
+}
+
+
 InferStatus LinearLayer::Forward(const vector<shared_ptr<Tensor<float>>> &inputs, vector<shared_ptr<Tensor<float>>> &outputs) 
 {
     if (inputs.empty()) {
@@ -37,8 +412,8 @@ InferStatus LinearLayer::Forward(const vector<shared_ptr<Tensor<float>>> &inputs
         return InferStatus::kInferFailedWeightParameterError;
     } else {
         if (this->use_bias_ && this->weights_.size() != this->bias_.size()) {
-            return InferStatus::kInferFailedBiasParameterError;
             LOG(ERROR) << "The size of the weight and bias parameters is not equal";
+            return InferStatus::kInferFailedBiasParameterError;
         }
     }
 
@@ -52,46 +427,55 @@ InferStatus LinearLayer::Forward(const vector<shared_ptr<Tensor<float>>> &inputs
         return InferStatus::kInferFailedBiasParameterError;
     }
 
-    uint32_t batch = inputs.size();
-    const shared_ptr<Tensor<float>> &weight = weights_.front();
-#pragma omp parallel for num_threads(batch)
+    if (use_bias_) {
+        const shared_ptr<Tensor<float>> &bias = this->bias_.front();
+        CHECK(bias != nullptr && bias->size() == uint32_t(out_features_)) << "The size of bias is not equal to the out features";
+    }
+
+    const uint32_t batch = inputs.size();
+    uint32_t input_dim = 0;
+    bool same_dim = true;
     for (uint32_t i = 0; i < batch; ++i) {
         const shared_ptr<Tensor<float>> &input = inputs.at(i);
+        CHECK(input != nullptr && !input->empty()) << "The input feature map of linear layer is empty";
         const vector<uint32_t> &raw_shapes = input->raw_shapes();
         CHECK(raw_shapes.size() == 2);
-        const uint32_t feature_dims = raw_shapes.at(0);
-        arma::fmat weight_data(weight->data().memptr(), out_features_, in_features_);
-        CHECK(weight_data.n_rows == out_features_);
-        CHECK(weight_data.n_cols == feature_dims && feature_dims == in_features_);
-        const uint32_t input_dim = raw_shapes.at(1);
-
-        arma::fmat col_vec(input->data().memptr(), in_features_, input_dim);
-        arma::fmat result = (weight_data * col_vec);
-
-        if (use_bias_) {
-            CHECK(!this->bias_.empty() && this->bias_.size() == 1);
-            const auto &bias_cube = this->bias_.front();
-            CHECK(!bias_cube->empty());
-
-            const auto &bias_data = bias_cube->data();
-            CHECK(bias_data.n_slices == 1);
-            CHECK(bias_data.n_rows == out_features_);
-            result += bias_data.slice(0);
-        }
+        CHECK(raw_shapes.at(0) == uint32_t(in_features_)) << "The feature dims of input is not equal to the in features";
+        same_dim = same_dim && (i == 0 || raw_shapes.at(1) == input_dim);
+        input_dim = raw_shapes.at(1);
 
         shared_ptr<Tensor<float>> output = outputs.at(i);
         if (output == nullptr || output->empty()) {
-            output = make_shared<Tensor<float>>(1, out_features_, input_dim);
+            output = make_shared<Tensor<float>>(1, out_features_, raw_shapes.at(1));
             outputs.at(i) = output;
         }
 
-        CHECK(output->channels() == 1 && output->rows() == out_features_ && output->cols() == input_dim);
+        CHECK(output->channels() == 1 && output->rows() == out_features_ && output->cols() == raw_shapes.at(1));
         const auto &output_raw_shapes = output->raw_shapes();
         CHECK(output_raw_shapes.size() == 2);
-        CHECK(output_raw_shapes.at(0) == out_features_ && output_raw_shapes.at(1) == input_dim);
-        output->at(0) = move(result);
+        CHECK(output_raw_shapes.at(0) == out_features_ && output_raw_shapes.at(1) == raw_shapes.at(1));
+    }
+    PrepareWeights();
+
+    // 每个样本按列主序存放in_features * input_dim个元素，整个batch拼成一个矩阵之后只读一遍权重
+    if (batch == 1 || !same_dim) {
+        for (uint32_t i = 0; i < batch; ++i) {
+            MatMul(inputs.at(i)->RawPtr(), inputs.at(i)->cols(), outputs.at(i)->data().memptr());
+        }
+        return InferStatus::kInferSuccess;
+    }
+
+    const size_t input_size = size_t(in_features_) * input_dim;
+    const size_t output_size = size_t(out_features_) * input_dim;
+    vector<float> batch_input(input_size * batch);
+    vector<float> batch_output(output_size * batch);
+    for (uint32_t i = 0; i < batch; ++i) {
+        memcpy(batch_input.data() + i * input_size, inputs.at(i)->RawPtr(), input_size * sizeof(float));
+    }
+    MatMul(batch_input.data(), input_dim * batch, batch_output.data());
+    for (uint32_t i = 0; i < batch; ++i) {
+        memcpy(outputs.at(i)->data().memptr(), batch_output.data() + i * output_size, output_size * sizeof(float));
     }
-    
     return InferStatus::kInferSuccess;
 }
 
@@ -134,17 +518,32 @@ ParseParameterAttrStatus LinearLayer::GetInstance(const shared_ptr<RuntimeOperat
     int32_t in_features = shapes.at(1);
     const bool use_bias = use_bias_param->value;
     
-    linear_layer = make_shared<LinearLayer>(in_features, out_features, use_bias);
+    const shared_ptr<LinearLayer> &layer = make_shared<LinearLayer>(in_features, out_features, use_bias);
+    linear_layer = layer;
+    // 原生模型文件中的权重和偏移量已经按打包格式保存，由加载器设置
+    if (op->prepacked_weights) return ParseParameterAttrStatus::kParameterAttrParseSuccess;
+
     if (use_bias) {
-        linear_layer->set_bias(bias->get<float>());
+        if (bias->raw_size() == 0) {
+            LOG(ERROR) << "The bias attribute has no data";
+            return ParseParameterAttrStatus::kAttrMissingBias;
+        }
+        const RuntimeAttributeSpan<float> &bias_values = bias->span<float>();
+        linear_layer->set_bias(bias_values.data, bias_values.size);
     }
 
-    // load weights
-    linear_layer->set_weights(weight->get<float>());
+    // load weights，直接从权重文件的映射中读取
+    if (weight->raw_size() == 0) {
+        LOG(ERROR) << "The weight attribute has no data";
+        return ParseParameterAttrStatus::kAttrMissingWeight;
+    }
+    const RuntimeAttributeSpan<float> &weight_values = weight->span<float>();
+    linear_layer->set_weights(weight_values.data, weight_values.size);
     return ParseParameterAttrStatus::kParameterAttrParseSuccess;
 }
 
 
 LayerRegistererWrapper kLinearGetInstance("nn.Linear", LinearLayer::GetInstance);
+FlopsEstimatorRegistererWrapper kLinearFlops("nn.Linear", RuntimeGraphOptimizer::EstimateWeightFlops);
 
 }
@@ -1,21 +1,245 @@
 #include "layer/details/maxpooling.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#if __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include "runtime/runtime_ir.hpp"
 #include "layer/abstract/layer_factory.hpp"
+#include "runtime/runtime_optimizer.hpp"
 
 
 namespace magic_infer 
 {
 
+/// 步长为1时使用van Herk算法的最小池化窗口，更小的窗口直接比较。列之间按向量比较，列之内逐个元素比较，
+/// 列之内直接比较也能按4个输出一组向量化，所以要更大的窗口才值得使用van Herk算法
+static const uint32_t kColumnVanHerkMinKernel = 4;
+static const uint32_t kRowVanHerkMinKernel = 9;
+
+
+/**
+ * 逐元素取最大值，output可以和a或b相同
+ * @param a 第一个输入
+ * @param b 第二个输入
+ * @param output 输出
+ * @param size 元素个数
+ */
+static void MaxVector(const float *a, const float *b, float *output, uint32_t size)
+{
+    uint32_t i = 0;
+#if __SSE2__
+    for (; i + 4 <= size; i += 4) {
+        _mm_storeu_ps(output + i, _mm_max_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    }
+#endif
+    for (; i < size; ++i) {
+        output[i] = max(a[i], b[i]);
+    }
+}
+
+
+/**
+ * 在列之间取最大值，第j个输出列是填充之后第j * stride到j * stride + kernel - 1列的最大值
+ * @param columns 返回填充之后第p列的起始地址，填充列的元素都是最小值
+ * @param padded_w 填充之后的列数
+ * @param rows 每一列的元素个数
+ * @param kernel 池化窗口的宽
+ * @param stride 步长
+ * @param output 输出的起始地址，第j个输出列从output + j * output_stride开始
+ * @param output_w 输出的列数
+ * @param output_stride 相邻输出列之间的距离
+ * @param suffix_max van Herk算法中每一列到所在块末尾的最大值，padded_w * rows个元素
+ * @param prefix_max van Herk算法中块起始到当前列的最大值，rows个元素
+ */
+template<typename ColumnFunc>
+static void PoolColumns(const ColumnFunc &columns, uint32_t padded_w, uint32_t rows, uint32_t kernel, uint32_t stride,
+    float *output, uint32_t output_w, uint32_t output_stride, float *suffix_max, float *prefix_max)
+{
+    if (stride != 1 || kernel < kColumnVanHerkMinKernel) {
+        for (uint32_t j = 0; j < output_w; ++j) {
+            float *output_col = output + j * output_stride;
+            memcpy(output_col, columns(j * stride), rows * sizeof(float));
+            for (uint32_t k = 1; k < kernel; ++k) {
+                MaxVector(output_col, columns(j * stride + k), output_col, rows);
+            }
+        }
+        return;
+    }
+
+    // van Herk / Gil-Werman：按kernel列分块，窗口[j, j + kernel)最多跨过一个块的边界，
+    // 它的最大值是第j列到块末尾的最大值和块起始到第j + kernel - 1列的最大值中的较大者，每个输出只需要3次比较
+    for (uint32_t begin = 0; begin < padded_w; begin += kernel) {
+        const uint32_t end = min(begin + kernel, padded_w) - 1;
+        memcpy(suffix_max + end * rows, columns(end), rows * sizeof(float));
+        for (uint32_t p = end; p > begin; --p) {
+            MaxVector(columns(p - 1), suffix_max + p * rows, suffix_max + (p - 1) * rows, rows);
+        }
+    }
+
+    for (uint32_t p = 0, offset = 0; p < padded_w; ++p, ++offset) {
+        if (offset == kernel) offset = 0;
+        if (offset == 0) {
+            memcpy(prefix_max, columns(p), rows * sizeof(float));
+        } else {
+            MaxVector(prefix_max, columns(p), prefix_max, rows);
+        }
+
+        if (p + 1 >= kernel) {
+            const uint32_t j = p + 1 - kernel;
+            MaxVector(suffix_max + j * rows, prefix_max, output + j * output_stride, rows);
+        }
+    }
+}
+
+
+/**
+ * 在一列之内取最大值，第i个输出是填充之后第i * stride到i * stride + kernel - 1个元素的最大值
+ * @param column 填充之后的一列，padded_h个元素
+ * @param padded_h 填充之后的元素个数
+ * @param kernel 池化窗口的高
+ * @param stride 步长
+ * @param output 输出，output_h个元素
+ * @param output_h 输出的元素个数
+ * @param suffix_max van Herk算法中每个元素到所在块末尾的最大值，padded_h个元素
+ */
+static void PoolRows(const float *column, uint32_t padded_h, uint32_t kernel, uint32_t stride, float *output, uint32_t output_h,
+    float *suffix_max)
+{
+    uint32_t i = 0;
+    if (stride == 1 && kernel >= kRowVanHerkMinKernel) {
+        for (uint32_t begin = 0; begin < padded_h; begin += kernel) {
+            const uint32_t end = min(begin + kernel, padded_h) - 1;
+            suffix_max[end] = column[end];
+            for (uint32_t p = end; p > begin; --p) {
+                suffix_max[p - 1] = max(column[p - 1], suffix_max[p]);
+            }
+        }
+
+        float prefix_max = 0.f;
+        for (uint32_t p = 0, offset = 0; p < padded_h; ++p, ++offset) {
+            if (offset == kernel) offset = 0;
+            prefix_max = offset == 0 ? column[p] : max(prefix_max, column[p]);
+            if (p + 1 >= kernel) output[p + 1 - kernel] = max(suffix_max[p + 1 - kernel], prefix_max);
+        }
+        return;
+    }
+
+#if __SSE2__
+    if (stride == 2 && kernel == 2) {
+        // 每次读入8个元素，分成偶数位置和奇数位置两组，两两比较得到4个输出
+        for (; i + 4 <= output_h; i += 4) {
+            const __m128 low = _mm_loadu_ps(column + 2 * i);
+            const __m128 high = _mm_loadu_ps(column + 2 * i + 4);
+            const __m128 even = _mm_shuffle_ps(low, high, _MM_SHUFFLE(2, 0, 2, 0));
+            const __m128 odd = _mm_shuffle_ps(low, high, _MM_SHUFFLE(3, 1, 3, 1));
+            _mm_storeu_ps(output + i, _mm_max_ps(even, odd));
+        }
+
+    } else if (stride == 2 && kernel == 3) {
+        // 第三个元素是下一组的偶数位置，[x8, x2, x4, x6]旋转为[x2, x4, x6, x8]，不读取窗口之外的元素
+        for (; i + 4 <= output_h; i += 4) {
+            const __m128 low = _mm_loadu_ps(column + 2 * i);
+            const __m128 high = _mm_loadu_ps(column + 2 * i + 4);
+            const __m128 even = _mm_shuffle_ps(low, high, _MM_SHUFFLE(2, 0, 2, 0));
+            const __m128 odd = _mm_shuffle_ps(low, high, _MM_SHUFFLE(3, 1, 3, 1));
+            const __m128 next = _mm_move_ss(even, _mm_load_ss(column + 2 * i + 8));
+            const __m128 next_even = _mm_shuffle_ps(next, next, _MM_SHUFFLE(0, 3, 2, 1));
+            _mm_storeu_ps(output + i, _mm_max_ps(_mm_max_ps(even, odd), next_even));
+        }
+
+    } else if (stride == 1) {
+        for (; i + 4 <= output_h; i += 4) {
+            __m128 value = _mm_loadu_ps(column + i);
+            for (uint32_t k = 1; k < kernel; ++k) {
+                value = _mm_max_ps(value, _mm_loadu_ps(column + i + k));
+            }
+            _mm_storeu_ps(output + i, value);
+        }
+    }
+#endif
+
+    for (; i < output_h; ++i) {
+        const float *window = column + i * stride;
+        float value = window[0];
+        for (uint32_t k = 1; k < kernel; ++k) {
+            value = max(value, window[k]);
+        }
+        output[i] = value;
+    }
+}
+
+
 MaxPoolingLayer::MaxPoolingLayer(uint32_t padding_h, uint32_t padding_w, uint32_t pooling_size_h,
     uint32_t pooling_size_w, uint32_t stride_h, uint32_t stride_w)
     : Layer("MaxPooling"), padding_h_(padding_h), padding_w_(padding_w), pooling_size_h_(pooling_size_h),
       pooling_size_w_(pooling_size_w), stride_h_(stride_h), stride_w_(stride_w) {}
 
 
+uint32_t MaxPoolingLayer::OutputHeight(uint32_t input_h) const
+{
+    const uint32_t padded_h = input_h + 2 * padding_h_;
+    if (!stride_h_ || !pooling_size_h_ || padded_h < pooling_size_h_) return 0;
+    return (padded_h - pooling_size_h_) / stride_h_ + 1;
+}
+
+
+uint32_t MaxPoolingLayer::OutputWidth(uint32_t input_w) const
+{
+    const uint32_t padded_w = input_w + 2 * padding_w_;
+    if (!stride_w_ || !pooling_size_w_ || padded_w < pooling_size_w_) return 0;
+    return (padded_w - pooling_size_w_) / stride_w_ + 1;
+}
+
+
+void MaxPoolingLayer::PoolChannel(const float *input, uint32_t input_h, uint32_t input_w, float *output) const
+{
+    const uint32_t padded_h = input_h + 2 * padding_h_;
+    const uint32_t padded_w = input_w + 2 * padding_w_;
+    const uint32_t output_h = OutputHeight(input_h);
+    const uint32_t output_w = OutputWidth(input_w);
+    CHECK(output_h > 0 && output_w > 0) << "The size of the output feature map is less than zero";
+
+    // 列之间的结果按填充之后的高存放，上下的填充行为最小值，列之内直接在其上滑动窗口
+    static thread_local vector<float> workspace;
+    const size_t pooled_size = size_t(output_w) * padded_h;
+    workspace.resize(pooled_size + size_t(padded_w) * input_h + 2 * input_h + padded_h);
+    float *pooled = workspace.data();
+    float *col_suffix_max = pooled + pooled_size;
+    float *col_prefix_max = col_suffix_max + size_t(padded_w) * input_h;
+    float *padding_col = col_prefix_max + input_h;
+    float *row_suffix_max = padding_col + input_h;
+
+    const float lowest = numeric_limits<float>::lowest();
+    fill(padding_col, padding_col + input_h, lowest);
+    if (padding_h_ > 0) {
+        for (uint32_t j = 0; j < output_w; ++j) {
+            float *pooled_col = pooled + j * padded_h;
+            fill(pooled_col, pooled_col + padding_h_, lowest);
+            fill(pooled_col + padding_h_ + input_h, pooled_col + padded_h, lowest);
+        }
+    }
+
+    const uint32_t padding_w = padding_w_;
+    auto columns = [input, input_h, input_w, padding_w, padding_col](uint32_t p) {
+        return p < padding_w || p >= padding_w + input_w ? padding_col : input + (p - padding_w) * input_h;
+    };
+    PoolColumns(columns, padded_w, input_h, pooling_size_w_, stride_w_, pooled + padding_h_, output_w, padded_h,
+        col_suffix_max, col_prefix_max);
+
+    for (uint32_t j = 0; j < output_w; ++j) {
+        PoolRows(pooled + j * padded_h, padded_h, pooling_size_h_, stride_h_, output + j * output_h, output_h, row_suffix_max);
+    }
+}
+
+
 InferStatus MaxPoolingLayer::Forward(const vector<shared_ptr<Tensor<float>>> &inputs, vector<shared_ptr<Tensor<float>>> &outputs) 
 {
     if (inputs.empty()) {
-        LOG(ERROR) << "The input feature map of average pooling layer is empty";
+        LOG(ERROR) << "The input feature map of max pooling layer is empty";
         return InferStatus::kInferFailedInputEmpty;
     }
 
@@ -25,8 +249,6 @@ InferStatus MaxPoolingLayer::Forward(const vector<shared_ptr<Tensor<float>>> &in
     }
 
     const uint32_t batch = inputs.size();
-    const uint32_t pooling_h = pooling_size_h_;
-    const uint32_t pooling_w = pooling_size_w_;
     if (!stride_h_ || !stride_w_) {
         LOG(ERROR) << "The stride parameter is set incorrectly. It must always be greater than 0";
         return InferStatus::kInferFailedStrideParameterError;
@@ -34,39 +256,24 @@ InferStatus MaxPoolingLayer::Forward(const vector<shared_ptr<Tensor<float>>> &in
 
     for (uint32_t i = 0; i < batch; ++i) {
         const shared_ptr<Tensor<float>> &input_data = inputs.at(i);
-        if (input_data->empty()) {
+        if (input_data == nullptr || input_data->empty()) {
+            LOG(ERROR) << "The input feature map of max pooling layer is empty";
             return InferStatus::kInferFailedInputEmpty;
-        } else {
-            uint32_t input_h = input_data->rows();
-            uint32_t input_w = input_data->cols();
-            uint32_t output_h = uint32_t(floor((input_h - pooling_h + 2 * padding_h_) / stride_h_ + 1));
-            uint32_t output_w = uint32_t(floor((input_w - pooling_w + 2 * padding_w_) / stride_w_ + 1));
-            if (!output_w || !output_h) {
-                LOG(ERROR) << "The size of the output feature map is less than zero";
-                return InferStatus::kInferFailedOutputSizeError;
-            }
+        }
+
+        if (!OutputHeight(input_data->rows()) || !OutputWidth(input_data->cols())) {
+            LOG(ERROR) << "The size of the output feature map is less than zero";
+            return InferStatus::kInferFailedOutputSizeError;
         }
     }
 
-#pragma omp parallel for num_threads(batch)
     for (uint32_t i = 0; i < batch; ++i) {
         const shared_ptr<Tensor<float>> &input_data = inputs.at(i);
-        shared_ptr<Tensor<float>> input_data_;
-        CHECK(input_data == nullptr || !input_data->empty()) << "The input feature map of max pooling layer is empty";
-
-        if (padding_h_ > 0 || padding_w_ > 0) {
-            input_data_ = input_data->Clone();
-            input_data_->Padding({padding_h_, padding_h_, padding_w_, padding_w_}, numeric_limits<float>::lowest());
-        } else {
-            input_data_ = input_data;
-        }
-
-        const uint32_t input_h = input_data_->rows();
-        const uint32_t input_w = input_data_->cols();
-        const uint32_t input_c = input_data_->channels();
-
-        const uint32_t output_h = uint32_t(floor((input_h - pooling_h) / stride_h_ + 1));
-        const uint32_t output_w = uint32_t(floor((input_w - pooling_w) / stride_w_ + 1));
+        const uint32_t input_h = input_data->rows();
+        const uint32_t input_w = input_data->cols();
+        const uint32_t input_c = input_data->channels();
+        const uint32_t output_h = OutputHeight(input_h);
+        const uint32_t output_w = OutputWidth(input_w);
 
         shared_ptr<Tensor<float>> output_data = outputs.at(i);
         if (output_data == nullptr || output_data->empty()) {
@@ -77,25 +284,12 @@ InferStatus MaxPoolingLayer::Forward(const vector<shared_ptr<Tensor<float>>> &in
         CHECK(output_data->rows() == output_h && output_data->cols() == output_w && output_data->channels() == input_c) 
             << "The output size of maxpooling is error";
 
+        // 各通道独立池化，按通道并行，batch为1时也能用上所有线程
+        const float *input_ptr = input_data->RawPtr();
+        float *output_ptr = output_data->data().memptr();
+#pragma omp parallel for schedule(static)
         for (uint32_t ic = 0; ic < input_c; ++ic) {
-            const arma::fmat &input_channel = input_data_->at(ic);
-            arma::fmat &output_channel = output_data->at(ic);
-            
-            for (uint32_t c = 0; c < input_w - pooling_w + 1; c += stride_w_) {
-                for (uint32_t r = 0; r < input_h - pooling_h + 1; r += stride_h_) {
-
-                    float *output_channel_ptr = output_channel.colptr(int(c / stride_w_));
-                    float max_value = numeric_limits<float>::lowest();
-                    for (uint32_t w = 0; w < pooling_w; ++w) {
-                        const float *col_ptr = input_channel.colptr(c + w) + r;
-                        for (uint32_t h = 0; h < pooling_h; ++h) {
-                            float current_value = *(col_ptr + h);
-                            max_value = max_value > current_value ? max_value : current_value;
-                        }
-                    }
-                    *(output_channel_ptr + int(r / stride_h_)) = max_value;
-                }
-            }
+            PoolChannel(input_ptr + size_t(ic) * input_h * input_w, input_h, input_w, output_ptr + size_t(ic) * output_h * output_w);
         }
     }
 
@@ -166,6 +360,18 @@ ParseParameterAttrStatus MaxPoolingLayer::GetInstance(const shared_ptr<RuntimeOp
 }
 
 
+/**
+ * 估算最大池化的浮点运算次数，每个输出元素比较一遍池化窗口
+ */
+static uint64_t EstimateMaxPoolingFlops(const shared_ptr<RuntimeOperator> &op, uint64_t output_elements)
+{
+    const auto iter = op->params.find("kernel_size");
+    const auto kernel = iter == op->params.end() ? nullptr : dynamic_cast<RuntimeParameterIntArray *>(iter->second);
+    return kernel ? output_elements * RuntimeGraphOptimizer::ShapeElements(kernel->value) : output_elements;
+}
+
+
 LayerRegistererWrapper kMaxPoolingGetInstance("nn.MaxPool2d", MaxPoolingLayer::GetInstance);
+FlopsEstimatorRegistererWrapper kMaxPoolingFlops("nn.MaxPool2d", EstimateMaxPoolingFlops);
 
 }
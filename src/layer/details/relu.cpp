@@ -1,5 +1,6 @@
 #include "layer/details/relu.hpp"
 #include "layer/abstract/layer_factory.hpp"
+#include "layer/details/activation_kernel.hpp"
 
 
 namespace magic_infer 
@@ -16,6 +17,7 @@ InferStatus ReluLayer::Forward(const vector<shared_ptr<Tensor<float>>> &inputs,
         return InferStatus::kInferFailedInputOutSizeAdaptingError;
     }
 
+    const ActivationKernel kernel = ActivationKernelRegistry::Get(ActivationType::kReLU);
     const uint32_t batch_size = inputs.size();
 #pragma omp parallel for num_threads(batch_size)
     for (uint32_t i = 0; i < batch_size; ++i) {
@@ -30,8 +32,7 @@ InferStatus ReluLayer::Forward(const vector<shared_ptr<Tensor<float>>> &inputs,
         }
         
         CHECK(output->shapes() == input->shapes()) << "The output size of relu is error";
-        output->set_data(input->data());
-        output->Transform([](float val) { return val > 0. ? val : 0.; });
+        kernel(input->RawPtr(), const_cast<float *>(output->RawPtr()), output->size());
     }
 
     return InferStatus::kInferSuccess;
@@ -1,5 +1,6 @@
 #include "layer/details/sigmoid.hpp"
 #include "layer/abstract/layer_factory.hpp"
+#include "layer/details/activation_kernel.hpp"
 #include <glog/logging.h>
 
 
@@ -18,6 +19,7 @@ InferStatus SigmoidLayer::Forward(const vector<shared_ptr<Tensor<float>>> &input
         return InferStatus::kInferFailedInputOutSizeAdaptingError;
     }
 
+    const ActivationKernel kernel = ActivationKernelRegistry::Get(ActivationType::kSigmoid);
     const uint32_t batch_size = inputs.size();
 #pragma omp parallel for num_threads(batch_size)
     for (uint32_t i = 0; i < batch_size; ++i) {
@@ -31,8 +33,7 @@ InferStatus SigmoidLayer::Forward(const vector<shared_ptr<Tensor<float>>> &input
         }
 
         CHECK (output->shapes() == input->shapes()) << "The output size of sigmoid is error";
-        output->set_data(input->data());
-        output->Transform([](const float value) { return 1.f / (1 + expf(-value)); });
+        kernel(input->RawPtr(), const_cast<float *>(output->RawPtr()), output->size());
     }
     
     return InferStatus::kInferSuccess;
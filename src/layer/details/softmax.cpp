@@ -1,14 +1,208 @@
 #include "layer/details/softmax.hpp"
+#include "layer/abstract/layer_factory.hpp"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
 #include <glog/logging.h>
+#if __SSE2__
+#include <emmintrin.h>
+#include "utils/sse_math.hpp"
+#endif
 
 
 namespace magic_infer 
 {
 
-SoftmaxLayer::SoftmaxLayer() : Layer("Softmax") {}
+/// 归一化的元素个数少于该值时不并行，避免线程调度的开销超过计算
+static const size_t kSoftmaxParallelSize = 1 << 14;
 
 
-InferStatus SoftmaxLayer::Forward(const vector<shared_ptr<Tensor<float>>> &inputs, vector<shared_ptr<Tensor<float>>> &outputs) 
+SoftmaxLayer::SoftmaxLayer(int dim, SoftmaxMode mode) : Layer("Softmax"), dim_(dim < 0 ? dim + 4 : dim), mode_(mode)
+{
+    CHECK(dim_ >= 1 && dim_ <= 3) << "Unsupported softmax dim: " << dim;
+}
+
+
+/**
+ * 在线合并最大值和指数和：sum是以max为基准的指数和，合并之后以两者中较大的最大值为基准
+ * @param max 最大值
+ * @param sum 指数和
+ * @param other_max 另一组的最大值
+ * @param other_sum 另一组的指数和
+ */
+static void MergeMaxSum(float &max, float &sum, float other_max, float other_sum)
+{
+    const float new_max = std::max(max, other_max);
+    sum = sum * expf(max - new_max) + other_sum * expf(other_max - new_max);
+    max = new_max;
+}
+
+
+/**
+ * 对一条间隔为stride的数据求最大值和指数和，结果合并到max和sum中
+ * @param input 输入
+ * @param length 元素个数
+ * @param stride 相邻元素之间的间隔
+ * @param max 最大值
+ * @param sum 指数和
+ */
+static void ScalarMaxSum(const float *input, uint32_t length, uint32_t stride, float &max, float &sum)
+{
+    for (uint32_t i = 0; i < length; ++i) {
+        MergeMaxSum(max, sum, input[size_t(i) * stride], 1.f);
+    }
+}
+
+
+/**
+ * 按最大值和指数和写出一条间隔为stride的数据的概率或者对数概率，输出可以和输入相同
+ * @param input 输入
+ * @param length 元素个数
+ * @param stride 相邻元素之间的间隔
+ * @param max 最大值
+ * @param sum 指数和
+ * @param mode 输出概率或者对数概率
+ * @param output 输出
+ */
+static void ScalarWrite(const float *input, uint32_t length, uint32_t stride, float max, float sum, SoftmaxMode mode, float *output)
+{
+    const float scale = 1.f / sum;
+    const float offset = max + logf(sum);
+    for (uint32_t i = 0; i < length; ++i) {
+        const size_t index = size_t(i) * stride;
+        output[index] = mode == SoftmaxMode::kSoftmax ? expf(input[index] - max) * scale : input[index] - offset;
+    }
+}
+
+
+#if __SSE2__
+/**
+ * 用4个向量更新每一路的最大值和指数和，每组只对历史的指数和缩放一次
+ */
+static inline void BlockMaxSum(__m128 x0, __m128 x1, __m128 x2, __m128 x3, __m128 &max4, __m128 &sum4)
+{
+    const __m128 new_max = _mm_max_ps(max4, _mm_max_ps(_mm_max_ps(x0, x1), _mm_max_ps(x2, x3)));
+    __m128 sum = _mm_mul_ps(sum4, exp_ps(_mm_sub_ps(max4, new_max)));
+    sum = _mm_add_ps(sum, _mm_add_ps(exp_ps(_mm_sub_ps(x0, new_max)), exp_ps(_mm_sub_ps(x1, new_max))));
+    sum = _mm_add_ps(sum, _mm_add_ps(exp_ps(_mm_sub_ps(x2, new_max)), exp_ps(_mm_sub_ps(x3, new_max))));
+    max4 = new_max;
+    sum4 = sum;
+}
+
+
+/**
+ * 用1个向量更新每一路的最大值和指数和
+ */
+static inline void VectorMaxSum(__m128 x, __m128 &max4, __m128 &sum4)
+{
+    const __m128 new_max = _mm_max_ps(max4, x);
+    sum4 = _mm_add_ps(_mm_mul_ps(sum4, exp_ps(_mm_sub_ps(max4, new_max))), exp_ps(_mm_sub_ps(x, new_max)));
+    max4 = new_max;
+}
+
+
+/**
+ * 按每一路的最大值和指数和写出4个相邻的概率或者对数概率
+ */
+static inline __m128 VectorWrite(__m128 x, __m128 max4, __m128 scale4, __m128 offset4, SoftmaxMode mode)
+{
+    return mode == SoftmaxMode::kSoftmax ? _mm_mul_ps(exp_ps(_mm_sub_ps(x, max4)), scale4) : _mm_sub_ps(x, offset4);
+}
+#endif
+
+
+/**
+ * 对一条连续的数据做softmax，第一遍读取同时求出最大值和指数和，第二遍写出结果
+ * @param input 输入
+ * @param length 元素个数
+ * @param mode 输出概率或者对数概率
+ * @param output 输出，可以和输入相同
+ */
+static void SoftmaxContiguous(const float *input, uint32_t length, SoftmaxMode mode, float *output)
+{
+    uint32_t i = 0;
+    float max = -FLT_MAX;
+    float sum = 0.f;
+#if __SSE2__
+    if (length >= 16) {
+        __m128 max4 = _mm_set1_ps(-FLT_MAX);
+        __m128 sum4 = _mm_setzero_ps();
+        for (; i + 16 <= length; i += 16) {
+            BlockMaxSum(_mm_loadu_ps(input + i), _mm_loadu_ps(input + i + 4), _mm_loadu_ps(input + i + 8), _mm_loadu_ps(input + i + 12),
+                max4, sum4);
+        }
+        for (; i + 4 <= length; i += 4) {
+            VectorMaxSum(_mm_loadu_ps(input + i), max4, sum4);
+        }
+
+        float lane_max[4];
+        float lane_sum[4];
+        _mm_storeu_ps(lane_max, max4);
+        _mm_storeu_ps(lane_sum, sum4);
+        for (uint32_t lane = 0; lane < 4; ++lane) {
+            MergeMaxSum(max, sum, lane_max[lane], lane_sum[lane]);
+        }
+    }
+#endif
+    ScalarMaxSum(input + i, length - i, 1, max, sum);
+
+    i = 0;
+#if __SSE2__
+    const __m128 max4 = _mm_set1_ps(max);
+    const __m128 scale4 = _mm_set1_ps(1.f / sum);
+    const __m128 offset4 = _mm_set1_ps(max + logf(sum));
+    for (; i + 4 <= length; i += 4) {
+        _mm_storeu_ps(output + i, VectorWrite(_mm_loadu_ps(input + i), max4, scale4, offset4, mode));
+    }
+#endif
+    ScalarWrite(input + i, length - i, 1, max, sum, mode, output + i);
+}
+
+
+/**
+ * 对最多4条相邻的、元素间隔为stride的数据同时做softmax，4条时每一路向量对应一条数据
+ * @param input 第一条数据的输入
+ * @param length 每条数据的元素个数
+ * @param stride 同一条数据中相邻元素之间的间隔
+ * @param lines 数据的条数，不超过4
+ * @param mode 输出概率或者对数概率
+ * @param output 第一条数据的输出，可以和输入相同
+ */
+static void SoftmaxStrided(const float *input, uint32_t length, uint32_t stride, uint32_t lines, SoftmaxMode mode, float *output)
+{
+#if __SSE2__
+    if (lines == 4) {
+        __m128 max4 = _mm_set1_ps(-FLT_MAX);
+        __m128 sum4 = _mm_setzero_ps();
+        uint32_t i = 0;
+        for (; i + 4 <= length; i += 4) {
+            const float *input_ptr = input + size_t(i) * stride;
+            BlockMaxSum(_mm_loadu_ps(input_ptr), _mm_loadu_ps(input_ptr + stride), _mm_loadu_ps(input_ptr + 2 * stride),
+                _mm_loadu_ps(input_ptr + 3 * stride), max4, sum4);
+        }
+        for (; i < length; ++i) {
+            VectorMaxSum(_mm_loadu_ps(input + size_t(i) * stride), max4, sum4);
+        }
+
+        const __m128 scale4 = _mm_div_ps(_mm_set1_ps(1.f), sum4);
+        const __m128 offset4 = _mm_add_ps(max4, log_ps(sum4));
+        for (i = 0; i < length; ++i) {
+            const size_t index = size_t(i) * stride;
+            _mm_storeu_ps(output + index, VectorWrite(_mm_loadu_ps(input + index), max4, scale4, offset4, mode));
+        }
+        return;
+    }
+#endif
+    for (uint32_t line = 0; line < lines; ++line) {
+        float max = -FLT_MAX;
+        float sum = 0.f;
+        ScalarMaxSum(input + line, length, stride, max, sum);
+        ScalarWrite(input + line, length, stride, max, sum, mode, output + line);
+    }
+}
+
+
+InferStatus SoftmaxLayer::Forward(const vector<shared_ptr<Tensor<float>>> &inputs, vector<shared_ptr<Tensor<float>>> &outputs)
 {
     if (inputs.empty()) {
         LOG(ERROR) << "The input feature map of softmax layer is empty";
@@ -21,7 +215,6 @@ InferStatus SoftmaxLayer::Forward(const vector<shared_ptr<Tensor<float>>> &input
     }
 
     const uint32_t batch_size = inputs.size();
-#pragma omp parallel for num_threads(batch_size)
     for (uint32_t i = 0; i < batch_size; ++i) {
         const shared_ptr<Tensor<float>> &input = inputs.at(i);
         CHECK(input != nullptr && !input->empty()) << "The input feature map for softmax layer is empty";
@@ -29,21 +222,156 @@ InferStatus SoftmaxLayer::Forward(const vector<shared_ptr<Tensor<float>>> &input
         shared_ptr<Tensor<float>> output = outputs.at(i);
         if (output == nullptr || output->empty()) {
             output = make_shared<Tensor<float>>(input->shapes());
-            LOG(ERROR) << "The output size of softmax is empty" << "The output size of softmax is error";
             outputs.at(i) = output;
         }
 
         CHECK(input->shapes() == output->shapes()) << "The output size of softmax is error";
 
-        const arma::fcube &input_data = input->data();
-        arma::fcube &output_data = output->data();
-        const float max = input_data.max();
-        const float sum = arma::accu(arma::exp(input_data - max));
-        const float offset = max + logf(sum);
-        output_data = arma::exp(input_data - offset);
+        // 通道内按列主序存放：行方向连续，列方向间隔为行数，通道方向间隔为一个通道的大小
+        const uint32_t channels = input->channels();
+        const uint32_t rows = input->rows();
+        const uint32_t cols = input->cols();
+        const uint32_t plane_size = rows * cols;
+        const float *input_ptr = input->RawPtr();
+        float *output_ptr = output->data().memptr();
+        const bool is_parallel = input->size() >= kSoftmaxParallelSize;
+
+        if (dim_ == 2) {
+            // 每一列是一条连续的数据
+#pragma omp parallel for schedule(static) if(is_parallel)
+            for (uint32_t line = 0; line < channels * cols; ++line) {
+                SoftmaxContiguous(input_ptr + size_t(line) * rows, rows, mode_, output_ptr + size_t(line) * rows);
+            }
+            continue;
+        }
+
+        // 沿通道或者列归一化时，相邻的4条数据在内存中也相邻，每次用向量同时处理4条
+        const uint32_t length = dim_ == 1 ? channels : cols;
+        const uint32_t stride = dim_ == 1 ? plane_size : rows;
+        const uint32_t lines = dim_ == 1 ? plane_size : rows;
+        const uint32_t outer = dim_ == 1 ? 1 : channels;
+        const uint32_t groups = (lines + 3) / 4;
+#pragma omp parallel for schedule(static) if(is_parallel)
+        for (uint32_t task = 0; task < outer * groups; ++task) {
+            const uint32_t o = task / groups;
+            const uint32_t line = task % groups * 4;
+            const size_t offset = size_t(o) * plane_size + line;
+            SoftmaxStrided(input_ptr + offset, length, stride, min(4u, lines - line), mode_, output_ptr + offset);
+        }
     }
 
     return InferStatus::kInferSuccess;
 }
 
+
+vector<pair<uint32_t, float>> SoftmaxLayer::TopK(const float *logits, uint32_t size, uint32_t k)
+{
+    CHECK(logits != nullptr && size > 0) << "The input of softmax top-k is empty";
+    k = min(k, size);
+    if (k == 0) return {};
+
+    // 堆顶是已选出的k个类别中最差的一个，只有更大的输入才需要进堆
+    typedef pair<float, uint32_t> Candidate;
+    auto is_better = [](const Candidate &lhs, const Candidate &rhs) {
+        return lhs.first > rhs.first || (lhs.first == rhs.first && lhs.second < rhs.second);
+    };
+    vector<Candidate> heap;
+    heap.reserve(k);
+    auto select = [&](uint32_t begin, uint32_t end) {
+        for (uint32_t i = begin; i < end; ++i) {
+            if (heap.size() < k) {
+                heap.emplace_back(logits[i], i);
+                push_heap(heap.begin(), heap.end(), is_better);
+            } else if (logits[i] > heap.front().first) {
+                pop_heap(heap.begin(), heap.end(), is_better);
+                heap.back() = {logits[i], i};
+                push_heap(heap.begin(), heap.end(), is_better);
+            }
+        }
+    };
+
+    uint32_t i = 0;
+    float max = -FLT_MAX;
+    float sum = 0.f;
+#if __SSE2__
+    if (size >= 16) {
+        __m128 max4 = _mm_set1_ps(-FLT_MAX);
+        __m128 sum4 = _mm_setzero_ps();
+        for (; i + 16 <= size; i += 16) {
+            const __m128 x0 = _mm_loadu_ps(logits + i);
+            const __m128 x1 = _mm_loadu_ps(logits + i + 4);
+            const __m128 x2 = _mm_loadu_ps(logits + i + 8);
+            const __m128 x3 = _mm_loadu_ps(logits + i + 12);
+            BlockMaxSum(x0, x1, x2, x3, max4, sum4);
+
+            // 只有块内的最大值超过堆顶时才逐个检查这16个输入
+            const __m128 block_max4 = _mm_max_ps(_mm_max_ps(x0, x1), _mm_max_ps(x2, x3));
+            const __m128 block_max2 = _mm_max_ps(block_max4, _mm_movehl_ps(block_max4, block_max4));
+            const float block_max = _mm_cvtss_f32(_mm_max_ss(block_max2, _mm_shuffle_ps(block_max2, block_max2, _MM_SHUFFLE(1, 1, 1, 1))));
+            if (heap.size() < k || block_max > heap.front().first) select(i, i + 16);
+        }
+
+        float lane_max[4];
+        float lane_sum[4];
+        _mm_storeu_ps(lane_max, max4);
+        _mm_storeu_ps(lane_sum, sum4);
+        for (uint32_t lane = 0; lane < 4; ++lane) {
+            MergeMaxSum(max, sum, lane_max[lane], lane_sum[lane]);
+        }
+    }
+#endif
+    ScalarMaxSum(logits + i, size - i, 1, max, sum);
+    select(i, size);
+
+    sort(heap.begin(), heap.end(), is_better);
+    vector<pair<uint32_t, float>> top_k;
+    top_k.reserve(heap.size());
+    for (const Candidate &candidate : heap) {
+        top_k.emplace_back(candidate.second, expf(candidate.first - max) / sum);
+    }
+    return top_k;
+}
+
+
+ParseParameterAttrStatus SoftmaxLayer::GetInstance(const shared_ptr<RuntimeOperator> &op, shared_ptr<Layer> &softmax_layer)
+{
+    CHECK(op != nullptr) << "Softmax operator is nullptr";
+    const auto &params = op->params;
+    if (params.find("dim") == params.end()) {
+        LOG(ERROR) << "Can not find the dim parameter";
+        return ParseParameterAttrStatus::kParameterMissingDim;
+    }
+
+    const auto &dim_param = dynamic_cast<RuntimeParameterInt *>(params.at("dim"));
+    if (dim_param == nullptr) {
+        LOG(ERROR) << "Can not find the dim parameter";
+        return ParseParameterAttrStatus::kParameterMissingDim;
+    }
+
+    // pnnx的dim包含batch维度，二维(batch, features)和三维(batch, rows, cols)的输入在Tensor中从行开始存放
+    int dim = dim_param->value;
+    if (!op->input_operands_seq.empty()) {
+        const int rank = op->input_operands_seq.front()->shapes.size();
+        if (dim < 0) dim += rank;
+        if (dim <= 0 || dim >= rank || rank > 4) {
+            LOG(ERROR) << "Unsupported softmax dim " << dim_param->value << " for the input of rank " << rank;
+            return ParseParameterAttrStatus::kParameterMissingDim;
+        }
+        if (rank == 2 || rank == 3) dim += 1;
+    } else if (dim == 0 || dim < -3 || dim > 3) {
+        LOG(ERROR) << "Unsupported softmax dim " << dim;
+        return ParseParameterAttrStatus::kParameterMissingDim;
+    }
+
+    const bool is_log = op->type == "nn.LogSoftmax" || op->type == "F.log_softmax";
+    softmax_layer = make_shared<SoftmaxLayer>(dim, is_log ? SoftmaxMode::kLogSoftmax : SoftmaxMode::kSoftmax);
+    return ParseParameterAttrStatus::kParameterAttrParseSuccess;
+}
+
+
+LayerRegistererWrapper kSoftmaxGetInstance("nn.Softmax", SoftmaxLayer::GetInstance);
+LayerRegistererWrapper kFunctionalSoftmaxGetInstance("F.softmax", SoftmaxLayer::GetInstance);
+LayerRegistererWrapper kLogSoftmaxGetInstance("nn.LogSoftmax", SoftmaxLayer::GetInstance);
+LayerRegistererWrapper kFunctionalLogSoftmaxGetInstance("F.log_softmax", SoftmaxLayer::GetInstance);
+
 }
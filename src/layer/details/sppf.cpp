@@ -0,0 +1,108 @@
+#include "layer/details/sppf.hpp"
+
+#include <cstring>
+
+#include "runtime/runtime_ir.hpp"
+#include "layer/abstract/layer_factory.hpp"
+#include "runtime/runtime_optimizer.hpp"
+
+
+namespace magic_infer
+{
+
+SPPFLayer::SPPFLayer(shared_ptr<MaxPoolingLayer> pooling_layer) : Layer("SPPF"), pooling_layer_(move(pooling_layer)) {}
+
+
+InferStatus SPPFLayer::Forward(const vector<shared_ptr<Tensor<float>>> &inputs, vector<shared_ptr<Tensor<float>>> &outputs)
+{
+    if (inputs.empty()) {
+        LOG(ERROR) << "The input feature map of sppf layer is empty";
+        return InferStatus::kInferFailedInputEmpty;
+    }
+
+    if (inputs.size() != outputs.size()) {
+        LOG(ERROR) << "The input and output size is not adapting";
+        return InferStatus::kInferFailedInputOutSizeAdaptingError;
+    }
+
+    const uint32_t batch = inputs.size();
+    for (uint32_t i = 0; i < batch; ++i) {
+        const shared_ptr<Tensor<float>> &input_data = inputs.at(i);
+        if (input_data == nullptr || input_data->empty()) {
+            LOG(ERROR) << "The input feature map of sppf layer is empty";
+            return InferStatus::kInferFailedInputEmpty;
+        }
+
+        // 每一级池化的输出都要和输入拼接，大小必须和输入一致
+        if (pooling_layer_->OutputHeight(input_data->rows()) != input_data->rows() ||
+            pooling_layer_->OutputWidth(input_data->cols()) != input_data->cols()) {
+            LOG(ERROR) << "The output size of sppf pooling must be equal to the input size";
+            return InferStatus::kInferFailedOutputSizeError;
+        }
+    }
+
+    for (uint32_t i = 0; i < batch; ++i) {
+        const shared_ptr<Tensor<float>> &input_data = inputs.at(i);
+        const uint32_t rows = input_data->rows();
+        const uint32_t cols = input_data->cols();
+        const uint32_t channels = input_data->channels();
+
+        shared_ptr<Tensor<float>> output_data = outputs.at(i);
+        if (output_data == nullptr || output_data->empty()) {
+            output_data = make_shared<Tensor<float>>(channels * (kPoolingNum + 1), rows, cols);
+            outputs.at(i) = output_data;
+        }
+
+        CHECK(output_data->rows() == rows && output_data->cols() == cols && output_data->channels() == channels * (kPoolingNum + 1))
+            << "The output size of sppf is error";
+
+        // 每个通道的下一级池化直接读取上一级刚写入输出的结果，数据还在缓存中，输入只读取一次
+        const size_t plane_size = size_t(rows) * cols;
+        const size_t group_size = plane_size * channels;
+        const float *input_ptr = input_data->RawPtr();
+        float *output_ptr = output_data->data().memptr();
+#pragma omp parallel for schedule(static)
+        for (uint32_t c = 0; c < channels; ++c) {
+            const float *channel_ptr = input_ptr + c * plane_size;
+            float *pooled_ptr = output_ptr + c * plane_size;
+            memcpy(pooled_ptr, channel_ptr, plane_size * sizeof(float));
+            for (uint32_t k = 0; k < kPoolingNum; ++k) {
+                pooling_layer_->PoolChannel(pooled_ptr, rows, cols, pooled_ptr + group_size);
+                pooled_ptr += group_size;
+            }
+        }
+    }
+
+    return InferStatus::kInferSuccess;
+}
+
+
+ParseParameterAttrStatus SPPFLayer::GetInstance(const shared_ptr<RuntimeOperator> &op, shared_ptr<Layer> &sppf_layer)
+{
+    CHECK(op != nullptr) << "SPPF get instance failed, operator is nullptr";
+
+    // 融合节点保留了最大池化的参数
+    shared_ptr<Layer> pooling_layer;
+    const ParseParameterAttrStatus status = MaxPoolingLayer::GetInstance(op, pooling_layer);
+    if (status != ParseParameterAttrStatus::kParameterAttrParseSuccess) return status;
+
+    sppf_layer = make_shared<SPPFLayer>(dynamic_pointer_cast<MaxPoolingLayer>(pooling_layer));
+    return ParseParameterAttrStatus::kParameterAttrParseSuccess;
+}
+
+
+/**
+ * 估算SPPF的浮点运算次数，三级池化的结果各占输出的四分之一
+ */
+static uint64_t EstimateSPPFFlops(const shared_ptr<RuntimeOperator> &op, uint64_t output_elements)
+{
+    const auto iter = op->params.find("kernel_size");
+    const auto kernel = iter == op->params.end() ? nullptr : dynamic_cast<RuntimeParameterIntArray *>(iter->second);
+    return (kernel ? RuntimeGraphOptimizer::ShapeElements(kernel->value) : 1) * output_elements / 4 * 3;
+}
+
+
+LayerRegistererWrapper kSPPFGetInstance("magic.SPPF", SPPFLayer::GetInstance);
+FlopsEstimatorRegistererWrapper kSPPFFlops("magic.SPPF", EstimateSPPFFlops);
+
+}
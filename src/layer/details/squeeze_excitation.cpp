@@ -0,0 +1,229 @@
+#include "layer/details/squeeze_excitation.hpp"
+
+#include <glog/logging.h>
+#if __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "layer/abstract/layer_factory.hpp"
+#include "runtime/runtime_optimizer.hpp"
+#include "layer/details/adaptive_avgpooling.hpp"
+
+
+namespace magic_infer
+{
+
+/// 缩放的元素个数少于该值时不并行，避免线程调度的开销超过计算
+static const size_t kScaleParallelSize = 1 << 14;
+
+
+SqueezeExcitationLayer::SqueezeExcitationLayer(uint32_t channels, uint32_t squeeze_channels)
+    : ParamLayer("SqueezeExcitation"), channels_(channels), squeeze_channels_(squeeze_channels)
+{
+    for (uint32_t i = 0; i < 2; ++i) {
+        this->weights_.push_back(make_shared<Tensor<float>>(1, 1, squeeze_channels * channels));
+    }
+    this->bias_.push_back(make_shared<Tensor<float>>(1, 1, squeeze_channels));
+    this->bias_.push_back(make_shared<Tensor<float>>(1, 1, channels));
+}
+
+
+/**
+ * 计算两个连续数组的内积，1x1卷积作用在1x1的特征图上就是矩阵的一行和向量的内积
+ * @param lhs 左操作数
+ * @param rhs 右操作数
+ * @param size 元素个数
+ * @return 内积
+ */
+static float DotVector(const float *lhs, const float *rhs, uint32_t size)
+{
+    uint32_t i = 0;
+    float sum = 0.f;
+#if __SSE2__
+    __m128 sum0 = _mm_setzero_ps();
+    __m128 sum1 = _mm_setzero_ps();
+    for (; i + 8 <= size; i += 8) {
+        sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_loadu_ps(lhs + i), _mm_loadu_ps(rhs + i)));
+        sum1 = _mm_add_ps(sum1, _mm_mul_ps(_mm_loadu_ps(lhs + i + 4), _mm_loadu_ps(rhs + i + 4)));
+    }
+    for (; i + 4 <= size; i += 4) {
+        sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_loadu_ps(lhs + i), _mm_loadu_ps(rhs + i)));
+    }
+
+    const __m128 sum4 = _mm_add_ps(sum0, sum1);
+    const __m128 sum2 = _mm_add_ps(sum4, _mm_movehl_ps(sum4, sum4));
+    sum = _mm_cvtss_f32(_mm_add_ss(sum2, _mm_shuffle_ps(sum2, sum2, _MM_SHUFFLE(1, 1, 1, 1))));
+#endif
+    for (; i < size; ++i) {
+        sum += lhs[i] * rhs[i];
+    }
+    return sum;
+}
+
+
+/**
+ * 将连续的size个元素乘以同一个缩放系数
+ * @param input 输入
+ * @param scale 缩放系数
+ * @param size 元素个数
+ * @param output 输出，可以和输入相同
+ */
+static void ScaleVector(const float *input, float scale, uint32_t size, float *output)
+{
+    uint32_t i = 0;
+#if __SSE2__
+    const __m128 scale4 = _mm_set1_ps(scale);
+    for (; i + 8 <= size; i += 8) {
+        _mm_storeu_ps(output + i, _mm_mul_ps(_mm_loadu_ps(input + i), scale4));
+        _mm_storeu_ps(output + i + 4, _mm_mul_ps(_mm_loadu_ps(input + i + 4), scale4));
+    }
+    for (; i + 4 <= size; i += 4) {
+        _mm_storeu_ps(output + i, _mm_mul_ps(_mm_loadu_ps(input + i), scale4));
+    }
+#endif
+    for (; i < size; ++i) {
+        output[i] = input[i] * scale;
+    }
+}
+
+
+InferStatus SqueezeExcitationLayer::Forward(const vector<shared_ptr<Tensor<float>>> &inputs, vector<shared_ptr<Tensor<float>>> &outputs)
+{
+    if (inputs.empty()) {
+        LOG(ERROR) << "The input feature map of squeeze excitation layer is empty";
+        return InferStatus::kInferFailedInputEmpty;
+    }
+
+    if (inputs.size() != outputs.size()) {
+        LOG(ERROR) << "The input and output size is not adapting";
+        return InferStatus::kInferFailedInputOutSizeAdaptingError;
+    }
+
+    if (this->weights_.size() != 2) {
+        LOG(ERROR) << "The size of weight parameters is not two";
+        return InferStatus::kInferFailedWeightParameterError;
+    }
+
+    if (this->bias_.size() != 2) {
+        LOG(ERROR) << "The size of bias parameters is not two";
+        return InferStatus::kInferFailedBiasParameterError;
+    }
+
+    const float *fc1_weight = this->weights_.at(0)->RawPtr();
+    const float *fc2_weight = this->weights_.at(1)->RawPtr();
+    const float *fc1_bias = this->bias_.at(0)->RawPtr();
+    const float *fc2_bias = this->bias_.at(1)->RawPtr();
+
+    vector<float> pooled(channels_);
+    vector<float> squeezed(squeeze_channels_);
+    vector<float> scales(channels_);
+    const uint32_t batch = inputs.size();
+    for (uint32_t i = 0; i < batch; ++i) {
+        const shared_ptr<Tensor<float>> &input = inputs.at(i);
+        if (input == nullptr || input->empty()) {
+            LOG(ERROR) << "The input feature map of squeeze excitation layer is empty";
+            return InferStatus::kInferFailedInputEmpty;
+        }
+
+        if (input->channels() != channels_) {
+            LOG(ERROR) << "The channels of the input feature map is not equal to the squeeze excitation layer";
+            return InferStatus::kInferFailedChannelParameterError;
+        }
+
+        shared_ptr<Tensor<float>> output = outputs.at(i);
+        if (output == nullptr || output->empty()) {
+            output = make_shared<Tensor<float>>(input->channels(), input->rows(), input->cols());
+            outputs.at(i) = output;
+        }
+        CHECK(output->shapes() == input->shapes()) << "The output size of squeeze excitation layer is error";
+
+        // 池化、两个1x1卷积和激活函数都只作用在长度为通道数的数组上
+        const uint32_t plane_size = input->rows() * input->cols();
+        AdaptiveAvgPoolingLayer::GlobalAveragePool(input->RawPtr(), channels_, plane_size, pooled.data());
+        for (uint32_t s = 0; s < squeeze_channels_; ++s) {
+            const float value = fc1_bias[s] + DotVector(fc1_weight + size_t(s) * channels_, pooled.data(), channels_);
+            squeezed.at(s) = max(value, 0.f);
+        }
+        for (uint32_t c = 0; c < channels_; ++c) {
+            const float value = fc2_bias[c] + DotVector(fc2_weight + size_t(c) * squeeze_channels_, squeezed.data(), squeeze_channels_);
+            scales.at(c) = value <= -3.f ? 0.f : (value >= 3.f ? 1.f : value / 6.f + 0.5f);
+        }
+
+        const float *input_ptr = input->RawPtr();
+        float *output_ptr = output->data().memptr();
+#pragma omp parallel for schedule(static) if(size_t(channels_) * plane_size >= kScaleParallelSize)
+        for (uint32_t c = 0; c < channels_; ++c) {
+            ScaleVector(input_ptr + size_t(c) * plane_size, scales.at(c), plane_size, output_ptr + size_t(c) * plane_size);
+        }
+    }
+    return InferStatus::kInferSuccess;
+}
+
+
+ParseParameterAttrStatus SqueezeExcitationLayer::GetInstance(const shared_ptr<RuntimeOperator> &op, shared_ptr<Layer> &se_layer)
+{
+    CHECK(op != nullptr) << "Squeeze excitation operator is nullptr";
+    const auto &attr = op->attribute;
+    for (const char *name : {"fc1.weight", "fc2.weight"}) {
+        if (attr.find(name) == attr.end() || attr.at(name)->shape.size() != 4) {
+            LOG(ERROR) << "Can not find the weight parameter " << name;
+            return ParseParameterAttrStatus::kAttrMissingWeight;
+        }
+    }
+    for (const char *name : {"fc1.bias", "fc2.bias"}) {
+        if (attr.find(name) == attr.end()) {
+            LOG(ERROR) << "Can not find the bias parameter " << name;
+            return ParseParameterAttrStatus::kAttrMissingBias;
+        }
+    }
+
+    // 两个卷积的权重分别是(squeeze, channels, 1, 1)和(channels, squeeze, 1, 1)
+    const vector<int> &fc1_shape = attr.at("fc1.weight")->shape;
+    const vector<int> &fc2_shape = attr.at("fc2.weight")->shape;
+    if (fc1_shape.at(0) <= 0 || fc1_shape.at(1) <= 0 || fc2_shape != vector<int>{fc1_shape.at(1), fc1_shape.at(0), 1, 1}
+        || fc1_shape.at(2) != 1 || fc1_shape.at(3) != 1) {
+        LOG(ERROR) << "The shapes of the squeeze excitation weights are not adapting";
+        return ParseParameterAttrStatus::kAttrMissingWeight;
+    }
+
+    const uint32_t squeeze_channels = fc1_shape.at(0);
+    const uint32_t channels = fc1_shape.at(1);
+    const RuntimeAttributeSpan<float> &fc1_weight = attr.at("fc1.weight")->span<float>();
+    const RuntimeAttributeSpan<float> &fc2_weight = attr.at("fc2.weight")->span<float>();
+    const RuntimeAttributeSpan<float> &fc1_bias = attr.at("fc1.bias")->span<float>();
+    const RuntimeAttributeSpan<float> &fc2_bias = attr.at("fc2.bias")->span<float>();
+    if (fc1_weight.size != squeeze_channels * channels || fc2_weight.size != squeeze_channels * channels) {
+        LOG(ERROR) << "The sizes of the squeeze excitation weights are not adapting";
+        return ParseParameterAttrStatus::kAttrMissingWeight;
+    }
+    if (fc1_bias.size != squeeze_channels || fc2_bias.size != channels) {
+        LOG(ERROR) << "The sizes of the squeeze excitation bias are not adapting";
+        return ParseParameterAttrStatus::kAttrMissingBias;
+    }
+
+    // 四块权重直接从权重文件的映射中读取，内容相同时和其他Layer共享
+    const shared_ptr<SqueezeExcitationLayer> &layer = make_shared<SqueezeExcitationLayer>(channels, squeeze_channels);
+    layer->ShareTensor("fc1.weight", fc1_weight.data, fc1_weight.size, layer->weights_.at(0));
+    layer->ShareTensor("fc2.weight", fc2_weight.data, fc2_weight.size, layer->weights_.at(1));
+    layer->ShareTensor("fc1.bias", fc1_bias.data, fc1_bias.size, layer->bias_.at(0));
+    layer->ShareTensor("fc2.bias", fc2_bias.data, fc2_bias.size, layer->bias_.at(1));
+    se_layer = layer;
+    return ParseParameterAttrStatus::kParameterAttrParseSuccess;
+}
+
+
+/**
+ * 估算SE模块的浮点运算次数，池化和逐通道乘法各读一遍特征图，两个1x1卷积只作用在长度为通道数的数组上
+ */
+static uint64_t EstimateSqueezeExcitationFlops(const shared_ptr<RuntimeOperator> &op, uint64_t output_elements)
+{
+    const auto iter = op->attribute.find("fc1.weight");
+    if (iter == op->attribute.end()) return output_elements;
+    return 2 * output_elements + 4 * RuntimeGraphOptimizer::ShapeElements(iter->second->shape);
+}
+
+
+LayerRegistererWrapper kSqueezeExcitationGetInstance("magic.SqueezeExcitation", SqueezeExcitationLayer::GetInstance);
+FlopsEstimatorRegistererWrapper kSqueezeExcitationFlops("magic.SqueezeExcitation", EstimateSqueezeExcitationFlops);
+
+}
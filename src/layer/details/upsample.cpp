@@ -1,15 +1,189 @@
 #include "layer/details/upsample.hpp"
 #include "layer/abstract/layer_factory.hpp"
+#include <cmath>
+#include <cstring>
+#if __SSE2__
+#include <emmintrin.h>
+#endif
 
 
 namespace magic_infer 
 {
 
-UpSampleLayer::UpSampleLayer(float scale_h, float scale_w, UpSampleMode mode)
-    : Layer("upsample"), scale_h_(scale_h), scale_w_(scale_w), mode_(mode) {}
+UpSampleLayer::UpSampleLayer(float scale_h, float scale_w, UpSampleMode mode, bool align_corners)
+    : Layer("upsample"), scale_h_(scale_h), scale_w_(scale_w), mode_(mode), align_corners_(align_corners) {}
 
 
-InferStatus UpSampleLayer::Forward(const vector<shared_ptr<Tensor<float>>> &inputs, vector<shared_ptr<Tensor<float>>> &outputs) 
+/**
+ * 计算邻近采样时每个输出坐标对应的输入坐标，和原来逐元素的除法结果一致，越界时取最后一个输入
+ * @param input_size 输入的长度
+ * @param output_size 输出的长度
+ * @param scale 放大倍数
+ * @return 每个输出坐标对应的输入坐标
+ */
+static vector<uint32_t> NearestIndex(uint32_t input_size, uint32_t output_size, float scale)
+{
+    vector<uint32_t> index(output_size);
+    for (uint32_t i = 0; i < output_size; ++i) {
+        index.at(i) = min(uint32_t(float(i) / scale), input_size - 1);
+    }
+    return index;
+}
+
+
+/**
+ * 将一列中的每个元素重复scale次，2倍时用向量的交错指令一次写出8个元素
+ * @param input 输入列
+ * @param input_h 输入列的长度
+ * @param scale 重复次数
+ * @param output 输出列，长度为input_h * scale
+ */
+static void RepeatColumn(const float *input, uint32_t input_h, uint32_t scale, float *output)
+{
+    uint32_t h = 0;
+    if (scale == 2) {
+#if __SSE2__
+        for (; h + 4 <= input_h; h += 4) {
+            const __m128 value = _mm_loadu_ps(input + h);
+            _mm_storeu_ps(output + 2 * h, _mm_unpacklo_ps(value, value));
+            _mm_storeu_ps(output + 2 * h + 4, _mm_unpackhi_ps(value, value));
+        }
+#endif
+        for (; h < input_h; ++h) {
+            output[2 * h] = input[h];
+            output[2 * h + 1] = input[h];
+        }
+        return;
+    }
+
+    for (; h < input_h; ++h) {
+        float *output_ptr = output + h * scale;
+        for (uint32_t s = 0; s < scale; ++s) {
+            output_ptr[s] = input[h];
+        }
+    }
+}
+
+
+/**
+ * 对单个通道做邻近采样，相邻的输出列来自同一个输入列时直接复制已经写好的列
+ * @param input 输入通道，按列主序存放
+ * @param input_h 输入的高
+ * @param output 输出通道，按列主序存放
+ * @param output_h 输出的高
+ * @param output_w 输出的宽
+ * @param repeat_h 高度方向的整数放大倍数，不是整数倍时为0
+ * @param src_h 每个输出行对应的输入行
+ * @param src_w 每个输出列对应的输入列
+ */
+static void NearestChannel(const float *input, uint32_t input_h, float *output, uint32_t output_h, uint32_t output_w,
+    uint32_t repeat_h, const vector<uint32_t> &src_h, const vector<uint32_t> &src_w)
+{
+    for (uint32_t w = 0; w < output_w; ++w) {
+        float *output_ptr = output + size_t(w) * output_h;
+        if (w > 0 && src_w.at(w) == src_w.at(w - 1)) {
+            memcpy(output_ptr, output_ptr - output_h, output_h * sizeof(float));
+            continue;
+        }
+
+        const float *input_ptr = input + size_t(src_w.at(w)) * input_h;
+        if (repeat_h > 0) {
+            RepeatColumn(input_ptr, input_h, repeat_h, output_ptr);
+        } else {
+            for (uint32_t h = 0; h < output_h; ++h) {
+                output_ptr[h] = input_ptr[src_h.at(h)];
+            }
+        }
+    }
+}
+
+
+/**
+ * 计算双线性插值时每个输出坐标对应的两个输入坐标和权重，和PyTorch的源坐标计算方式一致
+ * @param input_size 输入的长度
+ * @param output_size 输出的长度
+ * @param scale 放大倍数
+ * @param align_corners 是否对齐四个角上的像素
+ * @param index0 左侧或上侧的输入坐标
+ * @param index1 右侧或下侧的输入坐标
+ * @param lambda index1的权重
+ */
+static void BilinearIndex(uint32_t input_size, uint32_t output_size, float scale, bool align_corners,
+    vector<uint32_t> &index0, vector<uint32_t> &index1, vector<float> &lambda)
+{
+    index0.resize(output_size);
+    index1.resize(output_size);
+    lambda.resize(output_size);
+
+    // align_corners为真时输入和输出的两端对齐，否则按像素中心对齐
+    const float ratio = align_corners ? (output_size > 1 ? float(input_size - 1) / float(output_size - 1) : 0.f) : 1.f / scale;
+    for (uint32_t i = 0; i < output_size; ++i) {
+        const float src = align_corners ? ratio * float(i) : max(ratio * (float(i) + 0.5f) - 0.5f, 0.f);
+        const uint32_t src0 = min(uint32_t(src), input_size - 1);
+        index0.at(i) = src0;
+        index1.at(i) = src0 + (src0 < input_size - 1 ? 1 : 0);
+        lambda.at(i) = min(src - float(src0), 1.f);
+    }
+}
+
+
+/**
+ * 按同一个权重在两列之间插值，output = left + (right - left) * lambda
+ * @param left 左侧的输入列
+ * @param right 右侧的输入列
+ * @param lambda 右侧的权重
+ * @param size 列的长度
+ * @param output 输出列
+ */
+static void BlendColumn(const float *left, const float *right, float lambda, uint32_t size, float *output)
+{
+    uint32_t i = 0;
+#if __SSE2__
+    const __m128 lambda4 = _mm_set1_ps(lambda);
+    for (; i + 4 <= size; i += 4) {
+        const __m128 left4 = _mm_loadu_ps(left + i);
+        _mm_storeu_ps(output + i, _mm_add_ps(left4, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(right + i), left4), lambda4)));
+    }
+#endif
+    for (; i < size; ++i) {
+        output[i] = left[i] + (right[i] - left[i]) * lambda;
+    }
+}
+
+
+/**
+ * 对单个通道做双线性插值，先在宽度方向上对整列向量化插值，再在列内按行插值
+ * @param input 输入通道，按列主序存放
+ * @param input_h 输入的高
+ * @param output 输出通道，按列主序存放
+ * @param output_h 输出的高
+ * @param output_w 输出的宽
+ * @param h0 每个输出行对应的上侧输入行
+ * @param h1 每个输出行对应的下侧输入行
+ * @param lambda_h 下侧输入行的权重
+ * @param w0 每个输出列对应的左侧输入列
+ * @param w1 每个输出列对应的右侧输入列
+ * @param lambda_w 右侧输入列的权重
+ */
+static void BilinearChannel(const float *input, uint32_t input_h, float *output, uint32_t output_h, uint32_t output_w,
+    const vector<uint32_t> &h0, const vector<uint32_t> &h1, const vector<float> &lambda_h,
+    const vector<uint32_t> &w0, const vector<uint32_t> &w1, const vector<float> &lambda_w)
+{
+    thread_local vector<float> column;
+    column.resize(input_h);
+    for (uint32_t w = 0; w < output_w; ++w) {
+        BlendColumn(input + size_t(w0.at(w)) * input_h, input + size_t(w1.at(w)) * input_h, lambda_w.at(w), input_h, column.data());
+
+        float *output_ptr = output + size_t(w) * output_h;
+        for (uint32_t h = 0; h < output_h; ++h) {
+            const float top = column[h0[h]];
+            output_ptr[h] = top + (column[h1[h]] - top) * lambda_h[h];
+        }
+    }
+}
+
+
+InferStatus UpSampleLayer::Forward(const vector<shared_ptr<Tensor<float>>> &inputs, vector<shared_ptr<Tensor<float>>> &outputs)
 {
     if (inputs.empty()) {
         LOG(ERROR) << "The input feature map of upsample layer is empty";
@@ -20,10 +194,8 @@ InferStatus UpSampleLayer::Forward(const vector<shared_ptr<Tensor<float>>> &inpu
         LOG(ERROR) << "The input and output size is not adapting";
         return InferStatus::kInferFailedInputOutSizeAdaptingError;
     }
-    LOG_IF(FATAL, this->mode_ != UpSampleMode::kModeNearest) << "Unsupported upsample mode: " << int(mode_);
 
     const uint32_t batch_size = inputs.size();
-#pragma omp parallel for num_threads(batch_size)
     for (uint32_t i = 0; i < batch_size; ++i) {
         const arma::fcube &input_data = inputs.at(i)->data();
         shared_ptr<Tensor<float>> output = outputs.at(i);
@@ -32,30 +204,43 @@ InferStatus UpSampleLayer::Forward(const vector<shared_ptr<Tensor<float>>> &inpu
             outputs.at(i) = output;
         }
 
-        auto &output_data = output->data();
-        CHECK(output_data.n_rows == input_data.n_rows * scale_h_) << "The height of the feature map is not adapting!";
-        CHECK(output_data.n_cols == input_data.n_cols * scale_w_) << "The width of the feature map is not adapting!";
+        const auto &output_data = output->data();
+        CHECK(output_data.n_rows == uint32_t(input_data.n_rows * scale_h_)) << "The height of the feature map is not adapting!";
+        CHECK(output_data.n_cols == uint32_t(input_data.n_cols * scale_w_)) << "The width of the feature map is not adapting!";
         CHECK(input_data.n_slices == output_data.n_slices) << "The channel of the feature map is not adapting!";
+    }
 
-        const uint32_t channels = input_data.n_slices;
-        for (uint32_t c = 0; c < channels; ++c) {
-            const arma::fmat &input_channel = input_data.slice(c);
-            arma::fmat &output_channel = output_data.slice(c);
-            const uint32_t output_w = output_channel.n_cols;
-            const uint32_t output_h = output_channel.n_rows;
-
-            for (uint32_t w = 0; w < output_w; ++w) {
-                const uint32_t src_w = uint32_t((float) w / this->scale_w_);
-                CHECK(src_w < input_channel.n_cols);
-                float *output_channel_ptr = output_channel.colptr(w);
-                const float *input_channel_ptr = input_channel.colptr(src_w);
-
-                for (uint32_t h = 0; h < output_h; ++h) {
-                    const uint32_t src_h = uint32_t((float) h / this->scale_h_);
-                    CHECK(src_h < input_channel.n_rows);
-                    const float src_value = *(input_channel_ptr + src_h);
-                    *(output_channel_ptr + h) = src_value;
-                }
+    // 源坐标只和输入、输出的大小有关，每个样本计算一次之后所有通道共用
+    for (uint32_t i = 0; i < batch_size; ++i) {
+        const shared_ptr<Tensor<float>> &input = inputs.at(i);
+        const shared_ptr<Tensor<float>> &output = outputs.at(i);
+        const uint32_t channels = input->channels();
+        const uint32_t input_h = input->rows();
+        const uint32_t input_w = input->cols();
+        const uint32_t output_h = output->rows();
+        const uint32_t output_w = output->cols();
+        const float *input_ptr = input->RawPtr();
+        float *output_ptr = output->data().memptr();
+
+        if (this->mode_ == UpSampleMode::kModeNearest) {
+            const vector<uint32_t> &src_h = NearestIndex(input_h, output_h, scale_h_);
+            const vector<uint32_t> &src_w = NearestIndex(input_w, output_w, scale_w_);
+            const bool is_repeat = scale_h_ >= 1.f && scale_h_ == floorf(scale_h_) && output_h == input_h * uint32_t(scale_h_);
+            const uint32_t repeat_h = is_repeat ? uint32_t(scale_h_) : 0;
+#pragma omp parallel for schedule(static) if(channels > 1)
+            for (uint32_t c = 0; c < channels; ++c) {
+                NearestChannel(input_ptr + size_t(c) * input_h * input_w, input_h, output_ptr + size_t(c) * output_h * output_w,
+                    output_h, output_w, repeat_h, src_h, src_w);
+            }
+        } else {
+            vector<uint32_t> h0, h1, w0, w1;
+            vector<float> lambda_h, lambda_w;
+            BilinearIndex(input_h, output_h, scale_h_, align_corners_, h0, h1, lambda_h);
+            BilinearIndex(input_w, output_w, scale_w_, align_corners_, w0, w1, lambda_w);
+#pragma omp parallel for schedule(static) if(channels > 1)
+            for (uint32_t c = 0; c < channels; ++c) {
+                BilinearChannel(input_ptr + size_t(c) * input_h * input_w, input_h, output_ptr + size_t(c) * output_h * output_w,
+                    output_h, output_w, h0, h1, lambda_h, w0, w1, lambda_w);
             }
         }
     }
@@ -64,7 +249,7 @@ InferStatus UpSampleLayer::Forward(const vector<shared_ptr<Tensor<float>>> &inpu
 }
 
 
-ParseParameterAttrStatus UpSampleLayer::GetInstance(const shared_ptr<RuntimeOperator> &op, shared_ptr<Layer> &upsample_layer) 
+ParseParameterAttrStatus UpSampleLayer::GetInstance(const shared_ptr<RuntimeOperator> &op, shared_ptr<Layer> &upsample_layer)
 {
     CHECK(op != nullptr) << "Upsample operator is null";
     const auto &params = op->params;
@@ -74,7 +259,6 @@ ParseParameterAttrStatus UpSampleLayer::GetInstance(const shared_ptr<RuntimeOper
         return ParseParameterAttrStatus::kParameterMissingScale;
     }
 
-    const auto &scale_param = params.at("scale_factor");
     const auto &scales = dynamic_cast<RuntimeParameterFloatArray *>(params.at("scale_factor"));
     if (scales == nullptr) {
         LOG(ERROR) << "Can not find the scale factor parameter";
@@ -88,9 +272,22 @@ ParseParameterAttrStatus UpSampleLayer::GetInstance(const shared_ptr<RuntimeOper
     }
 
     const auto &mode = dynamic_cast<RuntimeParameterString *>(params.at("mode"));
-    CHECK(mode->value == "nearest") << "The mode " << mode->value << " is not supported!";
-    upsample_layer = make_shared<UpSampleLayer>(scales->value.at(0), scales->value.at(1));
-    
+    if (mode == nullptr || (mode->value != "nearest" && mode->value != "bilinear")) {
+        LOG(ERROR) << "The upsample mode " << (mode ? mode->value : string()) << " is not supported";
+        return ParseParameterAttrStatus::kParameterMissingResizeMode;
+    }
+
+    // 邻近采样没有align_corners参数，双线性插值缺省时和PyTorch一样不对齐
+    bool align_corners = false;
+    const auto &align_iter = params.find("align_corners");
+    if (align_iter != params.end()) {
+        const auto &align_param = dynamic_cast<RuntimeParameterBool *>(align_iter->second);
+        align_corners = align_param && align_param->value;
+    }
+
+    const UpSampleMode upsample_mode = mode->value == "nearest" ? UpSampleMode::kModeNearest : UpSampleMode::kModeBilinear;
+    upsample_layer = make_shared<UpSampleLayer>(scales->value.at(0), scales->value.at(1), upsample_mode, align_corners);
+
     return ParseParameterAttrStatus::kParameterAttrParseSuccess;
 }
 
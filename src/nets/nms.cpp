@@ -0,0 +1,205 @@
+#include "nets/nms.hpp"
+#include <algorithm>
+#include <numeric>
+#include <glog/logging.h>
+#if __SSE2__
+#include <emmintrin.h>
+#endif
+
+
+namespace magic_infer
+{
+
+/// 已经保留的框，按分量分别连续存放，便于一次读取4个框
+struct KeptBoxes
+{
+    vector<float> x1;
+    vector<float> y1;
+    vector<float> x2;
+    vector<float> y2;
+    vector<float> areas;
+    vector<float> class_ids;
+
+    void Reserve(size_t size)
+    {
+        for (vector<float> *values : {&x1, &y1, &x2, &y2, &areas, &class_ids}) {
+            values->reserve(size);
+        }
+    }
+
+    void Push(float box_x1, float box_y1, float box_x2, float box_y2, float area, float class_id)
+    {
+        x1.push_back(box_x1);
+        y1.push_back(box_y1);
+        x2.push_back(box_x2);
+        y2.push_back(box_y2);
+        areas.push_back(area);
+        class_ids.push_back(class_id);
+    }
+};
+
+
+/**
+ * 判断候选框是否被某个已经保留的框抑制，IoU > thresh改写为inter > thresh * union，避免除法
+ * @param kept 已经保留的框
+ * @param x1 候选框左上角的x
+ * @param y1 候选框左上角的y
+ * @param x2 候选框右下角的x
+ * @param y2 候选框右下角的y
+ * @param area 候选框的面积
+ * @param class_id 候选框的类别，按类别抑制时和已保留框的类别比较
+ * @param iou_thresh IoU的阈值
+ * @param class_aware 是否只在相同类别之间抑制
+ * @return 是否被抑制
+ */
+static bool Suppressed(const KeptBoxes &kept, float x1, float y1, float x2, float y2, float area, float class_id, float iou_thresh,
+    bool class_aware)
+{
+    const uint32_t size = kept.areas.size();
+    uint32_t i = 0;
+#if __SSE2__
+    const __m128 x1_4 = _mm_set1_ps(x1);
+    const __m128 y1_4 = _mm_set1_ps(y1);
+    const __m128 x2_4 = _mm_set1_ps(x2);
+    const __m128 y2_4 = _mm_set1_ps(y2);
+    const __m128 area4 = _mm_set1_ps(area);
+    const __m128 class4 = _mm_set1_ps(class_id);
+    const __m128 thresh4 = _mm_set1_ps(iou_thresh);
+    const __m128 zero = _mm_setzero_ps();
+    for (; i + 4 <= size; i += 4) {
+        const __m128 inter_w = _mm_max_ps(_mm_sub_ps(_mm_min_ps(x2_4, _mm_loadu_ps(kept.x2.data() + i)),
+            _mm_max_ps(x1_4, _mm_loadu_ps(kept.x1.data() + i))), zero);
+        const __m128 inter_h = _mm_max_ps(_mm_sub_ps(_mm_min_ps(y2_4, _mm_loadu_ps(kept.y2.data() + i)),
+            _mm_max_ps(y1_4, _mm_loadu_ps(kept.y1.data() + i))), zero);
+        const __m128 inter = _mm_mul_ps(inter_w, inter_h);
+        const __m128 unions = _mm_sub_ps(_mm_add_ps(area4, _mm_loadu_ps(kept.areas.data() + i)), inter);
+        __m128 overlap = _mm_cmpgt_ps(inter, _mm_mul_ps(thresh4, unions));
+        if (class_aware) {
+            overlap = _mm_and_ps(overlap, _mm_cmpeq_ps(class4, _mm_loadu_ps(kept.class_ids.data() + i)));
+        }
+        if (_mm_movemask_ps(overlap)) return true;
+    }
+#endif
+    for (; i < size; ++i) {
+        if (class_aware && kept.class_ids[i] != class_id) continue;
+        const float inter_w = max(min(x2, kept.x2[i]) - max(x1, kept.x1[i]), 0.f);
+        const float inter_h = max(min(y2, kept.y2[i]) - max(y1, kept.y1[i]), 0.f);
+        const float inter = inter_w * inter_h;
+        if (inter > iou_thresh * (area + kept.areas[i] - inter)) return true;
+    }
+    return false;
+}
+
+
+/**
+ * 从Detect层的稠密输出中筛选候选框，每一列连续存放，先按目标置信度过滤再计算类别
+ * @param output Detect层稠密输出的一个样本
+ * @param conf_thresh 目标置信度和类别置信度乘积的阈值
+ * @return 候选框
+ */
+static vector<YoloCandidate> DenseCandidates(const Tensor<float> &output, float conf_thresh)
+{
+    CHECK(output.channels() == 1 && output.cols() > 5) << "The output of yolo detect layer is wrong";
+    const arma::fmat &output_data = output.at(0);
+    const uint32_t rows = output.rows();
+    const uint32_t num_classes = output.cols() - 5;
+    const float *objectness = output_data.colptr(4);
+    const float *class_ptr = output_data.colptr(5);
+
+    vector<YoloCandidate> candidates;
+    for (uint32_t r = 0; r < rows; ++r) {
+        if (objectness[r] < conf_thresh) continue;
+
+        int32_t best_class = 0;
+        float best_conf = class_ptr[r];
+        for (uint32_t c = 1; c < num_classes; ++c) {
+            if (class_ptr[size_t(c) * rows + r] > best_conf) {
+                best_conf = class_ptr[size_t(c) * rows + r];
+                best_class = int32_t(c);
+            }
+        }
+
+        const float score = objectness[r] * best_conf;
+        if (score < conf_thresh) continue;
+        YoloCandidate candidate;
+        candidate.x = output_data.at(r, 0);
+        candidate.y = output_data.at(r, 1);
+        candidate.w = output_data.at(r, 2);
+        candidate.h = output_data.at(r, 3);
+        candidate.score = score;
+        candidate.class_id = best_class;
+        candidates.push_back(candidate);
+    }
+    return candidates;
+}
+
+
+NonMaxSuppression::NonMaxSuppression(float iou_thresh, uint32_t top_k, bool class_aware, uint32_t max_candidates)
+    : iou_thresh_(iou_thresh), top_k_(top_k), class_aware_(class_aware), max_candidates_(max_candidates) {}
+
+
+vector<YoloCandidate> NonMaxSuppression::Suppress(const vector<YoloCandidate> &candidates) const
+{
+    // 置信度相同时按原来的顺序，结果和排序算法无关
+    vector<uint32_t> order(candidates.size());
+    iota(order.begin(), order.end(), 0);
+    const auto higher = [&candidates](uint32_t lhs, uint32_t rhs) {
+        const float lhs_score = candidates[lhs].score;
+        const float rhs_score = candidates[rhs].score;
+        return lhs_score > rhs_score || (lhs_score == rhs_score && lhs < rhs);
+    };
+    if (max_candidates_ > 0 && order.size() > max_candidates_) {
+        nth_element(order.begin(), order.begin() + max_candidates_, order.end(), higher);
+        order.resize(max_candidates_);
+    }
+    sort(order.begin(), order.end(), higher);
+
+    vector<YoloCandidate> results;
+    KeptBoxes kept;
+    const size_t capacity = top_k_ > 0 ? min(size_t(top_k_), order.size()) : order.size();
+    kept.Reserve(capacity);
+    results.reserve(capacity);
+    for (const uint32_t index : order) {
+        const YoloCandidate &candidate = candidates[index];
+        const float x1 = candidate.x - candidate.w * 0.5f;
+        const float y1 = candidate.y - candidate.h * 0.5f;
+        const float x2 = candidate.x + candidate.w * 0.5f;
+        const float y2 = candidate.y + candidate.h * 0.5f;
+        const float area = (x2 - x1) * (y2 - y1);
+        const float class_id = float(candidate.class_id);
+        if (Suppressed(kept, x1, y1, x2, y2, area, class_id, iou_thresh_, class_aware_)) continue;
+
+        kept.Push(x1, y1, x2, y2, area, class_id);
+        results.push_back(candidate);
+        if (top_k_ > 0 && results.size() >= top_k_) break;
+    }
+    return results;
+}
+
+
+vector<vector<YoloCandidate>> NonMaxSuppression::Forward(const vector<shared_ptr<Tensor<float>>> &outputs, YoloDecodeMode mode,
+    float conf_thresh) const
+{
+    const uint32_t batch_size = outputs.size();
+    vector<vector<YoloCandidate>> detections(batch_size);
+
+    // 每张图的候选框数量差别很大，动态分配
+#pragma omp parallel for schedule(dynamic)
+    for (uint32_t b = 0; b < batch_size; ++b) {
+        const shared_ptr<Tensor<float>> &output = outputs.at(b);
+        CHECK(output != nullptr && !output->empty()) << "The output of yolo detect layer is empty";
+
+        vector<YoloCandidate> candidates;
+        if (mode == YoloDecodeMode::kDecodeSparse) {
+            candidates = YoloDetectLayer::ReadCandidates(*output);
+            candidates.erase(remove_if(candidates.begin(), candidates.end(),
+                [conf_thresh](const YoloCandidate &candidate) { return candidate.score < conf_thresh; }), candidates.end());
+        } else {
+            candidates = DenseCandidates(*output, conf_thresh);
+        }
+        detections.at(b) = Suppress(candidates);
+    }
+    return detections;
+}
+
+}
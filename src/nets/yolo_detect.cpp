@@ -1,21 +1,195 @@
 #include "nets/yolo_detect.hpp"
 #include "layer/abstract/layer_factory.hpp"
-
+#include "layer/details/activation_kernel.hpp"
+#include <algorithm>
+#include <cmath>
 #if __SSE2__
 #include <emmintrin.h>
-#include "utils/sse_math.hpp"
 #endif
 
 
 namespace magic_infer 
 {
 
+/// 稀疏输出中每个候选框占用的列数，依次是x, y, w, h, score和class_id
+static const uint32_t kCandidateInfo = 6;
+
+
 YoloDetectLayer::YoloDetectLayer(int32_t stages, int32_t num_classes, const vector<float> &strides,
     const vector<arma::fmat> &anchor_grids, const vector<arma::fmat> &grids, const vector<shared_ptr<ConvolutionLayer>> &conv_layers)
     : Layer("yolo"), stages_(stages), num_classes_(num_classes), strides_(strides), anchor_grids_(anchor_grids),
       grids_(grids), conv_layers_(conv_layers) {}
 
 
+void YoloDetectLayer::set_decode_mode(YoloDecodeMode mode, float conf_thresh)
+{
+    CHECK(conf_thresh > 0.f && conf_thresh < 1.f) << "The confidence threshold of yolo detect layer must be in (0, 1): " << conf_thresh;
+    this->decode_mode_ = mode;
+    this->conf_thresh_ = conf_thresh;
+}
+
+
+YoloDecodeMode YoloDetectLayer::decode_mode() const { return this->decode_mode_; }
+float YoloDetectLayer::conf_thresh() const { return this->conf_thresh_; }
+
+void YoloDetectLayer::Configure(const RuntimeLayerOptions &options) { set_decode_mode(options.yolo_decode_mode, options.yolo_conf_thresh); }
+
+
+static float Sigmoid(float value) { return 1.f / (1.f + expf(-value)); }
+
+
+void YoloDetectLayer::DecodeSparse(uint32_t stage, const Tensor<float> &input, vector<YoloCandidate> &candidates) const
+{
+    const uint32_t classes_info = num_classes_ + 5;
+    const uint32_t rows = input.rows();
+    const uint32_t cols = input.cols();
+    const uint32_t plane_size = rows * cols;
+    CHECK(input.channels() % classes_info == 0) << "The channels of yolo detect convolution output is wrong";
+    const uint32_t anchors = input.channels() / classes_info;
+
+    const arma::fmat &grid = this->grids_.at(stage);
+    const arma::fmat &anchor_grid = this->anchor_grids_.at(stage);
+    CHECK(grid.n_rows == anchors * plane_size && anchor_grid.n_rows == anchors * plane_size);
+    const float stride = this->strides_.at(stage);
+
+    // 类别置信度不超过1，目标置信度低于阈值的anchor一定被拒绝，在sigmoid之前比较可以省去所有被拒绝anchor的exp
+    const float logit_thresh = logf(conf_thresh_ / (1.f - conf_thresh_)) - 1e-5f;
+    const float *input_ptr = input.RawPtr();
+    vector<uint32_t> positions;
+    for (uint32_t a = 0; a < anchors; ++a) {
+        const float *anchor_ptr = input_ptr + size_t(a) * classes_info * plane_size;
+        const float *objectness = anchor_ptr + 4 * plane_size;
+
+        positions.clear();
+        uint32_t i = 0;
+#if __SSE2__
+        const __m128 logit_thresh4 = _mm_set1_ps(logit_thresh);
+        for (; i + 4 <= plane_size; i += 4) {
+            const int mask = _mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(objectness + i), logit_thresh4));
+            for (uint32_t k = 0; mask && k < 4; ++k) {
+                if (mask & (1 << k)) positions.push_back(i + k);
+            }
+        }
+#endif
+        for (; i < plane_size; ++i) {
+            if (objectness[i] >= logit_thresh) positions.push_back(i);
+        }
+
+        // 每个通道在内存中按列存放，换成稠密输出中按行展开的顺序
+        for (uint32_t &position : positions) {
+            position = (position % rows) * cols + position / rows;
+        }
+        sort(positions.begin(), positions.end());
+
+        for (const uint32_t position : positions) {
+            const uint32_t offset = (position % cols) * rows + position / cols;
+            const float *class_ptr = anchor_ptr + 5 * plane_size + offset;
+            int32_t best_class = 0;
+            float best_logit = class_ptr[0];
+            for (int32_t c = 1; c < num_classes_; ++c) {
+                if (class_ptr[size_t(c) * plane_size] > best_logit) {
+                    best_logit = class_ptr[size_t(c) * plane_size];
+                    best_class = c;
+                }
+            }
+
+            // sigmoid单调递增，只需要对最大的类别计算一次
+            const float score = Sigmoid(objectness[offset]) * Sigmoid(best_logit);
+            if (score < conf_thresh_) continue;
+
+            const uint32_t row = a * plane_size + position;
+            YoloCandidate candidate;
+            candidate.x = (Sigmoid(anchor_ptr[offset]) * 2.f + grid.at(row, 0)) * stride;
+            candidate.y = (Sigmoid(anchor_ptr[plane_size + offset]) * 2.f + grid.at(row, 1)) * stride;
+            const float w = Sigmoid(anchor_ptr[2 * plane_size + offset]) * 2.f;
+            const float h = Sigmoid(anchor_ptr[3 * plane_size + offset]) * 2.f;
+            candidate.w = w * w * anchor_grid.at(row, 0);
+            candidate.h = h * h * anchor_grid.at(row, 1);
+            candidate.score = score;
+            candidate.class_id = best_class;
+            candidates.push_back(candidate);
+        }
+    }
+}
+
+
+InferStatus YoloDetectLayer::ForwardSparse(const vector<vector<shared_ptr<Tensor<float>>>> &batches, vector<shared_ptr<Tensor<float>>> &outputs)
+{
+    const uint32_t stages = stages_;
+    const uint32_t classes_info = num_classes_ + 5;
+    const uint32_t batch_size = outputs.size();
+    CHECK(classes_info >= kCandidateInfo);
+
+    uint32_t concat_rows = 0;
+    vector<vector<vector<YoloCandidate>>> candidates(stages, vector<vector<YoloCandidate>>(batch_size));
+
+#pragma omp parallel for num_threads(stages) reduction(+:concat_rows)
+    for (uint32_t stage = 0; stage < stages; ++stage) {
+        const vector<shared_ptr<Tensor<float>>> &stage_input = batches.at(stage);
+        CHECK(stage_input.size() == batch_size);
+
+        vector<shared_ptr<Tensor<float>>> stage_output(batch_size);
+        const auto status = this->conv_layers_.at(stage)->Forward(stage_input, stage_output);
+        CHECK(status == InferStatus::kInferSuccess);
+        CHECK(stage_output.size() == batch_size);
+
+#pragma omp parallel for num_threads(batch_size)
+        for (uint32_t b = 0; b < batch_size; ++b) {
+            DecodeSparse(stage, *stage_output.at(b), candidates.at(stage).at(b));
+        }
+        concat_rows += stage_output.front()->size() / classes_info;
+    }
+
+    for (uint32_t b = 0; b < batch_size; ++b) {
+        shared_ptr<Tensor<float>> output = outputs.at(b);
+        if (output == nullptr || output->empty()) {
+            output = make_shared<Tensor<float>>(1, concat_rows, classes_info);
+            outputs.at(b) = output;
+        }
+        CHECK(output->rows() == concat_rows && output->cols() == classes_info) << "The output size of yolo detect layer is error";
+
+        // 只写候选框所在的列，候选框之后的行清空，不保留上一次Forward的结果
+        arma::fmat &output_data = output->at(0);
+        uint32_t row = 0;
+        for (uint32_t stage = 0; stage < stages; ++stage) {
+            for (const YoloCandidate &candidate : candidates.at(stage).at(b)) {
+                output_data.at(row, 0) = candidate.x;
+                output_data.at(row, 1) = candidate.y;
+                output_data.at(row, 2) = candidate.w;
+                output_data.at(row, 3) = candidate.h;
+                output_data.at(row, 4) = candidate.score;
+                output_data.at(row, 5) = float(candidate.class_id);
+                row += 1;
+            }
+        }
+        for (uint32_t col = 0; col < kCandidateInfo; ++col) {
+            float *output_col = output_data.colptr(col);
+            fill(output_col + row, output_col + concat_rows, col == 5 ? -1.f : 0.f);
+        }
+    }
+    return InferStatus::kInferSuccess;
+}
+
+
+vector<YoloCandidate> YoloDetectLayer::ReadCandidates(const Tensor<float> &output)
+{
+    CHECK(output.channels() == 1 && output.cols() >= kCandidateInfo) << "The output of yolo detect layer is not sparse";
+    vector<YoloCandidate> candidates;
+    const arma::fmat &output_data = output.at(0);
+    for (uint32_t row = 0; row < output.rows() && output_data.at(row, 5) >= 0.f; ++row) {
+        YoloCandidate candidate;
+        candidate.x = output_data.at(row, 0);
+        candidate.y = output_data.at(row, 1);
+        candidate.w = output_data.at(row, 2);
+        candidate.h = output_data.at(row, 3);
+        candidate.score = output_data.at(row, 4);
+        candidate.class_id = int32_t(output_data.at(row, 5));
+        candidates.push_back(candidate);
+    }
+    return candidates;
+}
+
+
 InferStatus YoloDetectLayer::Forward(const vector<shared_ptr<Tensor<float>>> &inputs, vector<shared_ptr<Tensor<float>>> &outputs) 
 {
     if (inputs.empty()) {
@@ -39,9 +213,11 @@ InferStatus YoloDetectLayer::Forward(const vector<shared_ptr<Tensor<float>>> &in
         const uint32_t index = i / batch_size;
         batches.at(index).push_back(inputs.at(i));
     }
+    if (decode_mode_ == YoloDecodeMode::kDecodeSparse) return ForwardSparse(batches, outputs);
 
     uint32_t concat_rows = 0;
     vector<shared_ptr<Tensor<float>>> zs(stages);
+    const ActivationKernel sigmoid_kernel = ActivationKernelRegistry::Get(ActivationType::kSigmoid);
 
 #pragma omp parallel for num_threads(stages) reduction(+:concat_rows)
     for (uint32_t stage = 0; stage < stages; ++stage) {
@@ -67,25 +243,8 @@ InferStatus YoloDetectLayer::Forward(const vector<shared_ptr<Tensor<float>>> &in
             input->ReRawView({stages, uint32_t(classes_info), ny * nx});
             const uint32_t size = input->size();
 
-            if (!(size % 4)) {
-#if __SSE2__
-                float *ptr = const_cast<float *>(input->RawPtr());
-                __m128 _one1 = _mm_set1_ps(1.f);
-                __m128 _one2 = _mm_set1_ps(1.f);
-                __m128 _zero = _mm_setzero_ps();
-                const uint32_t packet_size = 4;
-                for (uint32_t j = 0; j + (packet_size - 1) < size; j += packet_size) {
-                    __m128 _p = _mm_load_ps(ptr);
-                    _p = _mm_div_ps(_one1, _mm_add_ps(_one2, exp_ps(_mm_sub_ps(_zero, _p))));
-                    _mm_store_ps(ptr, _p);
-                    ptr += packet_size;
-                }
-#elif
-                input->Transform([](const float value) { return 1.f / (1.f + exp(-value)); });
-#endif
-            } else {
-                input->Transform([](const float value) { return 1.f / (1.f + exp(-value)); });
-            }
+            float *ptr = const_cast<float *>(input->RawPtr());
+            sigmoid_kernel(ptr, ptr, size);
 
             arma::fmat &x_stages = x_stages_tensor->at(b);
             for (uint32_t s = 0; s < stages; ++s) {
@@ -225,7 +384,8 @@ ParseParameterAttrStatus YoloDetectLayer::GetInstance(const shared_ptr<RuntimeOp
         grids.emplace_back(matrix.t());
     }
 
-    yolo_detect_layer = make_shared<YoloDetectLayer>(stages_number, num_classes, strides, anchor_grids, grids, conv_layers);
+    const shared_ptr<YoloDetectLayer> &layer = make_shared<YoloDetectLayer>(stages_number, num_classes, strides, anchor_grids, grids, conv_layers);
+    yolo_detect_layer = layer;
     return ParseParameterAttrStatus::kParameterAttrParseSuccess;
 }
 
@@ -2,6 +2,9 @@
 
 #include <algorithm>
 #include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <map>
 #include <stack>
 #include <utility>
 #include <glog/logging.h>
@@ -10,6 +13,72 @@
 namespace magic_infer 
 {
 
+static const map<string, TokenType> kTokenOperations{
+    {"add", TokenType::TokenAdd}, {"sub", TokenType::TokenSub}, {"mul", TokenType::TokenMul}, {"div", TokenType::TokenDiv},
+    {"pow", TokenType::TokenPow}, {"max", TokenType::TokenMax}, {"min", TokenType::TokenMin},
+    {"floor_divide", TokenType::TokenFloorDivide}, {"remainder", TokenType::TokenRemainder}, {"atan2", TokenType::TokenAtan2},
+    {"neg", TokenType::TokenNeg}, {"abs", TokenType::TokenAbs}, {"sqrt", TokenType::TokenSqrt}, {"rsqrt", TokenType::TokenRsqrt},
+    {"square", TokenType::TokenSquare}, {"reciprocal", TokenType::TokenReciprocal}, {"exp", TokenType::TokenExp},
+    {"log", TokenType::TokenLog}, {"log10", TokenType::TokenLog10}, {"sin", TokenType::TokenSin}, {"cos", TokenType::TokenCos},
+    {"tan", TokenType::TokenTan}, {"asin", TokenType::TokenAsin}, {"acos", TokenType::TokenAcos}, {"atan", TokenType::TokenAtan},
+    {"sinh", TokenType::TokenSinh}, {"cosh", TokenType::TokenCosh}, {"tanh", TokenType::TokenTanh},
+    {"floor", TokenType::TokenFloor}, {"ceil", TokenType::TokenCeil}, {"round", TokenType::TokenRound},
+    {"trunc", TokenType::TokenTrunc}, {"sign", TokenType::TokenSign},
+};
+
+
+int32_t TokenArity(TokenType token_type) 
+{
+    const int32_t type = int32_t(token_type);
+    if (token_type == TokenType::TokenAdd || token_type == TokenType::TokenMul) return 2;
+    if (type >= int32_t(TokenType::TokenSub) && type <= int32_t(TokenType::TokenAtan2)) return 2;
+    if (type >= int32_t(TokenType::TokenNeg) && type <= int32_t(TokenType::TokenSign)) return 1;
+    return 0;
+}
+
+
+float EvaluateToken(TokenType token_type, float lhs, float rhs) 
+{
+    switch (token_type) {
+        case TokenType::TokenAdd: return lhs + rhs;
+        case TokenType::TokenSub: return lhs - rhs;
+        case TokenType::TokenMul: return lhs * rhs;
+        case TokenType::TokenDiv: return lhs / rhs;
+        case TokenType::TokenPow: return powf(lhs, rhs);
+        case TokenType::TokenMax: return max(lhs, rhs);
+        case TokenType::TokenMin: return min(lhs, rhs);
+        case TokenType::TokenFloorDivide: return floorf(lhs / rhs);
+        case TokenType::TokenRemainder: return lhs - floorf(lhs / rhs) * rhs;
+        case TokenType::TokenAtan2: return atan2f(lhs, rhs);
+        case TokenType::TokenNeg: return -lhs;
+        case TokenType::TokenAbs: return fabsf(lhs);
+        case TokenType::TokenSqrt: return sqrtf(lhs);
+        case TokenType::TokenRsqrt: return 1.f / sqrtf(lhs);
+        case TokenType::TokenSquare: return lhs * lhs;
+        case TokenType::TokenReciprocal: return 1.f / lhs;
+        case TokenType::TokenExp: return expf(lhs);
+        case TokenType::TokenLog: return logf(lhs);
+        case TokenType::TokenLog10: return log10f(lhs);
+        case TokenType::TokenSin: return sinf(lhs);
+        case TokenType::TokenCos: return cosf(lhs);
+        case TokenType::TokenTan: return tanf(lhs);
+        case TokenType::TokenAsin: return asinf(lhs);
+        case TokenType::TokenAcos: return acosf(lhs);
+        case TokenType::TokenAtan: return atanf(lhs);
+        case TokenType::TokenSinh: return sinhf(lhs);
+        case TokenType::TokenCosh: return coshf(lhs);
+        case TokenType::TokenTanh: return tanhf(lhs);
+        case TokenType::TokenFloor: return floorf(lhs);
+        case TokenType::TokenCeil: return ceilf(lhs);
+        case TokenType::TokenRound: return nearbyintf(lhs);
+        case TokenType::TokenTrunc: return truncf(lhs);
+        case TokenType::TokenSign: return float((lhs > 0.f) - (lhs < 0.f));
+        default: LOG(FATAL) << "Unknown operator type: " << int(token_type);
+    }
+    return 0.f;
+}
+
+
 void ReversePolish(const shared_ptr<TokenNode> &root_node, vector<shared_ptr<TokenNode>> &reverse_polish) 
 {
     if (root_node != nullptr) {
@@ -28,25 +97,23 @@ void ExpressionParser::Tokenizer(bool need_retoken)
     statement_.erase(remove_if(statement_.begin(), statement_.end(), [](char c) { return isspace(c); }), statement_.end());
     CHECK(!statement_.empty()) << "The input statement is empty!";
 
+    this->tokens_.clear();
+    this->token_strs_.clear();
     for (int32_t i = 0; i < statement_.size();) {
         char c = statement_.at(i);
-        if (c == 'a') {
-            CHECK(i + 1 < statement_.size() && statement_.at(i + 1) == 'd') << "Parse add token failed, illegal character: " << c;
-            CHECK(i + 2 < statement_.size() && statement_.at(i + 2) == 'd') << "Parse add token failed, illegal character: " << c;
-            Token token(TokenType::TokenAdd, i, i + 3);
-            tokens_.push_back(token);
-            string token_operation = string(statement_.begin() + i, statement_.begin() + i + 3);
-            token_strs_.push_back(token_operation);
-            i = i + 3;
-        
-        } else if (c == 'm') {
-            CHECK(i + 1 < statement_.size() && statement_.at(i + 1) == 'u') << "Parse add token failed, illegal character: " << c;
-            CHECK(i + 2 < statement_.size() && statement_.at(i + 2) == 'l') << "Parse add token failed, illegal character: " << c;
-            Token token(TokenType::TokenMul, i, i + 3);
+        if (isalpha(c)) {
+            int32_t j = i + 1;
+            for (; j < statement_.size(); ++j) {
+                if (!isalnum(statement_.at(j)) && statement_.at(j) != '_') break;
+            }
+
+            string token_operation = string(statement_.begin() + i, statement_.begin() + j);
+            const auto &operation_iter = kTokenOperations.find(token_operation);
+            CHECK(operation_iter != kTokenOperations.end()) << "Unknown operation: " << token_operation;
+            Token token(operation_iter->second, i, j);
             tokens_.push_back(token);
-            string token_operation = string(statement_.begin() + i, statement_.begin() + i + 3);
             token_strs_.push_back(token_operation);
-            i = i + 3;
+            i = j;
         
         } else if (c == '@') {
             CHECK(i + 1 < statement_.size() && isdigit(statement_.at(i + 1))) << "Parse number token failed, illegal character: " << c;
@@ -62,6 +129,20 @@ void ExpressionParser::Tokenizer(bool need_retoken)
             token_strs_.push_back(token_input_number);
             i = j;
         
+        } else if (isdigit(c) || c == '.' || ((c == '-' || c == '+') && i + 1 < statement_.size() &&
+                   (isdigit(statement_.at(i + 1)) || statement_.at(i + 1) == '.'))) {
+            const char *number_begin = statement_.c_str() + i;
+            char *number_end = nullptr;
+            strtof(number_begin, &number_end);
+            CHECK(number_end > number_begin) << "Parse constant token failed, illegal character: " << c;
+
+            const int32_t j = i + int32_t(number_end - number_begin);
+            Token token(TokenType::TokenConstant, i, j);
+            tokens_.push_back(token);
+            string token_constant = string(statement_.begin() + i, statement_.begin() + j);
+            token_strs_.push_back(token_constant);
+            i = j;
+
         } else if (c == ',') {
             Token token(TokenType::TokenComma, i, i + 1);
             tokens_.push_back(token);
@@ -106,8 +187,6 @@ shared_ptr<TokenNode> ExpressionParser::Generate_(int32_t &index)
 {
     CHECK(index < this->tokens_.size());
     const auto current_token = this->tokens_.at(index);
-    CHECK(current_token.token_type == TokenType::TokenInputNumber || 
-          current_token.token_type == TokenType::TokenAdd || current_token.token_type == TokenType::TokenMul);
     
     if (current_token.token_type == TokenType::TokenInputNumber) {
         uint32_t start_pos = current_token.start_pos + 1;
@@ -117,46 +196,48 @@ shared_ptr<TokenNode> ExpressionParser::Generate_(int32_t &index)
         const string &str_number = string(this->statement_.begin() + start_pos, this->statement_.begin() + end_pos);
         return make_shared<TokenNode>(stoi(str_number), nullptr, nullptr);
 
-    } else if (current_token.token_type == TokenType::TokenMul || current_token.token_type == TokenType::TokenAdd) {
-        shared_ptr<TokenNode> current_node = make_shared<TokenNode>();
-        current_node->num_index = -int(current_token.token_type);
+    } else if (current_token.token_type == TokenType::TokenConstant) {
+        const string &str_constant = string(this->statement_.begin() + current_token.start_pos, this->statement_.begin() + current_token.end_pos);
+        shared_ptr<TokenNode> constant_node = make_shared<TokenNode>(-int(TokenType::TokenConstant), nullptr, nullptr);
+        constant_node->value = strtof(str_constant.c_str(), nullptr);
+        return constant_node;
+    }
 
-        index += 1;
-        CHECK(index < this->tokens_.size());
-        CHECK(this->tokens_.at(index).token_type == TokenType::TokenLeftBracket);
+    const int32_t arity = TokenArity(current_token.token_type);
+    CHECK(arity > 0) << "Unknown token type: " << int(current_token.token_type);
 
-        index += 1;
-        CHECK(index < this->tokens_.size());
-        const auto left_token = this->tokens_.at(index);
+    shared_ptr<TokenNode> current_node = make_shared<TokenNode>();
+    current_node->num_index = -int(current_token.token_type);
 
-        if (left_token.token_type == TokenType::TokenInputNumber || 
-            left_token.token_type == TokenType::TokenAdd || left_token.token_type == TokenType::TokenMul) {
-            current_node->left = Generate_(index);
-        } else {
-            LOG(FATAL) << "Unknown token type: " << int(left_token.token_type);
-        }
+    index += 1;
+    CHECK(index < this->tokens_.size());
+    CHECK(this->tokens_.at(index).token_type == TokenType::TokenLeftBracket);
+
+    index += 1;
+    current_node->left = Generate_(index);
 
+    if (arity == 2) {
         index += 1;
         CHECK(index < this->tokens_.size());
         CHECK(this->tokens_.at(index).token_type == TokenType::TokenComma);
 
         index += 1;
-        CHECK(index < this->tokens_.size());
-        const auto right_token = this->tokens_.at(index);
-        if (right_token.token_type == TokenType::TokenInputNumber || 
-            right_token.token_type == TokenType::TokenAdd || right_token.token_type == TokenType::TokenMul) {
-            current_node->right = Generate_(index);
-        } else {
-            LOG(FATAL) << "Unknown token type: " << int(left_token.token_type);
-        }
+        current_node->right = Generate_(index);
+    }
 
-        index += 1;
-        CHECK(index < this->tokens_.size());
-        CHECK(this->tokens_.at(index).token_type == TokenType::TokenRightBracket);
-        return current_node;
-    } else {
-        LOG(FATAL) << "Unknown token type: " << int(current_token.token_type);
+    index += 1;
+    CHECK(index < this->tokens_.size());
+    CHECK(this->tokens_.at(index).token_type == TokenType::TokenRightBracket);
+
+    // 常量折叠，所有操作数都是常数时直接计算出结果
+    const int32_t constant_index = -int(TokenType::TokenConstant);
+    if (current_node->left->num_index == constant_index && (arity == 1 || current_node->right->num_index == constant_index)) {
+        const float rhs = arity == 2 ? current_node->right->value : 0.f;
+        shared_ptr<TokenNode> constant_node = make_shared<TokenNode>(constant_index, nullptr, nullptr);
+        constant_node->value = EvaluateToken(current_token.token_type, current_node->left->value, rhs);
+        return constant_node;
     }
+    return current_node;
 }
 
 
@@ -174,11 +255,77 @@ vector<shared_ptr<TokenNode> > ExpressionParser::Generate()
     // 转逆波兰式,之后转移到expression中
     vector<shared_ptr<TokenNode>> reverse_polish;
     ReversePolish(root, reverse_polish);
+    return reverse_polish;
+}
 
+
+ExpressionProgram ExpressionParser::Compile() 
+{
+    const vector<shared_ptr<TokenNode>> &reverse_polish = this->Generate();
+    CHECK(!reverse_polish.empty());
+
+    // 逆波兰式中操作数所在的栈位置即为寄存器编号
+    ExpressionProgram program;
+    vector<ExpressionOperand> operand_stack;
     for (const auto &node : reverse_polish) {
-        LOG(INFO) << node->num_index;
+        if (node->num_index >= 0) {
+            ExpressionOperand operand;
+            operand.source = OperandSource::SourceInput;
+            operand.index = node->num_index;
+            program.input_num = max(program.input_num, uint32_t(node->num_index + 1));
+            operand_stack.push_back(operand);
+
+        } else if (node->num_index == -int(TokenType::TokenConstant)) {
+            ExpressionOperand operand;
+            operand.source = OperandSource::SourceConstant;
+            operand.index = int32_t(program.constants.size());
+            program.constants.push_back(node->value);
+            operand_stack.push_back(operand);
+
+        } else {
+            ExpressionInstruction instruction;
+            instruction.op = TokenType(-node->num_index);
+            const uint32_t arity = TokenArity(instruction.op);
+            CHECK(arity > 0 && operand_stack.size() >= arity) << "The number of operand is less than " << arity;
+            if (arity == 2) {
+                instruction.rhs = operand_stack.back();
+                operand_stack.pop_back();
+            }
+            instruction.lhs = operand_stack.back();
+            operand_stack.pop_back();
+
+            // 指数为常数的pow替换为开方、平方等更快的运算
+            if (instruction.op == TokenType::TokenPow && instruction.rhs.source == OperandSource::SourceConstant) {
+                const float exponent = program.constants.at(instruction.rhs.index);
+                if (exponent == 2.f) {
+                    instruction.op = TokenType::TokenSquare;
+                } else if (exponent == 0.5f) {
+                    instruction.op = TokenType::TokenSqrt;
+                } else if (exponent == -1.f) {
+                    instruction.op = TokenType::TokenReciprocal;
+                } else if (exponent == -0.5f) {
+                    instruction.op = TokenType::TokenRsqrt;
+                }
+            }
+
+            instruction.dst.source = OperandSource::SourceRegister;
+            instruction.dst.index = int32_t(operand_stack.size());
+            program.register_num = max(program.register_num, uint32_t(operand_stack.size() + 1));
+            program.instructions.push_back(instruction);
+            operand_stack.push_back(instruction.dst);
+        }
     }
-    return reverse_polish;
+
+    CHECK(operand_stack.size() == 1);
+    if (program.instructions.empty()) {
+        ExpressionInstruction instruction;
+        instruction.op = TokenType::TokenInputNumber;
+        instruction.lhs = operand_stack.back();
+        program.instructions.push_back(instruction);
+    }
+    program.instructions.back().dst.source = OperandSource::SourceOutput;
+    program.instructions.back().dst.index = 0;
+    return program;
 }
 
 
@@ -1,12 +1,16 @@
 #include "runtime/ir.h"
 
+#include <fcntl.h>
 #include <limits.h>
 #include <stdint.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <algorithm>
-#include <fstream>
-#include <sstream>
+#include <charconv>
 #include <string>
+#include <string_view>
 #include <stack>
 
 #if BUILD_PNNX
@@ -361,7 +365,8 @@ bool operator==(const Attribute& lhs, const Attribute& rhs)
     if (lhs.type != rhs.type) return false;
     if (lhs.type == 0) return true;
     if (lhs.shape != rhs.shape) return false;
-    if (lhs.data != rhs.data) return false;
+    if (lhs.raw_size() != rhs.raw_size()) return false;
+    if (lhs.raw_size() > 0 && memcmp(lhs.raw_data(), rhs.raw_data(), lhs.raw_size()) != 0) return false;
     return true;
 }
 
@@ -391,14 +396,78 @@ Attribute operator+(const Attribute& a, const Attribute& b)
     c.shape = a.shape;
     c.shape[0] += b.shape[0]; // concat the first dim
 
-    c.data.resize(a.data.size() + b.data.size());
-    memcpy(c.data.data(), a.data.data(), a.data.size());
-    memcpy(c.data.data() + a.data.size(), b.data.data(), b.data.size());
+    c.data.resize(a.raw_size() + b.raw_size());
+    memcpy(c.data.data(), a.raw_data(), a.raw_size());
+    memcpy(c.data.data() + a.raw_size(), b.raw_data(), b.raw_size());
     return c;
 }
 
 
-Parameter Parameter::parse_from_string(const string& value)
+static bool is_param_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+
+// the next line of the param text without the line break, advances p past it
+static string_view next_param_line(const char*& p, const char* end)
+{
+    const char* begin = p;
+    const char* eol = (const char*)memchr(p, '\n', end - p);
+    if (!eol) eol = end;
+    p = eol == end ? end : eol + 1;
+    return string_view(begin, eol - begin);
+}
+
+
+// the next whitespace separated token of the line, empty at the end of the line
+static string_view next_param_token(string_view& line)
+{
+    size_t b = 0;
+    while (b < line.size() && is_param_space(line[b])) b++;
+
+    size_t e = b;
+    while (e < line.size() && !is_param_space(line[e])) e++;
+
+    string_view token = line.substr(b, e - b);
+    line.remove_prefix(e);
+    return token;
+}
+
+
+// parses the leading number like stoi and stof, 0 when there is none
+static int param_to_int(string_view s)
+{
+    int i = 0;
+    from_chars(s.data(), s.data() + s.size(), i);
+    return i;
+}
+
+
+static float param_to_float(string_view s)
+{
+    float f = 0.f;
+    from_chars(s.data(), s.data() + s.size(), f);
+    return f;
+}
+
+
+// values not starting with a digit or a minus followed by a digit are strings
+static bool param_is_string(string_view s)
+{
+    if (s.empty()) return true;
+    if (s[0] == '-') return s.size() < 2 || s[1] < '0' || s[1] > '9';
+    return s[0] < '0' || s[0] > '9';
+}
+
+
+static bool param_is_float(string_view s)
+{
+    return s.find('.') != string_view::npos || s.find('e') != string_view::npos;
+}
+
+
+static Parameter parse_parameter(string_view value)
 {
     Parameter p;
     p.type = 0;
@@ -411,55 +480,63 @@ Parameter Parameter::parse_from_string(const string& value)
         return p;
     }
 
-    if (value[0] == '(' || value[0] == '[') {
+    if (!value.empty() && (value[0] == '(' || value[0] == '[')) {
         // list
-        string lc = value.substr(1, value.size() - 2);
-        istringstream lcss(lc);
+        string_view lc = value.substr(1, value.size() - 2);
 
-        while (!lcss.eof()) {
-            string elem;
-            getline(lcss, elem, ',');
+        while (true) {
+            const size_t comma = lc.find(',');
+            string_view elem = lc.substr(0, comma);
 
-            if ((elem[0] != '-' && (elem[0] < '0' || elem[0] > '9')) || (elem[0] == '-' && (elem[1] < '0' || elem[1] > '9'))) {
+            if (param_is_string(elem)) {
                 // string
                 p.type = 7;
-                p.as.push_back(elem);
-            
-            } else if (elem.find('.') != string::npos || elem.find('e') != string::npos) {
+                p.as.emplace_back(elem);
+
+            } else if (param_is_float(elem)) {
                 // float
                 p.type = 6;
-                p.af.push_back(stof(elem));
-            
+                p.af.push_back(param_to_float(elem));
+
             } else {
                 // integer
                 p.type = 5;
-                p.ai.push_back(stoi(elem));
+                p.ai.push_back(param_to_int(elem));
             }
+
+            if (comma == string_view::npos) break;
+            lc.remove_prefix(comma + 1);
         }
         return p;
     }
 
-    if ((value[0] != '-' && (value[0] < '0' || value[0] > '9')) || (value[0] == '-' && (value[1] < '0' || value[1] > '9'))) {
+    if (param_is_string(value)) {
         // string
         p.type = 4;
-        p.s = value;
+        p.s = string(value);
         return p;
     }
 
-    if (value.find('.') != string::npos || value.find('e') != string::npos) {
+    if (param_is_float(value)) {
         // float
         p.type = 3;
-        p.f = stof(value);
+        p.f = param_to_float(value);
         return p;
     }
 
     // integer
     p.type = 2;
-    p.i = stoi(value);
+    p.i = param_to_int(value);
     return p;
 }
 
 
+Parameter Parameter::parse_from_string(const string& value)
+{
+    return parse_parameter(value);
+}
+
+
 Graph::Graph() {}
 
 Graph::~Graph() {
@@ -476,26 +553,46 @@ Graph::Graph(const Graph& /*rhs*/) {}
 Graph& Graph::operator=(const Graph& /*rhs*/) { return *this; }
 
 
-static void load_parameter(Operator* op, const string& key, const string& value)
+static void load_parameter(Operator* op, string_view key, string_view value)
 {
-    op->params[key] = Parameter::parse_from_string(value);
+    op->params[string(key)] = parse_parameter(value);
 }
 
 
-static void load_input_key(Operator* op, const string& key, const string& value)
+static void load_input_key(Operator* op, string_view key, string_view value)
 {
     op->inputnames.resize(op->inputs.size());
     for (size_t i = 0; i < op->inputs.size(); i++) {
         const Operand* oprand = op->inputs[i];
         if (oprand->name == value) {
-            op->inputnames[i] = key;
+            op->inputnames[i] = string(key);
             break;
         }
     }
 }
 
 
-static void load_shape(Operator* op, const string& key, const string& value)
+// splits a "(1,3,?,?)f32" value into the type and the shape, unknown dims are -1
+static int parse_shape_type(string_view value, vector<int>& shape)
+{
+    const size_t rparen = value.rfind(')');
+    const string_view typestr = value.substr(rparen == string_view::npos ? 0 : rparen + 1);
+    string_view lc = value.substr(1, rparen == string_view::npos ? string_view::npos : rparen - 1);
+
+    shape.clear();
+    while (!lc.empty()) {
+        const size_t comma = lc.find(',');
+        string_view elem = lc.substr(0, comma);
+        shape.push_back(elem == "?" ? -1 : param_to_int(elem));
+
+        if (comma == string_view::npos) break;
+        lc.remove_prefix(comma + 1);
+    }
+    return string_to_type(string(typestr).c_str());
+}
+
+
+static void load_shape(Operator* op, string_view key, string_view value)
 {
     Operand* operand = 0;
     for (auto r : op->inputs) {
@@ -515,53 +612,26 @@ static void load_shape(Operator* op, const string& key, const string& value)
     }
 
     if (!operand) {
-        fprintf(stderr, "no such operand %s for operator %s\n", key.c_str(), op->name.c_str());
+        fprintf(stderr, "no such operand %s for operator %s\n", string(key).c_str(), op->name.c_str());
         return;
     }
+    if (value.empty()) return;
 
-    // type
-    string typestr = value.substr(value.find_last_of(')') + 1);
-    operand->type = string_to_type(typestr.c_str());
-
-    // shape
-    string lc = value.substr(1, value.find_last_of(')') - 1);
-    istringstream lcss(lc);
-
-    operand->shape.clear();
-    while (!lcss.eof()) {
-        string elem;
-        getline(lcss, elem, ',');
-
-        if (elem == "?") {
-            operand->shape.push_back(-1);
-        } else {
-            int i = stoi(elem);
-            operand->shape.push_back(i);
-        }
-    }
+    operand->type = parse_shape_type(value, operand->shape);
 }
 
 
-static void load_attribute(Operator* op, const string& key, const string& value, StoreZipReader& szr)
+static void load_attribute(Operator* op, string_view key, string_view value, StoreZipReader& szr)
 {
-    Attribute& a = op->attrs[key];
+    Attribute& a = op->attrs[string(key)];
+    if (value.empty()) return;
 
-    // type
-    string typestr = value.substr(value.find_last_of(')') + 1);
-    a.type = string_to_type(typestr.c_str());
+    // type and shape
+    vector<int> shape;
+    a.type = parse_shape_type(value, shape);
     if (a.type == 0) return;
 
-    // shape
-    string lc = value.substr(1, value.find_last_of(')') - 1);
-    istringstream lcss(lc);
-
-    a.shape.clear();
-    while (!lcss.eof()) {
-        string elem;
-        getline(lcss, elem, ',');
-        int i = stoi(elem);
-        a.shape.push_back(i);
-    }
+    a.shape = shape;
     if (a.shape.empty()) return;
 
     // weight_data
@@ -571,7 +641,7 @@ static void load_attribute(Operator* op, const string& key, const string& value,
     }
 
     size_t bytesize = size * type_to_elemsize(a.type);
-    string filename = op->name + "." + key;
+    string filename = op->name + "." + string(key);
     size_t filesize = szr.get_file_size(filename);
     if (filesize == 0) return; // no such file
 
@@ -579,90 +649,87 @@ static void load_attribute(Operator* op, const string& key, const string& value,
         fprintf(stderr, "file size not match expect %lu but got %lu\n", bytesize, filesize);
     }
 
-    a.data.resize(bytesize);
-    szr.read_file(filename, (char*)a.data.data());
+    // the attribute views the mapped bin file directly instead of copying it out,
+    // entries of files written before the writer aligned its data are still copied
+    a.data.clear();
+    a.mapped_data = szr.get_file_data(filename);
+    a.mapped_size = a.mapped_data ? min(filesize, bytesize) : 0;
+    if (a.mapped_data && (uintptr_t)a.mapped_data.get() % type_to_elemsize(a.type) != 0) {
+        a.data.assign(a.mapped_data.get(), a.mapped_data.get() + a.mapped_size);
+        a.data.resize(bytesize);
+        a.mapped_data.reset();
+        a.mapped_size = 0;
+    }
 }
 
 
-int Graph::load(const string& parampath, const string& binpath)
+// single pass over the param text, tokens are viewed in place and only copied into the graph,
+// attributes are skipped when there is no bin file
+static int load_param(Graph& graph, const char* data, size_t size, StoreZipReader* szr)
 {
-    ifstream is(parampath, ios::in | ios::binary);
-    if (!is.good()) {
-        fprintf(stderr, "open failed\n");
-        return -1;
-    }
-
-    StoreZipReader szr;
-    if (szr.open(binpath) != 0) {
-        fprintf(stderr, "open failed\n");
-        return -1;
-    }
+    const char* p = data;
+    const char* end = data + size;
 
-    int magic = 0;
-    {
-        string line;
-        getline(is, line);
-        istringstream iss(line);
-        iss >> magic;
-    }
+    // magic
+    next_param_line(p, end);
 
     int operator_count = 0;
     int operand_count = 0;
     {
-        string line;
-        getline(is, line);
-        istringstream iss(line);
-        iss >> operator_count >> operand_count;
+        string_view line = next_param_line(p, end);
+        operator_count = param_to_int(next_param_token(line));
+        operand_count = param_to_int(next_param_token(line));
     }
 
+    graph.ops.reserve(graph.ops.size() + max(operator_count, 0));
+    graph.operands.reserve(graph.operands.size() + max(operand_count, 0));
+
+    string operand_name;
     for (int i = 0; i < operator_count; i++) {
-        string line;
-        getline(is, line);
-        istringstream iss(line);
+        string_view line = next_param_line(p, end);
 
-        string type;
-        string name;
-        int input_count = 0;
-        int output_count = 0;
-        iss >> type >> name >> input_count >> output_count;
+        const string_view type = next_param_token(line);
+        const string_view name = next_param_token(line);
+        const int input_count = param_to_int(next_param_token(line));
+        const int output_count = param_to_int(next_param_token(line));
 
-        Operator* op = new_operator(type, name);
+        Operator* op = graph.new_operator(string(type), string(name));
         for (int j = 0; j < input_count; j++) {
-            string operand_name;
-            iss >> operand_name;
+            operand_name.assign(next_param_token(line));
 
-            Operand* r = get_operand(operand_name);
+            Operand* r = graph.get_operand(operand_name);
+            if (!r) {
+                fprintf(stderr, "operand %s of %s not found\n", operand_name.c_str(), op->name.c_str());
+                return -1;
+            }
             r->consumers.push_back(op);
             op->inputs.push_back(r);
         }
 
         for (int j = 0; j < output_count; j++) {
-            string operand_name;
-            iss >> operand_name;
+            operand_name.assign(next_param_token(line));
 
-            Operand* r = new_operand(operand_name);
+            Operand* r = graph.new_operand(operand_name);
             r->producer = op;
             op->outputs.push_back(r);
         }
 
         // key=value
-        while (!iss.eof()) {
-            string param;
-            iss >> param;
+        while (true) {
+            const string_view param = next_param_token(line);
+            if (param.empty()) break;
 
-            string key;
-            string value;
-            istringstream pss(param);
-            getline(pss, key, '=');
-            getline(pss, value);
+            const size_t eq = param.find('=');
+            const string_view key = param.substr(0, eq);
+            const string_view value = eq == string_view::npos ? string_view() : param.substr(eq + 1);
 
-            if (key[0] == '@') {
+            if (!key.empty() && key[0] == '@') {
                 // attribute
-                load_attribute(op, key.substr(1), value, szr);
-            } else if (key[0] == '$') {
+                if (szr) load_attribute(op, key.substr(1), value, *szr);
+            } else if (!key.empty() && key[0] == '$') {
                 // operand input key
                 load_input_key(op, key.substr(1), value);
-            } else if (key[0] == '#') {
+            } else if (!key.empty() && key[0] == '#') {
                 // operand shape
                 load_shape(op, key.substr(1), value);
             } else {
@@ -676,6 +743,43 @@ int Graph::load(const string& parampath, const string& binpath)
 }
 
 
+int Graph::load(const string& parampath, const string& binpath)
+{
+    int fd = ::open(parampath.c_str(), O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "open failed\n");
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        fprintf(stderr, "open failed\n");
+        ::close(fd);
+        return -1;
+    }
+
+    // the param text is parsed in place from a private read only mapping
+    const size_t size = st.st_size;
+    void* addr = size > 0 ? mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0) : 0;
+    ::close(fd);
+    if (addr == MAP_FAILED) {
+        fprintf(stderr, "mmap failed\n");
+        return -1;
+    }
+
+    StoreZipReader szr;
+    if (szr.open(binpath) != 0) {
+        fprintf(stderr, "open failed\n");
+        if (addr) munmap(addr, size);
+        return -1;
+    }
+
+    int ret = load_param(*this, (const char*)addr, size, &szr);
+    if (addr) munmap(addr, size);
+    return ret;
+}
+
+
 int Graph::save(const string& parampath, const string& binpath)
 {
     FILE* paramfp = fopen(parampath.c_str(), "wb");
@@ -766,7 +870,7 @@ int Graph::save(const string& parampath, const string& binpath)
             fprintf(paramfp, type_to_string(attr.type));
 
             string filename = op->name + "." + it.first;
-            szw.write_file(filename, attr.data.data(), attr.data.size());
+            szw.write_file(filename, attr.raw_data(), attr.raw_size());
         }
 
         if (op->inputnames.size() == op->inputs.size()) {
@@ -1768,85 +1872,7 @@ int Graph::python(const string& pypath, const string& pnnxbinpath)
 
 int Graph::parse(const string& param)
 {
-    istringstream is(param);
-    if (!is.good()) {
-        fprintf(stderr, "open failed\n");
-        return -1;
-    }
-
-    int magic = 0;
-    {
-        string line;
-        getline(is, line);
-        istringstream iss(line);
-        iss >> magic;
-    }
-
-    int operator_count = 0;
-    int operand_count = 0;    
-    {
-        string line;
-        getline(is, line);
-        istringstream iss(line);
-        iss >> operator_count >> operand_count;
-    }
-
-    for (int i = 0; i < operator_count; i++) {
-        string line;
-        getline(is, line);
-        istringstream iss(line);
-
-        string type;
-        string name;
-        int input_count = 0;
-        int output_count = 0;
-        iss >> type >> name >> input_count >> output_count;
-
-        Operator* op = new_operator(type, name);
-        for (int j = 0; j < input_count; j++) {
-            string operand_name;
-            iss >> operand_name;
-            Operand* r = get_operand(operand_name);
-            r->consumers.push_back(op);
-            op->inputs.push_back(r);
-        }
-
-        for (int j = 0; j < output_count; j++) {
-            string operand_name;
-            iss >> operand_name;
-            Operand* r = new_operand(operand_name);
-            r->producer = op;
-            op->outputs.push_back(r);
-        }
-
-        // key=value
-        while (!iss.eof()) {
-            string param;
-            iss >> param;
-
-            string key;
-            string value;
-            istringstream pss(param);
-            getline(pss, key, '=');
-            getline(pss, value);
-
-            if (key[0] == '@') {
-                // attribute
-                // load_attribute(op, key.substr(1), value, szr);
-            } else if (key[0] == '$') {
-                // operand input key
-                load_input_key(op, key.substr(1), value);
-            } else if (key[0] == '#') {
-                // operand shape
-                load_shape(op, key.substr(1), value);
-            } else {
-                // parameter
-                load_parameter(op, key, value);
-            }
-        }
-    }
-
-    return 0;
+    return load_param(*this, param.data(), param.size(), nullptr);
 }
 
 
@@ -1915,28 +1941,49 @@ Operand* Graph::new_operand(const torch::jit::Value* v)
 
 Operand* Graph::new_operand(const string& name)
 {
+    update_operand_index();
+
     Operand* r = new Operand;
     r->name = name;
     operands.push_back(r);
+    operand_index.emplace(name, r);
+    indexed_operand_count = operands.size();
     return r;
 }
 
 
-Operand* Graph::get_operand(const string& name)
+void Graph::update_operand_index() const
 {
+    if (indexed_operand_count == operands.size()) return;
+
+    // the first operand wins on duplicated names, same as the linear lookup
+    operand_index.clear();
+    operand_index.reserve(operands.size());
     for (Operand* r : operands) {
-        if (r->name == name) return r;
+        operand_index.emplace(r->name, r);
     }
-    return 0;
+    indexed_operand_count = operands.size();
+}
+
+
+Operand* Graph::get_operand(const string& name)
+{
+    return const_cast<Operand*>(static_cast<const Graph*>(this)->get_operand(name));
 }
 
 
 const Operand* Graph::get_operand(const string& name) const
 {
-    for (const Operand* r : operands) {
-        if (r->name == name) return r;
-    }
-    return 0;
+    update_operand_index();
+
+    auto it = operand_index.find(name);
+    if (it != operand_index.end() && it->second->name == name) return it->second;
+
+    // the operand was renamed or replaced in place, fall back to a full rebuild
+    indexed_operand_count = size_t(-1);
+    update_operand_index();
+    it = operand_index.find(name);
+    return it == operand_index.end() ? 0 : it->second;
 }
 
 } // namespace pnnx
@@ -1,14 +1,17 @@
 
 #include "runtime/runtime_ir.hpp"
 
+#include <algorithm>
 #include <memory>
 #include <iostream>
 #include <iomanip>
 #include <queue>
 #include <deque>
 #include <utility>
+#include <unordered_map>
 
 #include "layer/abstract/layer_factory.hpp"
+#include "layer/abstract/weight_cache.hpp"
 #include "utils/tick.hpp"
 
 
@@ -74,15 +77,23 @@ void RuntimeGraphShape::InitOperatorInputTensor(const vector<shared_ptr<RuntimeO
 void RuntimeGraphShape::InitOperatorOutputTensor(const vector<pnnx::Operator *> &pnnx_operators, const vector<shared_ptr<RuntimeOperator>> &operators) 
 {
     CHECK(!pnnx_operators.empty() && !operators.empty());
-    CHECK(pnnx_operators.size() == operators.size());
 
-    for (uint32_t i = 0; i < pnnx_operators.size(); ++i) {
-        const vector<pnnx::Operand *> operands = pnnx_operators.at(i)->outputs;
+    // 图优化可能删除部分计算节点，按名称匹配pnnx节点和计算节点
+    unordered_map<string, pnnx::Operator *> pnnx_operators_map;
+    for (pnnx::Operator *pnnx_op : pnnx_operators) {
+        pnnx_operators_map.insert({pnnx_op->name, pnnx_op});
+    }
+
+    for (const auto &runtime_op : operators) {
+        const auto &pnnx_op_iter = pnnx_operators_map.find(runtime_op->name);
+        if (pnnx_op_iter == pnnx_operators_map.end() && runtime_op->type == "pnnx.Output") continue;
+        CHECK(pnnx_op_iter != pnnx_operators_map.end()) << "Can not find the pnnx operator: " << runtime_op->name;
+
+        const vector<pnnx::Operand *> operands = pnnx_op_iter->second->outputs;
         CHECK(operands.size() <= 1) << "Only support one node one output yet!";
         if (operands.empty()) continue;
 
         pnnx::Operand *operand = operands.front();
-        const auto &runtime_op = operators.at(i);
         CHECK(operand != nullptr) << "Operand output is null";
         const vector<int32_t> &shapes = operand->shape;
         const auto &output_tensors = runtime_op->output_operands;
@@ -130,13 +141,122 @@ void RuntimeGraphShape::InitOperatorOutputTensor(const vector<pnnx::Operator *>
 }
 
 
+void RuntimeGraphShape::InitOperatorOutputTensor(const vector<shared_ptr<RuntimeOperator>> &operators)
+{
+    for (const auto &op : operators) {
+        const auto &output_operand = op->output_operands;
+        if (!output_operand || !output_operand->datas.empty()) continue;
+
+        const vector<int32_t> &shapes = output_operand->shapes;
+        CHECK(shapes.size() == 2 || shapes.size() == 4 || shapes.size() == 3) << "Unsupported shape sizes: " << shapes.size();
+        const int32_t batch = shapes.at(0);
+        CHECK(batch >= 0) << "Dynamic batch size is not supported!";
+
+        for (int32_t j = 0; j < batch; ++j) {
+            if (shapes.size() == 4) {
+                output_operand->datas.push_back(make_shared<Tensor<float>>(shapes.at(1), shapes.at(2), shapes.at(3)));
+            } else if (shapes.size() == 2) {
+                output_operand->datas.push_back(make_shared<Tensor<float>>(1, shapes.at(1), 1));
+            } else {
+                output_operand->datas.push_back(make_shared<Tensor<float>>(1, shapes.at(1), shapes.at(2)));
+            }
+        }
+    }
+}
+
+
+uint32_t RuntimeGraphShape::InitConcatInplaceTensor(const vector<shared_ptr<RuntimeOperator>> &operators)
+{
+    uint32_t inplace_num = 0;
+    unordered_map<string, shared_ptr<RuntimeOperator>> operators_map;
+    for (const auto &op : operators) {
+        operators_map.insert({op->name, op});
+    }
+
+    // 逆序遍历，后继的concat先规划，嵌套的concat在外层concat的输出上继续划分视图
+    for (auto op_iter = operators.rbegin(); op_iter != operators.rend(); ++op_iter) {
+        const shared_ptr<RuntimeOperator> &op = *op_iter;
+        if (op->type != "torch.cat" || !op->output_operands) continue;
+
+        const auto &dim_iter = op->params.find("dim");
+        if (dim_iter == op->params.end()) continue;
+        const auto &dim_param = dynamic_cast<RuntimeParameterInt *>(dim_iter->second);
+        if (!dim_param || (dim_param->value != 1 && dim_param->value != -3)) continue;
+
+        const vector<shared_ptr<RuntimeOperand>> &input_operands = op->input_operands_seq;
+        const vector<shared_ptr<Tensor<float>>> &output_datas = op->output_operands->datas;
+        const vector<int32_t> &output_shapes = op->output_operands->shapes;
+        if (input_operands.empty() || input_operands.size() != op->input_operands.size() || output_shapes.size() != 4) continue;
+
+        // 只处理通道维度上的拼接，每个输入的batch、高和宽都和输出一致
+        int32_t total_channels = 0;
+        bool can_inplace = true;
+        for (const auto &input_operand : input_operands) {
+            const vector<int32_t> &shapes = input_operand->shapes;
+            if (shapes.size() != 4 || shapes.at(0) != output_shapes.at(0) || shapes.at(2) != output_shapes.at(2) ||
+                shapes.at(3) != output_shapes.at(3) || input_operand->datas.size() != output_datas.size()) {
+                can_inplace = false;
+                break;
+            }
+            total_channels += shapes.at(1);
+        }
+        if (!can_inplace || total_channels != output_shapes.at(1)) continue;
+
+        const uint32_t rows = output_shapes.at(2);
+        const uint32_t cols = output_shapes.at(3);
+        uint32_t start_channel = 0;
+        for (const auto &input_operand : input_operands) {
+            const uint32_t channels = input_operand->shapes.at(1);
+            for (uint32_t b = 0; b < output_datas.size(); ++b) {
+                float *channel_ptr = output_datas.at(b)->data().memptr() + start_channel * rows * cols;
+                input_operand->datas.at(b) = make_shared<Tensor<float>>(channel_ptr, channels, rows, cols);
+            }
+
+            // 前驱节点只输出到concat时，直接把结果写入concat输出的切片中
+            const auto &producer_iter = operators_map.find(input_operand->name);
+            if (producer_iter != operators_map.end()) {
+                const shared_ptr<RuntimeOperator> &producer = producer_iter->second;
+                if (producer->output_operators.size() == 1 && producer->output_operands &&
+                    producer->output_operands->shapes == input_operand->shapes) {
+                    producer->output_operands->datas = input_operand->datas;
+                }
+            }
+            start_channel += channels;
+        }
+        inplace_num += 1;
+    }
+    return inplace_num;
+}
+
+
 RuntimeGraph::RuntimeGraph(string param_path, string bin_path) : param_path_(move(param_path)), bin_path_(move(bin_path)) {}
 
+RuntimeGraph::~RuntimeGraph() { JoinPrefetch(); }
+
 void RuntimeGraph::set_bin_path(const string &bin_path) { this->bin_path_ = bin_path; }
 void RuntimeGraph::set_param_path(const string &param_path) { this->param_path_ = param_path; }
+void RuntimeGraph::set_inplace_concat(bool inplace_concat) { this->inplace_concat_ = inplace_concat; }
+void RuntimeGraph::set_shared_weight_path(const string &shared_weight_path) { this->shared_weight_path_ = shared_weight_path; }
+
+void RuntimeGraph::set_lazy_weights(bool lazy_weights, bool prefetch_weights)
+{
+    this->lazy_weights_ = lazy_weights;
+    this->prefetch_weights_ = lazy_weights && prefetch_weights;
+}
+
+void RuntimeGraph::set_linear_weight_type(LinearWeightType linear_weight_type) { this->layer_options_.linear_weight_type = linear_weight_type; }
+
+void RuntimeGraph::set_yolo_decode_mode(YoloDecodeMode decode_mode, float conf_thresh)
+{
+    CHECK(conf_thresh > 0.f && conf_thresh < 1.f) << "The confidence threshold of yolo detect layer must be in (0, 1): " << conf_thresh;
+    this->layer_options_.yolo_decode_mode = decode_mode;
+    this->layer_options_.yolo_conf_thresh = conf_thresh;
+}
 
 const string &RuntimeGraph::param_path() const { return this->param_path_; }
 const string &RuntimeGraph::bin_path() const { return this->bin_path_; }
+const vector<shared_ptr<RuntimeOperator>> &RuntimeGraph::operators() const { return this->operators_; }
+const vector<RuntimePassReport> &RuntimeGraph::pass_reports() const { return this->pass_reports_; }
 
 
 bool RuntimeGraph::Init() 
@@ -159,53 +279,67 @@ bool RuntimeGraph::Init()
         return false;
     }
 
-    this->operators_.clear();
-    for (const pnnx::Operator *op : operators) {
-        if (!op) {
-            LOG(ERROR) << "Meet the empty node";
-            continue;
-        
-        } else {
-            shared_ptr<RuntimeOperator> runtime_operator = make_shared<RuntimeOperator>();
-            // 初始化算子的名称
-            runtime_operator->name = op->name;
-            runtime_operator->type = op->type;
-
-            // 初始化算子中的input
-            const vector<pnnx::Operand *> &inputs = op->inputs;
-            if (!inputs.empty()) {
-                InitInputOperators(inputs, runtime_operator);
-            }
+    // 各节点的参数和属性解码相互独立，并行解码之后按节点的下标写回，结果和串行解码一致
+    const int32_t operators_num = operators.size();
+    vector<shared_ptr<RuntimeOperator>> runtime_operators(operators_num);
+#pragma omp parallel for schedule(dynamic)
+    for (int32_t i = 0; i < operators_num; ++i) {
+        const pnnx::Operator *op = operators.at(i);
+        if (!op) continue;
+
+        shared_ptr<RuntimeOperator> runtime_operator = make_shared<RuntimeOperator>();
+        // 初始化算子的名称
+        runtime_operator->name = op->name;
+        runtime_operator->type = op->type;
+
+        // 初始化算子中的input
+        const vector<pnnx::Operand *> &inputs = op->inputs;
+        if (!inputs.empty()) {
+            InitInputOperators(inputs, runtime_operator);
+        }
 
-            // 记录输出operand中的名称
-            const vector<pnnx::Operand *> &outputs = op->outputs;
-            if (!outputs.empty()) {
-                InitOutputOperators(outputs, runtime_operator);
-            }
+        // 记录输出operand中的名称
+        const vector<pnnx::Operand *> &outputs = op->outputs;
+        if (!outputs.empty()) {
+            InitOutputOperators(outputs, runtime_operator);
+        }
 
-            // 初始化算子中的attribute(权重)
-            const map<string, pnnx::Attribute> &attrs = op->attrs;
-            if (!attrs.empty()) {
-                InitGraphAttrs(attrs, runtime_operator);
-            }
+        // 初始化算子中的attribute(权重)
+        const map<string, pnnx::Attribute> &attrs = op->attrs;
+        if (!attrs.empty()) {
+            InitGraphAttrs(attrs, runtime_operator);
+        }
 
-            // 初始化算子中的parameter
-            const map<string, pnnx::Parameter> &params = op->params;
-            if (!params.empty()) {
-                InitGraphParams(params, runtime_operator);
-            }
-            this->operators_.push_back(runtime_operator);
+        // 初始化算子中的parameter
+        const map<string, pnnx::Parameter> &params = op->params;
+        if (!params.empty()) {
+            InitGraphParams(params, runtime_operator);
+        }
+        runtime_operators.at(i) = runtime_operator;
+    }
+
+    this->operators_.clear();
+    this->operators_.reserve(operators_num);
+    for (const auto &runtime_operator : runtime_operators) {
+        if (!runtime_operator) {
+            LOG(ERROR) << "Meet the empty node";
+            continue;
         }
+        this->operators_.push_back(runtime_operator);
+    }
+
+    // 构建图关系，按名称索引后继节点，建图的开销和节点数、边数成线性关系
+    unordered_map<string, shared_ptr<RuntimeOperator>> operators_map;
+    operators_map.reserve(this->operators_.size());
+    for (const auto &op : this->operators_) {
+        operators_map.insert({op->name, op});
     }
 
-    // 构建图关系
     for (const auto &current_op : this->operators_) {
-        const vector<string> &output_names = current_op->output_names;
-        for (const auto &next_op : this->operators_) {
-            if (next_op == current_op) continue;
-            if (find(output_names.begin(), output_names.end(), next_op->name) != output_names.end()) {
-                current_op->output_operators.insert({next_op->name, next_op});
-            }
+        for (const string &output_name : current_op->output_names) {
+            const auto &next_iter = operators_map.find(output_name);
+            if (next_iter == operators_map.end() || next_iter->second == current_op) continue;
+            current_op->output_operators.insert({next_iter->first, next_iter->second});
         }
     }
 
@@ -216,38 +350,185 @@ bool RuntimeGraph::Init()
 
 void RuntimeGraph::Build(const string &input_name, const string &output_name) 
 {
+    Build(input_name, vector<string>{output_name});
+}
+
+
+void RuntimeGraph::Build(const string &input_name, const vector<string> &output_names)
+{
+    CHECK(!output_names.empty()) << "No output node is requested";
     if (graph_state_ == GraphState::NeedInit) {
         bool init_graph = Init();
         LOG_IF(FATAL, !init_graph) << "Init graph failed!";
     }
 
     CHECK(graph_state_ >= GraphState::NeedBuild) << "Graph status error, current state is " << int(graph_state_);
+    if (this->graph_ == nullptr) {
+        BuildLoadedGraph(input_name, output_names);
+        return;
+    }
+    JoinPrefetch();
     LOG_IF(FATAL, this->operators_.empty()) << "Graph operators is empty, may be no init";
 
     this->input_operators_maps_.clear();
     this->output_operators_maps_.clear();
 
+    // 请求的中间节点接上pnnx.Output节点，图优化只保留请求的输出所依赖的节点
+    // 名称索引只建立一次，请求多个输出时不用反复扫描节点数组
+    unordered_map<string, shared_ptr<RuntimeOperator>> operators_map;
+    operators_map.reserve(this->operators_.size());
+    for (const auto &op : this->operators_) {
+        operators_map.insert({op->name, op});
+    }
+    unordered_map<string, pnnx::Operator *> pnnx_operators_map;
+    pnnx_operators_map.reserve(this->graph_->ops.size());
+    for (pnnx::Operator *pnnx_op : this->graph_->ops) {
+        pnnx_operators_map.insert({pnnx_op->name, pnnx_op});
+    }
+
+    vector<string> output_operator_names;
+    for (const string &output_name : output_names) {
+        output_operator_names.push_back(AddOutputOperator(output_name, operators_map, pnnx_operators_map));
+    }
+    RuntimeGraphOptimizer optimizer = RuntimeGraphOptimizer::DefaultOptimizer(output_operator_names);
+    this->pass_reports_ = optimizer.Run(this->operators_);
+
     for (const auto &kOperator : this->operators_) {
         if (kOperator->type == "pnnx.Input") {
             this->input_operators_maps_.insert({kOperator->name, kOperator});
         } else if (kOperator->type == "pnnx.Output") {
             this->output_operators_maps_.insert({kOperator->name, kOperator});
-        } else {
-            shared_ptr<Layer> layer = RuntimeGraph::CreateLayer(kOperator);
-            CHECK(layer != nullptr) << "Layer create failed!";
-            if (layer) kOperator->layer = layer;
         }
     }
 
+    // 其他进程已经导出权重段时，Layer创建时直接引用其中的权重
+    WeightCache &weight_cache = WeightCache::Instance();
+    const bool export_weights = !this->shared_weight_path_.empty() && !weight_cache.AttachSegment(this->shared_weight_path_);
+
+    // 导出共享权重段需要所有的权重，此时不延迟创建
+    const bool lazy_weights = this->lazy_weights_ && !export_weights;
+
+    // 各节点的Layer只读取自身的参数和属性，并行创建，每个Layer只写回自己的节点
+    const int32_t operators_num = this->operators_.size();
+#pragma omp parallel for schedule(dynamic)
+    for (int32_t i = 0; i < operators_num; ++i) {
+        const auto &kOperator = this->operators_.at(i);
+        if (kOperator->type == "pnnx.Input" || kOperator->type == "pnnx.Output") continue;
+        if (lazy_weights && !kOperator->attribute.empty()) continue;
+
+        shared_ptr<Layer> layer = RuntimeGraph::CreateLayer(kOperator, this->layer_options_);
+        CHECK(layer != nullptr) << "Layer create failed!";
+        kOperator->layer = layer;
+    }
+
+    if (export_weights) {
+        LOG_IF(WARNING, !weight_cache.enabled()) << "The weight cache is disabled, no weights to share";
+        weight_cache.ExportSegment(this->shared_weight_path_);
+    }
+
+    const WeightCacheStats &cache_stats = weight_cache.stats();
+    LOG_IF(INFO, cache_stats.hit_num + cache_stats.segment_hit_num > 0) << "Weight cache holds " << cache_stats.cached_bytes << " bytes in "
+        << cache_stats.entry_num << " blocks, deduplicated " << cache_stats.deduplicated_bytes << " bytes, "
+        << cache_stats.segment_hit_num << " blocks from " << cache_stats.segment_bytes << " bytes of shared segments";
+
     RuntimeGraphShape::InitOperatorInputTensor(this->operators_);
     RuntimeGraphShape::InitOperatorOutputTensor(graph_->ops, this->operators_);
+    if (this->inplace_concat_) {
+        const uint32_t inplace_num = RuntimeGraphShape::InitConcatInplaceTensor(this->operators_);
+        LOG_IF(INFO, inplace_num > 0) << "Plan " << inplace_num << " concat operators in place";
+    }
     graph_state_ = GraphState::Complete;
     input_name_ = input_name;
-    output_name_ = output_name;
+    output_names_ = output_operator_names;
+
+    // 计算节点已经按拓扑顺序排列，后台线程按执行顺序提前创建延迟的Layer
+    if (lazy_weights && this->prefetch_weights_) {
+        const vector<shared_ptr<RuntimeOperator>> operators = this->operators_;
+        const RuntimeLayerOptions options = this->layer_options_;
+        this->prefetch_thread_ = thread([operators, options]() {
+            for (const auto &op : operators) {
+                if (op->type != "pnnx.Input" && op->type != "pnnx.Output") MaterializeLayer(op, options);
+            }
+        });
+    }
+}
+
+
+void RuntimeGraph::BuildLoadedGraph(const string &input_name, const vector<string> &output_names)
+{
+    CHECK(graph_state_ == GraphState::Complete) << "Graph status error, current state is " << int(graph_state_);
+    LOG_IF(FATAL, input_operators_maps_.find(input_name) == input_operators_maps_.end())
+        << "Can not find the input node " << input_name << " in the native model file";
+
+    // 原生模型文件中只有保存时的输出节点，中间节点的输出按Build时添加的pnnx.Output节点的名称查找
+    vector<string> output_operator_names;
+    for (const string &output_name : output_names) {
+        const string &output_op_name = output_operators_maps_.count(output_name) ? output_name : "pnnx_output_" + output_name;
+        LOG_IF(FATAL, output_operators_maps_.find(output_op_name) == output_operators_maps_.end()) << "The output node " << output_name
+            << " was not saved in the native model file, build the graph from the pnnx files to request it";
+        output_operator_names.push_back(output_op_name);
+    }
+    input_name_ = input_name;
+    output_names_ = output_operator_names;
+}
+
+
+bool RuntimeGraph::Save(const string &model_path) const
+{
+    if (graph_state_ != GraphState::Complete) {
+        LOG(ERROR) << "Graph need be build before saving!";
+        return false;
+    }
+    // 原生模型文件保存打包之后的权重，延迟创建的Layer需要先创建
+    for (const auto &op : this->operators_) {
+        if (op->type != "pnnx.Input" && op->type != "pnnx.Output") MaterializeLayer(op, this->layer_options_);
+    }
+    return RuntimeModel::Save(model_path, this->operators_, this->input_name_, this->output_names_);
+}
+
+
+bool RuntimeGraph::Load(const string &model_path)
+{
+    this->graph_.reset();
+    this->input_operators_maps_.clear();
+    this->output_operators_maps_.clear();
+    this->pass_reports_.clear();
+    graph_state_ = GraphState::NeedInit;
+
+    // 模型文件中保存的是图优化之后的计算图，不再执行图优化
+    if (!RuntimeModel::Load(model_path, this->operators_, this->input_name_, this->output_names_, this->model_mapping_)) {
+        LOG(ERROR) << "Load the native model file failed: " << model_path;
+        return false;
+    }
+
+    for (const auto &kOperator : this->operators_) {
+        if (kOperator->type == "pnnx.Input") {
+            this->input_operators_maps_.insert({kOperator->name, kOperator});
+        } else if (kOperator->type == "pnnx.Output") {
+            this->output_operators_maps_.insert({kOperator->name, kOperator});
+        }
+
+        // 模型文件中保存的是float权重和默认的输出方式，加载之后按计算图的设置配置
+        if (kOperator->layer) kOperator->layer->Configure(this->layer_options_);
+    }
+
+    RuntimeGraphShape::InitOperatorInputTensor(this->operators_);
+    RuntimeGraphShape::InitOperatorOutputTensor(this->operators_);
+    if (this->inplace_concat_) {
+        RuntimeGraphShape::InitConcatInplaceTensor(this->operators_);
+    }
+    graph_state_ = GraphState::Complete;
+    return true;
 }
 
 
 vector<shared_ptr<Tensor<float>>> RuntimeGraph::Forward(const vector<shared_ptr<Tensor<float>>> &inputs, bool debug) 
+{
+    return ForwardOutputs(inputs, debug).front();
+}
+
+
+vector<vector<shared_ptr<Tensor<float>>>> RuntimeGraph::ForwardOutputs(const vector<shared_ptr<Tensor<float>>> &inputs, bool debug)
 {
     if (graph_state_ < GraphState::Complete) {
         LOG(FATAL) << "Graph need be build!";
@@ -261,11 +542,11 @@ vector<shared_ptr<Tensor<float>>> RuntimeGraph::Forward(const vector<shared_ptr<
         input_op = input_operators_maps_.at(input_name_);
     }
 
-    shared_ptr<RuntimeOperator> output_op;
-    if (output_operators_maps_.find(output_name_) == output_operators_maps_.end()) {
-        LOG(FATAL) << "Can not find the output node: " << input_name_;
-    } else {
-        output_op = output_operators_maps_.at(output_name_);
+    vector<shared_ptr<RuntimeOperator>> output_ops;
+    for (const string &output_name : output_names_) {
+        const auto &output_iter = output_operators_maps_.find(output_name);
+        LOG_IF(FATAL, output_iter == output_operators_maps_.end()) << "Can not find the output node: " << output_name;
+        output_ops.push_back(output_iter->second);
     }
 
     deque<shared_ptr<RuntimeOperator>> operator_queue;
@@ -284,10 +565,7 @@ vector<shared_ptr<Tensor<float>>> RuntimeGraph::Forward(const vector<shared_ptr<
         shared_ptr<RuntimeOperator> current_op = operator_queue.front();
         operator_queue.pop_front();
 
-        if (!current_op || current_op == output_op) {
-            if (debug) LOG(INFO) << "Model Inference End";
-            break;
-        }
+        if (current_op->type == "pnnx.Output") continue;
 
         if (current_op == input_op) {
             const vector<shared_ptr<Tensor<float>>> &layer_output_datas = inputs;
@@ -313,6 +591,7 @@ vector<shared_ptr<Tensor<float>>> RuntimeGraph::Forward(const vector<shared_ptr<
             CHECK(current_op->output_operands != nullptr);
             vector<shared_ptr<Tensor<float>>> layer_output_datas = current_op->output_operands->datas;
 
+            if (this->lazy_weights_) MaterializeLayer(current_op, this->layer_options_);
             const auto &start = chrono::steady_clock::now();
             InferStatus status = current_op->layer->Forward(layer_input_datas, layer_output_datas);
             if (debug) {
@@ -334,11 +613,14 @@ vector<shared_ptr<Tensor<float>>> RuntimeGraph::Forward(const vector<shared_ptr<
         op->meet_num = 0;
     }
 
-    CHECK(output_op->input_operands.size() == 1) << "The graph only support one path to the output node yet!";
-    const auto &output_op_input_operand = output_op->input_operands.begin();
-    const auto &output_operand = output_op_input_operand->second;
-    
+    vector<vector<shared_ptr<Tensor<float>>>> outputs;
+    for (const auto &output_op : output_ops) {
+        CHECK(output_op->input_operands.size() == 1) << "The output node " << output_op->name << " should have one input";
+        outputs.push_back(output_op->input_operands.begin()->second->datas);
+    }
+
     if (debug) {
+        LOG(INFO) << "Model Inference End";
         LOG(INFO) << "Model Running Information, Time Cost:";
         double duration_all = 0.;
         for (const auto &run_info : run_duration_infos) {
@@ -348,19 +630,70 @@ vector<shared_ptr<Tensor<float>>> RuntimeGraph::Forward(const vector<shared_ptr<
         LOG(INFO) << "All time cost: " << duration_all << " s";
     }
 
-    return output_operand->datas;
+    return outputs;
+}
+
+
+string RuntimeGraph::AddOutputOperator(const string &output_name, unordered_map<string, shared_ptr<RuntimeOperator>> &operators_map,
+    const unordered_map<string, pnnx::Operator *> &pnnx_operators_map)
+{
+    const auto &requested_iter = operators_map.find(output_name);
+    LOG_IF(FATAL, requested_iter == operators_map.end()) << "Can not find the output node: " << output_name;
+    const shared_ptr<RuntimeOperator> requested_op = requested_iter->second;
+    if (requested_op->type == "pnnx.Output") return output_name;
+
+    // 再次Build时复用已经添加的输出节点
+    const string &output_op_name = "pnnx_output_" + output_name;
+    const auto &output_iter = requested_op->output_operators.find(output_op_name);
+    if (output_iter != requested_op->output_operators.end()) {
+        CHECK(output_iter->second->type == "pnnx.Output") << "The name of the output node is used: " << output_op_name;
+        return output_op_name;
+    }
+
+    const auto &pnnx_op_iter = pnnx_operators_map.find(output_name);
+    CHECK(pnnx_op_iter != pnnx_operators_map.end() && pnnx_op_iter->second->outputs.size() == 1) << "The node has no single output: " << output_name;
+
+    shared_ptr<RuntimeOperator> output_op = make_shared<RuntimeOperator>();
+    output_op->name = output_op_name;
+    output_op->type = "pnnx.Output";
+    InitInputOperators(pnnx_op_iter->second->outputs, output_op);
+
+    requested_op->output_names.push_back(output_op_name);
+    requested_op->output_operators.insert({output_op_name, output_op});
+    this->operators_.push_back(output_op);
+    operators_map.insert({output_op_name, output_op});
+    return output_op_name;
 }
 
 
-shared_ptr<Layer> RuntimeGraph::CreateLayer(const shared_ptr<RuntimeOperator> &op) 
+void RuntimeGraph::MaterializeLayer(const shared_ptr<RuntimeOperator> &op, const RuntimeLayerOptions &options)
+{
+    lock_guard<mutex> lock(op->layer_mutex);
+    if (op->layer) return;
+
+    shared_ptr<Layer> layer = RuntimeGraph::CreateLayer(op, options);
+    CHECK(layer != nullptr) << "Layer create failed!";
+    op->layer = layer;
+}
+
+
+void RuntimeGraph::JoinPrefetch()
+{
+    if (this->prefetch_thread_.joinable()) this->prefetch_thread_.join();
+}
+
+
+shared_ptr<Layer> RuntimeGraph::CreateLayer(const shared_ptr<RuntimeOperator> &op, const RuntimeLayerOptions &options) 
 {
     LOG_IF(FATAL, !op) << "Operator is empty!";
     const auto &layer = LayerRegisterer::CreateLayer(op);
     LOG_IF(FATAL, !layer) << "Layer init failed " << op->type;
+    layer->Configure(options);
     return layer;
 }
 
 
+
 void RuntimeGraph::SetOpInputData(const vector<shared_ptr<Tensor<float>>> &src, const vector<shared_ptr<Tensor<float>>> &dest) 
 {
     CHECK(src.size() == dest.size()) << "src size: " << src.size() << " dest size: " << dest.size();
@@ -371,6 +704,7 @@ void RuntimeGraph::SetOpInputData(const vector<shared_ptr<Tensor<float>>> &src,
 
         float *dest_ptr = (float *) dest.at(i)->RawPtr();
         float *src_ptr = (float *) src.at(i)->RawPtr();
+        if (dest_ptr == src_ptr) continue;
         memcpy(dest_ptr, src_ptr, sizeof(float) * copy_size);
     }
 }
@@ -500,7 +834,13 @@ void RuntimeGraph::InitGraphAttrs(const map<string, pnnx::Attribute> &attrs, con
             case 1: {
                 shared_ptr<RuntimeAttribute> runtime_attribute = make_shared<RuntimeAttribute>();
                 runtime_attribute->type = RuntimeDataType::kTypeFloat32;
-                runtime_attribute->weight_data = attr.data;
+                // 权重文件映射得到的属性不拷贝，直接共享映射
+                if (attr.mapped_data) {
+                    runtime_attribute->mapped_data = attr.mapped_data;
+                    runtime_attribute->mapped_size = attr.mapped_size;
+                } else {
+                    runtime_attribute->weight_data = attr.data;
+                }
                 runtime_attribute->shape = attr.shape;
                 runtime_operator->attribute.insert({name, runtime_attribute});
                 break;
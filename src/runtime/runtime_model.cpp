@@ -0,0 +1,597 @@
+#include "runtime/runtime_model.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <unordered_map>
+#include <unordered_set>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <glog/logging.h>
+
+#include "layer/abstract/layer_factory.hpp"
+#include "layer/abstract/param_layer.hpp"
+
+
+namespace magic_infer
+{
+
+static const char kModelMagic[8] = {'M', 'A', 'G', 'I', 'C', 'I', 'N', 'F'};
+static const uint32_t kModelVersion = 2;
+static const uint64_t kModelAlignment = 64;
+
+/// 每个计算节点在元数据中至少占用的字节数：名称、类型、输入个数、输出标记、后继个数、参数个数、属性个数和打包标记
+static const uint64_t kOperatorMinMetaSize = 6 * sizeof(uint32_t) + 2 * sizeof(uint8_t);
+
+/// 权重按Layer内部格式打包保存的算子类型
+static const unordered_set<string> kPrepackedTypes{"nn.Conv2d", "nn.Linear", "magic.GlobalPoolLinear"};
+
+
+/// 模型文件的头部
+struct RuntimeModelHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t operator_num;
+    uint64_t meta_size;   /// 元数据的字节数，元数据紧跟在头部之后
+    uint64_t data_offset; /// 数据区在文件中的偏移，数据块的偏移都相对于数据区
+};
+
+
+static uint64_t AlignSize(uint64_t size)
+{
+    return (size + kModelAlignment - 1) / kModelAlignment * kModelAlignment;
+}
+
+
+/// 顺序写入元数据，数据块写入对齐的数据区
+class RuntimeModelWriter
+{
+public:
+    template<class T>
+    void Write(const T &value)
+    {
+        const char *ptr = (const char *) &value;
+        meta_.insert(meta_.end(), ptr, ptr + sizeof(T));
+    }
+
+    void WriteString(const string &value)
+    {
+        Write<uint32_t>(value.size());
+        meta_.insert(meta_.end(), value.begin(), value.end());
+    }
+
+    template<class T>
+    void WriteArray(const vector<T> &values)
+    {
+        Write<uint32_t>(values.size());
+        for (const T &value : values) {
+            Write<T>(value);
+        }
+    }
+
+    uint64_t WriteData(const void *data, uint64_t size)
+    {
+        const uint64_t offset = AlignSize(data_.size());
+        data_.resize(offset + size);
+        if (size > 0) memcpy(data_.data() + offset, data, size);
+        return offset;
+    }
+
+    bool Save(const string &model_path, uint32_t operator_num) const
+    {
+        RuntimeModelHeader header;
+        memcpy(header.magic, kModelMagic, sizeof(kModelMagic));
+        header.version = kModelVersion;
+        header.operator_num = operator_num;
+        header.meta_size = meta_.size();
+        header.data_offset = AlignSize(sizeof(header) + meta_.size());
+
+        ofstream os(model_path, ios::out | ios::binary | ios::trunc);
+        if (!os.good()) {
+            LOG(ERROR) << "Can not open the model file: " << model_path;
+            return false;
+        }
+
+        const vector<char> padding(header.data_offset - sizeof(header) - meta_.size(), 0);
+        os.write((const char *) &header, sizeof(header));
+        os.write(meta_.data(), meta_.size());
+        os.write(padding.data(), padding.size());
+        os.write(data_.data(), data_.size());
+        return os.good();
+    }
+
+private:
+    vector<char> meta_;
+    vector<char> data_;
+};
+
+
+/// 从映射的模型文件中顺序读取元数据，越界时返回失败
+class RuntimeModelReader
+{
+public:
+    RuntimeModelReader(const char *meta, uint64_t meta_size, char *data, uint64_t data_size)
+        : meta_(meta), meta_size_(meta_size), data_(data), data_size_(data_size) {}
+
+    template<class T>
+    bool Read(T &value)
+    {
+        if (pos_ + sizeof(T) > meta_size_) return false;
+        memcpy(&value, meta_ + pos_, sizeof(T));
+        pos_ += sizeof(T);
+        return true;
+    }
+
+    bool ReadString(string &value)
+    {
+        uint32_t size = 0;
+        if (!Read(size) || pos_ + size > meta_size_) return false;
+        value.assign(meta_ + pos_, size);
+        pos_ += size;
+        return true;
+    }
+
+    template<class T>
+    bool ReadArray(vector<T> &values)
+    {
+        uint32_t size = 0;
+        if (!Read(size) || pos_ + uint64_t(size) * sizeof(T) > meta_size_) return false;
+        values.resize(size);
+        for (T &value : values) {
+            Read(value);
+        }
+        return true;
+    }
+
+    char *Data(uint64_t offset, uint64_t size) const
+    {
+        if (offset % kModelAlignment != 0 || offset + size > data_size_) return nullptr;
+        return data_ + offset;
+    }
+
+private:
+    const char *meta_ = nullptr;
+    uint64_t meta_size_ = 0;
+    char *data_ = nullptr;
+    uint64_t data_size_ = 0;
+    uint64_t pos_ = 0;
+};
+
+
+/**
+ * 按照节点之间的连接关系对计算节点做拓扑排序
+ * @param operators 计算图的计算节点
+ * @param sorted_operators 排序之后的计算节点
+ * @return 计算图中没有环时返回true
+ */
+static bool SortOperators(const vector<shared_ptr<RuntimeOperator>> &operators, vector<shared_ptr<RuntimeOperator>> &sorted_operators)
+{
+    unordered_map<string, uint32_t> in_degrees;
+    for (const auto &op : operators) {
+        in_degrees.insert({op->name, op->input_operands.size()});
+    }
+
+    deque<shared_ptr<RuntimeOperator>> ready_queue;
+    for (const auto &op : operators) {
+        if (op->input_operands.empty()) ready_queue.push_back(op);
+    }
+
+    sorted_operators.clear();
+    while (!ready_queue.empty()) {
+        const shared_ptr<RuntimeOperator> op = ready_queue.front();
+        ready_queue.pop_front();
+        sorted_operators.push_back(op);
+
+        for (const auto &next_op : op->output_operators) {
+            const auto &degree_iter = in_degrees.find(next_op.first);
+            if (degree_iter != in_degrees.end() && --degree_iter->second == 0) {
+                ready_queue.push_back(next_op.second);
+            }
+        }
+    }
+    return sorted_operators.size() == operators.size();
+}
+
+
+static void WriteParameter(RuntimeModelWriter &writer, const RuntimeParameter *parameter)
+{
+    writer.Write<int32_t>(int32_t(parameter->type));
+    switch (parameter->type) {
+        case RuntimeParameterType::kParameterBool: {
+            writer.Write<uint8_t>(dynamic_cast<const RuntimeParameterBool *>(parameter)->value);
+            break;
+        }
+        case RuntimeParameterType::kParameterInt: {
+            writer.Write<int32_t>(dynamic_cast<const RuntimeParameterInt *>(parameter)->value);
+            break;
+        }
+        case RuntimeParameterType::kParameterFloat: {
+            writer.Write<float>(dynamic_cast<const RuntimeParameterFloat *>(parameter)->value);
+            break;
+        }
+        case RuntimeParameterType::kParameterString: {
+            writer.WriteString(dynamic_cast<const RuntimeParameterString *>(parameter)->value);
+            break;
+        }
+        case RuntimeParameterType::kParameterIntArray: {
+            writer.WriteArray<int32_t>(dynamic_cast<const RuntimeParameterIntArray *>(parameter)->value);
+            break;
+        }
+        case RuntimeParameterType::kParameterFloatArray: {
+            writer.WriteArray<float>(dynamic_cast<const RuntimeParameterFloatArray *>(parameter)->value);
+            break;
+        }
+        case RuntimeParameterType::kParameterStringArray: {
+            const vector<string> &values = dynamic_cast<const RuntimeParameterStringArray *>(parameter)->value;
+            writer.Write<uint32_t>(values.size());
+            for (const string &value : values) {
+                writer.WriteString(value);
+            }
+            break;
+        }
+        default: break;
+    }
+}
+
+
+static RuntimeParameter *ReadParameter(RuntimeModelReader &reader)
+{
+    int32_t type = 0;
+    if (!reader.Read(type)) return nullptr;
+
+    switch (RuntimeParameterType(type)) {
+        case RuntimeParameterType::kParameterUnknown: {
+            return new RuntimeParameter;
+        }
+        case RuntimeParameterType::kParameterBool: {
+            uint8_t value = 0;
+            if (!reader.Read(value)) return nullptr;
+            RuntimeParameterBool *parameter = new RuntimeParameterBool;
+            parameter->value = value;
+            return parameter;
+        }
+        case RuntimeParameterType::kParameterInt: {
+            int32_t value = 0;
+            if (!reader.Read(value)) return nullptr;
+            RuntimeParameterInt *parameter = new RuntimeParameterInt;
+            parameter->value = value;
+            return parameter;
+        }
+        case RuntimeParameterType::kParameterFloat: {
+            float value = 0.f;
+            if (!reader.Read(value)) return nullptr;
+            RuntimeParameterFloat *parameter = new RuntimeParameterFloat;
+            parameter->value = value;
+            return parameter;
+        }
+        case RuntimeParameterType::kParameterString: {
+            string value;
+            if (!reader.ReadString(value)) return nullptr;
+            RuntimeParameterString *parameter = new RuntimeParameterString;
+            parameter->value = value;
+            return parameter;
+        }
+        case RuntimeParameterType::kParameterIntArray: {
+            vector<int32_t> value;
+            if (!reader.ReadArray(value)) return nullptr;
+            RuntimeParameterIntArray *parameter = new RuntimeParameterIntArray;
+            parameter->value = value;
+            return parameter;
+        }
+        case RuntimeParameterType::kParameterFloatArray: {
+            vector<float> value;
+            if (!reader.ReadArray(value)) return nullptr;
+            RuntimeParameterFloatArray *parameter = new RuntimeParameterFloatArray;
+            parameter->value = value;
+            return parameter;
+        }
+        case RuntimeParameterType::kParameterStringArray: {
+            uint32_t size = 0;
+            if (!reader.Read(size)) return nullptr;
+            vector<string> value(size);
+            for (string &v : value) {
+                if (!reader.ReadString(v)) return nullptr;
+            }
+            RuntimeParameterStringArray *parameter = new RuntimeParameterStringArray;
+            parameter->value = value;
+            return parameter;
+        }
+        default: return nullptr;
+    }
+}
+
+
+static void WriteTensors(RuntimeModelWriter &writer, const vector<shared_ptr<Tensor<float>>> &tensors)
+{
+    writer.Write<uint32_t>(tensors.size());
+    for (const auto &tensor : tensors) {
+        writer.Write<uint32_t>(tensor->channels());
+        writer.Write<uint32_t>(tensor->rows());
+        writer.Write<uint32_t>(tensor->cols());
+        writer.Write<uint64_t>(writer.WriteData(tensor->RawPtr(), tensor->size() * sizeof(float)));
+    }
+}
+
+
+static bool ReadTensors(RuntimeModelReader &reader, vector<shared_ptr<Tensor<float>>> &tensors)
+{
+    uint32_t tensor_num = 0;
+    if (!reader.Read(tensor_num)) return false;
+
+    tensors.clear();
+    for (uint32_t i = 0; i < tensor_num; ++i) {
+        uint32_t channels = 0, rows = 0, cols = 0;
+        uint64_t offset = 0;
+        if (!reader.Read(channels) || !reader.Read(rows) || !reader.Read(cols) || !reader.Read(offset)) return false;
+
+        // 权重张量直接引用映射中已经打包好的数据
+        char *data = reader.Data(offset, uint64_t(channels) * rows * cols * sizeof(float));
+        if (!data || !channels || !rows || !cols) return false;
+        tensors.push_back(make_shared<Tensor<float>>((float *) data, channels, rows, cols));
+    }
+    return true;
+}
+
+
+bool RuntimeModel::Save(const string &model_path, const vector<shared_ptr<RuntimeOperator>> &operators,
+    const string &input_name, const vector<string> &output_names)
+{
+    vector<shared_ptr<RuntimeOperator>> sorted_operators;
+    if (!SortOperators(operators, sorted_operators)) {
+        LOG(ERROR) << "The graph has a cycle and can not be saved";
+        return false;
+    }
+
+    unordered_map<string, uint32_t> operator_indices;
+    for (uint32_t i = 0; i < sorted_operators.size(); ++i) {
+        operator_indices.insert({sorted_operators.at(i)->name, i});
+    }
+
+    RuntimeModelWriter writer;
+    writer.WriteString(input_name);
+    writer.Write<uint32_t>(output_names.size());
+    for (const string &output_name : output_names) {
+        writer.WriteString(output_name);
+    }
+
+    for (const auto &op : sorted_operators) {
+        writer.WriteString(op->name);
+        writer.WriteString(op->type);
+
+        writer.Write<uint32_t>(op->input_operands_seq.size());
+        for (const auto &input_operand : op->input_operands_seq) {
+            const auto &producer_iter = operator_indices.find(input_operand->name);
+            if (producer_iter == operator_indices.end()) {
+                LOG(ERROR) << "Can not find the producer " << input_operand->name << " of operator " << op->name;
+                return false;
+            }
+            writer.Write<uint32_t>(producer_iter->second);
+            writer.Write<int32_t>(int32_t(input_operand->type));
+            writer.WriteArray<int32_t>(input_operand->shapes);
+        }
+
+        writer.Write<uint8_t>(op->output_operands != nullptr);
+        if (op->output_operands) writer.WriteArray<int32_t>(op->output_operands->shapes);
+
+        vector<uint32_t> consumer_indices;
+        for (const auto &output_name : op->output_names) {
+            if (op->output_operators.find(output_name) != op->output_operators.end()) {
+                consumer_indices.push_back(operator_indices.at(output_name));
+            }
+        }
+        writer.WriteArray<uint32_t>(consumer_indices);
+
+        writer.Write<uint32_t>(op->params.size());
+        for (const auto &param : op->params) {
+            writer.WriteString(param.first);
+            WriteParameter(writer, param.second);
+        }
+
+        // 打包保存的算子不再保存原始的weight和bias，加载时直接使用打包之后的权重
+        const shared_ptr<ParamLayer> &param_layer = dynamic_pointer_cast<ParamLayer>(op->layer);
+        bool prepacked = param_layer != nullptr && kPrepackedTypes.count(op->type);
+
+        // 低精度的Linear转换之后释放了float权重，只能保存属性中原始的weight和bias
+        if (prepacked && any_of(param_layer->weights().begin(), param_layer->weights().end(),
+            [](const shared_ptr<Tensor<float>> &tensor) { return tensor == nullptr; })) {
+            const auto &weight_iter = op->attribute.find("weight");
+            if (weight_iter == op->attribute.end() || weight_iter->second->raw_size() == 0) {
+                LOG(ERROR) << "The float weights of operator " << op->name << " were released after packing, save the model before running it";
+                return false;
+            }
+            prepacked = false;
+        }
+
+        writer.Write<uint32_t>(op->attribute.size());
+        for (const auto &attr : op->attribute) {
+            const bool skip_data = prepacked && (attr.first == "weight" || attr.first == "bias");
+            writer.WriteString(attr.first);
+            writer.Write<int32_t>(int32_t(attr.second->type));
+            writer.WriteArray<int32_t>(attr.second->shape);
+
+            const uint64_t size = skip_data ? 0 : attr.second->raw_size();
+            writer.Write<uint64_t>(size ? writer.WriteData(attr.second->raw_data(), size) : 0);
+            writer.Write<uint64_t>(size);
+        }
+
+        writer.Write<uint8_t>(prepacked);
+        if (prepacked) {
+            WriteTensors(writer, param_layer->weights());
+            WriteTensors(writer, param_layer->bias());
+        }
+    }
+    return writer.Save(model_path, sorted_operators.size());
+}
+
+
+bool RuntimeModel::Load(const string &model_path, vector<shared_ptr<RuntimeOperator>> &operators,
+    string &input_name, vector<string> &output_names, shared_ptr<char> &mapping)
+{
+    const int fd = open(model_path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        LOG(ERROR) << "Can not open the model file: " << model_path;
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(RuntimeModelHeader)) {
+        LOG(ERROR) << "The model file is broken: " << model_path;
+        close(fd);
+        return false;
+    }
+
+    // 私有的可写映射，张量视图需要可写的地址，写入时才会复制页面
+    const size_t file_size = st.st_size;
+    void *addr = mmap(nullptr, file_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        LOG(ERROR) << "Can not map the model file: " << model_path;
+        return false;
+    }
+    mapping = shared_ptr<char>((char *) addr, [file_size](char *ptr) { munmap(ptr, file_size); });
+
+    RuntimeModelHeader header;
+    memcpy(&header, mapping.get(), sizeof(header));
+    if (memcmp(header.magic, kModelMagic, sizeof(kModelMagic)) != 0 || header.version != kModelVersion) {
+        LOG(ERROR) << "The model file is not a MagicInfer model or the version is not supported: " << model_path;
+        return false;
+    }
+    // 节点个数决定了预先分配的节点数量，先确认元数据能够容纳这么多节点
+    if (sizeof(header) + header.meta_size > file_size || header.data_offset > file_size || header.data_offset % kModelAlignment != 0 ||
+        uint64_t(header.operator_num) * kOperatorMinMetaSize > header.meta_size) {
+        LOG(ERROR) << "The model file is broken: " << model_path;
+        return false;
+    }
+
+    RuntimeModelReader reader(mapping.get() + sizeof(header), header.meta_size, mapping.get() + header.data_offset, file_size - header.data_offset);
+    uint32_t output_num = 0;
+    bool success = reader.ReadString(input_name) && reader.Read(output_num) && uint64_t(output_num) * sizeof(uint32_t) <= header.meta_size;
+    output_names.assign(success ? output_num : 0, string());
+    for (uint32_t i = 0; success && i < output_num; ++i) {
+        success = reader.ReadString(output_names.at(i));
+    }
+    if (!success) {
+        LOG(ERROR) << "The model file is broken: " << model_path;
+        return false;
+    }
+
+    operators.clear();
+    for (uint32_t i = 0; i < header.operator_num; ++i) {
+        operators.push_back(make_shared<RuntimeOperator>());
+    }
+    vector<vector<uint32_t>> operator_consumers(header.operator_num);
+
+    for (uint32_t i = 0; i < header.operator_num; ++i) {
+        const shared_ptr<RuntimeOperator> &op = operators.at(i);
+        success = reader.ReadString(op->name) && reader.ReadString(op->type);
+
+        uint32_t input_num = 0;
+        success = success && reader.Read(input_num);
+        for (uint32_t j = 0; success && j < input_num; ++j) {
+            uint32_t producer_index = 0;
+            int32_t type = 0;
+            shared_ptr<RuntimeOperand> input_operand = make_shared<RuntimeOperand>();
+            success = reader.Read(producer_index) && reader.Read(type) && reader.ReadArray(input_operand->shapes) && producer_index < i;
+            if (!success) break;
+
+            // 生产者排在消费者之前，名称已经读取
+            input_operand->name = operators.at(producer_index)->name;
+            input_operand->type = RuntimeDataType(type);
+            op->input_operands.insert({input_operand->name, input_operand});
+            op->input_operands_seq.push_back(input_operand);
+        }
+
+        uint8_t has_output = 0;
+        success = success && reader.Read(has_output);
+        if (success && has_output) {
+            shared_ptr<RuntimeOperand> output_operand = make_shared<RuntimeOperand>();
+            output_operand->name = op->name + "_output";
+            output_operand->type = RuntimeDataType::kTypeFloat32;
+            success = reader.ReadArray(output_operand->shapes);
+            op->output_operands = output_operand;
+        }
+
+        // 消费者排在当前节点之后，读取完所有节点之后再连接
+        vector<uint32_t> &consumer_indices = operator_consumers.at(i);
+        success = success && reader.ReadArray(consumer_indices);
+        for (uint32_t j = 0; success && j < consumer_indices.size(); ++j) {
+            success = consumer_indices.at(j) > i && consumer_indices.at(j) < operators.size();
+        }
+
+        uint32_t param_num = 0;
+        success = success && reader.Read(param_num);
+        for (uint32_t j = 0; success && j < param_num; ++j) {
+            string name;
+            success = reader.ReadString(name);
+            RuntimeParameter *parameter = success ? ReadParameter(reader) : nullptr;
+            success = parameter != nullptr;
+            if (success) op->params.insert({name, parameter});
+        }
+
+        uint32_t attr_num = 0;
+        success = success && reader.Read(attr_num);
+        for (uint32_t j = 0; success && j < attr_num; ++j) {
+            string name;
+            int32_t type = 0;
+            uint64_t offset = 0, size = 0;
+            shared_ptr<RuntimeAttribute> attribute = make_shared<RuntimeAttribute>();
+            success = reader.ReadString(name) && reader.Read(type) && reader.ReadArray(attribute->shape) && reader.Read(offset) && reader.Read(size);
+            if (!success) break;
+
+            // 属性直接引用映射中的数据，和映射共享所有权
+            attribute->type = RuntimeDataType(type);
+            if (size > 0) {
+                const char *data = reader.Data(offset, size);
+                success = data != nullptr;
+                attribute->mapped_data = shared_ptr<const char>(mapping, data);
+                attribute->mapped_size = size;
+            }
+            op->attribute.insert({name, attribute});
+        }
+
+        uint8_t prepacked = 0;
+        vector<shared_ptr<Tensor<float>>> weights;
+        vector<shared_ptr<Tensor<float>>> bias;
+        success = success && reader.Read(prepacked);
+        if (success && prepacked) {
+            success = ReadTensors(reader, weights) && ReadTensors(reader, bias);
+        }
+
+        if (!success) {
+            LOG(ERROR) << "The model file is broken at operator " << i << ": " << model_path;
+            operators.clear();
+            return false;
+        }
+
+        if (op->type != "pnnx.Input" && op->type != "pnnx.Output") {
+            op->prepacked_weights = prepacked;
+            op->layer = LayerRegisterer::CreateLayer(op);
+            if (!op->layer) {
+                LOG(ERROR) << "Layer create failed: " << op->type;
+                operators.clear();
+                return false;
+            }
+
+            if (prepacked) {
+                op->layer->set_weights(weights);
+                if (!bias.empty()) op->layer->set_bias(bias);
+            }
+        }
+    }
+
+    for (uint32_t i = 0; i < operators.size(); ++i) {
+        const shared_ptr<RuntimeOperator> &op = operators.at(i);
+        for (const uint32_t consumer_index : operator_consumers.at(i)) {
+            const shared_ptr<RuntimeOperator> &next_op = operators.at(consumer_index);
+            op->output_names.push_back(next_op->name);
+            op->output_operators.insert({next_op->name, next_op});
+        }
+    }
+    return true;
+}
+
+}
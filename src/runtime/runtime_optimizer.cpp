@@ -0,0 +1,440 @@
+#include "runtime/runtime_optimizer.hpp"
+
+#include <algorithm>
+#include <deque>
+#include <unordered_map>
+#include <unordered_set>
+#include <glog/logging.h>
+
+#include "runtime/runtime_pass.hpp"
+
+
+namespace magic_infer
+{
+
+RuntimeGraphPass::RuntimeGraphPass(string pass_name) : pass_name_(move(pass_name)) {}
+
+const string &RuntimeGraphPass::pass_name() const { return this->pass_name_; }
+
+
+void RuntimeGraphOptimizer::AddPass(const shared_ptr<RuntimeGraphPass> &pass)
+{
+    CHECK(pass != nullptr) << "The graph pass is nullptr";
+    this->passes_.push_back(pass);
+}
+
+
+const vector<RuntimePassReport> &RuntimeGraphOptimizer::reports() const { return this->reports_; }
+
+
+const vector<RuntimePassReport> &RuntimeGraphOptimizer::Run(vector<shared_ptr<RuntimeOperator>> &operators)
+{
+    this->reports_.clear();
+    CHECK(Validate(operators)) << "The graph is malformed before optimization";
+
+    for (const auto &pass : this->passes_) {
+        RuntimePassReport report;
+        report.pass_name = pass->pass_name();
+        report.nodes_before = operators.size();
+        report.flops_before = EstimateFlops(operators);
+
+        report.changed_num = pass->Run(operators);
+        CHECK(Validate(operators)) << "The graph is malformed after pass " << pass->pass_name();
+
+        report.nodes_after = operators.size();
+        report.flops_after = EstimateFlops(operators);
+        VLOG(1) << "Pass " << report.pass_name << " changed " << report.changed_num << " nodes, nodes: " << report.nodes_before
+                << " -> " << report.nodes_after << ", flops: " << report.flops_before << " -> " << report.flops_after;
+        this->reports_.push_back(report);
+    }
+    return this->reports_;
+}
+
+
+RuntimeGraphOptimizer RuntimeGraphOptimizer::DefaultOptimizer(const vector<string> &output_names)
+{
+    RuntimeGraphOptimizer optimizer;
+    optimizer.AddPass(make_shared<DeadOperatorEliminationPass>(output_names));
+    optimizer.AddPass(make_shared<IdentityOperatorEliminationPass>());
+    optimizer.AddPass(make_shared<ConvBatchNormFoldPass>());
+    optimizer.AddPass(make_shared<SPPFFusionPass>());
+    optimizer.AddPass(make_shared<GlobalPoolLinearFusionPass>());
+    optimizer.AddPass(make_shared<SqueezeExcitationFusionPass>());
+    return optimizer;
+}
+
+
+bool RuntimeGraphOptimizer::Validate(const vector<shared_ptr<RuntimeOperator>> &operators)
+{
+    unordered_map<string, shared_ptr<RuntimeOperator>> operators_map;
+    for (const auto &op : operators) {
+        if (!op) {
+            LOG(ERROR) << "Meet the empty node";
+            return false;
+        }
+
+        if (!operators_map.insert({op->name, op}).second) {
+            LOG(ERROR) << "Duplicate node name: " << op->name;
+            return false;
+        }
+    }
+
+    for (const auto &op : operators) {
+        // 输入操作数必须来自图中的节点，并且前驱节点记录了当前节点
+        for (const auto &input_operand : op->input_operands) {
+            const auto &producer_iter = operators_map.find(input_operand.first);
+            if (producer_iter == operators_map.end()) {
+                LOG(ERROR) << "Can not find the producer " << input_operand.first << " of node " << op->name;
+                return false;
+            }
+
+            const auto &producer = producer_iter->second;
+            const auto &next_iter = producer->output_operators.find(op->name);
+            if (next_iter == producer->output_operators.end() || next_iter->second != op ||
+                find(producer->output_names.begin(), producer->output_names.end(), op->name) == producer->output_names.end()) {
+                LOG(ERROR) << "The producer " << producer->name << " does not link to node " << op->name;
+                return false;
+            }
+        }
+
+        for (const auto &input_operand : op->input_operands_seq) {
+            if (op->input_operands.find(input_operand->name) == op->input_operands.end()) {
+                LOG(ERROR) << "The input operand " << input_operand->name << " of node " << op->name << " is inconsistent";
+                return false;
+            }
+        }
+
+        // 后继节点必须在图中，并且后继节点的输入来自当前节点
+        for (const auto &next_op : op->output_operators) {
+            const auto &next_iter = operators_map.find(next_op.first);
+            if (next_iter == operators_map.end() || next_iter->second != next_op.second) {
+                LOG(ERROR) << "Can not find the consumer " << next_op.first << " of node " << op->name;
+                return false;
+            }
+
+            if (next_op.second->input_operands.find(op->name) == next_op.second->input_operands.end()) {
+                LOG(ERROR) << "The consumer " << next_op.first << " does not read from node " << op->name;
+                return false;
+            }
+        }
+
+        for (const auto &output_name : op->output_names) {
+            if (op->output_operators.find(output_name) == op->output_operators.end()) {
+                LOG(ERROR) << "The output name " << output_name << " of node " << op->name << " is not linked";
+                return false;
+            }
+        }
+    }
+
+    // 拓扑排序检查计算图中是否有环
+    unordered_map<string, uint32_t> in_degrees;
+    deque<shared_ptr<RuntimeOperator>> ready_operators;
+    for (const auto &op : operators) {
+        in_degrees.insert({op->name, op->input_operands.size()});
+        if (op->input_operands.empty()) ready_operators.push_back(op);
+    }
+
+    uint32_t visited_num = 0;
+    while (!ready_operators.empty()) {
+        const shared_ptr<RuntimeOperator> op = ready_operators.front();
+        ready_operators.pop_front();
+        visited_num += 1;
+
+        for (const auto &next_op : op->output_operators) {
+            if (--in_degrees.at(next_op.first) == 0) ready_operators.push_back(next_op.second);
+        }
+    }
+
+    if (visited_num != operators.size()) {
+        LOG(ERROR) << "The graph has a cycle";
+        return false;
+    }
+    return true;
+}
+
+
+vector<int32_t> RuntimeGraphOptimizer::OutputShapes(const shared_ptr<RuntimeOperator> &op)
+{
+    for (const auto &next_op : op->output_operators) {
+        const auto &input_operands = next_op.second->input_operands;
+        const auto &operand_iter = input_operands.find(op->name);
+        if (operand_iter != input_operands.end()) return operand_iter->second->shapes;
+    }
+    return {};
+}
+
+
+void FlopsEstimatorRegisterer::RegisterEstimator(const string &op_type, const Estimator &estimator)
+{
+    CHECK(estimator != nullptr) << "The flops estimator of " << op_type << " is nullptr";
+    EstimateRegistry &registry = Registry();
+    CHECK_EQ(registry.count(op_type), 0) << "Flops estimator: " << op_type << " has already registered!";
+    registry.insert({op_type, estimator});
+}
+
+
+FlopsEstimatorRegisterer::Estimator FlopsEstimatorRegisterer::GetEstimator(const string &op_type)
+{
+    const EstimateRegistry &registry = Registry();
+    const auto iter = registry.find(op_type);
+    return iter == registry.end() ? nullptr : iter->second;
+}
+
+
+FlopsEstimatorRegisterer::EstimateRegistry &FlopsEstimatorRegisterer::Registry()
+{
+    static EstimateRegistry *kRegistry = new EstimateRegistry();
+    CHECK(kRegistry != nullptr) << "Global flops estimator register init failed!";
+    return *kRegistry;
+}
+
+
+uint64_t RuntimeGraphOptimizer::ShapeElements(const vector<int32_t> &shapes)
+{
+    if (shapes.empty()) return 0;
+
+    uint64_t elements = 1;
+    for (const int32_t dim : shapes) {
+        elements *= uint64_t(max(dim, 0));
+    }
+    return elements;
+}
+
+
+uint64_t RuntimeGraphOptimizer::EstimateWeightFlops(const shared_ptr<RuntimeOperator> &op, uint64_t output_elements)
+{
+    const auto iter = op->attribute.find("weight");
+    if (iter == op->attribute.end() || iter->second->shape.empty() || iter->second->shape.front() <= 0) return output_elements;
+
+    const vector<int> &weight_shapes = iter->second->shape;
+    const uint64_t mac_per_output = ShapeElements(weight_shapes) / weight_shapes.front();
+    return 2 * output_elements * mac_per_output;
+}
+
+
+uint64_t RuntimeGraphOptimizer::EstimateFlops(const vector<shared_ptr<RuntimeOperator>> &operators)
+{
+    static const unordered_set<string> kDataMovementTypes{"pnnx.Input", "pnnx.Output", "Tensor.view", "Tensor.reshape",
+        "torch.flatten", "torch.cat", "nn.Identity", "nn.Dropout"};
+
+    uint64_t flops = 0;
+    for (const auto &op : operators) {
+        if (kDataMovementTypes.count(op->type)) continue;
+
+        // 没有后继的节点按输入形状估算输出
+        vector<int32_t> output_shapes = OutputShapes(op);
+        if (output_shapes.empty() && !op->input_operands_seq.empty()) output_shapes = op->input_operands_seq.front()->shapes;
+
+        const uint64_t output_elements = ShapeElements(output_shapes);
+        const FlopsEstimatorRegisterer::Estimator estimator = FlopsEstimatorRegisterer::GetEstimator(op->type);
+        flops += estimator ? estimator(op, output_elements) : output_elements;
+    }
+    return flops;
+}
+
+
+vector<vector<shared_ptr<RuntimeOperator>>> RuntimeGraphOptimizer::MatchChain(const vector<shared_ptr<RuntimeOperator>> &operators,
+    const vector<string> &types)
+{
+    vector<vector<shared_ptr<RuntimeOperator>>> chains;
+    if (types.empty()) return chains;
+
+    for (const auto &op : operators) {
+        if (op->type != types.front()) continue;
+
+        vector<shared_ptr<RuntimeOperator>> chain{op};
+        for (uint32_t i = 1; i < types.size(); ++i) {
+            const auto &current_op = chain.back();
+            if (current_op->output_operators.size() != 1) break;
+
+            const shared_ptr<RuntimeOperator> &next_op = current_op->output_operators.begin()->second;
+            if (next_op->type != types.at(i) || next_op->input_operands_seq.size() != 1) break;
+            chain.push_back(next_op);
+        }
+
+        if (chain.size() == types.size()) chains.push_back(chain);
+    }
+    return chains;
+}
+
+
+/**
+ * 将后继节点的输入从old_name改为由new_name节点提供
+ * @param next_op 后继节点
+ * @param old_name 原来的前驱节点名称
+ * @param new_name 新的前驱节点名称
+ */
+static void RenameInputOperand(const shared_ptr<RuntimeOperator> &next_op, const string &old_name, const string &new_name)
+{
+    auto &input_operands = next_op->input_operands;
+    const auto &operand_iter = input_operands.find(old_name);
+    if (operand_iter == input_operands.end()) return;
+
+    shared_ptr<RuntimeOperand> operand = operand_iter->second;
+    input_operands.erase(operand_iter);
+    operand->name = new_name;
+    input_operands.insert({new_name, operand});
+}
+
+
+/**
+ * 将只有一个输入的节点从计算图的连接关系中摘除，节点的后继改为直接读取其前驱的输出，不修改节点数组
+ * @param operators_map 按名称索引的计算节点
+ * @param op 待摘除的节点
+ * @return 是否摘除成功
+ */
+static bool UnlinkOperator(const unordered_map<string, shared_ptr<RuntimeOperator>> &operators_map, const shared_ptr<RuntimeOperator> &op)
+{
+    CHECK(op != nullptr) << "The removed node is nullptr";
+    if (op->input_operands.size() != 1 || op->input_operands_seq.size() != 1) return false;
+
+    const auto &producer_iter = operators_map.find(op->input_operands.begin()->first);
+    if (producer_iter == operators_map.end()) return false;
+
+    // 后继节点已经直接使用前驱节点的输出时无法删除
+    const shared_ptr<RuntimeOperator> producer = producer_iter->second;
+    for (const auto &next_op : op->output_operators) {
+        if (next_op.second->input_operands.count(producer->name)) return false;
+    }
+
+    auto &producer_output_names = producer->output_names;
+    producer_output_names.erase(remove(producer_output_names.begin(), producer_output_names.end(), op->name), producer_output_names.end());
+    producer->output_operators.erase(op->name);
+
+    for (const auto &next_op : op->output_operators) {
+        RenameInputOperand(next_op.second, op->name, producer->name);
+        producer->output_operators.insert(next_op);
+    }
+    for (const auto &output_name : op->output_names) {
+        if (find(producer_output_names.begin(), producer_output_names.end(), output_name) == producer_output_names.end()) {
+            producer_output_names.push_back(output_name);
+        }
+    }
+    return true;
+}
+
+
+bool RuntimeGraphOptimizer::RemoveOperator(vector<shared_ptr<RuntimeOperator>> &operators, const shared_ptr<RuntimeOperator> &op)
+{
+    return RemoveOperators(operators, {op}).front();
+}
+
+
+vector<bool> RuntimeGraphOptimizer::RemoveOperators(vector<shared_ptr<RuntimeOperator>> &operators,
+    const vector<shared_ptr<RuntimeOperator>> &removed_operators)
+{
+    unordered_map<string, shared_ptr<RuntimeOperator>> operators_map;
+    operators_map.reserve(operators.size());
+    for (const auto &op : operators) {
+        operators_map.insert({op->name, op});
+    }
+
+    // 依次摘除节点，被摘除节点的后继已经改名为新的前驱，按名称查找时不会再找到被摘除的节点
+    vector<bool> removed(removed_operators.size(), false);
+    unordered_set<shared_ptr<RuntimeOperator>> removed_set;
+    for (uint32_t i = 0; i < removed_operators.size(); ++i) {
+        if (removed_set.count(removed_operators.at(i)) || !UnlinkOperator(operators_map, removed_operators.at(i))) continue;
+        removed.at(i) = true;
+        removed_set.insert(removed_operators.at(i));
+    }
+
+    if (!removed_set.empty()) {
+        operators.erase(remove_if(operators.begin(), operators.end(),
+            [&removed_set](const shared_ptr<RuntimeOperator> &op) { return removed_set.count(op) > 0; }), operators.end());
+    }
+    return removed;
+}
+
+
+bool RuntimeGraphOptimizer::ReplaceOperators(vector<shared_ptr<RuntimeOperator>> &operators, const vector<shared_ptr<RuntimeOperator>> &chain,
+    const shared_ptr<RuntimeOperator> &new_op)
+{
+    CHECK(!chain.empty() && new_op != nullptr) << "The replaced chain or new node is empty";
+    const shared_ptr<RuntimeOperator> &front_op = chain.front();
+    const shared_ptr<RuntimeOperator> &back_op = chain.back();
+    unordered_set<string> chain_names;
+    for (const auto &op : chain) {
+        chain_names.insert(op->name);
+    }
+
+    // 新节点的名称不能和链外的节点重复
+    for (const auto &op : operators) {
+        if (op->name == new_op->name && !chain_names.count(op->name)) return false;
+    }
+
+    unordered_map<string, shared_ptr<RuntimeOperator>> operators_map;
+    for (const auto &op : operators) {
+        operators_map.insert({op->name, op});
+    }
+
+    // 除链尾之外，链中节点的输出只能被链中的节点使用
+    for (const auto &op : chain) {
+        if (op == back_op) continue;
+        for (const auto &next_op : op->output_operators) {
+            if (!chain_names.count(next_op.first)) return false;
+        }
+    }
+
+    // 新节点沿用链尾的名称时，后继节点已经按该名称读取输入
+    for (const auto &next_op : back_op->output_operators) {
+        if (next_op.first != new_op->name && new_op->name != back_op->name && next_op.second->input_operands.count(new_op->name)) {
+            return false;
+        }
+    }
+
+    // 调用者没有指定输入时使用链首的输入，指定的输入只能来自链外的节点
+    if (new_op->input_operands_seq.empty()) {
+        new_op->input_operands = front_op->input_operands;
+        new_op->input_operands_seq = front_op->input_operands_seq;
+    }
+    for (const auto &input_operand : new_op->input_operands_seq) {
+        if (chain_names.count(input_operand->name)) return false;
+    }
+    new_op->output_names = back_op->output_names;
+    new_op->output_operators = back_op->output_operators;
+    if (!new_op->output_operands) new_op->output_operands = back_op->output_operands;
+
+    // 链外的前驱不再输出到链中的节点，新节点的前驱在原来第一个链中节点的位置输出到新节点
+    unordered_set<shared_ptr<RuntimeOperator>> producers;
+    for (const auto &op : chain) {
+        for (const auto &input_operand : op->input_operands) {
+            const auto &producer_iter = operators_map.find(input_operand.first);
+            if (producer_iter != operators_map.end() && !chain_names.count(input_operand.first)) producers.insert(producer_iter->second);
+        }
+    }
+    for (const auto &producer : producers) {
+        const bool is_input = new_op->input_operands.count(producer->name) > 0;
+        vector<string> output_names;
+        for (const string &output_name : producer->output_names) {
+            const bool replaced = chain_names.count(output_name) || output_name == new_op->name;
+            if (!replaced) {
+                output_names.push_back(output_name);
+            } else if (is_input && find(output_names.begin(), output_names.end(), new_op->name) == output_names.end()) {
+                output_names.push_back(new_op->name);
+            }
+        }
+        if (is_input && find(output_names.begin(), output_names.end(), new_op->name) == output_names.end()) {
+            output_names.push_back(new_op->name);
+        }
+        producer->output_names = output_names;
+
+        for (const auto &op : chain) {
+            producer->output_operators.erase(op->name);
+        }
+        if (is_input) producer->output_operators[new_op->name] = new_op;
+    }
+
+    for (const auto &next_op : back_op->output_operators) {
+        RenameInputOperand(next_op.second, back_op->name, new_op->name);
+    }
+
+    // 新节点放在链尾的位置，此时它的所有前驱都已经排在前面
+    const auto &back_iter = find(operators.begin(), operators.end(), back_op);
+    CHECK(back_iter != operators.end()) << "Can not find the node " << back_op->name;
+    *back_iter = new_op;
+    operators.erase(remove_if(operators.begin(), operators.end(),
+        [&chain](const shared_ptr<RuntimeOperator> &op) { return find(chain.begin(), chain.end(), op) != chain.end(); }), operators.end());
+    return true;
+}
+
+}
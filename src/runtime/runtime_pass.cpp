@@ -0,0 +1,529 @@
+#include "runtime/runtime_pass.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <deque>
+#include <unordered_map>
+#include <unordered_set>
+#include <glog/logging.h>
+
+
+namespace magic_infer
+{
+
+DeadOperatorEliminationPass::DeadOperatorEliminationPass(vector<string> output_names)
+    : RuntimeGraphPass("DeadOperatorElimination"), output_names_(move(output_names)) {}
+
+
+uint32_t DeadOperatorEliminationPass::Run(vector<shared_ptr<RuntimeOperator>> &operators)
+{
+    unordered_map<string, shared_ptr<RuntimeOperator>> operators_map;
+    deque<shared_ptr<RuntimeOperator>> live_queue;
+    unordered_set<string> live_names;
+
+    const unordered_set<string> output_names(this->output_names_.begin(), this->output_names_.end());
+    for (const auto &op : operators) {
+        operators_map.insert({op->name, op});
+        const bool is_output = op->type == "pnnx.Output" && (output_names.empty() || output_names.count(op->name));
+        if (op->type == "pnnx.Input" || is_output) {
+            live_queue.push_back(op);
+            live_names.insert(op->name);
+        }
+    }
+
+    // 从输出节点反向遍历，能到达输出节点的计算节点都是有效节点
+    while (!live_queue.empty()) {
+        const shared_ptr<RuntimeOperator> op = live_queue.front();
+        live_queue.pop_front();
+
+        for (const auto &input_operand : op->input_operands) {
+            const auto &producer_iter = operators_map.find(input_operand.first);
+            if (producer_iter != operators_map.end() && live_names.insert(input_operand.first).second) {
+                live_queue.push_back(producer_iter->second);
+            }
+        }
+    }
+
+    if (live_names.size() == operators.size()) return 0;
+
+    const uint32_t operators_num = operators.size();
+    for (const auto &op : operators) {
+        if (!live_names.count(op->name)) continue;
+
+        // 有效节点不再向无效节点输出
+        auto &output_names = op->output_names;
+        output_names.erase(remove_if(output_names.begin(), output_names.end(),
+            [&live_names](const string &name) { return !live_names.count(name); }), output_names.end());
+        for (auto next_iter = op->output_operators.begin(); next_iter != op->output_operators.end();) {
+            if (!live_names.count(next_iter->first)) {
+                next_iter = op->output_operators.erase(next_iter);
+            } else {
+                ++next_iter;
+            }
+        }
+    }
+
+    operators.erase(remove_if(operators.begin(), operators.end(),
+        [&live_names](const shared_ptr<RuntimeOperator> &op) { return !live_names.count(op->name); }), operators.end());
+    return operators_num - operators.size();
+}
+
+
+IdentityOperatorEliminationPass::IdentityOperatorEliminationPass() : RuntimeGraphPass("IdentityOperatorElimination") {}
+
+
+uint32_t IdentityOperatorEliminationPass::Run(vector<shared_ptr<RuntimeOperator>> &operators)
+{
+    static const unordered_set<string> kIdentityTypes{"Tensor.view", "Tensor.reshape", "torch.flatten", "nn.Identity", "nn.Dropout"};
+
+    vector<shared_ptr<RuntimeOperator>> identity_operators;
+    for (const auto &op : operators) {
+        if (!kIdentityTypes.count(op->type) || op->input_operands_seq.size() != 1) continue;
+
+        // 输入和输出形状一致时，节点只是拷贝数据
+        const vector<int32_t> &output_shapes = RuntimeGraphOptimizer::OutputShapes(op);
+        if (!output_shapes.empty() && output_shapes == op->input_operands_seq.front()->shapes) {
+            identity_operators.push_back(op);
+        }
+    }
+
+    const vector<bool> &removed = RuntimeGraphOptimizer::RemoveOperators(operators, identity_operators);
+    return count(removed.begin(), removed.end(), true);
+}
+
+
+/**
+ * 读取节点属性中的float权重，属性不存在时以默认值填充
+ * @param attrs 节点的属性
+ * @param name 属性名称
+ * @param size 期望的元素个数
+ * @param default_value 属性不存在时的默认值
+ * @return 权重数组
+ */
+static vector<float> GetAttributeData(const map<string, shared_ptr<RuntimeAttribute>> &attrs, const string &name,
+    uint32_t size, float default_value)
+{
+    const auto &attr_iter = attrs.find(name);
+    if (attr_iter == attrs.end() || attr_iter->second->raw_size() == 0) {
+        return vector<float>(size, default_value);
+    }
+
+    const vector<float> &values = attr_iter->second->get<float>();
+    CHECK(values.size() == size) << "The size of attribute " << name << " is wrong: " << values.size() << " != " << size;
+    return values;
+}
+
+
+/**
+ * 将float权重写回节点属性
+ * @param attr 节点属性
+ * @param values 权重数组
+ */
+static void SetAttributeData(const shared_ptr<RuntimeAttribute> &attr, const vector<float> &values)
+{
+    attr->type = RuntimeDataType::kTypeFloat32;
+    attr->mapped_data.reset();
+    attr->mapped_size = 0;
+    attr->weight_data.resize(values.size() * sizeof(float));
+    memcpy(attr->weight_data.data(), values.data(), attr->weight_data.size());
+}
+
+
+ConvBatchNormFoldPass::ConvBatchNormFoldPass() : RuntimeGraphPass("ConvBatchNormFold") {}
+
+
+uint32_t ConvBatchNormFoldPass::Run(vector<shared_ptr<RuntimeOperator>> &operators)
+{
+    struct FoldedWeight
+    {
+        shared_ptr<RuntimeOperator> conv_op;
+        vector<float> weight;
+        vector<float> bias;
+    };
+
+    // 先计算所有折叠之后的权重，再一次性删除BatchNorm2d节点
+    vector<FoldedWeight> folded_weights;
+    vector<shared_ptr<RuntimeOperator>> bn_operators;
+    const auto &chains = RuntimeGraphOptimizer::MatchChain(operators, {"nn.Conv2d", "nn.BatchNorm2d"});
+    for (const auto &chain : chains) {
+        const shared_ptr<RuntimeOperator> &conv_op = chain.front();
+        const shared_ptr<RuntimeOperator> &bn_op = chain.back();
+
+        const auto &bn_params = bn_op->params;
+        const auto &conv_params = conv_op->params;
+        if (bn_params.find("eps") == bn_params.end() || conv_params.find("bias") == conv_params.end()) continue;
+
+        const auto &eps = dynamic_cast<RuntimeParameterFloat *>(bn_params.at("eps"));
+        const auto &use_bias = dynamic_cast<RuntimeParameterBool *>(conv_params.at("bias"));
+        if (!eps || !use_bias) continue;
+
+        const auto &bn_attrs = bn_op->attribute;
+        const auto &conv_attrs = conv_op->attribute;
+        if (bn_attrs.find("running_mean") == bn_attrs.end() || bn_attrs.find("running_var") == bn_attrs.end()) continue;
+        if (conv_attrs.find("weight") == conv_attrs.end()) continue;
+
+        const shared_ptr<RuntimeAttribute> &weight_attr = conv_attrs.at("weight");
+        if (weight_attr->shape.size() != 4 || weight_attr->shape.front() <= 0) continue;
+
+        const uint32_t out_channels = weight_attr->shape.front();
+        const vector<float> &mean = GetAttributeData(bn_attrs, "running_mean", out_channels, 0.f);
+        const vector<float> &var = GetAttributeData(bn_attrs, "running_var", out_channels, 1.f);
+        const vector<float> &affine_weight = GetAttributeData(bn_attrs, "weight", out_channels, 1.f);
+        const vector<float> &affine_bias = GetAttributeData(bn_attrs, "bias", out_channels, 0.f);
+
+        vector<float> weight = weight_attr->get<float>();
+        vector<float> bias = use_bias->value ? GetAttributeData(conv_attrs, "bias", out_channels, 0.f) : vector<float>(out_channels, 0.f);
+        CHECK(weight.size() % out_channels == 0) << "The size of convolution weight is wrong";
+
+        // w' = w * gamma / sqrt(var + eps), b' = (b - mean) * gamma / sqrt(var + eps) + beta
+        const uint32_t kernel_size = weight.size() / out_channels;
+        for (uint32_t oc = 0; oc < out_channels; ++oc) {
+            const float scale = affine_weight.at(oc) / sqrtf(var.at(oc) + eps->value);
+            float *kernel_ptr = weight.data() + oc * kernel_size;
+            for (uint32_t k = 0; k < kernel_size; ++k) {
+                kernel_ptr[k] *= scale;
+            }
+            bias.at(oc) = (bias.at(oc) - mean.at(oc)) * scale + affine_bias.at(oc);
+        }
+
+        folded_weights.push_back({conv_op, move(weight), move(bias)});
+        bn_operators.push_back(bn_op);
+    }
+
+    // BatchNorm2d的后继节点改为从卷积节点读取输入，删除成功之后才改写卷积的权重
+    uint32_t fold_num = 0;
+    const vector<bool> &removed = RuntimeGraphOptimizer::RemoveOperators(operators, bn_operators);
+    for (uint32_t i = 0; i < folded_weights.size(); ++i) {
+        if (!removed.at(i)) continue;
+
+        const FoldedWeight &folded = folded_weights.at(i);
+        auto &conv_attrs = folded.conv_op->attribute;
+        const auto &use_bias = dynamic_cast<RuntimeParameterBool *>(folded.conv_op->params.at("bias"));
+        const uint32_t out_channels = folded.bias.size();
+        SetAttributeData(conv_attrs.at("weight"), folded.weight);
+        if (!use_bias->value || conv_attrs.find("bias") == conv_attrs.end()) {
+            shared_ptr<RuntimeAttribute> bias_attr = make_shared<RuntimeAttribute>();
+            bias_attr->shape = {int(out_channels)};
+            conv_attrs[string("bias")] = bias_attr;
+            use_bias->value = true;
+        }
+        SetAttributeData(conv_attrs.at("bias"), folded.bias);
+        fold_num += 1;
+    }
+    return fold_num;
+}
+
+
+/**
+ * 读取节点的整数数组参数
+ * @param op 计算节点
+ * @param name 参数名称
+ * @return 参数的值，参数不存在或者类型不对时返回空
+ */
+static const vector<int> *GetIntArrayParameter(const shared_ptr<RuntimeOperator> &op, const string &name)
+{
+    const auto &param_iter = op->params.find(name);
+    if (param_iter == op->params.end()) return nullptr;
+
+    const auto &param = dynamic_cast<RuntimeParameterIntArray *>(param_iter->second);
+    return param ? &param->value : nullptr;
+}
+
+
+/**
+ * 按类型深拷贝节点的参数，融合节点持有自己的参数，被替换的节点析构时释放原来的参数
+ * @param op 计算节点
+ * @return 拷贝的参数
+ */
+static map<string, RuntimeParameter *> CopyParameters(const shared_ptr<RuntimeOperator> &op)
+{
+    map<string, RuntimeParameter *> params;
+    for (const auto &param : op->params) {
+        const RuntimeParameter *parameter = param.second;
+        RuntimeParameter *copied = nullptr;
+        switch (parameter->type) {
+            case RuntimeParameterType::kParameterBool: {
+                copied = new RuntimeParameterBool(*dynamic_cast<const RuntimeParameterBool *>(parameter));
+                break;
+            }
+            case RuntimeParameterType::kParameterInt: {
+                copied = new RuntimeParameterInt(*dynamic_cast<const RuntimeParameterInt *>(parameter));
+                break;
+            }
+            case RuntimeParameterType::kParameterFloat: {
+                copied = new RuntimeParameterFloat(*dynamic_cast<const RuntimeParameterFloat *>(parameter));
+                break;
+            }
+            case RuntimeParameterType::kParameterString: {
+                copied = new RuntimeParameterString(*dynamic_cast<const RuntimeParameterString *>(parameter));
+                break;
+            }
+            case RuntimeParameterType::kParameterIntArray: {
+                copied = new RuntimeParameterIntArray(*dynamic_cast<const RuntimeParameterIntArray *>(parameter));
+                break;
+            }
+            case RuntimeParameterType::kParameterFloatArray: {
+                copied = new RuntimeParameterFloatArray(*dynamic_cast<const RuntimeParameterFloatArray *>(parameter));
+                break;
+            }
+            case RuntimeParameterType::kParameterStringArray: {
+                copied = new RuntimeParameterStringArray(*dynamic_cast<const RuntimeParameterStringArray *>(parameter));
+                break;
+            }
+            default: {
+                copied = new RuntimeParameter(parameter->type);
+                break;
+            }
+        }
+        params.insert({param.first, copied});
+    }
+    return params;
+}
+
+
+SPPFFusionPass::SPPFFusionPass() : RuntimeGraphPass("SPPFFusion") {}
+
+
+uint32_t SPPFFusionPass::Run(vector<shared_ptr<RuntimeOperator>> &operators)
+{
+    const uint32_t pooling_num = 3;
+    unordered_map<string, shared_ptr<RuntimeOperator>> operators_map;
+    for (const auto &op : operators) {
+        operators_map.insert({op->name, op});
+    }
+
+    // 池化节点只输出到下一级池化和torch.cat，最后一级只输出到torch.cat
+    auto is_pooling = [&operators_map](const shared_ptr<RuntimeOperand> &operand, const string &input_name, const string &next_name,
+        const string &cat_name) -> shared_ptr<RuntimeOperator> {
+        const auto &op_iter = operators_map.find(operand->name);
+        if (op_iter == operators_map.end()) return nullptr;
+
+        const shared_ptr<RuntimeOperator> &op = op_iter->second;
+        if (op->type != "nn.MaxPool2d" || op->input_operands_seq.size() != 1 || op->input_operands_seq.front()->name != input_name) return nullptr;
+        if (op->output_operators.size() != (next_name.empty() ? 1 : 2) || !op->output_operators.count(cat_name)) return nullptr;
+        if (!next_name.empty() && !op->output_operators.count(next_name)) return nullptr;
+        return op;
+    };
+
+    // 先匹配再替换，替换会修改节点数组
+    vector<pair<vector<shared_ptr<RuntimeOperator>>, shared_ptr<RuntimeOperator>>> fused_chains;
+    for (const auto &cat_op : operators) {
+        if (cat_op->type != "torch.cat") continue;
+
+        const auto &dim_iter = cat_op->params.find("dim");
+        if (dim_iter == cat_op->params.end()) continue;
+        const auto &dim_param = dynamic_cast<RuntimeParameterInt *>(dim_iter->second);
+        if (!dim_param || (dim_param->value != 1 && dim_param->value != -3)) continue;
+
+        const vector<shared_ptr<RuntimeOperand>> &input_operands = cat_op->input_operands_seq;
+        if (input_operands.size() != pooling_num + 1 || cat_op->input_operands.size() != pooling_num + 1) continue;
+
+        vector<shared_ptr<RuntimeOperator>> pooling_ops;
+        for (uint32_t i = 1; i <= pooling_num; ++i) {
+            const string &next_name = i < pooling_num ? input_operands.at(i + 1)->name : string();
+            const auto &pooling_op = is_pooling(input_operands.at(i), input_operands.at(i - 1)->name, next_name, cat_op->name);
+            if (!pooling_op || input_operands.at(i)->shapes != input_operands.front()->shapes) break;
+            pooling_ops.push_back(pooling_op);
+        }
+        if (pooling_ops.size() != pooling_num || input_operands.front()->shapes.size() != 4) continue;
+
+        // 三级池化的参数相同，步长为1并且填充之后输出大小不变
+        const vector<int> *kernel_size = GetIntArrayParameter(pooling_ops.front(), "kernel_size");
+        const vector<int> *padding = GetIntArrayParameter(pooling_ops.front(), "padding");
+        const vector<int> *stride = GetIntArrayParameter(pooling_ops.front(), "stride");
+        if (!kernel_size || !padding || !stride || kernel_size->size() != 2 || padding->size() != 2) continue;
+        if (*stride != vector<int>{1, 1} || kernel_size->at(0) != 2 * padding->at(0) + 1 || kernel_size->at(1) != 2 * padding->at(1) + 1) continue;
+
+        bool same_params = true;
+        for (const auto &pooling_op : pooling_ops) {
+            for (const char *name : {"kernel_size", "padding", "stride"}) {
+                const vector<int> *value = GetIntArrayParameter(pooling_op, name);
+                same_params = same_params && value && *value == *GetIntArrayParameter(pooling_ops.front(), name);
+            }
+        }
+        if (!same_params) continue;
+
+        const shared_ptr<RuntimeOperand> &input_operand = input_operands.front();
+        if (!operators_map.count(input_operand->name)) continue;
+
+        // 融合节点替换三级池化和torch.cat，沿用torch.cat的名称，后继节点按名称读取输入
+        shared_ptr<RuntimeOperator> sppf_op = make_shared<RuntimeOperator>();
+        sppf_op->name = cat_op->name;
+        sppf_op->type = "magic.SPPF";
+        sppf_op->params = CopyParameters(pooling_ops.front());
+        sppf_op->input_operands.insert({input_operand->name, input_operand});
+        sppf_op->input_operands_seq.push_back(input_operand);
+
+        vector<shared_ptr<RuntimeOperator>> chain = pooling_ops;
+        chain.push_back(cat_op);
+        fused_chains.push_back({chain, sppf_op});
+    }
+
+    uint32_t fusion_num = 0;
+    for (const auto &fused_chain : fused_chains) {
+        if (RuntimeGraphOptimizer::ReplaceOperators(operators, fused_chain.first, fused_chain.second)) fusion_num += 1;
+    }
+    return fusion_num;
+}
+
+
+GlobalPoolLinearFusionPass::GlobalPoolLinearFusionPass() : RuntimeGraphPass("GlobalPoolLinearFusion") {}
+
+
+uint32_t GlobalPoolLinearFusionPass::Run(vector<shared_ptr<RuntimeOperator>> &operators)
+{
+    uint32_t fusion_num = 0;
+    const auto &chains = RuntimeGraphOptimizer::MatchChain(operators, {"nn.AdaptiveAvgPool2d", "torch.flatten", "nn.Linear"});
+    for (const auto &chain : chains) {
+        const shared_ptr<RuntimeOperator> &pool_op = chain.at(0);
+        const shared_ptr<RuntimeOperator> &flatten_op = chain.at(1);
+        const shared_ptr<RuntimeOperator> &linear_op = chain.at(2);
+
+        const vector<int> *output_size = GetIntArrayParameter(pool_op, "output_size");
+        if (!output_size || *output_size != vector<int>{1, 1}) continue;
+        if (pool_op->input_operands_seq.size() != 1 || pool_op->input_operands_seq.front()->shapes.size() != 4) continue;
+
+        // 只融合展平通道、高和宽的flatten
+        const auto &start_iter = flatten_op->params.find("start_dim");
+        const auto &end_iter = flatten_op->params.find("end_dim");
+        if (start_iter == flatten_op->params.end() || end_iter == flatten_op->params.end()) continue;
+        const auto &start_dim = dynamic_cast<RuntimeParameterInt *>(start_iter->second);
+        const auto &end_dim = dynamic_cast<RuntimeParameterInt *>(end_iter->second);
+        if (!start_dim || !end_dim || start_dim->value != 1 || (end_dim->value != -1 && end_dim->value != 3)) continue;
+
+        const auto &weight_iter = linear_op->attribute.find("weight");
+        if (weight_iter == linear_op->attribute.end() || weight_iter->second->shape.size() != 2) continue;
+        if (weight_iter->second->shape.at(1) != pool_op->input_operands_seq.front()->shapes.at(1)) continue;
+
+        shared_ptr<RuntimeOperator> head_op = make_shared<RuntimeOperator>();
+        head_op->name = linear_op->name;
+        head_op->type = "magic.GlobalPoolLinear";
+        head_op->attribute = linear_op->attribute;
+        head_op->output_operands = linear_op->output_operands;
+        head_op->params = CopyParameters(linear_op);
+        if (!RuntimeGraphOptimizer::ReplaceOperators(operators, chain, head_op)) continue;
+        fusion_num += 1;
+    }
+    return fusion_num;
+}
+
+
+/**
+ * 判断卷积节点是否等价于作用在1x1特征图上的全连接层：1x1的卷积核，没有填充，没有分组
+ * @param op 卷积节点
+ * @param in_channels 期望的输入通道数
+ * @return 卷积的权重属性，不满足条件时返回空
+ */
+static shared_ptr<RuntimeAttribute> GetPointwiseWeight(const shared_ptr<RuntimeOperator> &op, int in_channels)
+{
+    const auto &weight_iter = op->attribute.find("weight");
+    if (weight_iter == op->attribute.end()) return nullptr;
+
+    const vector<int> &shape = weight_iter->second->shape;
+    if (shape.size() != 4 || shape.at(0) <= 0 || shape.at(1) != in_channels || shape.at(2) != 1 || shape.at(3) != 1) return nullptr;
+
+    const vector<int> *padding = GetIntArrayParameter(op, "padding");
+    if (padding && any_of(padding->begin(), padding->end(), [](int value) { return value != 0; })) return nullptr;
+
+    const auto &groups_iter = op->params.find("groups");
+    if (groups_iter != op->params.end()) {
+        const auto &groups = dynamic_cast<RuntimeParameterInt *>(groups_iter->second);
+        if (!groups || groups->value != 1) return nullptr;
+    }
+    return weight_iter->second;
+}
+
+
+/**
+ * 返回卷积节点的偏置属性，没有偏置时返回全零的偏置
+ * @param op 卷积节点
+ * @param out_channels 输出通道数
+ * @return 偏置属性
+ */
+static shared_ptr<RuntimeAttribute> GetPointwiseBias(const shared_ptr<RuntimeOperator> &op, uint32_t out_channels)
+{
+    const auto &bias_param = op->params.find("bias");
+    const auto &use_bias = bias_param == op->params.end() ? nullptr : dynamic_cast<RuntimeParameterBool *>(bias_param->second);
+    const auto &bias_iter = op->attribute.find("bias");
+    if (use_bias && use_bias->value && bias_iter != op->attribute.end() && bias_iter->second->raw_size() > 0) {
+        return bias_iter->second;
+    }
+
+    shared_ptr<RuntimeAttribute> bias_attr = make_shared<RuntimeAttribute>();
+    bias_attr->shape = {int(out_channels)};
+    SetAttributeData(bias_attr, vector<float>(out_channels, 0.f));
+    return bias_attr;
+}
+
+
+SqueezeExcitationFusionPass::SqueezeExcitationFusionPass() : RuntimeGraphPass("SqueezeExcitationFusion") {}
+
+
+uint32_t SqueezeExcitationFusionPass::Run(vector<shared_ptr<RuntimeOperator>> &operators)
+{
+    unordered_set<string> operator_names;
+    for (const auto &op : operators) {
+        operator_names.insert(op->name);
+    }
+
+    // 先匹配再替换，替换会修改节点数组
+    vector<pair<vector<shared_ptr<RuntimeOperator>>, shared_ptr<RuntimeOperator>>> fused_chains;
+    const auto &chains = RuntimeGraphOptimizer::MatchChain(operators,
+        {"nn.AdaptiveAvgPool2d", "nn.Conv2d", "nn.ReLU", "nn.Conv2d", "nn.Hardsigmoid"});
+    for (const auto &chain : chains) {
+        const shared_ptr<RuntimeOperator> &pool_op = chain.at(0);
+        const shared_ptr<RuntimeOperator> &fc1_op = chain.at(1);
+        const shared_ptr<RuntimeOperator> &fc2_op = chain.at(3);
+        const shared_ptr<RuntimeOperator> &gate_op = chain.at(4);
+
+        const vector<int> *output_size = GetIntArrayParameter(pool_op, "output_size");
+        if (!output_size || *output_size != vector<int>{1, 1}) continue;
+        if (pool_op->input_operands_seq.size() != 1 || pool_op->input_operands_seq.front()->shapes.size() != 4) continue;
+        if (gate_op->output_operators.size() != 1) continue;
+
+        // 缩放系数只输出到和x相乘的表达式
+        const shared_ptr<RuntimeOperator> &mul_op = gate_op->output_operators.begin()->second;
+        const auto &expr_iter = mul_op->params.find("expr");
+        if (mul_op->type != "pnnx.Expression" || expr_iter == mul_op->params.end()) continue;
+        const auto &expr = dynamic_cast<RuntimeParameterString *>(expr_iter->second);
+        if (!expr || (expr->value != "mul(@0,@1)" && expr->value != "mul(@1,@0)")) continue;
+
+        const string &input_name = pool_op->input_operands_seq.front()->name;
+        const auto &mul_operands = mul_op->input_operands;
+        if (mul_op->input_operands_seq.size() != 2 || mul_operands.size() != 2) continue;
+        if (!mul_operands.count(gate_op->name) || !mul_operands.count(input_name) || !operator_names.count(input_name)) continue;
+
+        const int channels = pool_op->input_operands_seq.front()->shapes.at(1);
+        const shared_ptr<RuntimeAttribute> &fc1_weight = GetPointwiseWeight(fc1_op, channels);
+        if (!fc1_weight) continue;
+        const int squeeze_channels = fc1_weight->shape.front();
+        const shared_ptr<RuntimeAttribute> &fc2_weight = GetPointwiseWeight(fc2_op, squeeze_channels);
+        if (!fc2_weight || fc2_weight->shape.front() != channels) continue;
+
+        // 融合节点替换池化到乘法的整个子图，沿用乘法的名称，x同时输出到池化和乘法的两条边合并为一条
+        shared_ptr<RuntimeOperator> se_op = make_shared<RuntimeOperator>();
+        se_op->name = mul_op->name;
+        se_op->type = "magic.SqueezeExcitation";
+        se_op->attribute["fc1.weight"] = fc1_weight;
+        se_op->attribute["fc1.bias"] = GetPointwiseBias(fc1_op, squeeze_channels);
+        se_op->attribute["fc2.weight"] = fc2_weight;
+        se_op->attribute["fc2.bias"] = GetPointwiseBias(fc2_op, channels);
+
+        const shared_ptr<RuntimeOperand> &input_operand = mul_operands.at(input_name);
+        se_op->input_operands.insert({input_name, input_operand});
+        se_op->input_operands_seq.push_back(input_operand);
+
+        vector<shared_ptr<RuntimeOperator>> fused_chain = chain;
+        fused_chain.push_back(mul_op);
+        fused_chains.push_back({fused_chain, se_op});
+    }
+
+    uint32_t fusion_num = 0;
+    for (const auto &fused_chain : fused_chains) {
+        if (RuntimeGraphOptimizer::ReplaceOperators(operators, fused_chain.first, fused_chain.second)) fusion_num += 1;
+    }
+    return fusion_num;
+}
+
+}
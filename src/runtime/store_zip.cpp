@@ -2,6 +2,11 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <map>
 #include <string>
 #include <vector>
@@ -63,6 +68,9 @@ PACK(struct end_of_central_directory_record {
 });
 
 
+// alignment of the entry data written by StoreZipWriter
+static const size_t STOREZIP_ALIGNMENT = 64;
+
 static uint32_t CRC32_TABLE[256];
 
 static void CRC32_TABLE_INIT()
@@ -94,7 +102,7 @@ static uint32_t CRC32_buffer(const unsigned char* data, int len)
 
 StoreZipReader::StoreZipReader()
 {
-    fp = 0;
+    mapping_size = 0;
 }
 
 
@@ -107,66 +115,102 @@ StoreZipReader::~StoreZipReader()
 int StoreZipReader::open(const string& path)
 {
     close();
-    fp = fopen(path.c_str(), "rb");
-    if (!fp) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
         fprintf(stderr, "open failed\n");
         return -1;
     }
 
-    while (!feof(fp)) {
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        fprintf(stderr, "open failed\n");
+        ::close(fd);
+        return -1;
+    }
+
+    // an empty file is a valid archive without entries, mmap does not accept zero length
+    if (st.st_size == 0) {
+        ::close(fd);
+        return 0;
+    }
+
+    // stored zip entries are uncompressed, map the whole file once and hand out views
+    const size_t size = st.st_size;
+    void* addr = mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED) {
+        fprintf(stderr, "mmap failed\n");
+        return -1;
+    }
+
+    mapping = shared_ptr<const char>((const char*)addr, [size](const char* p) { munmap((void*)p, size); });
+    mapping_size = size;
+
+    const char* base = mapping.get();
+    size_t pos = 0;
+    while (pos + sizeof(uint32_t) <= mapping_size) {
         // peek signature
         uint32_t signature;
-        int nread = fread((char*)&signature, sizeof(signature), 1, fp);
-        if (nread != 1) break;
+        memcpy(&signature, base + pos, sizeof(signature));
+        pos += sizeof(signature);
 
         if (signature == 0x04034b50) {
             local_file_header lfh;
-            fread((char*)&lfh, sizeof(lfh), 1, fp);
+            if (pos + sizeof(lfh) > mapping_size) break;
+            memcpy(&lfh, base + pos, sizeof(lfh));
+            pos += sizeof(lfh);
 
             if (lfh.flag & 0x08) {
                 fprintf(stderr, "zip file contains data descriptor, this is not supported yet\n");
+                close();
                 return -1;
             }
 
             if (lfh.compression != 0 || lfh.compressed_size != lfh.uncompressed_size) {
                 fprintf(stderr, "not stored zip file %d %d\n", lfh.compressed_size, lfh.uncompressed_size);
+                close();
                 return -1;
             }
 
             // file name
-            string name;
-            name.resize(lfh.file_name_length);
-            fread((char*)name.data(), name.size(), 1, fp);
+            if (pos + lfh.file_name_length + lfh.extra_field_length + lfh.compressed_size > mapping_size) {
+                fprintf(stderr, "truncated zip file\n");
+                close();
+                return -1;
+            }
+            string name(base + pos, lfh.file_name_length);
+            pos += lfh.file_name_length;
 
             // skip extra field
-            fseek(fp, lfh.extra_field_length, SEEK_CUR);
+            pos += lfh.extra_field_length;
 
             StoreZipMeta fm;
-            fm.offset = ftell(fp);
+            fm.offset = pos;
             fm.size = lfh.compressed_size;
-            filemetas[name] = fm;            
-            // fprintf(stderr, "%s = %d    %d\n", name.c_str(), fm.offset, fm.size);            
-            fseek(fp, lfh.compressed_size, SEEK_CUR);
-        
+            filemetas[name] = fm;
+            pos += lfh.compressed_size;
+
         } else if (signature == 0x02014b50) {
             central_directory_file_header cdfh;
-            fread((char*)&cdfh, sizeof(cdfh), 1, fp);
+            if (pos + sizeof(cdfh) > mapping_size) break;
+            memcpy(&cdfh, base + pos, sizeof(cdfh));
+            pos += sizeof(cdfh);
+
+            // skip file name, extra field and file comment
+            pos += cdfh.file_name_length + cdfh.extra_field_length + cdfh.file_comment_length;
 
-            // skip file name
-            fseek(fp, cdfh.file_name_length, SEEK_CUR);
-            // skip extra field
-            fseek(fp, cdfh.extra_field_length, SEEK_CUR);
-            // skip file comment
-            fseek(fp, cdfh.file_comment_length, SEEK_CUR);
-        
         } else if (signature == 0x06054b50) {
             end_of_central_directory_record eocdr;
-            fread((char*)&eocdr, sizeof(eocdr), 1, fp);
+            if (pos + sizeof(eocdr) > mapping_size) break;
+            memcpy(&eocdr, base + pos, sizeof(eocdr));
+            pos += sizeof(eocdr);
+
             // skip comment
-            fseek(fp, eocdr.comment_length, SEEK_CUR);
-        
+            pos += eocdr.comment_length;
+
         } else {
             fprintf(stderr, "unsupported signature %x\n", signature);
+            close();
             return -1;
         }
     }
@@ -194,17 +238,28 @@ int StoreZipReader::read_file(const string& name, char* data)
     size_t offset = filemetas[name].offset;
     size_t size = filemetas[name].size;
 
-    fseek(fp, offset, SEEK_SET);
-    fread(data, size, 1, fp);
+    memcpy(data, mapping.get() + offset, size);
     return 0;
 }
 
 
+shared_ptr<const char> StoreZipReader::get_file_data(const string& name)
+{
+    if (filemetas.find(name) == filemetas.end()) {
+        fprintf(stderr, "no such file %s\n", name.c_str());
+        return nullptr;
+    }
+
+    // aliasing constructor, the view shares the ownership of the whole mapping
+    return shared_ptr<const char>(mapping, mapping.get() + filemetas[name].offset);
+}
+
+
 int StoreZipReader::close()
 {
-    if (!fp) return 0;
-    fclose(fp);
-    fp = 0;
+    mapping.reset();
+    mapping_size = 0;
+    filemetas.clear();
     return 0;
 }
 
@@ -250,10 +305,24 @@ int StoreZipWriter::write_file(const string& name, const char* data, size_t size
     lfh.compressed_size = size;
     lfh.uncompressed_size = size;
     lfh.file_name_length = name.size();
-    lfh.extra_field_length = 0;
+
+    // pad the extra field so that the entry data is 64 byte aligned and can be mapped in place
+    const size_t data_offset = offset + sizeof(signature) + sizeof(lfh) + name.size();
+    size_t padding = (STOREZIP_ALIGNMENT - data_offset % STOREZIP_ALIGNMENT) % STOREZIP_ALIGNMENT;
+    if (padding > 0 && padding < 4) padding += STOREZIP_ALIGNMENT;
+    lfh.extra_field_length = padding;
 
     fwrite((char*)&lfh, sizeof(lfh), 1, fp);
     fwrite((char*)name.c_str(), name.size(), 1, fp);
+    if (padding > 0) {
+        // extra field block with header id and data size, followed by zeros
+        vector<char> extra(padding, 0);
+        const uint16_t header_id = 0x4650;
+        const uint16_t extra_size = padding - 4;
+        memcpy(extra.data(), &header_id, sizeof(header_id));
+        memcpy(extra.data() + 2, &extra_size, sizeof(extra_size));
+        fwrite(extra.data(), padding, 1, fp);
+    }
     fwrite(data, size, 1, fp);
 
     StoreZipMeta szm;
@@ -0,0 +1,85 @@
+#include <gtest/gtest.h>
+#include <glog/logging.h>
+#include <cmath>
+#include <vector>
+#include "layer/details/activation_kernel.hpp"
+
+using namespace magic_infer;
+
+
+/**
+ * 生成测试数据，覆盖阈值附近、正负大数和0
+ * @param size 元素个数
+ * @return 测试数据
+ */
+static vector<float> ActivationInput(uint32_t size)
+{
+    const vector<float> special{0.f, -0.f, 3.f, -3.f, 2.999f, -2.999f, 3.001f, -3.001f, 80.f, -80.f, 100.f, -100.f};
+    vector<float> values(size);
+    for (uint32_t i = 0; i < size; ++i) {
+        values.at(i) = i < special.size() ? special.at(i) : float(int(i * 37 % 101) - 50) / 7.f;
+    }
+    return values;
+}
+
+
+TEST(test_activation, all_isa_match_scalar)
+{
+    const CpuIsa host_isa = ActivationKernelRegistry::HostIsa();
+    for (int type = 0; type < int(ActivationType::kActivationNum); ++type) {
+        const ActivationKernel scalar_kernel = ActivationKernelRegistry::Get(ActivationType(type), CpuIsa::kScalar);
+        for (int isa = int(CpuIsa::kScalar); isa <= int(host_isa); ++isa) {
+            const ActivationKernel kernel = ActivationKernelRegistry::Get(ActivationType(type), CpuIsa(isa));
+            // 覆盖空输入、只有尾部和主体加尾部的各种长度
+            for (uint32_t size = 0; size <= 70; ++size) {
+                const vector<float> &input = ActivationInput(size);
+                vector<float> expected(size + 1, 42.f);
+                vector<float> actual(size + 1, 42.f);
+                scalar_kernel(input.data(), expected.data(), size);
+                kernel(input.data(), actual.data(), size);
+                ASSERT_EQ(actual.at(size), 42.f) << "write out of range, isa " << isa;
+
+                for (uint32_t i = 0; i < size; ++i) {
+                    const ActivationType activation_type = ActivationType(type);
+                    if (activation_type == ActivationType::kSigmoid || activation_type == ActivationType::kSiLU) {
+                        ASSERT_NEAR(actual.at(i), expected.at(i), 1e-6f * max(1.f, fabsf(expected.at(i))))
+                            << "type " << type << ", isa " << isa << ", input " << input.at(i);
+                    } else {
+                        ASSERT_EQ(actual.at(i), expected.at(i)) << "type " << type << ", isa " << isa << ", input " << input.at(i);
+                    }
+                }
+            }
+        }
+    }
+}
+
+
+TEST(test_activation, inplace)
+{
+    for (int type = 0; type < int(ActivationType::kActivationNum); ++type) {
+        const vector<float> &input = ActivationInput(37);
+        vector<float> expected(input.size());
+        ActivationKernelRegistry::Get(ActivationType(type), CpuIsa::kScalar)(input.data(), expected.data(), input.size());
+
+        vector<float> values = input;
+        ActivationKernelRegistry::Get(ActivationType(type))(values.data(), values.data(), values.size());
+        for (uint32_t i = 0; i < values.size(); ++i) {
+            ASSERT_NEAR(values.at(i), expected.at(i), 1e-6f * max(1.f, fabsf(expected.at(i))));
+        }
+    }
+}
+
+
+TEST(test_activation, kernel_isa)
+{
+    const CpuIsa host_isa = ActivationKernelRegistry::HostIsa();
+    LOG(INFO) << "Host isa " << ActivationKernelRegistry::IsaName(host_isa);
+    for (int type = 0; type < int(ActivationType::kActivationNum); ++type) {
+        ASSERT_EQ(ActivationKernelRegistry::KernelIsa(ActivationType(type), CpuIsa::kScalar), CpuIsa::kScalar);
+        // 每个激活函数都有所有指令集的实现，选择的指令集不超过限制
+        ASSERT_LE(int(ActivationKernelRegistry::KernelIsa(ActivationType(type), host_isa)), int(host_isa));
+#if defined(__x86_64__)
+        ASSERT_EQ(ActivationKernelRegistry::KernelIsa(ActivationType(type), host_isa), host_isa);
+#endif
+    }
+}
@@ -304,3 +304,27 @@ TEST(test_layer, forward_average_pooling_out1x11)
         }
     }
 }
+
+
+TEST(test_layer, global_average_pooling)
+{
+    // 覆盖向量主体、尾部和按通道并行的大输入
+    const vector<vector<uint32_t>> shapes{{3, 1, 1}, {5, 3, 5}, {64, 7, 7}, {512, 13, 11}};
+    for (const auto &shape : shapes) {
+        const uint32_t channels = shape.at(0);
+        const uint32_t plane_size = shape.at(1) * shape.at(2);
+        shared_ptr<Tensor<float>> input = make_shared<Tensor<float>>(channels, shape.at(1), shape.at(2));
+        input->Rand();
+
+        vector<float> output(channels);
+        AdaptiveAvgPoolingLayer::GlobalAveragePool(input->RawPtr(), channels, plane_size, output.data());
+        for (uint32_t c = 0; c < channels; ++c) {
+            double expected = 0.;
+            const float *channel_ptr = input->RawPtr() + c * plane_size;
+            for (uint32_t i = 0; i < plane_size; ++i) {
+                expected += channel_ptr[i];
+            }
+            ASSERT_NEAR(output.at(c), expected / plane_size, 1e-5) << "channel " << c << ", plane " << plane_size;
+        }
+    }
+}
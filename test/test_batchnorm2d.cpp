@@ -1,8 +1,10 @@
 #include <gtest/gtest.h>
 #include <glog/logging.h>
+#include "runtime/ir.h"
 #include "runtime/runtime_ir.hpp"
 #include "data/load_data.hpp"
 #include "../include/layer/details/batchnorm2d.hpp"
+#include "test_graph_util.hpp"
 
 using namespace magic_infer;
 
@@ -205,3 +207,88 @@ TEST(test_layer, forward_batchnorm7)
         ASSERT_TRUE(arma::approx_equal(output_data1, output_data2, "absdiff", 1e-4));
     }
 }
+
+
+TEST(test_layer, forward_conv_batchnorm_fold) 
+{
+    TempGraphFiles files;
+    const uint32_t in_channels = 4, out_channels = 3, rows = 8, cols = 8;
+    const vector<float> weight{0.5f, -1.f, 0.25f, 2.f, 1.f, 1.f, -0.5f, 0.f, -2.f, 0.75f, 1.5f, -1.25f};
+    const vector<float> running_mean{0.1f, -0.2f, 0.3f};
+    const vector<float> running_var{0.5f, 1.5f, 2.f};
+    const vector<float> affine_weight{1.f, 0.5f, -2.f};
+    const vector<float> affine_bias{0.f, 1.f, -0.5f};
+    const float eps = 1e-5f;
+
+    pnnx::Graph pnnx_graph;
+    pnnx::Operand *input_operand = pnnx_graph.new_operand("0");
+    input_operand->type = 1;
+    input_operand->shape = {1, int(in_channels), int(rows), int(cols)};
+    pnnx::Operand *conv_operand = pnnx_graph.new_operand("1");
+    conv_operand->type = 1;
+    conv_operand->shape = {1, int(out_channels), int(rows), int(cols)};
+    pnnx::Operand *bn_operand = pnnx_graph.new_operand("2");
+    bn_operand->type = 1;
+    bn_operand->shape = {1, int(out_channels), int(rows), int(cols)};
+
+    pnnx::Operator *input_op = pnnx_graph.new_operator("pnnx.Input", "pnnx_input_0");
+    input_op->outputs.push_back(input_operand);
+    input_operand->producer = input_op;
+
+    pnnx::Operator *conv_op = pnnx_graph.new_operator("nn.Conv2d", "conv1");
+    conv_op->params["in_channels"] = int(in_channels);
+    conv_op->params["out_channels"] = int(out_channels);
+    conv_op->params["kernel_size"] = {1, 1};
+    conv_op->params["stride"] = {1, 1};
+    conv_op->params["padding"] = {0, 0};
+    conv_op->params["dilation"] = {1, 1};
+    conv_op->params["groups"] = 1;
+    conv_op->params["bias"] = false;
+    conv_op->params["padding_mode"] = "zeros";
+    conv_op->attrs["weight"] = pnnx::Attribute({int(out_channels), int(in_channels), 1, 1}, weight);
+    conv_op->inputs.push_back(input_operand);
+    conv_op->outputs.push_back(conv_operand);
+    input_operand->consumers.push_back(conv_op);
+    conv_operand->producer = conv_op;
+
+    pnnx::Operator *bn_op = pnnx_graph.new_operator("nn.BatchNorm2d", "bn1");
+    bn_op->params["num_features"] = int(out_channels);
+    bn_op->params["eps"] = eps;
+    bn_op->params["affine"] = true;
+    bn_op->attrs["running_mean"] = pnnx::Attribute({int(out_channels)}, running_mean);
+    bn_op->attrs["running_var"] = pnnx::Attribute({int(out_channels)}, running_var);
+    bn_op->attrs["weight"] = pnnx::Attribute({int(out_channels)}, affine_weight);
+    bn_op->attrs["bias"] = pnnx::Attribute({int(out_channels)}, affine_bias);
+    bn_op->inputs.push_back(conv_operand);
+    bn_op->outputs.push_back(bn_operand);
+    conv_operand->consumers.push_back(bn_op);
+    bn_operand->producer = bn_op;
+
+    pnnx::Operator *output_op = pnnx_graph.new_operator("pnnx.Output", "pnnx_output_0");
+    output_op->inputs.push_back(bn_operand);
+    bn_operand->consumers.push_back(output_op);
+    ASSERT_TRUE(files.Save(pnnx_graph));
+
+    RuntimeGraph graph(files.param_path(), files.bin_path());
+    graph.Build("pnnx_input_0", "pnnx_output_0");
+
+    shared_ptr<Tensor<float>> input = make_shared<Tensor<float>>(in_channels, rows, cols);
+    input->Rand();
+    vector<shared_ptr<Tensor<float>>> inputs{input};
+    const vector<shared_ptr<Tensor<float>>> &outputs = graph.Forward(inputs, false);
+    ASSERT_EQ(outputs.size(), 1);
+    ASSERT_EQ(outputs.front()->channels(), out_channels);
+
+    for (uint32_t oc = 0; oc < out_channels; ++oc) {
+        for (uint32_t r = 0; r < rows; ++r) {
+            for (uint32_t c = 0; c < cols; ++c) {
+                float conv_value = 0.f;
+                for (uint32_t ic = 0; ic < in_channels; ++ic) {
+                    conv_value += weight.at(oc * in_channels + ic) * input->at(ic, r, c);
+                }
+                const float bn_value = (conv_value - running_mean.at(oc)) / sqrtf(running_var.at(oc) + eps) * affine_weight.at(oc) + affine_bias.at(oc);
+                ASSERT_NEAR(outputs.front()->at(oc, r, c), bn_value, 1e-5f);
+            }
+        }
+    }
+}
@@ -2,6 +2,9 @@
 #include <glog/logging.h>
 #include "data/tensor.hpp"
 #include "../include/layer/details/concat.hpp"
+#include "runtime/ir.h"
+#include "runtime/runtime_ir.hpp"
+#include "test_graph_util.hpp"
 
 using namespace magic_infer;
 
@@ -40,3 +43,67 @@ TEST(test_layer, cat1)
         }
     }
 }
+
+
+TEST(test_layer, cat_inplace_graph)
+{
+    TempGraphFiles files;
+    pnnx::Graph pnnx_graph;
+    pnnx::Operand *input_operand = pnnx_graph.new_operand("0");
+    pnnx::Operand *relu_operand = pnnx_graph.new_operand("1");
+    pnnx::Operand *sigmoid_operand = pnnx_graph.new_operand("2");
+    pnnx::Operand *inner_operand = pnnx_graph.new_operand("3");
+    pnnx::Operand *outer_operand = pnnx_graph.new_operand("4");
+    for (pnnx::Operand *operand : {input_operand, relu_operand, sigmoid_operand, inner_operand, outer_operand}) {
+        operand->type = 1;
+        operand->shape = {1, 2, 4, 4};
+    }
+    inner_operand->shape = {1, 4, 4, 4};
+    outer_operand->shape = {1, 6, 4, 4};
+
+    LinkOperator(pnnx_graph.new_operator("pnnx.Input", "pnnx_input_0"), {}, input_operand);
+    LinkOperator(pnnx_graph.new_operator("nn.ReLU", "relu"), {input_operand}, relu_operand);
+    LinkOperator(pnnx_graph.new_operator("nn.Sigmoid", "sigmoid"), {input_operand}, sigmoid_operand);
+    pnnx::Operator *inner_op = pnnx_graph.new_operator("torch.cat", "cat_inner");
+    inner_op->params["dim"] = 1;
+    LinkOperator(inner_op, {relu_operand, sigmoid_operand}, inner_operand);
+    pnnx::Operator *outer_op = pnnx_graph.new_operator("torch.cat", "cat_outer");
+    outer_op->params["dim"] = 1;
+    LinkOperator(outer_op, {input_operand, inner_operand}, outer_operand);
+    LinkOperator(pnnx_graph.new_operator("pnnx.Output", "pnnx_output_0"), {outer_operand}, nullptr);
+    ASSERT_TRUE(files.Save(pnnx_graph));
+
+    RuntimeGraph graph(files.param_path(), files.bin_path());
+    graph.Build("pnnx_input_0", "pnnx_output_0");
+    RuntimeGraph copy_graph(files.param_path(), files.bin_path());
+    copy_graph.set_inplace_concat(false);
+    copy_graph.Build("pnnx_input_0", "pnnx_output_0");
+
+    // relu和sigmoid的输出是外层concat输出中第2到5个通道的视图
+    map<string, shared_ptr<RuntimeOperator>> operators;
+    for (const auto &op : graph.operators()) {
+        operators.insert({op->name, op});
+    }
+    const float *outer_ptr = operators.at("cat_outer")->output_operands->datas.front()->RawPtr();
+    ASSERT_EQ(operators.at("cat_inner")->output_operands->datas.front()->RawPtr(), outer_ptr + 2 * 16);
+    ASSERT_EQ(operators.at("relu")->output_operands->datas.front()->RawPtr(), outer_ptr + 2 * 16);
+    ASSERT_EQ(operators.at("sigmoid")->output_operands->datas.front()->RawPtr(), outer_ptr + 4 * 16);
+
+    for (int repeat = 0; repeat < 2; ++repeat) {
+        shared_ptr<Tensor<float>> input = make_shared<Tensor<float>>(2, 4, 4);
+        input->Rand();
+        vector<shared_ptr<Tensor<float>>> inputs{input};
+        const vector<shared_ptr<Tensor<float>>> outputs = graph.Forward(inputs, false);
+        const vector<shared_ptr<Tensor<float>>> copy_outputs = copy_graph.Forward(inputs, false);
+        ASSERT_EQ(outputs.size(), 1);
+        ASSERT_EQ(outputs.front()->channels(), 6);
+
+        for (uint32_t i = 0; i < input->size(); ++i) {
+            const float value = input->index(i);
+            ASSERT_EQ(outputs.front()->index(i), value);
+            ASSERT_EQ(outputs.front()->index(i + 32), max(value, 0.f));
+            ASSERT_NEAR(outputs.front()->index(i + 64), 1.f / (1.f + exp(-value)), 1e-5f);
+        }
+        ASSERT_TRUE(arma::approx_equal(outputs.front()->data(), copy_outputs.front()->data(), "absdiff", 1e-6f));
+    }
+}
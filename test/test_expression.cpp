@@ -381,6 +381,67 @@ TEST(test_layer, complex6)
 }
 
 
+
+TEST(test_layer, complex_broadcast) 
+{
+    const string &str = "add(mul(@0,@1),@2)";
+    ExpressionLayer layer(str);
+    shared_ptr<Tensor<float>> input1 = make_shared<Tensor<float>>(3, 37, 29);
+    input1->Rand();
+    shared_ptr<Tensor<float>> input2 = make_shared<Tensor<float>>(3, 1, 1);
+    input2->Fill(vector<float>{1.f, 2.f, 3.f});
+    shared_ptr<Tensor<float>> input3 = make_shared<Tensor<float>>(3, 37, 29);
+    input3->Rand();
+
+    vector<shared_ptr<Tensor<float>>> inputs{input1, input2, input3};
+    vector<shared_ptr<Tensor<float>>> outputs(1);
+    shared_ptr<Tensor<float>> output = make_shared<Tensor<float>>(3, 37, 29);
+    outputs.at(0) = output;
+    const auto status = layer.Forward(inputs, outputs);
+    ASSERT_EQ(status, InferStatus::kInferSuccess);
+
+    // 结果直接写入预先分配的输出张量
+    ASSERT_EQ(outputs.at(0), output);
+    for (uint32_t c = 0; c < 3; ++c) {
+        for (uint32_t r = 0; r < 37; ++r) {
+            for (uint32_t w = 0; w < 29; ++w) {
+                const float value = input1->at(c, r, w) * float(c + 1) + input3->at(c, r, w);
+                ASSERT_NEAR(output->at(c, r, w), value, 1e-5f);
+            }
+        }
+    }
+}
+
+
+TEST(test_layer, complex_batch) 
+{
+    const string &str = "mul(add(@0,@1),@0)";
+    ExpressionLayer layer(str);
+    const uint32_t batch_size = 4;
+
+    vector<shared_ptr<Tensor<float>>> inputs(2 * batch_size);
+    vector<shared_ptr<Tensor<float>>> outputs(batch_size);
+    for (uint32_t i = 0; i < 2 * batch_size; ++i) {
+        inputs.at(i) = make_shared<Tensor<float>>(5, 33, 17);
+        inputs.at(i)->Rand();
+    }
+    for (uint32_t i = 0; i < batch_size; ++i) {
+        outputs.at(i) = make_shared<Tensor<float>>(5, 33, 17);
+    }
+
+    const auto status = layer.Forward(inputs, outputs);
+    ASSERT_EQ(status, InferStatus::kInferSuccess);
+    for (uint32_t i = 0; i < batch_size; ++i) {
+        const auto &input1 = inputs.at(i);
+        const auto &input2 = inputs.at(i + batch_size);
+        for (uint32_t j = 0; j < outputs.at(i)->size(); ++j) {
+            const float value = (input1->index(j) + input2->index(j)) * input1->index(j);
+            ASSERT_NEAR(outputs.at(i)->index(j), value, 1e-5f);
+        }
+    }
+}
+
+
 TEST(test_parser, tokenizer) 
 {
     const string &str = "add(add(add(@0,@1),@1),add(@0,@2))";
@@ -493,3 +554,82 @@ TEST(test_parser, tokenizer3)
     ASSERT_EQ(token_strs.at(14), "mul");
     ASSERT_EQ(token_strs.at(15), "(");
 }
+
+
+TEST(test_parser, tokenizer_constant) 
+{
+    const string &str = "div(sub(@0, 1.5e+00), sqrt(add(@1, -2)))";
+    ExpressionParser parser(str);
+    parser.Tokenizer();
+    const auto &token_strs = parser.token_strs();
+    ASSERT_EQ(token_strs.size(), 19);
+
+    ASSERT_EQ(token_strs.at(0), "div");
+    ASSERT_EQ(token_strs.at(2), "sub");
+    ASSERT_EQ(token_strs.at(4), "@0");
+    ASSERT_EQ(token_strs.at(6), "1.5e+00");
+    ASSERT_EQ(token_strs.at(9), "sqrt");
+    ASSERT_EQ(token_strs.at(11), "add");
+    ASSERT_EQ(token_strs.at(13), "@1");
+    ASSERT_EQ(token_strs.at(15), "-2");
+}
+
+
+TEST(test_parser, constant_folding) 
+{
+    // mul(2,3)和sqrt(4)在解析时折叠为常数
+    ExpressionParser parser("add(mul(@0,mul(2,3)),sqrt(4))");
+    const ExpressionProgram &program = parser.Compile();
+    ASSERT_EQ(program.instructions.size(), 2);
+    ASSERT_EQ(program.input_num, 1);
+    ASSERT_EQ(program.constants.size(), 2);
+    ASSERT_FLOAT_EQ(program.constants.at(0), 6.f);
+    ASSERT_FLOAT_EQ(program.constants.at(1), 2.f);
+
+    // 整个表达式都是常数
+    ExpressionParser constant_parser("neg(div(exp(0),4))");
+    const ExpressionProgram &constant_program = constant_parser.Compile();
+    ASSERT_EQ(constant_program.instructions.size(), 1);
+    ASSERT_EQ(constant_program.input_num, 0);
+    ASSERT_FLOAT_EQ(constant_program.constants.at(0), -0.25f);
+}
+
+
+TEST(test_layer, complex_operations) 
+{
+    const vector<pair<string, function<float(float, float)>>> expressions{
+        {"sub(@0,@1)", [](float a, float b) { return a - b; }},
+        {"div(@0,add(@1,1))", [](float a, float b) { return a / (b + 1.f); }},
+        {"neg(mul(@0,-2.5))", [](float a, float b) { return 2.5f * a; }},
+        {"sqrt(add(@0,@1))", [](float a, float b) { return sqrtf(a + b); }},
+        {"exp(sub(@0,@1))", [](float a, float b) { return expf(a - b); }},
+        {"log(add(@0,1.0e+00))", [](float a, float b) { return logf(a + 1.f); }},
+        {"pow(sub(@0,@1),2)", [](float a, float b) { return (a - b) * (a - b); }},
+        {"pow(add(@0,@1),1.5)", [](float a, float b) { return powf(a + b, 1.5f); }},
+        {"rsqrt(add(mul(@0,@0),1e-5))", [](float a, float b) { return 1.f / sqrtf(a * a + 1e-5f); }},
+        {"max(@0,min(@1,0.5))", [](float a, float b) { return max(a, min(b, 0.5f)); }},
+        {"tanh(sub(@0,abs(@1)))", [](float a, float b) { return tanhf(a - fabsf(b)); }},
+        {"floor_divide(mul(@0,10),3)", [](float a, float b) { return floorf(a * 10.f / 3.f); }},
+        {"atan2(@0,sub(@1,0.5))", [](float a, float b) { return atan2f(a, b - 0.5f); }},
+    };
+
+    for (const auto &expression : expressions) {
+        ExpressionLayer layer(expression.first);
+        shared_ptr<Tensor<float>> input1 = make_shared<Tensor<float>>(3, 17, 19);
+        input1->Rand();
+        shared_ptr<Tensor<float>> input2 = make_shared<Tensor<float>>(3, 17, 19);
+        input2->Rand();
+        input1->Transform([](float value) { return fabsf(value) + 0.1f; });
+        input2->Transform([](float value) { return fabsf(value) + 0.1f; });
+
+        vector<shared_ptr<Tensor<float>>> inputs{input1, input2};
+        vector<shared_ptr<Tensor<float>>> outputs{make_shared<Tensor<float>>(3, 17, 19)};
+        const auto status = layer.Forward(inputs, outputs);
+        ASSERT_EQ(status, InferStatus::kInferSuccess);
+
+        for (uint32_t i = 0; i < input1->size(); ++i) {
+            const float value = expression.second(input1->index(i), input2->index(i));
+            ASSERT_NEAR(outputs.front()->index(i), value, 1e-4f * max(1.f, fabsf(value))) << expression.first;
+        }
+    }
+}
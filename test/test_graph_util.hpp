@@ -0,0 +1,80 @@
+#ifndef MAGIC_TEST_TEST_GRAPH_UTIL_HPP_
+#define MAGIC_TEST_TEST_GRAPH_UTIL_HPP_
+
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include <glog/logging.h>
+#include "runtime/ir.h"
+
+using namespace std;
+
+
+namespace magic_infer
+{
+
+/**
+ * 连接pnnx计算节点和它的输入输出操作数
+ * @param op 计算节点
+ * @param inputs 输入操作数
+ * @param output 输出操作数，为空时节点没有输出
+ * @return 计算节点
+ */
+inline pnnx::Operator *LinkOperator(pnnx::Operator *op, const vector<pnnx::Operand *> &inputs, pnnx::Operand *output)
+{
+    for (pnnx::Operand *input : inputs) {
+        op->inputs.push_back(input);
+        input->consumers.push_back(op);
+    }
+    if (output) {
+        op->outputs.push_back(output);
+        output->producer = op;
+    }
+    return op;
+}
+
+
+/// 测试用的临时目录，保存pnnx计算图和模型文件，析构时删除整个目录
+class TempGraphFiles
+{
+public:
+    TempGraphFiles()
+    {
+        string pattern = (filesystem::temp_directory_path() / "magic_test_XXXXXX").string();
+        CHECK(mkdtemp(pattern.data()) != nullptr) << "Create the temporary directory failed: " << pattern;
+        this->directory_ = pattern;
+    }
+
+    ~TempGraphFiles()
+    {
+        error_code error;
+        filesystem::remove_all(this->directory_, error);
+    }
+
+    TempGraphFiles(const TempGraphFiles &) = delete;
+    TempGraphFiles &operator=(const TempGraphFiles &) = delete;
+
+    /**
+     * 返回临时目录中的文件路径
+     * @param file_name 文件名
+     * @return 文件路径
+     */
+    string Path(const string &file_name) const { return (this->directory_ / file_name).string(); }
+
+    string param_path() const { return Path("graph.pnnx.param"); }
+    string bin_path() const { return Path("graph.pnnx.bin"); }
+
+    /**
+     * 将pnnx计算图保存到param_path和bin_path
+     * @param graph pnnx计算图
+     * @return 是否保存成功
+     */
+    bool Save(pnnx::Graph &graph) const { return graph.save(param_path(), bin_path()) == 0; }
+
+private:
+    filesystem::path directory_;
+};
+
+}
+#endif //MAGIC_TEST_TEST_GRAPH_UTIL_HPP_
@@ -2,6 +2,9 @@
 #include <glog/logging.h>
 #include "data/tensor.hpp"
 #include "../include/layer/details/linear.hpp"
+#include "runtime/ir.h"
+#include "runtime/runtime_ir.hpp"
+#include "test_graph_util.hpp"
 
 using namespace magic_infer;
 
@@ -481,3 +484,219 @@ TEST(test_layer, forward_linear12)
         ASSERT_EQ(result->at(0, i, 4), 2640);
     }
 }
+
+
+TEST(test_layer, forward_global_pool_linear)
+{
+    TempGraphFiles files;
+    const int in_features = 16;
+    const int out_features = 10;
+    const int rows = 5;
+    const int cols = 3;
+    vector<float> weight(out_features * in_features);
+    vector<float> bias(out_features);
+    for (uint32_t i = 0; i < weight.size(); ++i) {
+        weight.at(i) = float(int(i * 7 % 23) - 11) / 10.f;
+    }
+    for (uint32_t i = 0; i < bias.size(); ++i) {
+        bias.at(i) = float(i) / 10.f - 0.5f;
+    }
+
+    pnnx::Graph pnnx_graph;
+    const vector<vector<int>> shapes{{1, in_features, rows, cols}, {1, in_features, 1, 1}, {1, in_features}, {1, out_features}};
+    vector<pnnx::Operand *> operands;
+    for (uint32_t i = 0; i < shapes.size(); ++i) {
+        pnnx::Operand *operand = pnnx_graph.new_operand(to_string(i));
+        operand->type = 1;
+        operand->shape = shapes.at(i);
+        operands.push_back(operand);
+    }
+
+    LinkOperator(pnnx_graph.new_operator("pnnx.Input", "pnnx_input_0"), {}, operands.at(0));
+    pnnx::Operator *pool_op = pnnx_graph.new_operator("nn.AdaptiveAvgPool2d", "avgpool");
+    pool_op->params["output_size"] = {1, 1};
+    LinkOperator(pool_op, {operands.at(0)}, operands.at(1));
+    pnnx::Operator *flatten_op = pnnx_graph.new_operator("torch.flatten", "flatten");
+    flatten_op->params["start_dim"] = 1;
+    flatten_op->params["end_dim"] = -1;
+    LinkOperator(flatten_op, {operands.at(1)}, operands.at(2));
+    pnnx::Operator *linear_op = pnnx_graph.new_operator("nn.Linear", "fc");
+    linear_op->params["bias"] = true;
+    linear_op->params["in_features"] = in_features;
+    linear_op->params["out_features"] = out_features;
+    linear_op->attrs["weight"] = pnnx::Attribute({out_features, in_features}, weight);
+    linear_op->attrs["bias"] = pnnx::Attribute({out_features}, bias);
+    LinkOperator(linear_op, {operands.at(2)}, operands.at(3));
+    LinkOperator(pnnx_graph.new_operator("pnnx.Output", "pnnx_output_0"), {operands.at(3)}, nullptr);
+    ASSERT_TRUE(files.Save(pnnx_graph));
+
+    RuntimeGraph graph(files.param_path(), files.bin_path());
+    graph.Build("pnnx_input_0", "pnnx_output_0");
+    ASSERT_EQ(graph.operators().size(), 3);
+    ASSERT_EQ(graph.operators().at(1)->type, "magic.GlobalPoolLinear");
+
+    shared_ptr<Tensor<float>> input = make_shared<Tensor<float>>(in_features, rows, cols);
+    input->Rand();
+    vector<shared_ptr<Tensor<float>>> inputs{input};
+    const vector<shared_ptr<Tensor<float>>> &outputs = graph.Forward(inputs, false);
+    ASSERT_EQ(outputs.size(), 1);
+    ASSERT_EQ(outputs.front()->size(), out_features);
+
+    // 池化、展平之后和按行存放的权重相乘
+    for (int o = 0; o < out_features; ++o) {
+        float expected = bias.at(o);
+        for (int c = 0; c < in_features; ++c) {
+            float mean = 0.f;
+            for (int r = 0; r < rows; ++r) {
+                for (int w = 0; w < cols; ++w) {
+                    mean += input->at(c, r, w);
+                }
+            }
+            expected += weight.at(o * in_features + c) * mean / float(rows * cols);
+        }
+        ASSERT_NEAR(outputs.front()->index(o), expected, 1e-5f);
+    }
+
+    // 计算图按设置的精度创建分类头，第一次执行之后只保留fp16权重
+    RuntimeGraph half_graph(files.param_path(), files.bin_path());
+    half_graph.set_linear_weight_type(LinearWeightType::kFloat16);
+    half_graph.Build("pnnx_input_0", "pnnx_output_0");
+    const shared_ptr<LinearLayer> &half_layer = dynamic_pointer_cast<LinearLayer>(half_graph.operators().at(1)->layer);
+    ASSERT_NE(half_layer, nullptr);
+    ASSERT_EQ(half_layer->weight_type(), LinearWeightType::kFloat16);
+
+    const vector<shared_ptr<Tensor<float>>> &half_outputs = half_graph.Forward(inputs, false);
+    ASSERT_EQ(half_layer->weights().front(), nullptr);
+    for (int o = 0; o < out_features; ++o) {
+        ASSERT_NEAR(half_outputs.front()->index(o), outputs.front()->index(o), 1e-2f);
+    }
+}
+
+
+/**
+ * 按行存放的权重直接计算input * weight^T + bias，作为各种精度和batch的参考结果
+ */
+static float LinearReference(const vector<float> &weight, const vector<float> &bias, const Tensor<float> &input,
+    uint32_t in_features, uint32_t o, uint32_t d)
+{
+    float expected = bias.empty() ? 0.f : bias.at(o);
+    for (uint32_t i = 0; i < in_features; ++i) {
+        expected += weight.at(o * in_features + i) * input.at(0, i, d);
+    }
+    return expected;
+}
+
+
+TEST(test_layer, forward_linear_batch)
+{
+    const uint32_t in_features = 37;
+    const uint32_t out_features = 301;
+    const uint32_t batch = 3;
+    vector<float> weight(out_features * in_features);
+    vector<float> bias(out_features);
+    for (uint32_t i = 0; i < weight.size(); ++i) {
+        weight.at(i) = float(int(i * 13 % 29) - 14) / 16.f;
+    }
+    for (uint32_t i = 0; i < bias.size(); ++i) {
+        bias.at(i) = float(i % 7) - 3.f;
+    }
+
+    // in_dims为1时每个样本单独做GEMV，大于1时整个batch拼成一次GEMM
+    for (const uint32_t in_dims : {1u, 5u}) {
+        LinearLayer linear_layer(in_features, out_features, true);
+        linear_layer.set_weights(weight);
+        linear_layer.set_bias(bias);
+
+        vector<shared_ptr<Tensor<float>>> inputs;
+        vector<shared_ptr<Tensor<float>>> outputs(batch);
+        for (uint32_t b = 0; b < batch; ++b) {
+            shared_ptr<Tensor<float>> input = make_shared<Tensor<float>>(1, in_features, in_dims);
+            input->Rand();
+            inputs.push_back(input);
+        }
+
+        ASSERT_EQ(linear_layer.Forward(inputs, outputs), InferStatus::kInferSuccess);
+        for (uint32_t b = 0; b < batch; ++b) {
+            ASSERT_EQ(outputs.at(b)->raw_shapes(), (vector<uint32_t>{out_features, in_dims}));
+            for (uint32_t o = 0; o < out_features; ++o) {
+                for (uint32_t d = 0; d < in_dims; ++d) {
+                    const float expected = LinearReference(weight, bias, *inputs.at(b), in_features, o, d);
+                    ASSERT_NEAR(outputs.at(b)->at(0, o, d), expected, 1e-4f);
+                }
+            }
+        }
+    }
+}
+
+
+TEST(test_layer, forward_linear_weight_type)
+{
+    const uint32_t in_features = 67;
+    const uint32_t out_features = 130;
+    vector<float> weight(out_features * in_features);
+    for (uint32_t i = 0; i < weight.size(); ++i) {
+        weight.at(i) = float(int(i * 17 % 101) - 50) / 37.f;
+    }
+
+    // fp16的相对误差约为2^-11，int8每个元素的误差不超过该行缩放系数的一半
+    const vector<pair<LinearWeightType, float>> weight_types{{LinearWeightType::kFloat16, 2e-2f}, {LinearWeightType::kInt8, 0.2f}};
+    for (const auto &[weight_type, tolerance] : weight_types) {
+        for (const uint32_t in_dims : {1u, 3u, 5u}) {
+            LinearLayer linear_layer(in_features, out_features, false);
+            linear_layer.set_weights(weight);
+            linear_layer.set_weight_type(weight_type);
+            ASSERT_EQ(linear_layer.weight_type(), weight_type);
+
+            vector<shared_ptr<Tensor<float>>> inputs;
+            vector<shared_ptr<Tensor<float>>> outputs(2);
+            for (uint32_t b = 0; b < 2; ++b) {
+                shared_ptr<Tensor<float>> input = make_shared<Tensor<float>>(1, in_features, in_dims);
+                input->Rand();
+                inputs.push_back(input);
+            }
+
+            ASSERT_EQ(linear_layer.Forward(inputs, outputs), InferStatus::kInferSuccess);
+            for (uint32_t b = 0; b < 2; ++b) {
+                for (uint32_t o = 0; o < out_features; ++o) {
+                    for (uint32_t d = 0; d < in_dims; ++d) {
+                        const float expected = LinearReference(weight, {}, *inputs.at(b), in_features, o, d);
+                        ASSERT_NEAR(outputs.at(b)->at(0, o, d), expected, tolerance);
+                    }
+                }
+            }
+
+            // 转换之后释放float权重，重新设置权重之后才能切换回float
+            ASSERT_EQ(linear_layer.weights().front(), nullptr);
+            linear_layer.set_weights(weight);
+            linear_layer.set_weight_type(LinearWeightType::kFloat32);
+            ASSERT_EQ(linear_layer.Forward(inputs, outputs), InferStatus::kInferSuccess);
+            for (uint32_t o = 0; o < out_features; ++o) {
+                ASSERT_NEAR(outputs.front()->at(0, o, 0), LinearReference(weight, {}, *inputs.front(), in_features, o, 0), 1e-4f);
+            }
+        }
+    }
+}
+
+
+TEST(test_layer, linear_empty_weight_attribute)
+{
+    // 权重文件中缺失的条目得到没有数据的属性，不能创建出全零权重的Layer
+    shared_ptr<RuntimeOperator> op = make_shared<RuntimeOperator>();
+    op->name = "fc";
+    op->type = "nn.Linear";
+    RuntimeParameterBool *use_bias = new RuntimeParameterBool;
+    use_bias->value = false;
+    op->params.insert({"bias", use_bias});
+    shared_ptr<RuntimeAttribute> weight = make_shared<RuntimeAttribute>();
+    weight->type = RuntimeDataType::kTypeFloat32;
+    weight->shape = {4, 3};
+    op->attribute.insert({"weight", weight});
+    op->attribute.insert({"bias", make_shared<RuntimeAttribute>()});
+
+    shared_ptr<Layer> layer;
+    ASSERT_EQ(LinearLayer::GetInstance(op, layer), ParseParameterAttrStatus::kAttrMissingWeight);
+
+    // 原生模型文件的加载器随后设置打包之后的权重
+    op->prepacked_weights = true;
+    ASSERT_EQ(LinearLayer::GetInstance(op, layer), ParseParameterAttrStatus::kParameterAttrParseSuccess);
+}
@@ -1,6 +1,11 @@
 #include <gtest/gtest.h>
 #include <glog/logging.h>
+#include <fstream>
 #include "data/load_data.hpp"
+#include "runtime/ir.h"
+#include "runtime/store_zip.hpp"
+#include "runtime/runtime_attr.hpp"
+#include "test_graph_util.hpp"
 
 using namespace magic_infer;
 
@@ -150,3 +155,107 @@ TEST(test_load, load_large_data)
     }
     ASSERT_EQ(data_minus_one, 1024 * 1024);
 }
+
+
+TEST(test_load, load_csv_tensor)
+{
+    // 两个通道，每个通道3行4列，包含正号、指数、多余的空白和CRLF换行
+    TempGraphFiles files;
+    const string tensor_path = files.Path("tensor.csv");
+    {
+        ofstream out(tensor_path, ios::binary);
+        for (int i = 0; i < 6; ++i) {
+            for (int j = 0; j < 4; ++j) {
+                const int value = i * 4 + j;
+                if (j > 0) out << ", ";
+                if (value % 3 == 0) out << "+" << value;
+                else if (value % 3 == 1) out << value << "e0 ";
+                else out << -value * 0.5f;
+            }
+            out << "\r\n";
+        }
+    }
+
+    Tensor<float> tensor(2, 3, 4);
+    CSVDataLoader::LoadData(tensor_path, tensor);
+    const arma::fmat &data = CSVDataLoader::LoadData(tensor_path);
+    ASSERT_EQ(data.n_rows, 6);
+    ASSERT_EQ(data.n_cols, 4);
+    for (uint32_t c = 0; c < 2; ++c) {
+        for (uint32_t r = 0; r < 3; ++r) {
+            for (uint32_t col = 0; col < 4; ++col) {
+                const int value = (c * 3 + r) * 4 + col;
+                const float expected = value % 3 == 2 ? -value * 0.5f : float(value);
+                ASSERT_EQ(tensor.at(c, r, col), expected);
+                ASSERT_EQ(data.at(c * 3 + r, col), expected);
+            }
+        }
+    }
+
+    const string invalid_path = files.Path("invalid.csv");
+    {
+        ofstream out(invalid_path, ios::binary);
+        out << "1.0,2.0,3.0\n4.0,5.0x,6.0\n";
+    }
+    EXPECT_DEATH(CSVDataLoader::LoadData(invalid_path), "invalid.csv:2:5 \\(element 2\\), invalid number \"5.0x\"");
+}
+
+
+TEST(test_load, store_zip_mmap)
+{
+    const vector<float> weight{0.5f, -1.f, 0.25f, 2.f, 1.f, 1.f};
+    const string text = "abc";
+    TempGraphFiles files;
+    const string zip_path = files.Path("store_zip.bin");
+
+    pnnx::StoreZipWriter writer;
+    ASSERT_EQ(writer.open(zip_path), 0);
+    ASSERT_EQ(writer.write_file("a.txt", text.data(), text.size()), 0);
+    ASSERT_EQ(writer.write_file("conv1.weight", (const char *) weight.data(), weight.size() * sizeof(float)), 0);
+    ASSERT_EQ(writer.close(), 0);
+
+    pnnx::StoreZipReader reader;
+    ASSERT_EQ(reader.open(zip_path), 0);
+    ASSERT_EQ(reader.get_file_size("a.txt"), text.size());
+    ASSERT_EQ(reader.get_file_size("conv1.weight"), weight.size() * sizeof(float));
+
+    string text_read(text.size(), ' ');
+    ASSERT_EQ(reader.read_file("a.txt", &text_read[0]), 0);
+    ASSERT_EQ(text_read, text);
+
+    // 写入的数据按64字节对齐，关闭之后视图依然有效
+    shared_ptr<const char> weight_data = reader.get_file_data("conv1.weight");
+    ASSERT_NE(weight_data, nullptr);
+    ASSERT_EQ((uintptr_t) weight_data.get() % 64, 0);
+    ASSERT_EQ(reader.get_file_data("missing"), nullptr);
+    reader.close();
+
+    // 空文件是没有条目的合法压缩包
+    const string empty_path = files.Path("store_zip_empty.bin");
+    ofstream(empty_path, ios::binary | ios::trunc).close();
+    ASSERT_EQ(reader.open(empty_path), 0);
+    ASSERT_EQ(reader.get_file_data("conv1.weight"), nullptr);
+    reader.close();
+
+    RuntimeAttribute attribute;
+    attribute.type = RuntimeDataType::kTypeFloat32;
+    attribute.mapped_data = weight_data;
+    attribute.mapped_size = weight.size() * sizeof(float);
+    const RuntimeAttributeSpan<float> &span = attribute.span<float>();
+    ASSERT_EQ(span.size, weight.size());
+    ASSERT_EQ((const char *) span.data, weight_data.get());
+    ASSERT_EQ(attribute.get<float>(), weight);
+
+    // pnnx图加载的属性直接引用权重文件的映射
+    pnnx::Graph graph;
+    pnnx::Operator *op = graph.new_operator("nn.Linear", "linear");
+    op->attrs["weight"] = pnnx::Attribute({2, 3}, weight);
+    ASSERT_TRUE(files.Save(graph));
+
+    pnnx::Graph load_graph;
+    ASSERT_EQ(load_graph.load(files.param_path(), files.bin_path()), 0);
+    const pnnx::Attribute &load_attr = load_graph.ops.front()->attrs.at("weight");
+    ASSERT_TRUE(load_attr.data.empty());
+    ASSERT_NE(load_attr.mapped_data, nullptr);
+    ASSERT_TRUE(load_attr == op->attrs.at("weight"));
+}
@@ -0,0 +1,209 @@
+#include <gtest/gtest.h>
+#include <glog/logging.h>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include "layer/details/activation_kernel.hpp"
+#include "utils/avx_math.hpp"
+#include "utils/avx512_math.hpp"
+
+using namespace magic_infer;
+
+#if MAGIC_X86_DISPATCH
+
+typedef void (*MathKernel)(const float *input, float *output, uint32_t size);
+
+
+template<__m256 (*Func)(__m256)>
+static MAGIC_TARGET_AVX2 void Apply256(const float *input, float *output, uint32_t size)
+{
+    for (uint32_t i = 0; i + 8 <= size; i += 8) {
+        _mm256_storeu_ps(output + i, Func(_mm256_loadu_ps(input + i)));
+    }
+}
+
+
+template<__m512 (*Func)(__m512)>
+static MAGIC_TARGET_AVX512 void Apply512(const float *input, float *output, uint32_t size)
+{
+    for (uint32_t i = 0; i + 16 <= size; i += 16) {
+        _mm512_storeu_ps(output + i, Func(_mm512_loadu_ps(input + i)));
+    }
+}
+
+
+/// 误差的度量方式，和avx_math.hpp中的误差表一致
+enum class MathError
+{
+    kULP,
+    kAbsolute,
+    kRelative,
+};
+
+
+struct MathCase
+{
+    string name;
+    double (*reference)(double);
+    float low;
+    float high;
+    MathError error;
+    double bound;
+    MathKernel avx2;
+    MathKernel avx512;
+};
+
+
+static double Sigmoid(double x) { return 1. / (1. + exp(-x)); }
+
+
+/**
+ * 在[low, high]之内按float的位模式均匀取样，保证每个数量级都有输入
+ * @param low 下界
+ * @param high 上界
+ * @param size 取样个数，是16的倍数
+ * @return 输入
+ */
+static vector<float> MathInput(float low, float high, uint32_t size)
+{
+    // 把float的位模式映射到单调的整数上，负数取反
+    auto to_ordered = [](float value) {
+        int32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        return bits < 0 ? int64_t(INT32_MIN) - bits : int64_t(bits);
+    };
+    auto from_ordered = [](int64_t ordered) {
+        const int32_t bits = ordered < 0 ? int32_t(int64_t(INT32_MIN) - ordered) : int32_t(ordered);
+        float value;
+        memcpy(&value, &bits, sizeof(value));
+        return value;
+    };
+
+    const int64_t begin = to_ordered(low);
+    const int64_t end = to_ordered(high);
+    vector<float> input(size);
+    for (uint32_t i = 0; i < size; ++i) {
+        input.at(i) = from_ordered(begin + (end - begin) * int64_t(i) / int64_t(size - 1));
+    }
+    return input;
+}
+
+
+/**
+ * 计算核函数相对于double参考值的最大误差
+ * @param math_case 测试的函数
+ * @param kernel 核函数
+ * @return 最大误差
+ */
+static double MaxError(const MathCase &math_case, MathKernel kernel)
+{
+    const uint32_t size = 1 << 20;
+    const vector<float> &input = MathInput(math_case.low, math_case.high, size);
+    vector<float> output(size);
+    kernel(input.data(), output.data(), size);
+
+    double max_error = 0.;
+    for (uint32_t i = 0; i < size; ++i) {
+        const double expected = math_case.reference(input.at(i));
+        const double error = fabs(double(output.at(i)) - expected);
+        if (math_case.error == MathError::kULP) {
+            const float magnitude = max(fabsf(float(expected)), FLT_MIN);
+            const double ulp = nextafterf(magnitude, FLT_MAX) - magnitude;
+            max_error = max(max_error, error / ulp);
+        } else if (math_case.error == MathError::kRelative) {
+            max_error = max(max_error, error / fabs(expected));
+        } else {
+            max_error = max(max_error, error);
+        }
+    }
+    return max_error;
+}
+
+
+TEST(test_math, documented_error)
+{
+    const vector<MathCase> math_cases{
+        {"exp", exp, -87.f, 88.f, MathError::kULP, 1.01, Apply256<exp256_ps>, Apply512<exp512_ps>},
+        {"exp_fast", exp, -87.f, 88.f, MathError::kRelative, 8.1e-5, Apply256<exp256_fast_ps>, Apply512<exp512_fast_ps>},
+        {"log", log, FLT_MIN, FLT_MAX, MathError::kULP, 0.83, Apply256<log256_ps>, Apply512<log512_ps>},
+        {"log_fast", log, FLT_MIN, FLT_MAX, MathError::kAbsolute, 2.0e-5, Apply256<log256_fast_ps>, Apply512<log512_fast_ps>},
+        {"sigmoid", Sigmoid, -87.f, 88.f, MathError::kULP, 2.5, Apply256<sigmoid256_ps>, Apply512<sigmoid512_ps>},
+        {"sigmoid_fast", Sigmoid, -87.f, 88.f, MathError::kRelative, 8.1e-5, Apply256<sigmoid256_fast_ps>,
+            Apply512<sigmoid512_fast_ps>},
+        {"tanh", tanh, -9.f, 9.f, MathError::kULP, 5.5, Apply256<tanh256_ps>, Apply512<tanh512_ps>},
+        {"tanh_fast", tanh, -9.f, 9.f, MathError::kAbsolute, 7.3e-5, Apply256<tanh256_fast_ps>, Apply512<tanh512_fast_ps>},
+        {"erf", erf, -4.f, 4.f, MathError::kULP, 2.5, Apply256<erf256_ps>, Apply512<erf512_ps>},
+        {"erf_fast", erf, -4.f, 4.f, MathError::kAbsolute, 1.1e-6, Apply256<erf256_fast_ps>, Apply512<erf512_fast_ps>},
+    };
+
+    const CpuIsa host_isa = ActivationKernelRegistry::HostIsa();
+    for (const MathCase &math_case : math_cases) {
+        if (host_isa >= CpuIsa::kAVX2) {
+            const double error = MaxError(math_case, math_case.avx2);
+            LOG(INFO) << math_case.name << " avx2 max error " << error;
+            ASSERT_LE(error, math_case.bound) << math_case.name;
+        }
+        if (host_isa >= CpuIsa::kAVX512) {
+            const double error = MaxError(math_case, math_case.avx512);
+            LOG(INFO) << math_case.name << " avx512 max error " << error;
+            ASSERT_LE(error, math_case.bound) << math_case.name;
+        }
+    }
+}
+
+
+TEST(test_math, special_values)
+{
+    if (ActivationKernelRegistry::HostIsa() < CpuIsa::kAVX2) return;
+    const vector<float> input{0.f, -1.f, INFINITY, NAN, 1.f, -0.f, 1e-30f, -200.f};
+    vector<float> output(input.size());
+
+    Apply256<log256_ps>(input.data(), output.data(), input.size());
+    ASSERT_EQ(output.at(0), -INFINITY);
+    ASSERT_TRUE(isnan(output.at(1)));
+    ASSERT_EQ(output.at(2), INFINITY);
+    ASSERT_TRUE(isnan(output.at(3)));
+    ASSERT_EQ(output.at(4), 0.f);
+
+    // 超出区间的输入饱和，不产生NaN
+    Apply256<tanh256_ps>(input.data(), output.data(), input.size());
+    ASSERT_EQ(output.at(2), 1.f);
+    ASSERT_EQ(output.at(6), 1e-30f);
+    ASSERT_EQ(output.at(7), -1.f);
+    Apply256<erf256_ps>(input.data(), output.data(), input.size());
+    ASSERT_EQ(output.at(2), 1.f);
+    ASSERT_EQ(output.at(5), 0.f);
+    ASSERT_EQ(output.at(7), -1.f);
+    Apply256<sigmoid256_ps>(input.data(), output.data(), input.size());
+    ASSERT_EQ(output.at(2), 1.f);
+    ASSERT_EQ(output.at(0), 0.5f);
+}
+
+
+TEST(test_math, fast_math_mode)
+{
+    const MathMode math_mode = ActivationKernelRegistry::math_mode();
+    const CpuIsa host_isa = ActivationKernelRegistry::HostIsa();
+    ActivationKernelRegistry::set_math_mode(MathMode::kFast);
+    const ActivationKernel fast_kernel = ActivationKernelRegistry::Get(ActivationType::kSigmoid);
+    ActivationKernelRegistry::set_math_mode(MathMode::kAccurate);
+    const ActivationKernel accurate_kernel = ActivationKernelRegistry::Get(ActivationType::kSigmoid);
+    ActivationKernelRegistry::set_math_mode(math_mode);
+
+    ASSERT_EQ(accurate_kernel, ActivationKernelRegistry::Get(ActivationType::kSigmoid, host_isa, MathMode::kAccurate));
+    if (host_isa >= CpuIsa::kAVX2) ASSERT_NE(fast_kernel, accurate_kernel);
+    // 没有快速版本的指令集和激活函数使用精确版本
+    ASSERT_EQ(ActivationKernelRegistry::Get(ActivationType::kSigmoid, CpuIsa::kScalar, MathMode::kFast),
+        ActivationKernelRegistry::Get(ActivationType::kSigmoid, CpuIsa::kScalar, MathMode::kAccurate));
+    ASSERT_EQ(ActivationKernelRegistry::Get(ActivationType::kReLU, host_isa, MathMode::kFast),
+        ActivationKernelRegistry::Get(ActivationType::kReLU, host_isa, MathMode::kAccurate));
+
+    const vector<float> input{-5.f, -1.f, 0.f, 0.5f, 1.f, 2.f, 8.f, 20.f};
+    vector<float> output(input.size());
+    fast_kernel(input.data(), output.data(), input.size());
+    for (uint32_t i = 0; i < input.size(); ++i) {
+        ASSERT_NEAR(output.at(i), Sigmoid(input.at(i)), 1e-4);
+    }
+}
+
+#endif // MAGIC_X86_DISPATCH
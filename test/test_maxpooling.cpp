@@ -2,6 +2,7 @@
 #include <glog/logging.h>
 #include "data/tensor.hpp"
 #include "../include/layer/details/maxpooling.hpp"
+#include "../include/layer/details/sppf.hpp"
 
 using namespace magic_infer;
 
@@ -516,3 +517,110 @@ TEST(test_layer, forward_max_pooling_s77_k77)
         }
     }
 }
+
+
+/**
+ * 带填充的最大池化参考实现，逐个窗口比较，填充的位置不参与比较
+ * @param input 输入
+ * @param kernel 池化窗口的高和宽
+ * @param stride 步长
+ * @param padding 填充
+ * @return 输出
+ */
+static shared_ptr<Tensor<float>> MaxPoolingPadded(const shared_ptr<Tensor<float>> &input, uint32_t kernel, uint32_t stride, uint32_t padding)
+{
+    const int32_t input_h = input->rows();
+    const int32_t input_w = input->cols();
+    const uint32_t output_h = (input_h + 2 * padding - kernel) / stride + 1;
+    const uint32_t output_w = (input_w + 2 * padding - kernel) / stride + 1;
+
+    shared_ptr<Tensor<float>> output = make_shared<Tensor<float>>(input->channels(), output_h, output_w);
+    for (uint32_t c = 0; c < input->channels(); ++c) {
+        for (uint32_t r = 0; r < output_h; ++r) {
+            for (uint32_t w = 0; w < output_w; ++w) {
+                float max_value = numeric_limits<float>::lowest();
+                for (int32_t kr = 0; kr < int32_t(kernel); ++kr) {
+                    for (int32_t kw = 0; kw < int32_t(kernel); ++kw) {
+                        const int32_t input_r = int32_t(r * stride) + kr - int32_t(padding);
+                        const int32_t input_c = int32_t(w * stride) + kw - int32_t(padding);
+                        if (input_r < 0 || input_r >= input_h || input_c < 0 || input_c >= input_w) continue;
+                        max_value = max(max_value, input->at(c, input_r, input_c));
+                    }
+                }
+                output->at(c, r, w) = max_value;
+            }
+        }
+    }
+    return output;
+}
+
+
+TEST(test_layer, forward_max_pooling_kernels)
+{
+    // 覆盖2x2/s2、3x3/s2的专用实现，步长为1时直接比较和van Herk两种实现，以及其他的通用实现
+    const vector<vector<uint32_t>> params{{2, 2, 0}, {3, 2, 0}, {3, 2, 1}, {2, 1, 0}, {3, 1, 1}, {5, 1, 2}, {7, 1, 3},
+        {11, 1, 5}, {13, 1, 0}, {4, 3, 1}, {5, 5, 0}};
+    const vector<vector<uint32_t>> sizes{{20, 20}, {7, 9}, {13, 5}, {33, 31}, {40, 17}};
+
+    for (const auto &param : params) {
+        const uint32_t kernel = param.at(0);
+        const uint32_t stride = param.at(1);
+        const uint32_t padding = param.at(2);
+        MaxPoolingLayer max_layer(padding, padding, kernel, kernel, stride, stride);
+
+        for (const auto &size : sizes) {
+            if (size.at(0) + 2 * padding < kernel || size.at(1) + 2 * padding < kernel) continue;
+            shared_ptr<Tensor<float>> input = make_shared<Tensor<float>>(3, size.at(0), size.at(1));
+            input->Rand();
+
+            vector<shared_ptr<Tensor<float>>> inputs{input};
+            vector<shared_ptr<Tensor<float>>> outputs(1);
+            ASSERT_EQ(max_layer.Forward(inputs, outputs), InferStatus::kInferSuccess);
+
+            const shared_ptr<Tensor<float>> &expected = MaxPoolingPadded(input, kernel, stride, padding);
+            const shared_ptr<Tensor<float>> &output = outputs.front();
+            ASSERT_EQ(output->shapes(), expected->shapes()) << "kernel " << kernel << ", stride " << stride;
+            for (uint32_t i = 0; i < expected->size(); ++i) {
+                ASSERT_EQ(output->index(i), expected->index(i)) << "kernel " << kernel << ", stride " << stride << ", padding "
+                    << padding << ", size " << size.at(0) << "x" << size.at(1) << ", index " << i;
+            }
+        }
+    }
+}
+
+
+TEST(test_layer, forward_sppf)
+{
+    const uint32_t channels = 4;
+    const uint32_t batch = 2;
+    vector<shared_ptr<Tensor<float>>> inputs;
+    for (uint32_t i = 0; i < batch; ++i) {
+        shared_ptr<Tensor<float>> input = make_shared<Tensor<float>>(channels, 20, 20);
+        input->Rand();
+        inputs.push_back(input);
+    }
+
+    shared_ptr<MaxPoolingLayer> max_layer = make_shared<MaxPoolingLayer>(2, 2, 5, 5, 1, 1);
+    SPPFLayer sppf_layer(max_layer);
+    vector<shared_ptr<Tensor<float>>> outputs(batch);
+    ASSERT_EQ(sppf_layer.Forward(inputs, outputs), InferStatus::kInferSuccess);
+
+    // 和逐级池化再拼接的结果一致
+    for (uint32_t i = 0; i < batch; ++i) {
+        const shared_ptr<Tensor<float>> &output = outputs.at(i);
+        ASSERT_EQ(output->channels(), channels * (SPPFLayer::kPoolingNum + 1));
+
+        shared_ptr<Tensor<float>> expected = inputs.at(i);
+        for (uint32_t k = 0; k <= SPPFLayer::kPoolingNum; ++k) {
+            if (k > 0) expected = MaxPoolingPadded(expected, 5, 1, 2);
+            for (uint32_t c = 0; c < channels; ++c) {
+                ASSERT_TRUE(arma::approx_equal(output->at(k * channels + c), expected->at(c), "absdiff", 0.f));
+            }
+        }
+    }
+
+    // 输出大小改变的池化参数不能用于SPPF
+    SPPFLayer invalid_layer(make_shared<MaxPoolingLayer>(0, 0, 5, 5, 1, 1));
+    vector<shared_ptr<Tensor<float>>> invalid_outputs(batch);
+    ASSERT_EQ(invalid_layer.Forward(inputs, invalid_outputs), InferStatus::kInferFailedOutputSizeError);
+}
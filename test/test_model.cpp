@@ -0,0 +1,460 @@
+#include <gtest/gtest.h>
+#include <glog/logging.h>
+#include <cstring>
+#include <fstream>
+#include <omp.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "runtime/ir.h"
+#include "runtime/runtime_ir.hpp"
+#include "layer/abstract/weight_cache.hpp"
+#include "test_graph_util.hpp"
+
+using namespace magic_infer;
+
+
+/**
+ * 构建一个包含卷积、BatchNorm、ReLU和concat的pnnx计算图并保存
+ * @param files 保存计算图的临时目录
+ */
+static void SaveConvGraph(const TempGraphFiles &files)
+{
+    const int in_channels = 3, out_channels = 4, rows = 8, cols = 8;
+    pnnx::Graph pnnx_graph;
+    pnnx::Operand *input_operand = pnnx_graph.new_operand("0");
+    pnnx::Operand *conv_operand = pnnx_graph.new_operand("1");
+    pnnx::Operand *bn_operand = pnnx_graph.new_operand("2");
+    pnnx::Operand *relu_operand = pnnx_graph.new_operand("3");
+    pnnx::Operand *cat_operand = pnnx_graph.new_operand("4");
+    for (pnnx::Operand *operand : {input_operand, conv_operand, bn_operand, relu_operand, cat_operand}) {
+        operand->type = 1;
+        operand->shape = {1, out_channels, rows, cols};
+    }
+    input_operand->shape = {1, in_channels, rows, cols};
+    cat_operand->shape = {1, out_channels + in_channels, rows, cols};
+
+    vector<float> weight(out_channels * in_channels * 9);
+    for (uint32_t i = 0; i < weight.size(); ++i) {
+        weight.at(i) = float(int(i % 7) - 3) * 0.125f;
+    }
+
+    LinkOperator(pnnx_graph.new_operator("pnnx.Input", "pnnx_input_0"), {}, input_operand);
+    pnnx::Operator *conv_op = pnnx_graph.new_operator("nn.Conv2d", "conv1");
+    conv_op->params["in_channels"] = in_channels;
+    conv_op->params["out_channels"] = out_channels;
+    conv_op->params["kernel_size"] = {3, 3};
+    conv_op->params["stride"] = {1, 1};
+    conv_op->params["padding"] = {1, 1};
+    conv_op->params["dilation"] = {1, 1};
+    conv_op->params["groups"] = 1;
+    conv_op->params["bias"] = true;
+    conv_op->params["padding_mode"] = "zeros";
+    conv_op->attrs["weight"] = pnnx::Attribute({out_channels, in_channels, 3, 3}, weight);
+    conv_op->attrs["bias"] = pnnx::Attribute({out_channels}, vector<float>{0.1f, -0.2f, 0.3f, -0.4f});
+    LinkOperator(conv_op, {input_operand}, conv_operand);
+
+    pnnx::Operator *bn_op = pnnx_graph.new_operator("nn.BatchNorm2d", "bn1");
+    bn_op->params["num_features"] = out_channels;
+    bn_op->params["eps"] = 1e-5f;
+    bn_op->params["affine"] = true;
+    bn_op->attrs["running_mean"] = pnnx::Attribute({out_channels}, vector<float>{0.1f, -0.2f, 0.3f, 0.f});
+    bn_op->attrs["running_var"] = pnnx::Attribute({out_channels}, vector<float>{0.5f, 1.5f, 2.f, 1.f});
+    bn_op->attrs["weight"] = pnnx::Attribute({out_channels}, vector<float>{1.f, 0.5f, -2.f, 1.f});
+    bn_op->attrs["bias"] = pnnx::Attribute({out_channels}, vector<float>{0.f, 1.f, -0.5f, 0.25f});
+    LinkOperator(bn_op, {conv_operand}, bn_operand);
+
+    LinkOperator(pnnx_graph.new_operator("nn.ReLU", "relu1"), {bn_operand}, relu_operand);
+    pnnx::Operator *cat_op = pnnx_graph.new_operator("torch.cat", "cat1");
+    cat_op->params["dim"] = 1;
+    LinkOperator(cat_op, {relu_operand, input_operand}, cat_operand);
+    LinkOperator(pnnx_graph.new_operator("pnnx.Output", "pnnx_output_0"), {cat_operand}, nullptr);
+    CHECK(files.Save(pnnx_graph));
+}
+
+
+TEST(test_model, save_and_load)
+{
+    TempGraphFiles files;
+    SaveConvGraph(files);
+    RuntimeGraph graph(files.param_path(), files.bin_path());
+    graph.Build("pnnx_input_0", "pnnx_output_0");
+    ASSERT_TRUE(graph.Save(files.Path("model.magic")));
+
+    RuntimeGraph native_graph("", "");
+    ASSERT_TRUE(native_graph.Load(files.Path("model.magic")));
+    ASSERT_EQ(native_graph.operators().size(), graph.operators().size());
+    ASSERT_TRUE(native_graph.pass_reports().empty());
+    ASSERT_TRUE(RuntimeGraphOptimizer::Validate(native_graph.operators()));
+
+    // 卷积的权重直接引用模型文件映射中按64字节对齐的打包数据
+    for (const auto &op : native_graph.operators()) {
+        if (op->type != "nn.Conv2d") continue;
+        ASSERT_EQ(op->attribute.at("weight")->raw_size(), 0);
+        const auto &weights = op->layer->weights();
+        ASSERT_EQ(weights.size(), 4);
+        ASSERT_EQ((uintptr_t) weights.front()->RawPtr() % 64, 0);
+        ASSERT_EQ(op->layer->bias().size(), 4);
+    }
+
+    for (int repeat = 0; repeat < 2; ++repeat) {
+        shared_ptr<Tensor<float>> input = make_shared<Tensor<float>>(3, 8, 8);
+        input->Rand();
+        vector<shared_ptr<Tensor<float>>> inputs{input};
+        const vector<shared_ptr<Tensor<float>>> outputs = graph.Forward(inputs, false);
+        const vector<shared_ptr<Tensor<float>>> native_outputs = native_graph.Forward(inputs, false);
+        ASSERT_EQ(native_outputs.size(), 1);
+        ASSERT_EQ(native_outputs.front()->shapes(), outputs.front()->shapes());
+        for (uint32_t i = 0; i < outputs.front()->size(); ++i) {
+            ASSERT_EQ(native_outputs.front()->index(i), outputs.front()->index(i));
+        }
+    }
+}
+
+
+TEST(test_model, parallel_build)
+{
+    TempGraphFiles files;
+    // 并行解码属性和创建Layer的结果与单线程一致
+    SaveConvGraph(files);
+    const int32_t max_threads = omp_get_max_threads();
+    omp_set_num_threads(1);
+    RuntimeGraph serial_graph(files.param_path(), files.bin_path());
+    serial_graph.Build("pnnx_input_0", "pnnx_output_0");
+    omp_set_num_threads(4);
+    RuntimeGraph parallel_graph(files.param_path(), files.bin_path());
+    parallel_graph.Build("pnnx_input_0", "pnnx_output_0");
+    omp_set_num_threads(max_threads);
+
+    const auto &serial_operators = serial_graph.operators();
+    const auto &parallel_operators = parallel_graph.operators();
+    ASSERT_EQ(serial_operators.size(), parallel_operators.size());
+    for (uint32_t i = 0; i < serial_operators.size(); ++i) {
+        ASSERT_EQ(serial_operators.at(i)->name, parallel_operators.at(i)->name);
+        ASSERT_EQ(serial_operators.at(i)->output_names, parallel_operators.at(i)->output_names);
+        ASSERT_EQ(serial_operators.at(i)->layer == nullptr, parallel_operators.at(i)->layer == nullptr);
+        if (serial_operators.at(i)->type != "nn.Conv2d") continue;
+
+        const auto &serial_weights = serial_operators.at(i)->layer->weights();
+        const auto &parallel_weights = parallel_operators.at(i)->layer->weights();
+        ASSERT_EQ(serial_weights.size(), parallel_weights.size());
+        for (uint32_t j = 0; j < serial_weights.size(); ++j) {
+            ASSERT_TRUE(arma::approx_equal(serial_weights.at(j)->data(), parallel_weights.at(j)->data(), "absdiff", 0.f));
+        }
+    }
+}
+
+
+TEST(test_model, lazy_weights)
+{
+    TempGraphFiles files;
+    // 延迟创建的卷积在第一次执行时才创建Layer，结果与立即创建一致
+    SaveConvGraph(files);
+    RuntimeGraph eager_graph(files.param_path(), files.bin_path());
+    eager_graph.Build("pnnx_input_0", "pnnx_output_0");
+
+    shared_ptr<Tensor<float>> input = make_shared<Tensor<float>>(3, 8, 8);
+    input->Rand();
+    vector<shared_ptr<Tensor<float>>> inputs{input};
+    const vector<shared_ptr<Tensor<float>>> eager_outputs = eager_graph.Forward(inputs, false);
+
+    for (bool prefetch : {false, true}) {
+        RuntimeGraph lazy_graph(files.param_path(), files.bin_path());
+        lazy_graph.set_lazy_weights(true, prefetch);
+        lazy_graph.Build("pnnx_input_0", "pnnx_output_0");
+        for (const auto &op : lazy_graph.operators()) {
+            if (op->type == "nn.ReLU") ASSERT_NE(op->layer, nullptr);
+            if (op->type == "nn.Conv2d" && !prefetch) ASSERT_EQ(op->layer, nullptr);
+        }
+
+        const vector<shared_ptr<Tensor<float>>> lazy_outputs = lazy_graph.Forward(inputs, false);
+        ASSERT_EQ(lazy_outputs.size(), 1);
+        ASSERT_EQ(lazy_outputs.front()->shapes(), eager_outputs.front()->shapes());
+        for (uint32_t i = 0; i < eager_outputs.front()->size(); ++i) {
+            ASSERT_EQ(lazy_outputs.front()->index(i), eager_outputs.front()->index(i));
+        }
+        for (const auto &op : lazy_graph.operators()) {
+            if (op->type == "nn.Conv2d") ASSERT_NE(op->layer, nullptr);
+        }
+    }
+
+    // 保存原生模型文件之前创建所有延迟的Layer
+    RuntimeGraph save_graph(files.param_path(), files.bin_path());
+    save_graph.set_lazy_weights(true);
+    save_graph.Build("pnnx_input_0", "pnnx_output_0");
+    ASSERT_TRUE(save_graph.Save(files.Path("model_lazy.magic")));
+    RuntimeGraph native_graph("", "");
+    ASSERT_TRUE(native_graph.Load(files.Path("model_lazy.magic")));
+    const vector<shared_ptr<Tensor<float>>> native_outputs = native_graph.Forward(inputs, false);
+    for (uint32_t i = 0; i < eager_outputs.front()->size(); ++i) {
+        ASSERT_EQ(native_outputs.front()->index(i), eager_outputs.front()->index(i));
+    }
+}
+
+
+TEST(test_model, multiple_outputs)
+{
+    TempGraphFiles files;
+    // 一次执行同时得到中间节点和输出节点的结果，只请求中间节点时删除其后的节点
+    SaveConvGraph(files);
+    RuntimeGraph full_graph(files.param_path(), files.bin_path());
+    full_graph.Build("pnnx_input_0", "pnnx_output_0");
+
+    shared_ptr<Tensor<float>> input = make_shared<Tensor<float>>(3, 8, 8);
+    input->Rand();
+    vector<shared_ptr<Tensor<float>>> inputs{input};
+    const vector<shared_ptr<Tensor<float>>> full_outputs = full_graph.Forward(inputs, false);
+    ASSERT_EQ(full_outputs.size(), 1);
+    const shared_ptr<Tensor<float>> &cat_output = full_outputs.front();
+
+    RuntimeGraph graph(files.param_path(), files.bin_path());
+    const vector<string> output_names{"pnnx_output_0", "bn1", "relu1"};
+    graph.Build("pnnx_input_0", output_names);
+    const vector<vector<shared_ptr<Tensor<float>>>> outputs = graph.ForwardOutputs(inputs, false);
+    ASSERT_EQ(outputs.size(), 3);
+    for (const auto &output : outputs) ASSERT_EQ(output.size(), 1);
+
+    const shared_ptr<Tensor<float>> &bn_output = outputs.at(1).front();
+    const shared_ptr<Tensor<float>> &relu_output = outputs.at(2).front();
+    ASSERT_EQ(bn_output->shapes(), vector<uint32_t>({4, 8, 8}));
+    ASSERT_EQ(relu_output->shapes(), vector<uint32_t>({4, 8, 8}));
+    for (uint32_t c = 0; c < 4; ++c) {
+        for (uint32_t r = 0; r < 8; ++r) {
+            for (uint32_t col = 0; col < 8; ++col) {
+                ASSERT_EQ(outputs.at(0).front()->at(c, r, col), cat_output->at(c, r, col));
+                ASSERT_EQ(relu_output->at(c, r, col), cat_output->at(c, r, col));
+                ASSERT_EQ(relu_output->at(c, r, col), max(bn_output->at(c, r, col), 0.f));
+            }
+        }
+    }
+
+    RuntimeGraph backbone_graph(files.param_path(), files.bin_path());
+    backbone_graph.Build("pnnx_input_0", vector<string>{"relu1"});
+    for (const auto &op : backbone_graph.operators()) {
+        ASSERT_NE(op->type, "torch.cat");
+        ASSERT_NE(op->name, "pnnx_output_0");
+    }
+    for (int repeat = 0; repeat < 2; ++repeat) {
+        const vector<shared_ptr<Tensor<float>>> backbone_outputs = backbone_graph.Forward(inputs, false);
+        ASSERT_EQ(backbone_outputs.size(), 1);
+        for (uint32_t i = 0; i < relu_output->size(); ++i) {
+            ASSERT_EQ(backbone_outputs.front()->index(i), relu_output->index(i));
+        }
+    }
+
+    // 保存之后加载的模型仍然返回所有请求的输出
+    ASSERT_TRUE(graph.Save(files.Path("model_outputs.magic")));
+    RuntimeGraph native_graph("", "");
+    ASSERT_TRUE(native_graph.Load(files.Path("model_outputs.magic")));
+    const vector<vector<shared_ptr<Tensor<float>>>> native_outputs = native_graph.ForwardOutputs(inputs, false);
+    ASSERT_EQ(native_outputs.size(), 3);
+    for (uint32_t i = 0; i < 3; ++i) {
+        for (uint32_t j = 0; j < outputs.at(i).front()->size(); ++j) {
+            ASSERT_EQ(native_outputs.at(i).front()->index(j), outputs.at(i).front()->index(j));
+        }
+    }
+
+    // 加载的模型再次Build时从保存的输出节点中选择，没有保存的中间节点报错
+    native_graph.Build("pnnx_input_0", vector<string>{"relu1", "pnnx_output_0"});
+    const vector<vector<shared_ptr<Tensor<float>>>> selected_outputs = native_graph.ForwardOutputs(inputs, false);
+    ASSERT_EQ(selected_outputs.size(), 2);
+    for (uint32_t j = 0; j < relu_output->size(); ++j) {
+        ASSERT_EQ(selected_outputs.at(0).front()->index(j), relu_output->index(j));
+    }
+    ASSERT_DEATH(native_graph.Build("pnnx_input_0", "conv1"), "was not saved in the native model file");
+}
+
+
+TEST(test_model, share_weights)
+{
+    TempGraphFiles files;
+    // 同一个模型的两个计算图共享卷积的权重，关闭缓存之后各自持有权重
+    SaveConvGraph(files);
+    WeightCache &cache = WeightCache::Instance();
+    cache.Clear();
+
+    RuntimeGraph graph1(files.param_path(), files.bin_path());
+    graph1.Build("pnnx_input_0", "pnnx_output_0");
+    RuntimeGraph graph2(files.param_path(), files.bin_path());
+    graph2.Build("pnnx_input_0", "pnnx_output_0");
+    cache.set_enabled(false);
+    RuntimeGraph graph3(files.param_path(), files.bin_path());
+    graph3.Build("pnnx_input_0", "pnnx_output_0");
+    cache.set_enabled(true);
+
+    const auto &find_conv = [](const RuntimeGraph &graph) {
+        for (const auto &op : graph.operators()) {
+            if (op->type == "nn.Conv2d") return op->layer;
+        }
+        return shared_ptr<Layer>();
+    };
+    const shared_ptr<Layer> &conv1 = find_conv(graph1);
+    const shared_ptr<Layer> &conv2 = find_conv(graph2);
+    const shared_ptr<Layer> &conv3 = find_conv(graph3);
+    ASSERT_NE(conv1, nullptr);
+    ASSERT_EQ(conv1->weights(), conv2->weights());
+    ASSERT_EQ(conv1->bias(), conv2->bias());
+    ASSERT_NE(conv1->weights().front(), conv3->weights().front());
+    for (uint32_t i = 0; i < conv1->weights().size(); ++i) {
+        ASSERT_TRUE(arma::approx_equal(conv1->weights().at(i)->data(), conv3->weights().at(i)->data(), "absdiff", 0.f));
+    }
+
+    // 卷积权重4x3x3x3和偏移量4个元素各命中一次
+    const WeightCacheStats &stats = cache.stats();
+    ASSERT_EQ(stats.hit_num, 2);
+    ASSERT_EQ(stats.entry_num, 2);
+    ASSERT_EQ(stats.deduplicated_bytes, (4 * 3 * 3 * 3 + 4) * sizeof(float));
+    ASSERT_EQ(stats.cached_bytes, stats.deduplicated_bytes);
+
+    // 内容不同的权重不会共享
+    conv3->set_weights(vector<float>(4 * 3 * 3 * 3, 1.f));
+    ASSERT_NE(conv3->weights().front(), conv1->weights().front());
+    ASSERT_EQ(conv1->weights().front()->at(0, 0, 0), conv2->weights().front()->at(0, 0, 0));
+}
+
+
+TEST(test_model, shared_weight_segment)
+{
+    TempGraphFiles files;
+    SaveConvGraph(files);
+    WeightCache &cache = WeightCache::Instance();
+    const string &shm_name = "/magic_infer_test_" + to_string(getpid());
+    const vector<string> paths{shm_name, files.Path("model_segment.weights")};
+    for (uint32_t i = 0; i < paths.size(); ++i) {
+        const string &path = paths.at(i);
+        WeightCache::RemoveSegment(path);
+        ASSERT_FALSE(cache.AttachSegment(path));
+
+        // 第一个进程导出权重段
+        cache.Clear();
+        RuntimeGraph graph1(files.param_path(), files.bin_path());
+        graph1.set_shared_weight_path(path);
+        graph1.Build("pnnx_input_0", "pnnx_output_0");
+        // 之前映射的权重段在进程退出之前保持映射，内容相同的权重仍然从中引用
+        ASSERT_EQ(cache.stats().segment_hit_num, i == 0 ? 0 : 2);
+
+        // 之后的进程没有本地缓存，卷积的权重和偏移量直接引用权重段
+        cache.Clear();
+        RuntimeGraph graph2(files.param_path(), files.bin_path());
+        graph2.set_shared_weight_path(path);
+        graph2.Build("pnnx_input_0", "pnnx_output_0");
+        const WeightCacheStats &stats = cache.stats();
+        ASSERT_EQ(stats.segment_hit_num, 2);
+        ASSERT_EQ(stats.hit_num, 0);
+        ASSERT_GT(stats.segment_bytes, (4 * 3 * 3 * 3 + 4) * sizeof(float));
+
+        shared_ptr<Tensor<float>> input = make_shared<Tensor<float>>(3, 8, 8);
+        input->Rand();
+        vector<shared_ptr<Tensor<float>>> inputs{input};
+        const vector<shared_ptr<Tensor<float>>> outputs1 = graph1.Forward(inputs, false);
+        const vector<shared_ptr<Tensor<float>>> outputs2 = graph2.Forward(inputs, false);
+        ASSERT_EQ(outputs1.front()->shapes(), outputs2.front()->shapes());
+        for (uint32_t i = 0; i < outputs1.front()->size(); ++i) {
+            ASSERT_EQ(outputs1.front()->index(i), outputs2.front()->index(i));
+        }
+        ASSERT_TRUE(WeightCache::RemoveSegment(path));
+    }
+
+    // 格式错误的权重段不会被映射
+    ofstream os(files.Path("model_segment_broken.weights"), ios::out | ios::binary | ios::trunc);
+    os << string(256, 'x');
+    os.close();
+    ASSERT_FALSE(cache.AttachSegment(files.Path("model_segment_broken.weights")));
+    cache.Clear();
+}
+
+
+TEST(test_model, shared_weight_segment_process)
+{
+    TempGraphFiles files;
+    SaveConvGraph(files);
+    WeightCache &cache = WeightCache::Instance();
+    const string &path = files.Path("model_process.weights");
+
+    // 子进程等待父进程导出权重段之后再映射
+    int ready_pipe[2];
+    ASSERT_EQ(pipe(ready_pipe), 0);
+    const pid_t pid = fork();
+    ASSERT_GE(pid, 0);
+    if (pid == 0) {
+        // libgomp的线程池不能跨fork使用，子进程只用一个线程
+        omp_set_num_threads(1);
+        close(ready_pipe[1]);
+        char ready = 0;
+        bool success = read(ready_pipe[0], &ready, 1) == 1 && ready == 1;
+        close(ready_pipe[0]);
+
+        // 子进程没有本地缓存，卷积的权重和偏移量直接引用父进程导出的权重段
+        cache.Clear();
+        success = success && cache.AttachSegment(path);
+        RuntimeGraph segment_graph(files.param_path(), files.bin_path());
+        segment_graph.set_shared_weight_path(path);
+        segment_graph.Build("pnnx_input_0", "pnnx_output_0");
+        const WeightCacheStats &stats = cache.stats();
+        success = success && stats.segment_hit_num == 2 && stats.hit_num == 0;
+
+        cache.set_enabled(false);
+        RuntimeGraph local_graph(files.param_path(), files.bin_path());
+        local_graph.Build("pnnx_input_0", "pnnx_output_0");
+        shared_ptr<Tensor<float>> input = make_shared<Tensor<float>>(3, 8, 8);
+        input->Rand();
+        vector<shared_ptr<Tensor<float>>> inputs{input};
+        const vector<shared_ptr<Tensor<float>>> segment_outputs = segment_graph.Forward(inputs, false);
+        const vector<shared_ptr<Tensor<float>>> local_outputs = local_graph.Forward(inputs, false);
+        success = success && segment_outputs.front()->shapes() == local_outputs.front()->shapes();
+        for (uint32_t i = 0; success && i < local_outputs.front()->size(); ++i) {
+            success = segment_outputs.front()->index(i) == local_outputs.front()->index(i);
+        }
+        _exit(success ? 0 : 1);
+    }
+
+    close(ready_pipe[0]);
+    cache.Clear();
+    RuntimeGraph graph(files.param_path(), files.bin_path());
+    graph.set_shared_weight_path(path);
+    graph.Build("pnnx_input_0", "pnnx_output_0");
+    const char ready = 1;
+    ASSERT_EQ(write(ready_pipe[1], &ready, 1), 1);
+    close(ready_pipe[1]);
+
+    int status = 0;
+    ASSERT_EQ(waitpid(pid, &status, 0), pid);
+    ASSERT_TRUE(WIFEXITED(status));
+    ASSERT_EQ(WEXITSTATUS(status), 0);
+    ASSERT_TRUE(WeightCache::RemoveSegment(path));
+    cache.Clear();
+}
+
+
+TEST(test_model, load_broken_file)
+{
+    TempGraphFiles files;
+    RuntimeGraph graph("", "");
+    ASSERT_FALSE(graph.Load(files.Path("not_exist.magic")));
+
+    SaveConvGraph(files);
+    RuntimeGraph pnnx_graph(files.param_path(), files.bin_path());
+    pnnx_graph.Build("pnnx_input_0", "pnnx_output_0");
+    ASSERT_TRUE(pnnx_graph.Save(files.Path("model_broken.magic")));
+
+    // 截断模型文件，加载时报告错误而不是越界读取
+    ifstream is(files.Path("model_broken.magic"), ios::in | ios::binary);
+    const string content((istreambuf_iterator<char>(is)), istreambuf_iterator<char>());
+    ofstream os(files.Path("model_broken.magic"), ios::out | ios::binary | ios::trunc);
+    os.write(content.data(), 200);
+    os.close();
+    ASSERT_FALSE(graph.Load(files.Path("model_broken.magic")));
+
+    // 节点个数超过元数据能够容纳的数量时不分配节点
+    string huge_content = content;
+    const uint32_t operator_num = 0x7fffffff;
+    memcpy(&huge_content[12], &operator_num, sizeof(operator_num));
+    ofstream huge_os(files.Path("model_broken.magic"), ios::out | ios::binary | ios::trunc);
+    huge_os << huge_content;
+    huge_os.close();
+    ASSERT_FALSE(graph.Load(files.Path("model_broken.magic")));
+
+    ofstream magic_os(files.Path("model_broken.magic"), ios::out | ios::binary | ios::trunc);
+    magic_os << "NOTMAGIC" << content.substr(8);
+    magic_os.close();
+    ASSERT_FALSE(graph.Load(files.Path("model_broken.magic")));
+}
@@ -0,0 +1,189 @@
+#include <gtest/gtest.h>
+#include <glog/logging.h>
+#include <random>
+#include "nets/nms.hpp"
+
+using namespace magic_infer;
+
+
+static YoloCandidate MakeCandidate(float x, float y, float w, float h, float score, int32_t class_id)
+{
+    YoloCandidate candidate;
+    candidate.x = x;
+    candidate.y = y;
+    candidate.w = w;
+    candidate.h = h;
+    candidate.score = score;
+    candidate.class_id = class_id;
+    return candidate;
+}
+
+
+/**
+ * 随机生成成簇的候选框，保证有足够多的框互相重叠
+ */
+static vector<YoloCandidate> RandomCandidates(uint32_t size, uint32_t num_classes, uint32_t seed)
+{
+    mt19937 engine(seed);
+    uniform_real_distribution<float> center(0.f, 640.f);
+    uniform_real_distribution<float> jitter(-16.f, 16.f);
+    uniform_real_distribution<float> extent(8.f, 160.f);
+    uniform_real_distribution<float> score(0.25f, 1.f);
+    uniform_int_distribution<int32_t> class_id(0, int32_t(num_classes) - 1);
+
+    vector<YoloCandidate> candidates;
+    while (candidates.size() < size) {
+        const float x = center(engine);
+        const float y = center(engine);
+        const float w = extent(engine);
+        const float h = extent(engine);
+        const int32_t cls = class_id(engine);
+        for (uint32_t i = 0; i < 8 && candidates.size() < size; ++i) {
+            candidates.push_back(MakeCandidate(x + jitter(engine), y + jitter(engine), w + jitter(engine), h + jitter(engine), score(engine), cls));
+        }
+    }
+    return candidates;
+}
+
+
+/**
+ * 两两比较的参考实现
+ */
+static vector<YoloCandidate> NmsReference(const vector<YoloCandidate> &candidates, float iou_thresh, bool class_aware)
+{
+    vector<uint32_t> order(candidates.size());
+    for (uint32_t i = 0; i < order.size(); ++i) order.at(i) = i;
+    stable_sort(order.begin(), order.end(), [&](uint32_t lhs, uint32_t rhs) { return candidates[lhs].score > candidates[rhs].score; });
+
+    vector<YoloCandidate> results;
+    vector<bool> suppressed(candidates.size(), false);
+    for (uint32_t i = 0; i < order.size(); ++i) {
+        if (suppressed.at(order.at(i))) continue;
+        const YoloCandidate &lhs = candidates.at(order.at(i));
+        results.push_back(lhs);
+        for (uint32_t j = i + 1; j < order.size(); ++j) {
+            const YoloCandidate &rhs = candidates.at(order.at(j));
+            if (class_aware && lhs.class_id != rhs.class_id) continue;
+            const float inter_w = max(min(lhs.x + lhs.w * 0.5f, rhs.x + rhs.w * 0.5f) - max(lhs.x - lhs.w * 0.5f, rhs.x - rhs.w * 0.5f), 0.f);
+            const float inter_h = max(min(lhs.y + lhs.h * 0.5f, rhs.y + rhs.h * 0.5f) - max(lhs.y - lhs.h * 0.5f, rhs.y - rhs.h * 0.5f), 0.f);
+            const float inter = inter_w * inter_h;
+            if (inter > iou_thresh * (lhs.w * lhs.h + rhs.w * rhs.h - inter)) suppressed.at(order.at(j)) = true;
+        }
+    }
+    return results;
+}
+
+
+TEST(test_net, nms_suppress)
+{
+    const vector<YoloCandidate> candidates{
+        MakeCandidate(100.f, 100.f, 50.f, 50.f, 0.9f, 0),
+        MakeCandidate(104.f, 102.f, 50.f, 50.f, 0.8f, 0),
+        MakeCandidate(102.f, 100.f, 50.f, 50.f, 0.7f, 1),
+        MakeCandidate(300.f, 300.f, 20.f, 20.f, 0.6f, 0),
+    };
+
+    // 第二个框和第一个框同类且重叠，第三个框只和其他类别的框重叠
+    const vector<YoloCandidate> &results = NonMaxSuppression(0.45f, 0, true).Suppress(candidates);
+    ASSERT_EQ(results.size(), 3);
+    ASSERT_EQ(results.at(0).score, 0.9f);
+    ASSERT_EQ(results.at(1).score, 0.7f);
+    ASSERT_EQ(results.at(2).score, 0.6f);
+
+    const vector<YoloCandidate> &agnostic = NonMaxSuppression(0.45f, 0, false).Suppress(candidates);
+    ASSERT_EQ(agnostic.size(), 2);
+    ASSERT_EQ(agnostic.at(1).score, 0.6f);
+
+    const vector<YoloCandidate> &top_k = NonMaxSuppression(0.45f, 2, true).Suppress(candidates);
+    ASSERT_EQ(top_k.size(), 2);
+    ASSERT_EQ(top_k.at(1).score, 0.7f);
+    ASSERT_TRUE(NonMaxSuppression().Suppress({}).empty());
+}
+
+
+TEST(test_net, nms_reference)
+{
+    for (const bool class_aware : {true, false}) {
+        const vector<YoloCandidate> &candidates = RandomCandidates(3001, 4, 7);
+        const vector<YoloCandidate> &expected = NmsReference(candidates, 0.5f, class_aware);
+        const vector<YoloCandidate> &results = NonMaxSuppression(0.5f, 0, class_aware).Suppress(candidates);
+        ASSERT_GT(expected.size(), 10);
+        ASSERT_LT(expected.size(), candidates.size());
+        ASSERT_EQ(results.size(), expected.size());
+        for (uint32_t i = 0; i < results.size(); ++i) {
+            ASSERT_EQ(results.at(i).x, expected.at(i).x);
+            ASSERT_EQ(results.at(i).score, expected.at(i).score);
+            ASSERT_EQ(results.at(i).class_id, expected.at(i).class_id);
+        }
+    }
+}
+
+
+TEST(test_net, nms_forward_batch)
+{
+    const uint32_t batch_size = 3;
+    const uint32_t rows = 512;
+    const uint32_t num_classes = 3;
+    const float conf_thresh = 0.3f;
+    const NonMaxSuppression nms(0.45f, 100, true);
+
+    vector<shared_ptr<Tensor<float>>> dense_outputs;
+    vector<shared_ptr<Tensor<float>>> sparse_outputs;
+    vector<vector<YoloCandidate>> expected;
+    for (uint32_t b = 0; b < batch_size; ++b) {
+        const vector<YoloCandidate> &boxes = RandomCandidates(rows, num_classes, 11 + b);
+        shared_ptr<Tensor<float>> dense = make_shared<Tensor<float>>(1, rows, num_classes + 5);
+        shared_ptr<Tensor<float>> sparse = make_shared<Tensor<float>>(1, rows, num_classes + 5);
+        vector<YoloCandidate> candidates;
+
+        // 稠密输出中目标置信度和最大的类别置信度相乘，一部分框低于阈值
+        uint32_t sparse_rows = 0;
+        for (uint32_t r = 0; r < rows; ++r) {
+            const YoloCandidate &box = boxes.at(r);
+            const float objectness = (r % 4 == 0) ? 0.2f : box.score;
+            const float class_conf = (r % 3 == 0) ? 0.5f : 0.95f;
+            dense->at(0, r, 0) = box.x;
+            dense->at(0, r, 1) = box.y;
+            dense->at(0, r, 2) = box.w;
+            dense->at(0, r, 3) = box.h;
+            dense->at(0, r, 4) = objectness;
+            for (uint32_t c = 0; c < num_classes; ++c) {
+                dense->at(0, r, 5 + c) = int32_t(c) == box.class_id ? class_conf : 0.1f;
+            }
+
+            const float score = objectness * class_conf;
+            if (score < conf_thresh) continue;
+            YoloCandidate candidate = box;
+            candidate.score = score;
+            candidates.push_back(candidate);
+
+            const vector<float> values{box.x, box.y, box.w, box.h, score, float(box.class_id)};
+            for (uint32_t c = 0; c < values.size(); ++c) {
+                sparse->at(0, sparse_rows, c) = values.at(c);
+            }
+            sparse_rows += 1;
+        }
+        sparse->at(0, sparse_rows, 5) = -1.f;
+
+        dense_outputs.push_back(dense);
+        sparse_outputs.push_back(sparse);
+        expected.push_back(nms.Suppress(candidates));
+        ASSERT_FALSE(expected.back().empty());
+    }
+
+    const vector<vector<YoloCandidate>> &dense_results = nms.Forward(dense_outputs, YoloDecodeMode::kDecodeDense, conf_thresh);
+    const vector<vector<YoloCandidate>> &sparse_results = nms.Forward(sparse_outputs, YoloDecodeMode::kDecodeSparse, conf_thresh);
+    ASSERT_EQ(dense_results.size(), batch_size);
+    ASSERT_EQ(sparse_results.size(), batch_size);
+    for (uint32_t b = 0; b < batch_size; ++b) {
+        ASSERT_LE(expected.at(b).size(), 100);
+        for (const auto &results : {dense_results.at(b), sparse_results.at(b)}) {
+            ASSERT_EQ(results.size(), expected.at(b).size());
+            for (uint32_t i = 0; i < results.size(); ++i) {
+                ASSERT_EQ(results.at(i).x, expected.at(b).at(i).x);
+                ASSERT_EQ(results.at(i).class_id, expected.at(b).at(i).class_id);
+                ASSERT_FLOAT_EQ(results.at(i).score, expected.at(b).at(i).score);
+            }
+        }
+    }
+}
@@ -0,0 +1,289 @@
+#include <gtest/gtest.h>
+#include <glog/logging.h>
+#include "runtime/ir.h"
+#include "runtime/runtime_ir.hpp"
+#include "runtime/runtime_pass.hpp"
+#include "layer/details/maxpooling.hpp"
+#include "test_graph_util.hpp"
+
+using namespace magic_infer;
+
+
+static shared_ptr<RuntimeOperator> MakeOperator(const string &name, const string &type)
+{
+    shared_ptr<RuntimeOperator> op = make_shared<RuntimeOperator>();
+    op->name = name;
+    op->type = type;
+    return op;
+}
+
+
+static void LinkOperators(const shared_ptr<RuntimeOperator> &producer, const shared_ptr<RuntimeOperator> &consumer, const vector<int32_t> &shapes)
+{
+    shared_ptr<RuntimeOperand> operand = make_shared<RuntimeOperand>();
+    operand->name = producer->name;
+    operand->shapes = shapes;
+    operand->type = RuntimeDataType::kTypeFloat32;
+
+    consumer->input_operands.insert({producer->name, operand});
+    consumer->input_operands_seq.push_back(operand);
+    producer->output_names.push_back(consumer->name);
+    producer->output_operators.insert({consumer->name, consumer});
+}
+
+
+TEST(test_optimizer, validate)
+{
+    const auto &input = MakeOperator("pnnx_input_0", "pnnx.Input");
+    const auto &relu = MakeOperator("relu", "nn.ReLU");
+    const auto &output = MakeOperator("pnnx_output_0", "pnnx.Output");
+    LinkOperators(input, relu, {1, 3, 4, 4});
+    LinkOperators(relu, output, {1, 3, 4, 4});
+
+    vector<shared_ptr<RuntimeOperator>> operators{input, relu, output};
+    ASSERT_TRUE(RuntimeGraphOptimizer::Validate(operators));
+
+    // 前驱节点没有记录后继节点
+    relu->output_operators.clear();
+    ASSERT_FALSE(RuntimeGraphOptimizer::Validate(operators));
+
+    // 计算图中有环
+    relu->output_operators.insert({output->name, output});
+    LinkOperators(output, relu, {1, 3, 4, 4});
+    ASSERT_FALSE(RuntimeGraphOptimizer::Validate(operators));
+}
+
+
+TEST(test_optimizer, dead_operator_elimination)
+{
+    const auto &input = MakeOperator("pnnx_input_0", "pnnx.Input");
+    const auto &relu = MakeOperator("relu", "nn.ReLU");
+    const auto &sigmoid = MakeOperator("sigmoid", "nn.Sigmoid");
+    const auto &hardswish = MakeOperator("hardswish", "nn.Hardswish");
+    const auto &output = MakeOperator("pnnx_output_0", "pnnx.Output");
+    LinkOperators(input, relu, {1, 3, 4, 4});
+    LinkOperators(relu, output, {1, 3, 4, 4});
+    LinkOperators(relu, sigmoid, {1, 3, 4, 4});
+    LinkOperators(sigmoid, hardswish, {1, 3, 4, 4});
+
+    vector<shared_ptr<RuntimeOperator>> operators{input, relu, sigmoid, hardswish, output};
+    DeadOperatorEliminationPass pass;
+    ASSERT_EQ(pass.Run(operators), 2);
+    ASSERT_EQ(operators.size(), 3);
+    ASSERT_TRUE(RuntimeGraphOptimizer::Validate(operators));
+    ASSERT_EQ(relu->output_names, vector<string>{"pnnx_output_0"});
+    ASSERT_EQ(relu->output_operators.size(), 1);
+}
+
+
+TEST(test_optimizer, identity_operator_elimination)
+{
+    const auto &input = MakeOperator("pnnx_input_0", "pnnx.Input");
+    const auto &view = MakeOperator("view", "Tensor.view");
+    const auto &flatten = MakeOperator("flatten", "torch.flatten");
+    const auto &linear = MakeOperator("linear", "nn.Linear");
+    const auto &output = MakeOperator("pnnx_output_0", "pnnx.Output");
+    LinkOperators(input, view, {1, 8, 2, 2});
+    LinkOperators(view, flatten, {1, 8, 2, 2});
+    LinkOperators(flatten, linear, {1, 32});
+    LinkOperators(linear, output, {1, 10});
+
+    vector<shared_ptr<RuntimeOperator>> operators{input, view, flatten, linear, output};
+    IdentityOperatorEliminationPass pass;
+    ASSERT_EQ(pass.Run(operators), 1);
+    ASSERT_EQ(operators.size(), 4);
+    ASSERT_TRUE(RuntimeGraphOptimizer::Validate(operators));
+
+    // 形状改变的flatten保留，并直接读取输入节点的输出
+    ASSERT_EQ(flatten->input_operands.size(), 1);
+    ASSERT_EQ(flatten->input_operands.begin()->first, input->name);
+    ASSERT_EQ(input->output_names, vector<string>{"flatten"});
+}
+
+
+TEST(test_optimizer, remove_operators)
+{
+    // 连续的Identity节点批量删除，后一个节点按改名之后的前驱查找
+    const uint32_t identity_num = 1000;
+    const auto &input = MakeOperator("pnnx_input_0", "pnnx.Input");
+    const auto &output = MakeOperator("pnnx_output_0", "pnnx.Output");
+    vector<shared_ptr<RuntimeOperator>> operators{input};
+    vector<shared_ptr<RuntimeOperator>> identity_operators;
+    for (uint32_t i = 0; i < identity_num; ++i) {
+        const auto &identity = MakeOperator("identity_" + to_string(i), "nn.Identity");
+        LinkOperators(operators.back(), identity, {1, 3, 4, 4});
+        operators.push_back(identity);
+        identity_operators.push_back(identity);
+    }
+    LinkOperators(operators.back(), output, {1, 3, 4, 4});
+    operators.push_back(output);
+
+    // 重复的节点只删除一次
+    identity_operators.push_back(identity_operators.front());
+    const vector<bool> &removed = RuntimeGraphOptimizer::RemoveOperators(operators, identity_operators);
+    ASSERT_EQ(count(removed.begin(), removed.end(), true), identity_num);
+    ASSERT_FALSE(removed.back());
+    ASSERT_EQ(operators.size(), 2);
+    ASSERT_TRUE(RuntimeGraphOptimizer::Validate(operators));
+    ASSERT_EQ(output->input_operands.begin()->first, input->name);
+    ASSERT_EQ(input->output_names, vector<string>{"pnnx_output_0"});
+}
+
+
+TEST(test_optimizer, match_and_replace)
+{
+    const auto &input = MakeOperator("pnnx_input_0", "pnnx.Input");
+    const auto &conv = MakeOperator("conv", "nn.Conv2d");
+    const auto &relu = MakeOperator("relu", "nn.ReLU");
+    const auto &output = MakeOperator("pnnx_output_0", "pnnx.Output");
+    LinkOperators(input, conv, {1, 3, 8, 8});
+    LinkOperators(conv, relu, {1, 16, 8, 8});
+    LinkOperators(relu, output, {1, 16, 8, 8});
+
+    shared_ptr<RuntimeAttribute> weight = make_shared<RuntimeAttribute>();
+    weight->shape = {16, 3, 3, 3};
+    conv->attribute.insert({"weight", weight});
+
+    vector<shared_ptr<RuntimeOperator>> operators{input, conv, relu, output};
+    ASSERT_EQ(RuntimeGraphOptimizer::EstimateFlops(operators), 2 * 16 * 8 * 8 * 27 + 16 * 8 * 8);
+
+    const auto &chains = RuntimeGraphOptimizer::MatchChain(operators, {"nn.Conv2d", "nn.ReLU"});
+    ASSERT_EQ(chains.size(), 1);
+    ASSERT_EQ(chains.front().size(), 2);
+    ASSERT_TRUE(RuntimeGraphOptimizer::MatchChain(operators, {"nn.ReLU", "nn.Conv2d"}).empty());
+
+    const auto &conv_relu = MakeOperator("conv_relu", "nn.Conv2d");
+    ASSERT_TRUE(RuntimeGraphOptimizer::ReplaceOperators(operators, chains.front(), conv_relu));
+    ASSERT_EQ(operators.size(), 3);
+    ASSERT_EQ(operators.at(1), conv_relu);
+    ASSERT_TRUE(RuntimeGraphOptimizer::Validate(operators));
+    ASSERT_EQ(output->input_operands.begin()->first, conv_relu->name);
+    ASSERT_EQ(input->output_operators.begin()->second, conv_relu);
+}
+
+
+TEST(test_optimizer, estimate_expression_flops)
+{
+    // 表达式按输入个数估算，没有输入的表达式不能得到回绕的巨大数值
+    const auto &input = MakeOperator("pnnx_input_0", "pnnx.Input");
+    const auto &add = MakeOperator("add", "pnnx.Expression");
+    const auto &constant = MakeOperator("constant", "pnnx.Expression");
+    const auto &output = MakeOperator("pnnx_output_0", "pnnx.Output");
+    for (uint32_t i = 0; i < 3; ++i) {
+        LinkOperators(input, add, {1, 4, 2, 2});
+    }
+    LinkOperators(add, output, {1, 4, 2, 2});
+    LinkOperators(constant, output, {1, 4, 2, 2});
+
+    ASSERT_EQ(RuntimeGraphOptimizer::EstimateFlops({add}), 2 * 16);
+    ASSERT_EQ(RuntimeGraphOptimizer::EstimateFlops({constant}), 16);
+}
+
+
+TEST(test_optimizer, build_graph)
+{
+    TempGraphFiles files;
+    const vector<int> shapes{1, 2, 4, 4};
+    pnnx::Graph pnnx_graph;
+    pnnx::Operand *input_operand = pnnx_graph.new_operand("0");
+    pnnx::Operand *relu_operand = pnnx_graph.new_operand("1");
+    pnnx::Operand *view_operand = pnnx_graph.new_operand("2");
+    pnnx::Operand *sigmoid_operand = pnnx_graph.new_operand("3");
+    pnnx::Operand *dead_operand = pnnx_graph.new_operand("4");
+    for (pnnx::Operand *operand : {input_operand, relu_operand, view_operand, sigmoid_operand, dead_operand}) {
+        operand->type = 1;
+        operand->shape = shapes;
+    }
+
+    LinkOperator(pnnx_graph.new_operator("pnnx.Input", "pnnx_input_0"), {}, input_operand);
+    LinkOperator(pnnx_graph.new_operator("nn.ReLU", "relu"), {input_operand}, relu_operand);
+    pnnx::Operator *view_op = pnnx_graph.new_operator("Tensor.view", "view");
+    view_op->params["shape"] = {1, 2, 4, 4};
+    LinkOperator(view_op, {relu_operand}, view_operand);
+    LinkOperator(pnnx_graph.new_operator("nn.Sigmoid", "sigmoid"), {view_operand}, sigmoid_operand);
+    LinkOperator(pnnx_graph.new_operator("nn.Hardsigmoid", "hardsigmoid"), {relu_operand}, dead_operand);
+    LinkOperator(pnnx_graph.new_operator("pnnx.Output", "pnnx_output_0"), {sigmoid_operand}, nullptr);
+    ASSERT_TRUE(files.Save(pnnx_graph));
+
+    RuntimeGraph graph(files.param_path(), files.bin_path());
+    graph.Build("pnnx_input_0", "pnnx_output_0");
+    ASSERT_EQ(graph.operators().size(), 4);
+
+    const auto &reports = graph.pass_reports();
+    ASSERT_EQ(reports.size(), 6);
+    ASSERT_EQ(reports.at(0).nodes_before, 6);
+    ASSERT_EQ(reports.at(0).nodes_after, 5);
+    ASSERT_EQ(reports.at(1).nodes_after, 4);
+    ASSERT_LT(reports.at(0).flops_after, reports.at(0).flops_before);
+
+    shared_ptr<Tensor<float>> input = make_shared<Tensor<float>>(2, 4, 4);
+    input->Rand();
+    vector<shared_ptr<Tensor<float>>> inputs{input};
+    const vector<shared_ptr<Tensor<float>>> &outputs = graph.Forward(inputs, false);
+    ASSERT_EQ(outputs.size(), 1);
+
+    for (uint32_t i = 0; i < input->size(); ++i) {
+        const float relu_value = max(input->index(i), 0.f);
+        ASSERT_NEAR(outputs.front()->index(i), 1.f / (1.f + exp(-relu_value)), 1e-5f);
+    }
+}
+
+
+TEST(test_optimizer, sppf_fusion)
+{
+    TempGraphFiles files;
+    const vector<int> shapes{1, 2, 9, 7};
+    pnnx::Graph pnnx_graph;
+    vector<pnnx::Operand *> operands;
+    for (const string &name : {"0", "1", "2", "3", "4"}) {
+        pnnx::Operand *operand = pnnx_graph.new_operand(name);
+        operand->type = 1;
+        operand->shape = name == "4" ? vector<int>{1, 8, 9, 7} : shapes;
+        operands.push_back(operand);
+    }
+
+    LinkOperator(pnnx_graph.new_operator("pnnx.Input", "pnnx_input_0"), {}, operands.at(0));
+    for (uint32_t i = 1; i <= 3; ++i) {
+        pnnx::Operator *pool_op = pnnx_graph.new_operator("nn.MaxPool2d", "pool_" + to_string(i));
+        pool_op->params["kernel_size"] = {5, 5};
+        pool_op->params["padding"] = {2, 2};
+        pool_op->params["stride"] = {1, 1};
+        LinkOperator(pool_op, {operands.at(i - 1)}, operands.at(i));
+    }
+    pnnx::Operator *cat_op = pnnx_graph.new_operator("torch.cat", "cat");
+    cat_op->params["dim"] = 1;
+    LinkOperator(cat_op, {operands.at(0), operands.at(1), operands.at(2), operands.at(3)}, operands.at(4));
+    LinkOperator(pnnx_graph.new_operator("pnnx.Output", "pnnx_output_0"), {operands.at(4)}, nullptr);
+    ASSERT_TRUE(files.Save(pnnx_graph));
+
+    RuntimeGraph graph(files.param_path(), files.bin_path());
+    graph.Build("pnnx_input_0", "pnnx_output_0");
+    ASSERT_EQ(graph.operators().size(), 3);
+    ASSERT_EQ(graph.operators().at(1)->type, "magic.SPPF");
+    const auto &reports = graph.pass_reports();
+    const auto &report_iter = find_if(reports.begin(), reports.end(),
+        [](const RuntimePassReport &report) { return report.pass_name == "SPPFFusion"; });
+    ASSERT_TRUE(report_iter != reports.end());
+    ASSERT_EQ(report_iter->changed_num, 1);
+
+    shared_ptr<Tensor<float>> input = make_shared<Tensor<float>>(2, 9, 7);
+    input->Rand();
+    vector<shared_ptr<Tensor<float>>> inputs{input};
+    const vector<shared_ptr<Tensor<float>>> &outputs = graph.Forward(inputs, false);
+    ASSERT_EQ(outputs.size(), 1);
+    ASSERT_EQ(outputs.front()->channels(), 8);
+
+    // 和逐级执行MaxPool2d的结果一致
+    MaxPoolingLayer max_layer(2, 2, 5, 5, 1, 1);
+    vector<shared_ptr<Tensor<float>>> pooled{input};
+    for (uint32_t k = 0; k <= 3; ++k) {
+        if (k > 0) {
+            vector<shared_ptr<Tensor<float>>> next_pooled(1);
+            ASSERT_EQ(max_layer.Forward(pooled, next_pooled), InferStatus::kInferSuccess);
+            pooled = next_pooled;
+        }
+        for (uint32_t c = 0; c < 2; ++c) {
+            ASSERT_TRUE(arma::approx_equal(outputs.front()->at(k * 2 + c), pooled.front()->at(c), "absdiff", 0.f));
+        }
+    }
+}
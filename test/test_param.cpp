@@ -0,0 +1,256 @@
+#include <gtest/gtest.h>
+#include <glog/logging.h>
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include "runtime/ir.h"
+
+using namespace std;
+
+
+/**
+ * 原来基于istringstream的参数解析
+ * @param value 参数的文本
+ * @return 参数
+ */
+static pnnx::Parameter ParseReferenceParameter(const string &value)
+{
+    pnnx::Parameter p;
+    if (value == "None" || value == "()" || value == "[]") return p;
+    if (value == "True" || value == "False") return pnnx::Parameter(value == "True");
+
+    auto is_string = [](const string &elem) {
+        return (elem[0] != '-' && (elem[0] < '0' || elem[0] > '9')) || (elem[0] == '-' && (elem[1] < '0' || elem[1] > '9'));
+    };
+    auto is_float = [](const string &elem) { return elem.find('.') != string::npos || elem.find('e') != string::npos; };
+
+    if (value[0] == '(' || value[0] == '[') {
+        istringstream lcss(value.substr(1, value.size() - 2));
+        while (!lcss.eof()) {
+            string elem;
+            getline(lcss, elem, ',');
+            if (is_string(elem)) {
+                p.type = 7;
+                p.as.push_back(elem);
+            } else if (is_float(elem)) {
+                p.type = 6;
+                p.af.push_back(stof(elem));
+            } else {
+                p.type = 5;
+                p.ai.push_back(stoi(elem));
+            }
+        }
+        return p;
+    }
+
+    if (is_string(value)) return pnnx::Parameter(value);
+    if (is_float(value)) return pnnx::Parameter(stof(value));
+    return pnnx::Parameter(stoi(value));
+}
+
+
+/**
+ * 原来基于istringstream的结构文件解析，作为对照只解析属性的类型和形状，不读取权重
+ * @param graph 输出的计算图
+ * @param param_path 结构文件路径
+ * @return 是否解析成功
+ */
+static bool LoadReferenceParam(pnnx::Graph &graph, const string &param_path)
+{
+    ifstream is(param_path, ios::in | ios::binary);
+    if (!is.good()) return false;
+
+    string line;
+    getline(is, line);
+
+    int operator_count = 0;
+    int operand_count = 0;
+    getline(is, line);
+    istringstream(line) >> operator_count >> operand_count;
+
+    auto parse_shape = [](const string &value, vector<int> &shape) {
+        istringstream lcss(value.substr(1, value.find_last_of(')') - 1));
+        shape.clear();
+        while (!lcss.eof()) {
+            string elem;
+            getline(lcss, elem, ',');
+            shape.push_back(elem == "?" ? -1 : stoi(elem));
+        }
+        return value.substr(value.find_last_of(')') + 1);
+    };
+
+    for (int i = 0; i < operator_count; i++) {
+        getline(is, line);
+        istringstream iss(line);
+
+        string type;
+        string name;
+        int input_count = 0;
+        int output_count = 0;
+        iss >> type >> name >> input_count >> output_count;
+
+        pnnx::Operator *op = graph.new_operator(type, name);
+        for (int j = 0; j < input_count; j++) {
+            string operand_name;
+            iss >> operand_name;
+            pnnx::Operand *r = graph.get_operand(operand_name);
+            if (!r) return false;
+            r->consumers.push_back(op);
+            op->inputs.push_back(r);
+        }
+
+        for (int j = 0; j < output_count; j++) {
+            string operand_name;
+            iss >> operand_name;
+            pnnx::Operand *r = graph.new_operand(operand_name);
+            r->producer = op;
+            op->outputs.push_back(r);
+        }
+
+        while (!iss.eof()) {
+            string param;
+            iss >> param;
+
+            string key;
+            string value;
+            istringstream pss(param);
+            getline(pss, key, '=');
+            getline(pss, value);
+
+            if (key[0] == '@') {
+                pnnx::Attribute &attribute = op->attrs[key.substr(1)];
+                vector<int> shape;
+                const string &type_str = parse_shape(value, shape);
+                const vector<string> type_names{"f32", "f64", "f16", "i32", "i64", "i16", "i8", "u8", "bool", "cp64", "cp128", "cp32"};
+                const auto &type_iter = find(type_names.begin(), type_names.end(), type_str);
+                attribute.type = type_iter == type_names.end() ? 0 : int(type_iter - type_names.begin()) + 1;
+                if (attribute.type != 0) attribute.shape = shape;
+            } else if (key[0] == '$') {
+                op->inputnames.resize(op->inputs.size());
+                for (size_t k = 0; k < op->inputs.size(); k++) {
+                    if (op->inputs[k]->name == value) {
+                        op->inputnames[k] = key.substr(1);
+                        break;
+                    }
+                }
+            } else if (key[0] == '#') {
+                for (pnnx::Operand *r : op->inputs) {
+                    if (r->name == key.substr(1)) parse_shape(value, r->shape);
+                }
+                for (pnnx::Operand *r : op->outputs) {
+                    if (r->name == key.substr(1)) parse_shape(value, r->shape);
+                }
+            } else {
+                op->params[key] = ParseReferenceParameter(value);
+            }
+        }
+    }
+    return true;
+}
+
+
+static void ExpectSameParameter(const pnnx::Parameter &expected, const pnnx::Parameter &actual, const string &name)
+{
+    ASSERT_EQ(expected.type, actual.type) << name;
+    if (expected.type == 1) ASSERT_EQ(expected.b, actual.b) << name;
+    if (expected.type == 2) ASSERT_EQ(expected.i, actual.i) << name;
+    if (expected.type == 3) ASSERT_EQ(expected.f, actual.f) << name;
+    ASSERT_EQ(expected.s, actual.s) << name;
+    ASSERT_EQ(expected.ai, actual.ai) << name;
+    ASSERT_EQ(expected.af, actual.af) << name;
+    ASSERT_EQ(expected.as, actual.as) << name;
+}
+
+
+static void ExpectSameGraph(const pnnx::Graph &expected, const pnnx::Graph &actual, bool with_attributes)
+{
+    ASSERT_EQ(expected.ops.size(), actual.ops.size());
+    ASSERT_EQ(expected.operands.size(), actual.operands.size());
+
+    for (size_t i = 0; i < expected.operands.size(); ++i) {
+        const pnnx::Operand *expected_operand = expected.operands.at(i);
+        const pnnx::Operand *actual_operand = actual.operands.at(i);
+        ASSERT_EQ(expected_operand->name, actual_operand->name);
+        ASSERT_EQ(expected_operand->shape, actual_operand->shape) << expected_operand->name;
+        ASSERT_EQ(expected_operand->producer->name, actual_operand->producer->name);
+        ASSERT_EQ(expected_operand->consumers.size(), actual_operand->consumers.size());
+    }
+
+    for (size_t i = 0; i < expected.ops.size(); ++i) {
+        const pnnx::Operator *expected_op = expected.ops.at(i);
+        const pnnx::Operator *actual_op = actual.ops.at(i);
+        ASSERT_EQ(expected_op->type, actual_op->type);
+        ASSERT_EQ(expected_op->name, actual_op->name);
+        ASSERT_EQ(expected_op->inputnames, actual_op->inputnames) << expected_op->name;
+        ASSERT_EQ(expected_op->inputs.size(), actual_op->inputs.size());
+        for (size_t j = 0; j < expected_op->inputs.size(); ++j) {
+            ASSERT_EQ(expected_op->inputs.at(j)->name, actual_op->inputs.at(j)->name);
+        }
+        ASSERT_EQ(expected_op->outputs.size(), actual_op->outputs.size());
+        for (size_t j = 0; j < expected_op->outputs.size(); ++j) {
+            ASSERT_EQ(expected_op->outputs.at(j)->name, actual_op->outputs.at(j)->name);
+        }
+
+        ASSERT_EQ(expected_op->params.size(), actual_op->params.size()) << expected_op->name;
+        for (const auto &[key, parameter] : expected_op->params) {
+            ASSERT_TRUE(actual_op->params.count(key)) << expected_op->name << "." << key;
+            ExpectSameParameter(parameter, actual_op->params.at(key), expected_op->name + "." + key);
+        }
+
+        if (!with_attributes) continue;
+        ASSERT_EQ(expected_op->attrs.size(), actual_op->attrs.size()) << expected_op->name;
+        for (const auto &[key, attribute] : expected_op->attrs) {
+            ASSERT_TRUE(actual_op->attrs.count(key)) << expected_op->name << "." << key;
+            ASSERT_EQ(attribute.type, actual_op->attrs.at(key).type) << expected_op->name << "." << key;
+            ASSERT_EQ(attribute.shape, actual_op->attrs.at(key).shape) << expected_op->name << "." << key;
+        }
+    }
+}
+
+
+TEST(test_param, parse_parameter)
+{
+    using pnnx::Parameter;
+    ASSERT_EQ(Parameter::parse_from_string("None").type, 0);
+    ASSERT_EQ(Parameter::parse_from_string("()").type, 0);
+    ASSERT_TRUE(Parameter::parse_from_string("True").b);
+    ASSERT_EQ(Parameter::parse_from_string("-3").i, -3);
+    ASSERT_EQ(Parameter::parse_from_string("1.000000e-05").f, 1e-5f);
+    ASSERT_EQ(Parameter::parse_from_string("-inf").s, "-inf");
+    ASSERT_EQ(Parameter::parse_from_string("(1,-2,3)").ai, vector<int>({1, -2, 3}));
+    ASSERT_EQ(Parameter::parse_from_string("(0.5,2.5)").af, vector<float>({0.5f, 2.5f}));
+    ASSERT_EQ(Parameter::parse_from_string("[a,b]").as, vector<string>({"a", "b"}));
+    ASSERT_EQ(Parameter::parse_from_string("(a,)").as, vector<string>({"a", ""}));
+}
+
+
+TEST(test_param, load_all_weights)
+{
+    // 逐个对比weights目录下所有结构文件的新旧解析结果
+    uint32_t param_num = 0;
+    for (const auto &entry : filesystem::recursive_directory_iterator("../../weights")) {
+        const string &param_path = entry.path().string();
+        if (entry.path().extension() != ".param") continue;
+
+        pnnx::Graph expected;
+        ASSERT_TRUE(LoadReferenceParam(expected, param_path)) << param_path;
+
+        string bin_path = param_path.substr(0, param_path.size() - 6) + ".bin";
+        if (filesystem::exists(bin_path)) {
+            pnnx::Graph actual;
+            ASSERT_EQ(actual.load(param_path, bin_path), 0) << param_path;
+            ExpectSameGraph(expected, actual, true);
+        }
+
+        ifstream is(param_path, ios::in | ios::binary);
+        stringstream text;
+        text << is.rdbuf();
+        pnnx::Graph parsed;
+        ASSERT_EQ(parsed.parse(text.str()), 0) << param_path;
+        ExpectSameGraph(expected, parsed, false);
+        param_num += 1;
+    }
+    LOG(INFO) << "Compared " << param_num << " param files";
+    ASSERT_GT(param_num, 0);
+}
@@ -75,7 +75,7 @@ TEST(test_layer, forward_sigmoid3)
         CHECK(input_->size() == output_->size());
         uint32_t size = input_->size();
         for (uint32_t j = 0; j < size; ++j) {
-            ASSERT_EQ(output_->index(j), 1.f / (1 + exp(-input_->index(j))));
+            ASSERT_LE(abs(output_->index(j) - 1.f / (1 + exp(-input_->index(j)))), 1e-6);
         }
     }
 }
@@ -100,7 +100,7 @@ TEST(test_layer, forward_sigmoid4)
         CHECK(input_->size() == output_->size());
         uint32_t size = input_->size();
         for (uint32_t j = 0; j < size; ++j) {
-            ASSERT_EQ(output_->index(j), 1.f / (1 + exp(-input_->index(j))));
+            ASSERT_LE(abs(output_->index(j) - 1.f / (1 + exp(-input_->index(j)))), 1e-6);
         }
     }
 }
@@ -125,7 +125,7 @@ TEST(test_layer, forward_sigmoid5)
         CHECK(input_->size() == output_->size());
         uint32_t size = input_->size();
         for (uint32_t j = 0; j < size; ++j) {
-            ASSERT_EQ(output_->index(j), 1.f / (1 + exp(-input_->index(j))));
+            ASSERT_LE(abs(output_->index(j) - 1.f / (1 + exp(-input_->index(j)))), 1e-6);
         }
     }
 }
@@ -1,6 +1,8 @@
 #include <gtest/gtest.h>
 #include <glog/logging.h>
 #include "../include/layer/details/softmax.hpp"
+#include "layer/abstract/layer_factory.hpp"
+#include "runtime/runtime_ir.hpp"
 
 using namespace magic_infer;
 
@@ -142,3 +144,133 @@ TEST(test_layer, forward_softmax5)
     ASSERT_NEAR(output->index(8), 2.32554716e-01, 1e-6);
     ASSERT_NEAR(output->index(9), 6.32149258e-01, 1e-6);
 }
+
+
+/**
+ * 用double计算沿dim的softmax或log_softmax，dim按Tensor的(batch, channels, rows, cols)计
+ */
+static void SoftmaxReference(const shared_ptr<Tensor<float>> &input, int dim, bool is_log, vector<double> &output)
+{
+    const uint32_t sizes[3] = {input->channels(), input->rows(), input->cols()};
+    output.assign(input->size(), 0.);
+    for (uint32_t c = 0; c < sizes[0]; ++c) {
+        for (uint32_t r = 0; r < sizes[1]; ++r) {
+            for (uint32_t w = 0; w < sizes[2]; ++w) {
+                uint32_t index[3] = {c, r, w};
+                double max = -1e30;
+                for (index[dim - 1] = 0; index[dim - 1] < sizes[dim - 1]; ++index[dim - 1]) {
+                    max = std::max(max, double(input->at(index[0], index[1], index[2])));
+                }
+                double sum = 0.;
+                for (index[dim - 1] = 0; index[dim - 1] < sizes[dim - 1]; ++index[dim - 1]) {
+                    sum += exp(double(input->at(index[0], index[1], index[2])) - max);
+                }
+
+                const double value = input->at(c, r, w);
+                const size_t offset = size_t(c) * sizes[1] * sizes[2] + size_t(w) * sizes[1] + r;
+                output.at(offset) = is_log ? value - max - log(sum) : exp(value - max) / sum;
+            }
+        }
+    }
+}
+
+
+TEST(test_layer, forward_softmax_dims)
+{
+    const vector<vector<uint32_t>> shapes{{3, 40, 37}, {21, 5, 6}, {1, 1, 100}};
+    for (const auto &shape : shapes) {
+        shared_ptr<Tensor<float>> input = make_shared<Tensor<float>>(shape.at(0), shape.at(1), shape.at(2));
+        input->Rand();
+        float *input_ptr = input->data().memptr();
+        for (uint32_t i = 0; i < input->size(); ++i) {
+            input_ptr[i] *= 20.f;
+        }
+
+        for (int dim = 1; dim <= 3; ++dim) {
+            for (bool is_log : {false, true}) {
+                SoftmaxLayer softmax_layer(dim, is_log ? SoftmaxMode::kLogSoftmax : SoftmaxMode::kSoftmax);
+                vector<shared_ptr<Tensor<float>>> inputs{input};
+                vector<shared_ptr<Tensor<float>>> outputs(1);
+                ASSERT_EQ(softmax_layer.Forward(inputs, outputs), InferStatus::kInferSuccess);
+
+                vector<double> expected;
+                SoftmaxReference(input, dim, is_log, expected);
+                const float *output_ptr = outputs.front()->RawPtr();
+                for (uint32_t i = 0; i < expected.size(); ++i) {
+                    ASSERT_NEAR(output_ptr[i], expected.at(i), is_log ? 1e-5 : 1e-6) << dim << " " << is_log << " " << i;
+                }
+            }
+        }
+    }
+}
+
+
+TEST(test_layer, softmax_get_instance)
+{
+    // pnnx的dim包含batch维度，(1, 10)按行存放在Tensor(1, 10, 1)中
+    shared_ptr<RuntimeOperator> op = make_shared<RuntimeOperator>();
+    op->type = "F.log_softmax";
+    RuntimeParameterInt *dim_param = new RuntimeParameterInt;
+    dim_param->value = -1;
+    op->params.insert({"dim", dim_param});
+    shared_ptr<RuntimeOperand> operand = make_shared<RuntimeOperand>();
+    operand->shapes = {1, 10};
+    op->input_operands_seq.push_back(operand);
+
+    const shared_ptr<Layer> &layer = LayerRegisterer::CreateLayer(op);
+    ASSERT_NE(layer, nullptr);
+    shared_ptr<Tensor<float>> input = make_shared<Tensor<float>>(1, 10, 1);
+    for (uint32_t i = 0; i < 10; ++i) {
+        input->index(i) = float(i);
+    }
+    vector<shared_ptr<Tensor<float>>> inputs{input};
+    vector<shared_ptr<Tensor<float>>> outputs(1);
+    ASSERT_EQ(layer->Forward(inputs, outputs), InferStatus::kInferSuccess);
+
+    double sum = 0.;
+    for (uint32_t i = 0; i < 10; ++i) {
+        sum += exp(double(i));
+    }
+    for (uint32_t i = 0; i < 10; ++i) {
+        ASSERT_NEAR(outputs.front()->index(i), double(i) - log(sum), 1e-5);
+    }
+
+    // 不支持在batch维度上归一化
+    dim_param->value = 0;
+    op->type = "nn.Softmax";
+    shared_ptr<Layer> batch_layer;
+    ASSERT_EQ(SoftmaxLayer::GetInstance(op, batch_layer), ParseParameterAttrStatus::kParameterMissingDim);
+}
+
+
+TEST(test_layer, softmax_top_k)
+{
+    const uint32_t size = 1000;
+    vector<float> logits(size);
+    for (uint32_t i = 0; i < size; ++i) {
+        logits.at(i) = float(int(i * 7919 % 1009) - 500) / 50.f;
+    }
+    logits.at(17) = logits.at(923) = 12.f;
+
+    shared_ptr<Tensor<float>> input = make_shared<Tensor<float>>(1, 1, size);
+    input->Fill(logits);
+    SoftmaxLayer softmax_layer;
+    vector<shared_ptr<Tensor<float>>> inputs{input};
+    vector<shared_ptr<Tensor<float>>> outputs(1);
+    ASSERT_EQ(softmax_layer.Forward(inputs, outputs), InferStatus::kInferSuccess);
+
+    vector<uint32_t> order(size);
+    for (uint32_t i = 0; i < size; ++i) {
+        order.at(i) = i;
+    }
+    stable_sort(order.begin(), order.end(), [&logits](uint32_t lhs, uint32_t rhs) { return logits.at(lhs) > logits.at(rhs); });
+
+    for (uint32_t k : {0u, 1u, 5u, 37u, size + 10}) {
+        const vector<pair<uint32_t, float>> &top_k = SoftmaxLayer::TopK(logits.data(), size, k);
+        ASSERT_EQ(top_k.size(), min(k, size));
+        for (uint32_t i = 0; i < top_k.size(); ++i) {
+            ASSERT_EQ(top_k.at(i).first, order.at(i)) << k << " " << i;
+            ASSERT_NEAR(top_k.at(i).second, outputs.front()->index(order.at(i)), 1e-6);
+        }
+    }
+}
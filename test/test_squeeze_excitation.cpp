@@ -0,0 +1,174 @@
+#include <gtest/gtest.h>
+#include <glog/logging.h>
+#include "data/tensor.hpp"
+#include "layer/abstract/weight_cache.hpp"
+#include "layer/details/squeeze_excitation.hpp"
+#include "runtime/ir.h"
+#include "runtime/runtime_ir.hpp"
+#include "test_graph_util.hpp"
+
+using namespace magic_infer;
+
+
+TEST(test_layer, forward_squeeze_excitation)
+{
+    TempGraphFiles files;
+    const int channels = 12;
+    const int squeeze_channels = 4;
+    const int rows = 7;
+    const int cols = 5;
+    vector<float> fc1_weight(squeeze_channels * channels);
+    vector<float> fc2_weight(channels * squeeze_channels);
+    vector<float> fc2_bias(channels);
+    for (uint32_t i = 0; i < fc1_weight.size(); ++i) {
+        fc1_weight.at(i) = float(int(i * 7 % 23) - 11) / 5.f;
+        fc2_weight.at(i) = float(int(i * 5 % 19) - 9) / 3.f;
+    }
+    for (uint32_t i = 0; i < fc2_bias.size(); ++i) {
+        fc2_bias.at(i) = float(i) / 2.f - 3.f;
+    }
+
+    pnnx::Graph pnnx_graph;
+    const vector<vector<int>> shapes{{1, channels, rows, cols}, {1, channels, 1, 1}, {1, squeeze_channels, 1, 1},
+        {1, squeeze_channels, 1, 1}, {1, channels, 1, 1}, {1, channels, 1, 1}, {1, channels, rows, cols}};
+    vector<pnnx::Operand *> operands;
+    for (uint32_t i = 0; i < shapes.size(); ++i) {
+        pnnx::Operand *operand = pnnx_graph.new_operand(to_string(i));
+        operand->type = 1;
+        operand->shape = shapes.at(i);
+        operands.push_back(operand);
+    }
+
+    auto new_conv = [&pnnx_graph](const string &name, int in_channels, int out_channels, bool bias) {
+        pnnx::Operator *conv_op = pnnx_graph.new_operator("nn.Conv2d", name);
+        conv_op->params["in_channels"] = in_channels;
+        conv_op->params["out_channels"] = out_channels;
+        conv_op->params["kernel_size"] = {1, 1};
+        conv_op->params["stride"] = {1, 1};
+        conv_op->params["padding"] = {0, 0};
+        conv_op->params["dilation"] = {1, 1};
+        conv_op->params["groups"] = 1;
+        conv_op->params["bias"] = bias;
+        conv_op->params["padding_mode"] = string("zeros");
+        return conv_op;
+    };
+
+    // fc1没有偏置，融合节点使用全零的偏置
+    LinkOperator(pnnx_graph.new_operator("pnnx.Input", "pnnx_input_0"), {}, operands.at(0));
+    pnnx::Operator *pool_op = pnnx_graph.new_operator("nn.AdaptiveAvgPool2d", "avgpool");
+    pool_op->params["output_size"] = {1, 1};
+    LinkOperator(pool_op, {operands.at(0)}, operands.at(1));
+    pnnx::Operator *fc1_op = new_conv("fc1", channels, squeeze_channels, false);
+    fc1_op->attrs["weight"] = pnnx::Attribute({squeeze_channels, channels, 1, 1}, fc1_weight);
+    LinkOperator(fc1_op, {operands.at(1)}, operands.at(2));
+    LinkOperator(pnnx_graph.new_operator("nn.ReLU", "activation"), {operands.at(2)}, operands.at(3));
+    pnnx::Operator *fc2_op = new_conv("fc2", squeeze_channels, channels, true);
+    fc2_op->attrs["weight"] = pnnx::Attribute({channels, squeeze_channels, 1, 1}, fc2_weight);
+    fc2_op->attrs["bias"] = pnnx::Attribute({channels}, fc2_bias);
+    LinkOperator(fc2_op, {operands.at(3)}, operands.at(4));
+    LinkOperator(pnnx_graph.new_operator("nn.Hardsigmoid", "scale_activation"), {operands.at(4)}, operands.at(5));
+    pnnx::Operator *mul_op = pnnx_graph.new_operator("pnnx.Expression", "mul");
+    mul_op->params["expr"] = string("mul(@0,@1)");
+    LinkOperator(mul_op, {operands.at(5), operands.at(0)}, operands.at(6));
+    LinkOperator(pnnx_graph.new_operator("pnnx.Output", "pnnx_output_0"), {operands.at(6)}, nullptr);
+    ASSERT_TRUE(files.Save(pnnx_graph));
+
+    RuntimeGraph graph(files.param_path(), files.bin_path());
+    graph.Build("pnnx_input_0", "pnnx_output_0");
+    ASSERT_EQ(graph.operators().size(), 3);
+    ASSERT_EQ(graph.operators().at(1)->type, "magic.SqueezeExcitation");
+
+    const uint32_t batch = 1;
+    vector<shared_ptr<Tensor<float>>> inputs;
+    for (uint32_t i = 0; i < batch; ++i) {
+        shared_ptr<Tensor<float>> input = make_shared<Tensor<float>>(channels, rows, cols);
+        input->Rand();
+        inputs.push_back(input);
+    }
+    const vector<shared_ptr<Tensor<float>>> &outputs = graph.Forward(inputs, false);
+    ASSERT_EQ(outputs.size(), batch);
+
+    // 按未融合的六个节点逐步计算
+    for (uint32_t i = 0; i < batch; ++i) {
+        const shared_ptr<Tensor<float>> &input = inputs.at(i);
+        vector<float> pooled(channels, 0.f);
+        for (int c = 0; c < channels; ++c) {
+            for (int r = 0; r < rows; ++r) {
+                for (int w = 0; w < cols; ++w) {
+                    pooled.at(c) += input->at(c, r, w) / float(rows * cols);
+                }
+            }
+        }
+
+        vector<float> squeezed(squeeze_channels, 0.f);
+        for (int s = 0; s < squeeze_channels; ++s) {
+            for (int c = 0; c < channels; ++c) {
+                squeezed.at(s) += fc1_weight.at(s * channels + c) * pooled.at(c);
+            }
+            squeezed.at(s) = max(squeezed.at(s), 0.f);
+        }
+
+        for (int c = 0; c < channels; ++c) {
+            float scale = fc2_bias.at(c);
+            for (int s = 0; s < squeeze_channels; ++s) {
+                scale += fc2_weight.at(c * squeeze_channels + s) * squeezed.at(s);
+            }
+            scale = min(max(scale / 6.f + 0.5f, 0.f), 1.f);
+            for (int r = 0; r < rows; ++r) {
+                for (int w = 0; w < cols; ++w) {
+                    ASSERT_NEAR(outputs.at(i)->at(c, r, w), input->at(c, r, w) * scale, 1e-5f);
+                }
+            }
+        }
+    }
+}
+
+
+TEST(test_layer, squeeze_excitation_share_weights)
+{
+    const int channels = 8;
+    const int squeeze_channels = 2;
+    vector<float> fc1_weight(squeeze_channels * channels);
+    vector<float> fc2_weight(channels * squeeze_channels);
+    vector<float> fc1_bias(squeeze_channels, 0.5f);
+    vector<float> fc2_bias(channels, -0.5f);
+    for (uint32_t i = 0; i < fc1_weight.size(); ++i) {
+        fc1_weight.at(i) = float(i) * 0.25f - 1.f;
+        fc2_weight.at(i) = 1.f - float(i) * 0.125f;
+    }
+
+    shared_ptr<RuntimeOperator> op = make_shared<RuntimeOperator>();
+    op->name = "se";
+    op->type = "magic.SqueezeExcitation";
+    auto add_attribute = [&op](const string &name, const vector<int> &shape, const vector<float> &values) {
+        shared_ptr<RuntimeAttribute> attribute = make_shared<RuntimeAttribute>();
+        attribute->type = RuntimeDataType::kTypeFloat32;
+        attribute->shape = shape;
+        attribute->weight_data.resize(values.size() * sizeof(float));
+        memcpy(attribute->weight_data.data(), values.data(), attribute->weight_data.size());
+        op->attribute.insert({name, attribute});
+    };
+    add_attribute("fc1.weight", {squeeze_channels, channels, 1, 1}, fc1_weight);
+    add_attribute("fc2.weight", {channels, squeeze_channels, 1, 1}, fc2_weight);
+    add_attribute("fc1.bias", {squeeze_channels}, fc1_bias);
+    add_attribute("fc2.bias", {channels}, fc2_bias);
+
+    // 两个相同的SE层从属性的数据直接填充权重，并通过权重缓存共享同一份张量
+    WeightCache &cache = WeightCache::Instance();
+    cache.Clear();
+    shared_ptr<Layer> layer1;
+    shared_ptr<Layer> layer2;
+    ASSERT_EQ(SqueezeExcitationLayer::GetInstance(op, layer1), ParseParameterAttrStatus::kParameterAttrParseSuccess);
+    ASSERT_EQ(SqueezeExcitationLayer::GetInstance(op, layer2), ParseParameterAttrStatus::kParameterAttrParseSuccess);
+    ASSERT_EQ(layer1->weights().size(), 2);
+    ASSERT_EQ(layer1->bias().size(), 2);
+    ASSERT_EQ(layer1->weights(), layer2->weights());
+    ASSERT_EQ(layer1->bias(), layer2->bias());
+    ASSERT_EQ(cache.stats().hit_num, 4);
+    for (uint32_t i = 0; i < fc1_weight.size(); ++i) {
+        ASSERT_EQ(layer1->weights().at(0)->index(i), fc1_weight.at(i));
+        ASSERT_EQ(layer1->weights().at(1)->index(i), fc2_weight.at(i));
+    }
+    ASSERT_EQ(layer1->bias().at(1)->index(channels - 1), fc2_bias.back());
+    cache.Clear();
+}
@@ -1,6 +1,9 @@
 #include <gtest/gtest.h>
 #include <glog/logging.h>
 #include "../include/layer/details/upsample.hpp"
+#include "runtime/ir.h"
+#include "runtime/runtime_ir.hpp"
+#include "test_graph_util.hpp"
 
 using namespace magic_infer;
 
@@ -178,3 +181,170 @@ TEST(test_layer, forward_upsample5)
         }
     }
 }
+
+
+/**
+ * 按PyTorch的方式计算双线性插值的源坐标，返回两个输入坐标和下标较大者的权重
+ */
+static void BilinearSource(uint32_t input_size, uint32_t output_size, float scale, bool align_corners, uint32_t index,
+    uint32_t &index0, uint32_t &index1, float &lambda)
+{
+    float src = 0.f;
+    if (align_corners) {
+        src = output_size > 1 ? float(index) * float(input_size - 1) / float(output_size - 1) : 0.f;
+    } else {
+        src = max((float(index) + 0.5f) / scale - 0.5f, 0.f);
+    }
+    index0 = min(uint32_t(floorf(src)), input_size - 1);
+    index1 = min(index0 + 1, input_size - 1);
+    lambda = src - float(index0);
+}
+
+
+TEST(test_layer, forward_upsample_nearest_scales)
+{
+    const uint32_t channels = 3;
+    const uint32_t rows = 13;
+    const uint32_t cols = 7;
+    for (const auto &scales : vector<pair<float, float>>{{2.f, 2.f}, {3.f, 1.f}, {1.5f, 2.5f}}) {
+        UpSampleLayer layer(scales.first, scales.second);
+        shared_ptr<Tensor<float>> input = make_shared<Tensor<float>>(channels, rows, cols);
+        input->Rand();
+        vector<shared_ptr<Tensor<float>>> inputs{input};
+        vector<shared_ptr<Tensor<float>>> outputs(1);
+        ASSERT_EQ(layer.Forward(inputs, outputs), InferStatus::kInferSuccess);
+
+        const shared_ptr<Tensor<float>> &output = outputs.front();
+        ASSERT_EQ(output->rows(), uint32_t(rows * scales.first));
+        ASSERT_EQ(output->cols(), uint32_t(cols * scales.second));
+        for (uint32_t c = 0; c < channels; ++c) {
+            for (uint32_t r = 0; r < output->rows(); ++r) {
+                for (uint32_t w = 0; w < output->cols(); ++w) {
+                    const uint32_t src_r = min(uint32_t(float(r) / scales.first), rows - 1);
+                    const uint32_t src_w = min(uint32_t(float(w) / scales.second), cols - 1);
+                    ASSERT_EQ(output->at(c, r, w), input->at(c, src_r, src_w)) << r << " " << w;
+                }
+            }
+        }
+    }
+}
+
+
+TEST(test_layer, forward_upsample_bilinear)
+{
+    // 2x2放大到4x4，对齐四角时第二个输出在两个输入之间的1/3处，不对齐时在1/4处
+    shared_ptr<Tensor<float>> corner = make_shared<Tensor<float>>(1, 2, 2);
+    corner->at(0, 0, 0) = 0.f;
+    corner->at(0, 0, 1) = 1.f;
+    corner->at(0, 1, 0) = 2.f;
+    corner->at(0, 1, 1) = 3.f;
+    vector<shared_ptr<Tensor<float>>> corner_inputs{corner};
+    vector<shared_ptr<Tensor<float>>> corner_outputs(1);
+    UpSampleLayer align_layer(2.f, 2.f, UpSampleMode::kModeBilinear, true);
+    ASSERT_EQ(align_layer.Forward(corner_inputs, corner_outputs), InferStatus::kInferSuccess);
+    ASSERT_NEAR(corner_outputs.front()->at(0, 0, 1), 1.f / 3.f, 1e-6f);
+    ASSERT_NEAR(corner_outputs.front()->at(0, 3, 3), 3.f, 1e-6f);
+
+    corner_outputs.front() = nullptr;
+    UpSampleLayer center_layer(2.f, 2.f, UpSampleMode::kModeBilinear, false);
+    ASSERT_EQ(center_layer.Forward(corner_inputs, corner_outputs), InferStatus::kInferSuccess);
+    ASSERT_NEAR(corner_outputs.front()->at(0, 0, 1), 0.25f, 1e-6f);
+    ASSERT_NEAR(corner_outputs.front()->at(0, 3, 3), 3.f, 1e-6f);
+
+    const uint32_t channels = 4;
+    const uint32_t rows = 11;
+    const uint32_t cols = 9;
+    for (bool align_corners : {false, true}) {
+        for (const auto &scales : vector<pair<float, float>>{{2.f, 2.f}, {3.f, 1.5f}}) {
+            UpSampleLayer layer(scales.first, scales.second, UpSampleMode::kModeBilinear, align_corners);
+            shared_ptr<Tensor<float>> input = make_shared<Tensor<float>>(channels, rows, cols);
+            input->Rand();
+            vector<shared_ptr<Tensor<float>>> inputs{input};
+            vector<shared_ptr<Tensor<float>>> outputs(1);
+            ASSERT_EQ(layer.Forward(inputs, outputs), InferStatus::kInferSuccess);
+
+            const shared_ptr<Tensor<float>> &output = outputs.front();
+            ASSERT_EQ(output->rows(), uint32_t(rows * scales.first));
+            ASSERT_EQ(output->cols(), uint32_t(cols * scales.second));
+            for (uint32_t r = 0; r < output->rows(); ++r) {
+                uint32_t r0, r1;
+                float lambda_r;
+                BilinearSource(rows, output->rows(), scales.first, align_corners, r, r0, r1, lambda_r);
+                for (uint32_t w = 0; w < output->cols(); ++w) {
+                    uint32_t w0, w1;
+                    float lambda_w;
+                    BilinearSource(cols, output->cols(), scales.second, align_corners, w, w0, w1, lambda_w);
+                    for (uint32_t c = 0; c < channels; ++c) {
+                        const float expected = (1.f - lambda_r) * ((1.f - lambda_w) * input->at(c, r0, w0) + lambda_w * input->at(c, r0, w1))
+                            + lambda_r * ((1.f - lambda_w) * input->at(c, r1, w0) + lambda_w * input->at(c, r1, w1));
+                        ASSERT_NEAR(output->at(c, r, w), expected, 1e-5f) << align_corners << " " << r << " " << w;
+                    }
+                }
+            }
+        }
+    }
+}
+
+
+TEST(test_layer, upsample_concat_inplace_graph)
+{
+    TempGraphFiles files;
+    pnnx::Graph pnnx_graph;
+    pnnx::Operand *input_operand = pnnx_graph.new_operand("0");
+    pnnx::Operand *nearest_operand = pnnx_graph.new_operand("1");
+    pnnx::Operand *bilinear_operand = pnnx_graph.new_operand("2");
+    pnnx::Operand *cat_operand = pnnx_graph.new_operand("3");
+    for (pnnx::Operand *operand : {input_operand, nearest_operand, bilinear_operand, cat_operand}) {
+        operand->type = 1;
+        operand->shape = {1, 2, 8, 8};
+    }
+    input_operand->shape = {1, 2, 4, 4};
+    cat_operand->shape = {1, 4, 8, 8};
+
+    LinkOperator(pnnx_graph.new_operator("pnnx.Input", "pnnx_input_0"), {}, input_operand);
+    pnnx::Operator *nearest_op = pnnx_graph.new_operator("nn.Upsample", "nearest");
+    nearest_op->params["mode"] = string("nearest");
+    nearest_op->params["scale_factor"] = vector<float>{2.f, 2.f};
+    LinkOperator(nearest_op, {input_operand}, nearest_operand);
+    pnnx::Operator *bilinear_op = pnnx_graph.new_operator("nn.Upsample", "bilinear");
+    bilinear_op->params["mode"] = string("bilinear");
+    bilinear_op->params["align_corners"] = true;
+    bilinear_op->params["scale_factor"] = vector<float>{2.f, 2.f};
+    LinkOperator(bilinear_op, {input_operand}, bilinear_operand);
+    pnnx::Operator *cat_op = pnnx_graph.new_operator("torch.cat", "cat");
+    cat_op->params["dim"] = 1;
+    LinkOperator(cat_op, {nearest_operand, bilinear_operand}, cat_operand);
+    LinkOperator(pnnx_graph.new_operator("pnnx.Output", "pnnx_output_0"), {cat_operand}, nullptr);
+    ASSERT_TRUE(files.Save(pnnx_graph));
+
+    RuntimeGraph graph(files.param_path(), files.bin_path());
+    graph.Build("pnnx_input_0", "pnnx_output_0");
+
+    // 两个上采样的结果直接写入concat输出的通道切片，concat不再复制
+    map<string, shared_ptr<RuntimeOperator>> operators;
+    for (const auto &op : graph.operators()) {
+        operators.insert({op->name, op});
+    }
+    const float *cat_ptr = operators.at("cat")->output_operands->datas.front()->RawPtr();
+    ASSERT_EQ(operators.at("nearest")->output_operands->datas.front()->RawPtr(), cat_ptr);
+    ASSERT_EQ(operators.at("bilinear")->output_operands->datas.front()->RawPtr(), cat_ptr + 2 * 64);
+
+    shared_ptr<Tensor<float>> input = make_shared<Tensor<float>>(2, 4, 4);
+    input->Rand();
+    vector<shared_ptr<Tensor<float>>> inputs{input};
+    const vector<shared_ptr<Tensor<float>>> outputs = graph.Forward(inputs, false);
+    ASSERT_EQ(outputs.size(), 1);
+    ASSERT_EQ(outputs.front()->channels(), 4);
+
+    UpSampleLayer bilinear_layer(2.f, 2.f, UpSampleMode::kModeBilinear, true);
+    vector<shared_ptr<Tensor<float>>> bilinear_outputs(1);
+    ASSERT_EQ(bilinear_layer.Forward(inputs, bilinear_outputs), InferStatus::kInferSuccess);
+    for (uint32_t c = 0; c < 2; ++c) {
+        for (uint32_t r = 0; r < 8; ++r) {
+            for (uint32_t w = 0; w < 8; ++w) {
+                ASSERT_EQ(outputs.front()->at(c, r, w), input->at(c, r / 2, w / 2));
+                ASSERT_EQ(outputs.front()->at(c + 2, r, w), bilinear_outputs.front()->at(c, r, w));
+            }
+        }
+    }
+}
@@ -2,6 +2,7 @@
 #include <glog/logging.h>
 #include "runtime/runtime_ir.hpp"
 #include "data/load_data.hpp"
+#include "nets/yolo_detect.hpp"
 
 using namespace magic_infer;
 
@@ -64,3 +65,119 @@ TEST(test_net, forward_yolo2)
         }
     }
 }
+
+
+TEST(test_net, forward_yolo_sparse_decode)
+{
+    const uint32_t stages = 3;
+    const uint32_t anchors = 3;
+    const uint32_t num_classes = 3;
+    const uint32_t classes_info = num_classes + 5;
+    const uint32_t in_channels = 4;
+    const uint32_t batch_size = 2;
+    const float conf_thresh = 0.3f;
+    const vector<float> strides{8.f, 16.f, 32.f};
+    const vector<pair<uint32_t, uint32_t>> sizes{{8, 6}, {4, 3}, {2, 1}};
+
+    // 宽高不相等，能检查稀疏解码时行列的顺序和稠密输出一致
+    vector<arma::fmat> grids;
+    vector<arma::fmat> anchor_grids;
+    vector<shared_ptr<ConvolutionLayer>> conv_layers;
+    vector<shared_ptr<Tensor<float>>> inputs;
+    for (uint32_t s = 0; s < stages; ++s) {
+        const uint32_t rows = sizes.at(s).first;
+        const uint32_t cols = sizes.at(s).second;
+        arma::fmat grid(anchors * rows * cols, 2);
+        arma::fmat anchor_grid(anchors * rows * cols, 2);
+        for (uint32_t a = 0; a < anchors; ++a) {
+            for (uint32_t r = 0; r < rows; ++r) {
+                for (uint32_t c = 0; c < cols; ++c) {
+                    const uint32_t row = a * rows * cols + r * cols + c;
+                    grid.at(row, 0) = float(c) - 0.5f;
+                    grid.at(row, 1) = float(r) - 0.5f;
+                    anchor_grid.at(row, 0) = 10.f * (a + 1) * (s + 1);
+                    anchor_grid.at(row, 1) = 13.f * (a + 1) * (s + 1);
+                }
+            }
+        }
+        grids.push_back(grid);
+        anchor_grids.push_back(anchor_grid);
+
+        vector<float> weights(anchors * classes_info * in_channels);
+        vector<float> bias(anchors * classes_info);
+        for (uint32_t i = 0; i < weights.size(); ++i) {
+            weights.at(i) = float(int((i + s) * 37 % 17) - 8) / 4.f;
+        }
+        for (uint32_t i = 0; i < bias.size(); ++i) {
+            bias.at(i) = float(int(i * 5 % 7) - 3) / 2.f;
+        }
+        shared_ptr<ConvolutionLayer> conv_layer = make_shared<ConvolutionLayer>(anchors * classes_info, in_channels, 1, 1, 0, 0, 1, 1, 1);
+        conv_layer->set_weights(weights);
+        conv_layer->set_bias(bias);
+        conv_layers.push_back(conv_layer);
+
+        for (uint32_t b = 0; b < batch_size; ++b) {
+            shared_ptr<Tensor<float>> input = make_shared<Tensor<float>>(in_channels, rows, cols);
+            input->Rand();
+            inputs.push_back(input);
+        }
+    }
+
+    YoloDetectLayer dense_layer(stages, num_classes, strides, anchor_grids, grids, conv_layers);
+    vector<shared_ptr<Tensor<float>>> dense_outputs(batch_size);
+    ASSERT_EQ(dense_layer.Forward(inputs, dense_outputs), InferStatus::kInferSuccess);
+
+    YoloDetectLayer sparse_layer(stages, num_classes, strides, anchor_grids, grids, conv_layers);
+    sparse_layer.set_decode_mode(YoloDecodeMode::kDecodeSparse, conf_thresh);
+    vector<shared_ptr<Tensor<float>>> sparse_outputs(batch_size);
+    ASSERT_EQ(sparse_layer.Forward(inputs, sparse_outputs), InferStatus::kInferSuccess);
+
+    for (uint32_t b = 0; b < batch_size; ++b) {
+        const shared_ptr<Tensor<float>> &dense = dense_outputs.at(b);
+        ASSERT_EQ(sparse_outputs.at(b)->shapes(), dense->shapes());
+        const vector<YoloCandidate> &candidates = YoloDetectLayer::ReadCandidates(*sparse_outputs.at(b));
+        ASSERT_FALSE(candidates.empty());
+        ASSERT_LT(candidates.size(), dense->rows());
+
+        // 按稠密输出的顺序逐行扫描，保留下来的anchor应该依次对应候选框
+        uint32_t index = 0;
+        for (uint32_t r = 0; r < dense->rows(); ++r) {
+            uint32_t best_class = 0;
+            for (uint32_t c = 1; c < num_classes; ++c) {
+                if (dense->at(0, r, 5 + c) > dense->at(0, r, 5 + best_class)) best_class = c;
+            }
+            const float score = dense->at(0, r, 4) * dense->at(0, r, 5 + best_class);
+            if (score < conf_thresh) continue;
+
+            ASSERT_LT(index, candidates.size());
+            const YoloCandidate &candidate = candidates.at(index);
+            ASSERT_EQ(candidate.class_id, int32_t(best_class));
+            ASSERT_NEAR(candidate.score, score, 1e-4f);
+            ASSERT_NEAR(candidate.x, dense->at(0, r, 0), 1e-3f);
+            ASSERT_NEAR(candidate.y, dense->at(0, r, 1), 1e-3f);
+            ASSERT_NEAR(candidate.w, dense->at(0, r, 2), 1e-2f);
+            ASSERT_NEAR(candidate.h, dense->at(0, r, 3), 1e-2f);
+            index += 1;
+        }
+        ASSERT_EQ(index, candidates.size());
+    }
+
+    // 提高阈值之后复用上一次的输出张量，候选框之后的行不能残留上一次的结果
+    vector<uint32_t> previous_nums;
+    for (const auto &output : sparse_outputs) {
+        previous_nums.push_back(YoloDetectLayer::ReadCandidates(*output).size());
+    }
+    sparse_layer.set_decode_mode(YoloDecodeMode::kDecodeSparse, 0.99f);
+    ASSERT_EQ(sparse_layer.Forward(inputs, sparse_outputs), InferStatus::kInferSuccess);
+    for (uint32_t b = 0; b < batch_size; ++b) {
+        const shared_ptr<Tensor<float>> &output = sparse_outputs.at(b);
+        const uint32_t candidate_num = YoloDetectLayer::ReadCandidates(*output).size();
+        ASSERT_LT(candidate_num, previous_nums.at(b));
+        for (uint32_t r = candidate_num; r < output->rows(); ++r) {
+            for (uint32_t c = 0; c < 5; ++c) {
+                ASSERT_EQ(output->at(0, r, c), 0.f);
+            }
+            ASSERT_EQ(output->at(0, r, 5), -1.f);
+        }
+    }
+}
@@ -0,0 +1,38 @@
+#include <iostream>
+#include <string>
+#include <glog/logging.h>
+#include "runtime/runtime_ir.hpp"
+
+using namespace magic_infer;
+
+
+/**
+ * 离线转换工具，将pnnx模型Build之后保存为MagicInfer原生模型文件
+ * 用法: magic_convert model.pnnx.param model.pnnx.bin model.magic [input_name] [output_name]
+ */
+int main(int argc, char *argv[])
+{
+    if (argc < 4) {
+        cerr << "Usage: " << argv[0] << " model.pnnx.param model.pnnx.bin model.magic [input_name] [output_name]" << endl;
+        return -1;
+    }
+
+    google::InitGoogleLogging(argv[0]);
+    FLAGS_alsologtostderr = true;
+
+    const string param_path = argv[1];
+    const string bin_path = argv[2];
+    const string model_path = argv[3];
+    const string input_name = argc > 4 ? argv[4] : "pnnx_input_0";
+    const string output_name = argc > 5 ? argv[5] : "pnnx_output_0";
+
+    RuntimeGraph graph(param_path, bin_path);
+    graph.Build(input_name, output_name);
+    if (!graph.Save(model_path)) {
+        LOG(ERROR) << "Convert failed: " << param_path;
+        return -1;
+    }
+
+    LOG(INFO) << "Convert " << param_path << " to " << model_path << ", operators: " << graph.operators().size();
+    return 0;
+}